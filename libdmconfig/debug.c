@@ -38,6 +38,7 @@ struct code2str {
 
 static struct code2str cmd2str[] = {
 	initC2S(CMD_DB_SET),
+	initC2S(CMD_DB_BULK_SET),
 	initC2S(CMD_DB_GET),
 	initC2S(CMD_DB_LIST),
 
@@ -49,7 +50,12 @@ static struct code2str cmd2str[] = {
 
 	initC2S(CMD_DB_COMMIT),
 	initC2S(CMD_DB_CANCEL),
+	initC2S(CMD_DB_COMMIT_DRY_RUN),
 	initC2S(CMD_DB_SAVE),
+	initC2S(CMD_DB_COMPARE_AND_SET),
+	initC2S(CMD_DB_ATOMIC_ADD),
+	initC2S(CMD_DB_SAVEPOINT),
+	initC2S(CMD_DB_ROLLBACK_SAVEPOINT),
 
 	initC2S(CMD_STARTSESSION),
 	initC2S(CMD_ENDSESSION),
@@ -61,6 +67,8 @@ static struct code2str cmd2str[] = {
 	initC2S(CMD_PARAM_NOTIFY),
 	initC2S(CMD_RECURSIVE_PARAM_NOTIFY),
 	initC2S(CMD_GET_PASSIVE_NOTIFICATIONS),
+	initC2S(CMD_GET_SCHEMA_MAP),
+	initC2S(CMD_PARAM_NOTIFY_FILTER),
 
 	initC2S(CMD_CLIENT_ACTIVE_NOTIFY),
 };
@@ -85,6 +93,8 @@ static struct code2str avp2str[] = {
 	initC2S(AVP_RC),
 	initC2S(AVP_SESSIONID),
 	initC2S(AVP_NOTIFY_TYPE),
+	initC2S(AVP_NOTIFY_FLAGS),
+	initC2S(AVP_NOTIFY_PREDICATE),
 	initC2S(AVP_UNKNOWN),
 	initC2S(AVP_INT64),
 	initC2S(AVP_UINT64),
@@ -96,6 +106,7 @@ static struct code2str avp2str[] = {
 	initC2S(AVP_INSTANCE),
 	initC2S(AVP_OBJECT),
 	initC2S(AVP_ELEMENT),
+	initC2S(AVP_SELECTOR),
 
 	initC2S(AVP_TIMEOUT_SESSION),
 	initC2S(AVP_TIMEOUT_REQUEST),
@@ -26,22 +26,30 @@ uint32_t rpc_switchsession(void *ctx, uint32_t flags, int32_t timeout, DM2_REQUE
 uint32_t rpc_endsession(void *ctx);
 uint32_t rpc_sessioninfo(void *ctx, DM2_REQUEST *answer);
 uint32_t rpc_cfgsessioninfo(void *ctx, DM2_REQUEST *answer);
-uint32_t rpc_subscribe_notify(void *ctx, DM2_REQUEST *answer);
+uint32_t rpc_subscribe_notify(void *ctx, uint32_t flags, DM2_REQUEST *answer);
 uint32_t rpc_unsubscribe_notify(void *ctx, DM2_REQUEST *answer);
 uint32_t rpc_param_notify(void *ctx, uint32_t notify, int pcnt, dm_selector *path, DM2_REQUEST *answer);
 uint32_t rpc_recursive_param_notify(void *ctx, uint32_t notify, dm_selector path, DM2_REQUEST *answer);
-uint32_t rpc_get_passive_notifications(void *ctx, DM2_REQUEST *answer);
+uint32_t rpc_get_passive_notifications(void *ctx, uint32_t max, DM2_REQUEST *answer);
+uint32_t rpc_get_schema_map(void *ctx, dm_selector path, DM2_REQUEST *answer);
+uint32_t rpc_param_notify_filter(void *ctx, dm_selector path, uint32_t predicate, struct dm2_avp *operand, DM2_REQUEST *answer);
 uint32_t rpc_db_addinstance(void *ctx, dm_selector path, dm_id id, DM2_REQUEST *answer);
 uint32_t rpc_db_delinstance(void *ctx, dm_selector path, DM2_REQUEST *answer);
 uint32_t rpc_db_set(void *ctx, int pvcnt, struct rpc_db_set_path_value *values, DM2_REQUEST *answer);
+uint32_t rpc_db_bulk_set(void *ctx, const dm_selector path, uint8_t create, int ccnt, struct dm_bin *columns, DM2_AVPGRP *rows, DM2_REQUEST *answer);
 uint32_t rpc_db_get(void *ctx, int pcnt, dm_selector *values, DM2_REQUEST *answer);
 uint32_t rpc_db_list(void *ctx, int level, dm_selector path, DM2_REQUEST *answer);
 uint32_t rpc_db_retrieve_enum(void *ctx, dm_selector path, DM2_REQUEST *answer);
-uint32_t rpc_db_dump(void *ctx, char *path, DM2_REQUEST *answer);
+uint32_t rpc_db_dump(void *ctx, char *path, uint64_t offset, uint32_t size, uint32_t format, DM2_REQUEST *answer);
 uint32_t rpc_db_save(void *ctx, DM2_REQUEST *answer);
 uint32_t rpc_db_commit(void *ctx, DM2_REQUEST *answer);
+uint32_t rpc_db_commit_dry_run(void *ctx, DM2_REQUEST *answer);
 uint32_t rpc_db_cancel(void *ctx, DM2_REQUEST *answer);
 uint32_t rpc_db_findinstance(void *ctx, const dm_selector path, const struct dm_bin *name, const struct dm2_avp *search, DM2_REQUEST *answer);
+uint32_t rpc_db_compare_and_set(void *ctx, const dm_selector path, const struct dm2_avp *expected, const struct dm2_avp *value, DM2_REQUEST *answer);
+uint32_t rpc_db_atomic_add(void *ctx, const dm_selector path, int64_t delta, DM2_REQUEST *answer);
+uint32_t rpc_db_savepoint(void *ctx, DM2_REQUEST *answer);
+uint32_t rpc_db_rollback_savepoint(void *ctx, uint32_t savepoint, DM2_REQUEST *answer);
 uint32_t rpc_register_role(void *ctx, const char *role);
 uint32_t rpc_system_restart(void *ctx);
 uint32_t rpc_system_shutdown(void *ctx);
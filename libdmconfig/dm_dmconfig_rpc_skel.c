@@ -118,11 +118,15 @@ static inline uint32_t
 rpc_subscribe_notify_skel(void *ctx, DM2_AVPGRP *obj, DM2_REQUEST *answer)
 {
 	uint32_t rc;
+	uint32_t flags = 0;
 
-	if ((rc = dm_expect_end(obj)) != RC_OK)
+	/* optional: NOTIFY_FLAG_* */
+	if (dm_expect_end(obj) != RC_OK
+	    && ((rc = dm_expect_uint32_type(obj, AVP_NOTIFY_FLAGS, VP_TRAVELPING, &flags)) != RC_OK
+		|| (rc = dm_expect_end(obj)) != RC_OK))
 		return rc;
 
-	return rpc_subscribe_notify(ctx, answer);
+	return rpc_subscribe_notify(ctx, flags, answer);
 }
 
 static inline uint32_t
@@ -188,11 +192,51 @@ static inline uint32_t
 rpc_get_passive_notifications_skel(void *ctx, DM2_AVPGRP *obj, DM2_REQUEST *answer)
 {
 	uint32_t rc;
+	uint32_t max = 0;
 
-	if ((rc = dm_expect_end(obj)) != RC_OK)
+	/* optional: maximum number of events to return */
+	if (dm_expect_end(obj) != RC_OK
+	    && ((rc = dm_expect_uint32_type(obj, AVP_COUNTER, VP_TRAVELPING, &max)) != RC_OK
+		|| (rc = dm_expect_end(obj)) != RC_OK))
 		return rc;
 
-	return rpc_get_passive_notifications(ctx, answer);
+	return rpc_get_passive_notifications(ctx, max, answer);
+}
+
+static inline uint32_t
+rpc_get_schema_map_skel(void *ctx, DM2_AVPGRP *obj, DM2_REQUEST *answer)
+{
+	uint32_t rc;
+	dm_selector path;
+
+	if ((rc = dm_expect_path_type(obj, AVP_PATH, VP_TRAVELPING, &path)) != RC_OK
+	    || (rc = dm_expect_end(obj)) != RC_OK)
+		return rc;
+
+	return rpc_get_schema_map(ctx, path, answer);
+}
+
+static inline uint32_t
+rpc_param_notify_filter_skel(void *ctx, DM2_AVPGRP *obj, DM2_REQUEST *answer)
+{
+	uint32_t rc;
+	dm_selector path;
+	uint32_t predicate;
+	struct dm2_avp operand;
+
+	if ((rc = dm_expect_path_type(obj, AVP_PATH, VP_TRAVELPING, &path)) != RC_OK
+	    || (rc = dm_expect_uint32_type(obj, AVP_NOTIFY_PREDICATE, VP_TRAVELPING, &predicate)) != RC_OK)
+		return rc;
+
+	/* the operand is optional for Notify-Predicate-None */
+	if (dm_expect_end(obj) == RC_OK)
+		return rpc_param_notify_filter(ctx, path, predicate, NULL, answer);
+
+	if ((rc = dm_expect_value(obj, &operand)) != RC_OK
+	    || (rc = dm_expect_end(obj)) != RC_OK)
+		return rc;
+
+	return rpc_param_notify_filter(ctx, path, predicate, &operand, answer);
 }
 
 static inline uint32_t
@@ -251,6 +295,41 @@ rpc_db_set_skel(void *ctx, DM2_AVPGRP *obj, DM2_REQUEST *answer)
 	return rc;
 }
 
+static inline uint32_t
+rpc_db_bulk_set_skel(void *ctx, DM2_AVPGRP *obj, DM2_REQUEST *answer)
+{
+	uint32_t rc;
+	dm_selector path;
+	uint8_t create;
+	DM2_AVPGRP grp;
+	int ccnt = 0;
+	struct dm_bin *columns = NULL;
+
+	if ((rc = dm_expect_path_type(obj, AVP_PATH, VP_TRAVELPING, &path)) != RC_OK
+	    || (rc = dm_expect_uint8_type(obj, AVP_BOOL, VP_TRAVELPING, &create)) != RC_OK
+	    || (rc = dm_expect_object(obj, &grp)) != RC_OK)
+		return rc;
+
+	do {
+		if ((ccnt % BLOCK_ALLOC) == 0)
+			if (!(columns = talloc_realloc(NULL, columns, struct dm_bin, ccnt + BLOCK_ALLOC)))
+				return RC_ERR_ALLOC;
+
+		if ((rc = dm_expect_bin(&grp, AVP_NAME, VP_TRAVELPING, &columns[ccnt])) != RC_OK) {
+			talloc_free(columns);
+			return rc;
+		}
+
+		ccnt++;
+	} while (dm_expect_group_end(&grp) != RC_OK);
+
+	/* the rows are decoded by the implementation straight into the store */
+	rc = rpc_db_bulk_set(ctx, path, create, ccnt, columns, obj, answer);
+
+	talloc_free(columns);
+	return rc;
+}
+
 static inline uint32_t
 rpc_db_get_skel(void *ctx, DM2_AVPGRP *obj, DM2_REQUEST *answer)
 {
@@ -310,12 +389,26 @@ rpc_db_dump_skel(void *ctx, DM2_AVPGRP *obj, DM2_REQUEST *answer)
 {
 	uint32_t rc;
 	char *path;
+	uint64_t offset = 0;
+	uint32_t size = 0;
+	uint32_t format = CONFIG_FORMAT_XML;
 
-	if ((rc = dm_expect_string_type(obj, AVP_PATH, VP_TRAVELPING, &path)) != RC_OK
-	    || (rc = dm_expect_end(obj)) != RC_OK)
+	if ((rc = dm_expect_string_type(obj, AVP_PATH, VP_TRAVELPING, &path)) != RC_OK)
 		return rc;
 
-	return rpc_db_dump(ctx, path, answer);
+	/* optional: offset and size of the chunk to return, optionally followed by the format */
+	if (dm_expect_end(obj) != RC_OK) {
+		if ((rc = dm_expect_uint64_type(obj, AVP_UINT64, VP_TRAVELPING, &offset)) != RC_OK
+		    || (rc = dm_expect_uint32_type(obj, AVP_COUNTER, VP_TRAVELPING, &size)) != RC_OK)
+			return rc;
+
+		if (dm_expect_end(obj) != RC_OK
+		    && ((rc = dm_expect_uint32_type(obj, AVP_CONFIG_FORMAT, VP_TRAVELPING, &format)) != RC_OK
+			|| (rc = dm_expect_end(obj)) != RC_OK))
+			return rc;
+	}
+
+	return rpc_db_dump(ctx, path, offset, size, format, answer);
 }
 
 static inline uint32_t
@@ -340,6 +433,17 @@ rpc_db_commit_skel(void *ctx, DM2_AVPGRP *obj, DM2_REQUEST *answer)
 	return rpc_db_commit(ctx, answer);
 }
 
+static inline uint32_t
+rpc_db_commit_dry_run_skel(void *ctx, DM2_AVPGRP *obj, DM2_REQUEST *answer)
+{
+	uint32_t rc;
+
+	if ((rc = dm_expect_end(obj)) != RC_OK)
+		return rc;
+
+	return rpc_db_commit_dry_run(ctx, answer);
+}
+
 static inline uint32_t
 rpc_db_cancel_skel(void *ctx, DM2_AVPGRP *obj, DM2_REQUEST *answer)
 {
@@ -368,6 +472,62 @@ rpc_db_findinstance_skel(void *ctx, DM2_AVPGRP *obj, DM2_REQUEST *answer)
 	return rpc_db_findinstance(ctx, path, &name, &value, answer);
 }
 
+static inline uint32_t
+rpc_db_compare_and_set_skel(void *ctx, DM2_AVPGRP *obj, DM2_REQUEST *answer)
+{
+	uint32_t rc;
+	dm_selector path;
+	struct dm2_avp expected;
+	struct dm2_avp value;
+
+	if ((rc = dm_expect_path_type(obj, AVP_PATH, VP_TRAVELPING, &path)) != RC_OK
+	    || (rc = dm_expect_value(obj, &expected)) != RC_OK
+	    || (rc = dm_expect_value(obj, &value)) != RC_OK
+	    || (rc = dm_expect_end(obj)) != RC_OK)
+		return rc;
+
+	return rpc_db_compare_and_set(ctx, path, &expected, &value, answer);
+}
+
+static inline uint32_t
+rpc_db_atomic_add_skel(void *ctx, DM2_AVPGRP *obj, DM2_REQUEST *answer)
+{
+	uint32_t rc;
+	dm_selector path;
+	int64_t delta;
+
+	if ((rc = dm_expect_path_type(obj, AVP_PATH, VP_TRAVELPING, &path)) != RC_OK
+	    || (rc = dm_expect_int64_type(obj, AVP_INT64, VP_TRAVELPING, &delta)) != RC_OK
+	    || (rc = dm_expect_end(obj)) != RC_OK)
+		return rc;
+
+	return rpc_db_atomic_add(ctx, path, delta, answer);
+}
+
+static inline uint32_t
+rpc_db_savepoint_skel(void *ctx, DM2_AVPGRP *obj, DM2_REQUEST *answer)
+{
+	uint32_t rc;
+
+	if ((rc = dm_expect_end(obj)) != RC_OK)
+		return rc;
+
+	return rpc_db_savepoint(ctx, answer);
+}
+
+static inline uint32_t
+rpc_db_rollback_savepoint_skel(void *ctx, DM2_AVPGRP *obj, DM2_REQUEST *answer)
+{
+	uint32_t rc;
+	uint32_t savepoint;
+
+	if ((rc = dm_expect_uint32_type(obj, AVP_SAVEPOINT, VP_TRAVELPING, &savepoint)) != RC_OK
+	    || (rc = dm_expect_end(obj)) != RC_OK)
+		return rc;
+
+	return rpc_db_rollback_savepoint(ctx, savepoint, answer);
+}
+
 static inline uint32_t
 rpc_register_role_skel(void *ctx, DM2_AVPGRP *obj)
 {
@@ -526,6 +686,14 @@ rpc_dmconfig_switch(void *ctx, const DMC_REQUEST *req, DM2_AVPGRP *obj, DM2_REQU
 		rc = rpc_get_passive_notifications_skel(ctx, obj, *answer);
 		break;
 
+	case CMD_GET_SCHEMA_MAP:
+		rc = rpc_get_schema_map_skel(ctx, obj, *answer);
+		break;
+
+	case CMD_PARAM_NOTIFY_FILTER:
+		rc = rpc_param_notify_filter_skel(ctx, obj, *answer);
+		break;
+
 	case CMD_DB_ADDINSTANCE:
 		rc = rpc_db_addinstance_skel(ctx, obj, *answer);
 		break;
@@ -538,6 +706,10 @@ rpc_dmconfig_switch(void *ctx, const DMC_REQUEST *req, DM2_AVPGRP *obj, DM2_REQU
 		rc = rpc_db_set_skel(ctx, obj, *answer);
 		break;
 
+	case CMD_DB_BULK_SET:
+		rc = rpc_db_bulk_set_skel(ctx, obj, *answer);
+		break;
+
 	case CMD_DB_GET:
 		rc = rpc_db_get_skel(ctx, obj, *answer);
 		break;
@@ -562,6 +734,10 @@ rpc_dmconfig_switch(void *ctx, const DMC_REQUEST *req, DM2_AVPGRP *obj, DM2_REQU
 		rc = rpc_db_commit_skel(ctx, obj, *answer);
 		break;
 
+	case CMD_DB_COMMIT_DRY_RUN:
+		rc = rpc_db_commit_dry_run_skel(ctx, obj, *answer);
+		break;
+
 	case CMD_DB_CANCEL:
 		rc = rpc_db_cancel_skel(ctx, obj, *answer);
 		break;
@@ -570,6 +746,22 @@ rpc_dmconfig_switch(void *ctx, const DMC_REQUEST *req, DM2_AVPGRP *obj, DM2_REQU
 		rc = rpc_db_findinstance_skel(ctx, obj, *answer);
 		break;
 
+	case CMD_DB_COMPARE_AND_SET:
+		rc = rpc_db_compare_and_set_skel(ctx, obj, *answer);
+		break;
+
+	case CMD_DB_ATOMIC_ADD:
+		rc = rpc_db_atomic_add_skel(ctx, obj, *answer);
+		break;
+
+	case CMD_DB_SAVEPOINT:
+		rc = rpc_db_savepoint_skel(ctx, obj, *answer);
+		break;
+
+	case CMD_DB_ROLLBACK_SAVEPOINT:
+		rc = rpc_db_rollback_savepoint_skel(ctx, obj, *answer);
+		break;
+
 	case CMD_REGISTER_ROLE:
 		rc = rpc_register_role_skel(ctx, obj);
 		break;
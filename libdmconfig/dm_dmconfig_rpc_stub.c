@@ -103,6 +103,11 @@ uint32_t rpc_cfgsessioninfo_async(DMCONTEXT *ctx, DMRESULT_CB cb, void *data)
 }
 
 uint32_t rpc_subscribe_notify_async(DMCONTEXT *ctx, DMRESULT_CB cb, void *data)
+{
+	return rpc_subscribe_notify_flags_async(ctx, 0, cb, data);
+}
+
+uint32_t rpc_subscribe_notify_flags_async(DMCONTEXT *ctx, uint32_t flags, DMRESULT_CB cb, void *data)
 {
 	uint32_t rc;
 	DM2_REQUEST *req;
@@ -110,6 +115,9 @@ uint32_t rpc_subscribe_notify_async(DMCONTEXT *ctx, DMRESULT_CB cb, void *data)
 	if (!(req = dm_new_request(ctx, CMD_SUBSCRIBE_NOTIFY, CMD_FLAG_REQUEST, 0, 0)))
 		return RC_ERR_ALLOC;
 
+	if (flags && (rc = dm_add_uint32(req, AVP_NOTIFY_FLAGS, VP_TRAVELPING, flags)) != RC_OK)
+		return rc;
+
 	if ((rc = dm_finalize_packet(req)) != RC_OK)
 		return rc;
 
@@ -171,6 +179,13 @@ uint32_t rpc_recursive_param_notify_async(DMCONTEXT *ctx, uint32_t notify, const
 }
 
 uint32_t rpc_get_passive_notifications_async(DMCONTEXT *ctx, DMRESULT_CB cb, void *data)
+{
+	return rpc_get_passive_notifications_paged_async(ctx, 0, cb, data);
+}
+
+/* max == 0 retrieves all pending passive notifications, otherwise the answer
+ * contains at most max events and the rest remains queued for the next call */
+uint32_t rpc_get_passive_notifications_paged_async(DMCONTEXT *ctx, uint32_t max, DMRESULT_CB cb, void *data)
 {
 	uint32_t rc;
 	DM2_REQUEST *req;
@@ -178,6 +193,46 @@ uint32_t rpc_get_passive_notifications_async(DMCONTEXT *ctx, DMRESULT_CB cb, voi
 	if (!(req = dm_new_request(ctx, CMD_GET_PASSIVE_NOTIFICATIONS, CMD_FLAG_REQUEST, 0, 0)))
 		return RC_ERR_ALLOC;
 
+	if (max && (rc = dm_add_uint32(req, AVP_COUNTER, VP_TRAVELPING, max)) != RC_OK)
+		return rc;
+
+	if ((rc = dm_finalize_packet(req)) != RC_OK)
+		return rc;
+
+	return dm_enqueue_request(ctx, req, cb, data);
+}
+
+uint32_t rpc_get_schema_map_async(DMCONTEXT *ctx, const char *path, DMRESULT_CB cb, void *data)
+{
+	uint32_t rc;
+	DM2_REQUEST *req;
+
+	if (!(req = dm_new_request(ctx, CMD_GET_SCHEMA_MAP, CMD_FLAG_REQUEST, 0, 0)))
+		return RC_ERR_ALLOC;
+
+	if ((rc = dm_add_string(req, AVP_PATH, VP_TRAVELPING, path)) != RC_OK
+	    || (rc = dm_finalize_packet(req)) != RC_OK)
+		return rc;
+
+	return dm_enqueue_request(ctx, req, cb, data);
+}
+
+/* operand may be NULL for NOTIFY_PREDICATE_NONE */
+uint32_t rpc_param_notify_filter_async(DMCONTEXT *ctx, const char *path, uint32_t predicate, struct dm2_avp *operand, DMRESULT_CB cb, void *data)
+{
+	uint32_t rc;
+	DM2_REQUEST *req;
+
+	if (!(req = dm_new_request(ctx, CMD_PARAM_NOTIFY_FILTER, CMD_FLAG_REQUEST, 0, 0)))
+		return RC_ERR_ALLOC;
+
+	if ((rc = dm_add_string(req, AVP_PATH, VP_TRAVELPING, path)) != RC_OK
+	    || (rc = dm_add_uint32(req, AVP_NOTIFY_PREDICATE, VP_TRAVELPING, predicate)) != RC_OK)
+		return rc;
+
+	if (operand && (rc = dm_add_raw(req, operand->code, operand->vendor_id, operand->data, operand->size)) != RC_OK)
+		return rc;
+
 	if ((rc = dm_finalize_packet(req)) != RC_OK)
 		return rc;
 
@@ -256,6 +311,46 @@ uint32_t rpc_db_set_async(DMCONTEXT *ctx, int pvcnt, struct rpc_db_set_path_valu
 	return dm_enqueue_request(ctx, req, cb, data);
 }
 
+uint32_t rpc_db_bulk_set_async(DMCONTEXT *ctx, const char *path, int create, int ccnt, const char **columns, int rcnt, const struct rpc_db_bulk_set_row *rows, DMRESULT_CB cb, void *data)
+{
+	uint32_t rc;
+	DM2_REQUEST *req;
+	int i, j;
+
+	if (!(req = dm_new_request(ctx, CMD_DB_BULK_SET, CMD_FLAG_REQUEST, 0, 0)))
+		return RC_ERR_ALLOC;
+
+	if ((rc = dm_add_string(req, AVP_PATH, VP_TRAVELPING, path)) != RC_OK
+	    || (rc = dm_add_uint8(req, AVP_BOOL, VP_TRAVELPING, create ? 1 : 0)) != RC_OK
+	    || (rc = dm_add_object(req)) != RC_OK)
+		return rc;
+
+	for (i = 0; i < ccnt; i++)
+		if ((rc = dm_add_string(req, AVP_NAME, VP_TRAVELPING, columns[i])) != RC_OK)
+			return rc;
+
+	if ((rc = dm_finalize_group(req)) != RC_OK)
+		return rc;
+
+	for (i = 0; i < rcnt; i++) {
+		if ((rc = dm_add_object(req)) != RC_OK
+		    || (rc = dm_add_uint16(req, AVP_UINT16, VP_TRAVELPING, rows[i].id)) != RC_OK)
+			return rc;
+
+		for (j = 0; j < ccnt; j++)
+			if ((rc = dm_add_raw(req, rows[i].values[j].code, rows[i].values[j].vendor_id, rows[i].values[j].data, rows[i].values[j].size)) != RC_OK)
+				return rc;
+
+		if ((rc = dm_finalize_group(req)) != RC_OK)
+			return rc;
+	}
+
+	if ((rc = dm_finalize_packet(req)) != RC_OK)
+		return rc;
+
+	return dm_enqueue_request(ctx, req, cb, data);
+}
+
 uint32_t rpc_db_get_async(DMCONTEXT *ctx, int pcnt, const char **paths, DMRESULT_CB cb, void *data)
 {
 	uint32_t rc;
@@ -321,6 +416,24 @@ uint32_t rpc_db_dump_async(DMCONTEXT *ctx, const char *path, DMRESULT_CB cb, voi
 	return dm_enqueue_request(ctx, req, cb, data);
 }
 
+uint32_t rpc_db_dump_chunk_async(DMCONTEXT *ctx, const char *path, uint64_t offset, uint32_t size, uint32_t format, DMRESULT_CB cb, void *data)
+{
+	uint32_t rc;
+	DM2_REQUEST *req;
+
+	if (!(req = dm_new_request(ctx, CMD_DB_DUMP, CMD_FLAG_REQUEST, 0, 0)))
+		return RC_ERR_ALLOC;
+
+	if ((rc = dm_add_string(req, AVP_PATH, VP_TRAVELPING, path)) != RC_OK
+	    || (rc = dm_add_uint64(req, AVP_UINT64, VP_TRAVELPING, offset)) != RC_OK
+	    || (rc = dm_add_uint32(req, AVP_COUNTER, VP_TRAVELPING, size)) != RC_OK
+	    || (rc = dm_add_uint32(req, AVP_CONFIG_FORMAT, VP_TRAVELPING, format)) != RC_OK
+	    || (rc = dm_finalize_packet(req)) != RC_OK)
+		return rc;
+
+	return dm_enqueue_request(ctx, req, cb, data);
+}
+
 uint32_t rpc_db_save_async(DMCONTEXT *ctx, DMRESULT_CB cb, void *data)
 {
 	uint32_t rc;
@@ -349,6 +462,20 @@ uint32_t rpc_db_commit_async(DMCONTEXT *ctx, DMRESULT_CB cb, void *data)
 	return dm_enqueue_request(ctx, req, cb, data);
 }
 
+uint32_t rpc_db_commit_dry_run_async(DMCONTEXT *ctx, DMRESULT_CB cb, void *data)
+{
+	uint32_t rc;
+	DM2_REQUEST *req;
+
+	if (!(req = dm_new_request(ctx, CMD_DB_COMMIT_DRY_RUN, CMD_FLAG_REQUEST, 0, 0)))
+		return RC_ERR_ALLOC;
+
+	if ((rc = dm_finalize_packet(req)) != RC_OK)
+		return rc;
+
+	return dm_enqueue_request(ctx, req, cb, data);
+}
+
 uint32_t rpc_db_cancel_async(DMCONTEXT *ctx, DMRESULT_CB cb, void *data)
 {
 	uint32_t rc;
@@ -380,6 +507,68 @@ uint32_t rpc_db_findinstance_async(DMCONTEXT *ctx, const const char *path, const
 	return dm_enqueue_request(ctx, req, cb, data);
 }
 
+uint32_t rpc_db_compare_and_set_async(DMCONTEXT *ctx, const char *path, const struct dm2_avp *expected, const struct dm2_avp *value, DMRESULT_CB cb, void *data)
+{
+	uint32_t rc;
+	DM2_REQUEST *req;
+
+	if (!(req = dm_new_request(ctx, CMD_DB_COMPARE_AND_SET, CMD_FLAG_REQUEST, 0, 0)))
+		return RC_ERR_ALLOC;
+
+	if ((rc = dm_add_string(req, AVP_PATH, VP_TRAVELPING, path)) != RC_OK
+	    || (rc = dm_add_raw(req, expected->code, expected->vendor_id, expected->data, expected->size)) != RC_OK
+	    || (rc = dm_add_raw(req, value->code, value->vendor_id, value->data, value->size)) != RC_OK
+	    || (rc = dm_finalize_packet(req)) != RC_OK)
+		return rc;
+
+	return dm_enqueue_request(ctx, req, cb, data);
+}
+
+uint32_t rpc_db_atomic_add_async(DMCONTEXT *ctx, const char *path, int64_t delta, DMRESULT_CB cb, void *data)
+{
+	uint32_t rc;
+	DM2_REQUEST *req;
+
+	if (!(req = dm_new_request(ctx, CMD_DB_ATOMIC_ADD, CMD_FLAG_REQUEST, 0, 0)))
+		return RC_ERR_ALLOC;
+
+	if ((rc = dm_add_string(req, AVP_PATH, VP_TRAVELPING, path)) != RC_OK
+	    || (rc = dm_add_int64(req, AVP_INT64, VP_TRAVELPING, delta)) != RC_OK
+	    || (rc = dm_finalize_packet(req)) != RC_OK)
+		return rc;
+
+	return dm_enqueue_request(ctx, req, cb, data);
+}
+
+uint32_t rpc_db_savepoint_async(DMCONTEXT *ctx, DMRESULT_CB cb, void *data)
+{
+	uint32_t rc;
+	DM2_REQUEST *req;
+
+	if (!(req = dm_new_request(ctx, CMD_DB_SAVEPOINT, CMD_FLAG_REQUEST, 0, 0)))
+		return RC_ERR_ALLOC;
+
+	if ((rc = dm_finalize_packet(req)) != RC_OK)
+		return rc;
+
+	return dm_enqueue_request(ctx, req, cb, data);
+}
+
+uint32_t rpc_db_rollback_savepoint_async(DMCONTEXT *ctx, uint32_t savepoint, DMRESULT_CB cb, void *data)
+{
+	uint32_t rc;
+	DM2_REQUEST *req;
+
+	if (!(req = dm_new_request(ctx, CMD_DB_ROLLBACK_SAVEPOINT, CMD_FLAG_REQUEST, 0, 0)))
+		return RC_ERR_ALLOC;
+
+	if ((rc = dm_add_uint32(req, AVP_SAVEPOINT, VP_TRAVELPING, savepoint)) != RC_OK
+	    || (rc = dm_finalize_packet(req)) != RC_OK)
+		return rc;
+
+	return dm_enqueue_request(ctx, req, cb, data);
+}
+
 uint32_t rpc_register_role_async(DMCONTEXT *ctx, const char *role, DMRESULT_CB cb, void *data)
 {
 	uint32_t rc;
@@ -544,6 +733,16 @@ uint32_t rpc_subscribe_notify(DMCONTEXT *ctx, DM2_AVPGRP *answer)
 	return reply.rc;
 }
 
+uint32_t rpc_subscribe_notify_flags(DMCONTEXT *ctx, uint32_t flags, DM2_AVPGRP *answer)
+{
+	struct async_reply reply = {.rc = RC_OK, .answer = answer };
+
+	rpc_subscribe_notify_flags_async(ctx, flags, dm_async_cb, &reply);
+	ev_run(ctx->ev, 0);
+
+	return reply.rc;
+}
+
 uint32_t rpc_unsubscribe_notify(DMCONTEXT *ctx, DM2_AVPGRP *answer)
 {
 	struct async_reply reply = {.rc = RC_OK, .answer = answer };
@@ -584,6 +783,36 @@ uint32_t rpc_get_passive_notifications(DMCONTEXT *ctx, DM2_AVPGRP *answer)
 	return reply.rc;
 }
 
+uint32_t rpc_get_passive_notifications_paged(DMCONTEXT *ctx, uint32_t max, DM2_AVPGRP *answer)
+{
+	struct async_reply reply = {.rc = RC_OK, .answer = answer };
+
+	rpc_get_passive_notifications_paged_async(ctx, max, dm_async_cb, &reply);
+	ev_run(ctx->ev, 0);
+
+	return reply.rc;
+}
+
+uint32_t rpc_get_schema_map(DMCONTEXT *ctx, const char *path, DM2_AVPGRP *answer)
+{
+	struct async_reply reply = {.rc = RC_OK, .answer = answer };
+
+	rpc_get_schema_map_async(ctx, path, dm_async_cb, &reply);
+	ev_run(ctx->ev, 0);
+
+	return reply.rc;
+}
+
+uint32_t rpc_param_notify_filter(DMCONTEXT *ctx, const char *path, uint32_t predicate, struct dm2_avp *operand, DM2_AVPGRP *answer)
+{
+	struct async_reply reply = {.rc = RC_OK, .answer = answer };
+
+	rpc_param_notify_filter_async(ctx, path, predicate, operand, dm_async_cb, &reply);
+	ev_run(ctx->ev, 0);
+
+	return reply.rc;
+}
+
 uint32_t rpc_db_addinstance(DMCONTEXT *ctx, const char *path, uint16_t id, DM2_AVPGRP *answer)
 {
 	struct async_reply reply = {.rc = RC_OK, .answer = answer };
@@ -614,6 +843,16 @@ uint32_t rpc_db_set(DMCONTEXT *ctx, int pvcnt, struct rpc_db_set_path_value *val
 	return reply.rc;
 }
 
+uint32_t rpc_db_bulk_set(DMCONTEXT *ctx, const char *path, int create, int ccnt, const char **columns, int rcnt, const struct rpc_db_bulk_set_row *rows, DM2_AVPGRP *answer)
+{
+	struct async_reply reply = {.rc = RC_OK, .answer = answer };
+
+	rpc_db_bulk_set_async(ctx, path, create, ccnt, columns, rcnt, rows, dm_async_cb, &reply);
+	ev_run(ctx->ev, 0);
+
+	return reply.rc;
+}
+
 uint32_t rpc_db_get(DMCONTEXT *ctx, int pcnt, const char **paths, DM2_AVPGRP *answer)
 {
 	struct async_reply reply = {.rc = RC_OK, .answer = answer };
@@ -654,6 +893,16 @@ uint32_t rpc_db_dump(DMCONTEXT *ctx, const char *path, DM2_AVPGRP *answer)
 	return reply.rc;
 }
 
+uint32_t rpc_db_dump_chunk(DMCONTEXT *ctx, const char *path, uint64_t offset, uint32_t size, uint32_t format, DM2_AVPGRP *answer)
+{
+	struct async_reply reply = {.rc = RC_OK, .answer = answer };
+
+	rpc_db_dump_chunk_async(ctx, path, offset, size, format, dm_async_cb, &reply);
+	ev_run(ctx->ev, 0);
+
+	return reply.rc;
+}
+
 uint32_t rpc_db_save(DMCONTEXT *ctx, DM2_AVPGRP *answer)
 {
 	struct async_reply reply = {.rc = RC_OK, .answer = answer };
@@ -674,6 +923,16 @@ uint32_t rpc_db_commit(DMCONTEXT *ctx, DM2_AVPGRP *answer)
 	return reply.rc;
 }
 
+uint32_t rpc_db_commit_dry_run(DMCONTEXT *ctx, DM2_AVPGRP *answer)
+{
+	struct async_reply reply = {.rc = RC_OK, .answer = answer };
+
+	rpc_db_commit_dry_run_async(ctx, dm_async_cb, &reply);
+	ev_run(ctx->ev, 0);
+
+	return reply.rc;
+}
+
 uint32_t rpc_db_cancel(DMCONTEXT *ctx, DM2_AVPGRP *answer)
 {
 	struct async_reply reply = {.rc = RC_OK, .answer = answer };
@@ -694,6 +953,46 @@ uint32_t rpc_db_findinstance(DMCONTEXT *ctx, const const char *path, const char
 	return reply.rc;
 }
 
+uint32_t rpc_db_compare_and_set(DMCONTEXT *ctx, const char *path, const struct dm2_avp *expected, const struct dm2_avp *value, DM2_AVPGRP *answer)
+{
+	struct async_reply reply = {.rc = RC_OK, .answer = answer };
+
+	rpc_db_compare_and_set_async(ctx, path, expected, value, dm_async_cb, &reply);
+	ev_run(ctx->ev, 0);
+
+	return reply.rc;
+}
+
+uint32_t rpc_db_atomic_add(DMCONTEXT *ctx, const char *path, int64_t delta, DM2_AVPGRP *answer)
+{
+	struct async_reply reply = {.rc = RC_OK, .answer = answer };
+
+	rpc_db_atomic_add_async(ctx, path, delta, dm_async_cb, &reply);
+	ev_run(ctx->ev, 0);
+
+	return reply.rc;
+}
+
+uint32_t rpc_db_savepoint(DMCONTEXT *ctx, DM2_AVPGRP *answer)
+{
+	struct async_reply reply = {.rc = RC_OK, .answer = answer };
+
+	rpc_db_savepoint_async(ctx, dm_async_cb, &reply);
+	ev_run(ctx->ev, 0);
+
+	return reply.rc;
+}
+
+uint32_t rpc_db_rollback_savepoint(DMCONTEXT *ctx, uint32_t savepoint, DM2_AVPGRP *answer)
+{
+	struct async_reply reply = {.rc = RC_OK, .answer = answer };
+
+	rpc_db_rollback_savepoint_async(ctx, savepoint, dm_async_cb, &reply);
+	ev_run(ctx->ev, 0);
+
+	return reply.rc;
+}
+
 uint32_t rpc_register_role(DMCONTEXT *ctx, const char *role)
 {
 	struct async_reply reply = {.rc = RC_OK, .answer = NULL };
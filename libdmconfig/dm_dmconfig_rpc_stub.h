@@ -18,27 +18,43 @@ struct rpc_db_set_path_value {
         struct dm2_avp value;
 };
 
+struct rpc_db_bulk_set_row {
+	uint16_t id;				/* 0 lets mand choose the id of a new instance */
+	const struct dm2_avp *values;		/* one value per column */
+};
+
 uint32_t rpc_startsession_async(DMCONTEXT *ctx, uint32_t flags, int32_t timeout, DMRESULT_CB cb, void *data);
 uint32_t rpc_switchsession_async(DMCONTEXT *ctx, uint32_t flags, int32_t timeout, DMRESULT_CB cb, void *data);
 uint32_t rpc_endsession_async(DMCONTEXT *ctx);
 uint32_t rpc_sessioninfo_async(DMCONTEXT *ctx, DMRESULT_CB cb, void *data);
 uint32_t rpc_cfgsessioninfo_async(DMCONTEXT *ctx, DMRESULT_CB cb, void *data);
 uint32_t rpc_subscribe_notify_async(DMCONTEXT *ctx, DMRESULT_CB cb, void *data);
+uint32_t rpc_subscribe_notify_flags_async(DMCONTEXT *ctx, uint32_t flags, DMRESULT_CB cb, void *data);
 uint32_t rpc_unsubscribe_notify_async(DMCONTEXT *ctx, DMRESULT_CB cb, void *data);
 uint32_t rpc_param_notify_async(DMCONTEXT *ctx, uint32_t notify, int pcnt, const char **paths, DMRESULT_CB cb, void *data);
 uint32_t rpc_recursive_param_notify_async(DMCONTEXT *ctx, uint32_t notify, const char *path, DMRESULT_CB cb, void *data);
 uint32_t rpc_get_passive_notifications_async(DMCONTEXT *ctx, DMRESULT_CB cb, void *data);
+uint32_t rpc_get_passive_notifications_paged_async(DMCONTEXT *ctx, uint32_t max, DMRESULT_CB cb, void *data);
+uint32_t rpc_get_schema_map_async(DMCONTEXT *ctx, const char *path, DMRESULT_CB cb, void *data);
+uint32_t rpc_param_notify_filter_async(DMCONTEXT *ctx, const char *path, uint32_t predicate, struct dm2_avp *operand, DMRESULT_CB cb, void *data);
 uint32_t rpc_db_addinstance_async(DMCONTEXT *ctx, const char *path, uint16_t id, DMRESULT_CB cb, void *data);
 uint32_t rpc_db_delinstance_async(DMCONTEXT *ctx, const char *path, DMRESULT_CB cb, void *data);
 uint32_t rpc_db_set_async(DMCONTEXT *ctx, int pvcnt, struct rpc_db_set_path_value *values, DMRESULT_CB cb, void *data);
+uint32_t rpc_db_bulk_set_async(DMCONTEXT *ctx, const char *path, int create, int ccnt, const char **columns, int rcnt, const struct rpc_db_bulk_set_row *rows, DMRESULT_CB cb, void *data);
 uint32_t rpc_db_get_async(DMCONTEXT *ctx, int pcnt, const char **paths, DMRESULT_CB cb, void *data);
 uint32_t rpc_db_list_async(DMCONTEXT *ctx, int level, const char *path, DMRESULT_CB cb, void *data);
 uint32_t rpc_db_retrieve_enum_async(DMCONTEXT *ctx, const char *path, DMRESULT_CB cb, void *data);
 uint32_t rpc_db_dump_async(DMCONTEXT *ctx, const char *path, DMRESULT_CB cb, void *data);
+uint32_t rpc_db_dump_chunk_async(DMCONTEXT *ctx, const char *path, uint64_t offset, uint32_t size, uint32_t format, DMRESULT_CB cb, void *data);
 uint32_t rpc_db_save_async(DMCONTEXT *ctx, DMRESULT_CB cb, void *data);
 uint32_t rpc_db_commit_async(DMCONTEXT *ctx, DMRESULT_CB cb, void *data);
+uint32_t rpc_db_commit_dry_run_async(DMCONTEXT *ctx, DMRESULT_CB cb, void *data);
 uint32_t rpc_db_cancel_async(DMCONTEXT *ctx, DMRESULT_CB cb, void *data);
 uint32_t rpc_db_findinstance_async(DMCONTEXT *ctx, const const char *path, const char *name, const struct dm2_avp *search, DMRESULT_CB cb, void *data);
+uint32_t rpc_db_compare_and_set_async(DMCONTEXT *ctx, const char *path, const struct dm2_avp *expected, const struct dm2_avp *value, DMRESULT_CB cb, void *data);
+uint32_t rpc_db_atomic_add_async(DMCONTEXT *ctx, const char *path, int64_t delta, DMRESULT_CB cb, void *data);
+uint32_t rpc_db_savepoint_async(DMCONTEXT *ctx, DMRESULT_CB cb, void *data);
+uint32_t rpc_db_rollback_savepoint_async(DMCONTEXT *ctx, uint32_t savepoint, DMRESULT_CB cb, void *data);
 uint32_t rpc_register_role_async(DMCONTEXT *ctx, const char *role, DMRESULT_CB cb, void *data);
 uint32_t rpc_system_restart_async(DMCONTEXT *ctx);
 uint32_t rpc_system_shutdown_async(DMCONTEXT *ctx);
@@ -57,21 +73,32 @@ uint32_t rpc_endsession(DMCONTEXT *ctx);
 uint32_t rpc_sessioninfo(DMCONTEXT *ctx, DM2_AVPGRP *grp);
 uint32_t rpc_cfgsessioninfo(DMCONTEXT *ctx, DM2_AVPGRP *grp);
 uint32_t rpc_subscribe_notify(DMCONTEXT *ctx, DM2_AVPGRP *grp);
+uint32_t rpc_subscribe_notify_flags(DMCONTEXT *ctx, uint32_t flags, DM2_AVPGRP *grp);
 uint32_t rpc_unsubscribe_notify(DMCONTEXT *ctx, DM2_AVPGRP *grp);
 uint32_t rpc_param_notify(DMCONTEXT *ctx, uint32_t notify, int pcnt, const char **paths, DM2_AVPGRP *grp);
 uint32_t rpc_recursive_param_notify(DMCONTEXT *ctx, uint32_t notify, const char *path, DM2_AVPGRP *grp);
 uint32_t rpc_get_passive_notifications(DMCONTEXT *ctx, DM2_AVPGRP *grp);
+uint32_t rpc_get_passive_notifications_paged(DMCONTEXT *ctx, uint32_t max, DM2_AVPGRP *grp);
+uint32_t rpc_get_schema_map(DMCONTEXT *ctx, const char *path, DM2_AVPGRP *grp);
+uint32_t rpc_param_notify_filter(DMCONTEXT *ctx, const char *path, uint32_t predicate, struct dm2_avp *operand, DM2_AVPGRP *grp);
 uint32_t rpc_db_addinstance(DMCONTEXT *ctx, const char *path, uint16_t id, DM2_AVPGRP *grp);
 uint32_t rpc_db_delinstance(DMCONTEXT *ctx, const char *path, DM2_AVPGRP *grp);
 uint32_t rpc_db_set(DMCONTEXT *ctx, int pvcnt, struct rpc_db_set_path_value *values, DM2_AVPGRP *grp);
+uint32_t rpc_db_bulk_set(DMCONTEXT *ctx, const char *path, int create, int ccnt, const char **columns, int rcnt, const struct rpc_db_bulk_set_row *rows, DM2_AVPGRP *grp);
 uint32_t rpc_db_get(DMCONTEXT *ctx, int pcnt, const char **paths, DM2_AVPGRP *grp);
 uint32_t rpc_db_list(DMCONTEXT *ctx, int level, const char *path, DM2_AVPGRP *grp);
 uint32_t rpc_db_retrieve_enum(DMCONTEXT *ctx, const char *path, DM2_AVPGRP *grp);
 uint32_t rpc_db_dump(DMCONTEXT *ctx, const char *path, DM2_AVPGRP *grp);
+uint32_t rpc_db_dump_chunk(DMCONTEXT *ctx, const char *path, uint64_t offset, uint32_t size, uint32_t format, DM2_AVPGRP *grp);
 uint32_t rpc_db_save(DMCONTEXT *ctx, DM2_AVPGRP *grp);
 uint32_t rpc_db_commit(DMCONTEXT *ctx, DM2_AVPGRP *grp);
+uint32_t rpc_db_commit_dry_run(DMCONTEXT *ctx, DM2_AVPGRP *grp);
 uint32_t rpc_db_cancel(DMCONTEXT *ctx, DM2_AVPGRP *grp);
 uint32_t rpc_db_findinstance(DMCONTEXT *ctx, const const char *path, const char *name, const struct dm2_avp *search, DM2_AVPGRP *grp);
+uint32_t rpc_db_compare_and_set(DMCONTEXT *ctx, const char *path, const struct dm2_avp *expected, const struct dm2_avp *value, DM2_AVPGRP *grp);
+uint32_t rpc_db_atomic_add(DMCONTEXT *ctx, const char *path, int64_t delta, DM2_AVPGRP *grp);
+uint32_t rpc_db_savepoint(DMCONTEXT *ctx, DM2_AVPGRP *grp);
+uint32_t rpc_db_rollback_savepoint(DMCONTEXT *ctx, uint32_t savepoint, DM2_AVPGRP *grp);
 uint32_t rpc_register_role(DMCONTEXT *ctx, const char *role);
 uint32_t rpc_system_restart(DMCONTEXT *ctx);
 uint32_t rpc_system_shutdown(DMCONTEXT *ctx);
@@ -373,6 +373,23 @@ uint32_t dm_expect_int32_type(DM2_AVPGRP *grp, uint32_t exp_code, uint32_t exp_v
 	return RC_OK;
 }
 
+uint32_t dm_expect_int64_type(DM2_AVPGRP *grp, uint32_t exp_code, uint32_t exp_vendor_id, int64_t *value)
+{
+	uint32_t r;
+	size_t size;
+	void *data;
+
+	assert(grp != NULL);
+	assert(value != NULL);
+
+	if ((r = dm_expect_raw(grp, exp_code, exp_vendor_id, &data, &size) != RC_OK)
+	    || size != sizeof(*value))
+		return RC_ERR_MISC;
+
+	*value = dm_get_int64_avp(data);
+	return RC_OK;
+}
+
 uint32_t dm_expect_address_type(DM2_AVPGRP *grp, uint32_t exp_code, uint32_t exp_vendor_id, int *af, struct in_addr *addr, size_t addr_size)
 {
 	uint32_t r;
@@ -46,6 +46,10 @@ extern int dmconfig_debug_level;
 #define CMD_FLAG_READWRITE		0x0
 #define CMD_FLAG_CONFIGURE		(1 << 0)
 
+		/* subscribe notify flags */
+
+#define NOTIFY_FLAG_SELECTOR		(1 << 0)	/* send AVP_SELECTOR instead of AVP_PATH */
+
 /* function headers */
 
 /* API v2 */
@@ -84,6 +88,7 @@ uint32_t dm_expect_uint64_type(DM2_AVPGRP *grp, uint32_t exp_code, uint32_t exp_
 uint32_t dm_expect_int8_type(DM2_AVPGRP *grp, uint32_t exp_code, uint32_t exp_vendor_id, int8_t *value) __attribute__((nonnull (1,4)));
 uint32_t dm_expect_int16_type(DM2_AVPGRP *grp, uint32_t exp_code, uint32_t exp_vendor_id, int16_t *value) __attribute__((nonnull (1,4)));
 uint32_t dm_expect_int32_type(DM2_AVPGRP *grp, uint32_t exp_code, uint32_t exp_vendor_id, int32_t *value) __attribute__((nonnull (1,4)));
+uint32_t dm_expect_int64_type(DM2_AVPGRP *grp, uint32_t exp_code, uint32_t exp_vendor_id, int64_t *value) __attribute__((nonnull (1,4)));
 uint32_t dm_expect_address_type(DM2_AVPGRP *grp, uint32_t exp_code, uint32_t exp_vendor_id, int *af, struct in_addr *addr, size_t addr_size) __attribute__((nonnull (1,4,5)));
 uint32_t dm_expect_group(DM2_AVPGRP *grp, uint32_t exp_code, uint32_t exp_vendor_id, DM2_AVPGRP *obj) __attribute__((nonnull (1,4)));
 uint32_t dm_expect_group_end(DM2_AVPGRP *grp) __attribute__((nonnull (1)));
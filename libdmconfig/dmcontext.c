@@ -177,7 +177,9 @@ uint32_t dm_enqueue(DMCONTEXT *socket, DM2_REQUEST *req, int flags, DMRESULT_CB
 	 */
 	ev_now_update(socket->ev);
 
-	if ((flags | REPLY) != REPLY) {
+	/* shared packets get their ids on the first enqueue only */
+	if ((flags | REPLY) != REPLY
+	    && !((flags & SHARED) && req->packet->hop2hop_id)) {
 		/* initialize static hopid */
 		switch (hopid) {		/* one never knows... */
 		case 0:		srand((unsigned int)time(NULL));
@@ -192,7 +194,14 @@ uint32_t dm_enqueue(DMCONTEXT *socket, DM2_REQUEST *req, int flags, DMRESULT_CB
 
 	if (!(rqi = talloc_zero(socket, DM2_REQUEST_INFO)))
 		return RC_ERR_ALLOC;
-	rqi->packet = talloc_steal(rqi, req->packet);
+	if (flags & SHARED)
+		rqi->packet = talloc_reference(rqi, req->packet);
+	else
+		rqi->packet = talloc_steal(rqi, req->packet);
+	if (!rqi->packet) {
+		talloc_free(rqi);
+		return RC_ERR_ALLOC;
+	}
 	rqi->flags = flags;
 	rqi->reply_cb = cb;
 	rqi->userdata = data;
@@ -502,7 +511,10 @@ writeEvent(EV_P_ ev_io *w, int revents __attribute__((unused)))
 
 			ctx->pos = ctx->packet = req->packet;
 			ctx->left = dm_packet_length(ctx->packet);
-			talloc_steal(socket, req->packet);
+			if (req->flags & SHARED)
+				talloc_reference(socket, req->packet);
+			else
+				talloc_steal(socket, req->packet);
 
 			if (req->flags & (ONE_WAY | REPLY)) {
 				/* drop the packet from the request queue */
@@ -547,7 +559,7 @@ writeEvent(EV_P_ ev_io *w, int revents __attribute__((unused)))
 		trace(":[%p] loop exit: %zd bytes,ctx->left: %zd ", socket, len, ctx->left);
 
 		if (ctx->left == 0) {
-			talloc_free(ctx->packet);
+			talloc_unlink(socket, ctx->packet);
 			ctx->packet = NULL;
 		}
 
@@ -573,7 +585,8 @@ dm_free_requests(DMCONTEXT *sock, DMCONFIG_EVENT event)
 		talloc_free(r);
 	}
 
-	talloc_free(sock->writeCtx.packet);
+	if (sock->writeCtx.packet)
+		talloc_unlink(sock, sock->writeCtx.packet);
 	sock->writeCtx.packet = NULL;
 
 	talloc_free(sock->readCtx.packet);
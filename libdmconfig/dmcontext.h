@@ -86,6 +86,7 @@ typedef void (*DMRESULT_CB) (DMCONTEXT *socket, DMCONFIG_EVENT event, DM2_AVPGRP
 #define ONE_WAY  (1 << 0)
 #define REQUEST  (1 << 1)
 #define REPLY    (1 << 2)
+#define SHARED   (1 << 3)	/* packet is referenced, not owned, it may be queued on several sockets */
 
 /**
  * dmconfig connect callback.
@@ -287,6 +287,25 @@ dm_put_avp(DM2_REQUEST *req, uint32_t code, uint32_t vendor_id, const void *data
 	return RC_OK;
 }
 
+/* append raw bytes to the AVP opened with dm_new_group() */
+uint32_t
+dm_put_data(DM2_REQUEST *req, const void *data, size_t len)
+{
+	uint32_t rc;
+
+	if (req->level == 0)
+		return RC_ERR_AVP_MISFORMED;
+
+	/* room for the padding added by dm_finalize_group() */
+	if ((rc = dm_packet_ensure_space(req, len + 3)) != RC_OK)
+		return rc;
+
+	memcpy(((unsigned char *)req->packet) + req->grp[req->level].pos, data, len);
+	req->grp[req->level].pos += len;
+
+	return RC_OK;
+}
+
 uint32_t
 dm_add_address(DM2_REQUEST *req, uint32_t code, uint32_t vendor_id, int af, const void *data)
 {
@@ -163,6 +163,7 @@ uint32_t dm_finalize_packet(DM2_REQUEST *req) __attribute__((nonnull (1)));
 uint32_t dm_new_group(DM2_REQUEST *req, uint32_t code, uint32_t vendor_id) __attribute__((nonnull (1)));
 uint32_t dm_finalize_group(DM2_REQUEST *req) __attribute__((nonnull (1)));
 uint32_t dm_put_avp(DM2_REQUEST *req, uint32_t code, uint32_t vendor_id, const void *data, size_t len) __attribute__((nonnull (1)));
+uint32_t dm_put_data(DM2_REQUEST *req, const void *data, size_t len) __attribute__((nonnull (1,2)));
 
 static inline uint32_t dm_add_object(DM2_REQUEST *req) __attribute__((nonnull (1)));
 static inline uint32_t dm_add_raw(DM2_REQUEST *req, uint32_t code, uint32_t vendor_id, const void *data, size_t len) __attribute__((nonnull (1)));
@@ -184,3 +184,35 @@ void clear_actions(void)
 	talloc_free(exec_chain);
 	exec_chain = NULL;
 }
+
+const char *action_name(enum dm_actions action)
+{
+	return t_actions[action];
+}
+
+/*
+ * dry run: collect() queues actions like a real change would, they are
+ * reported to cb sorted by action and selector instead of being executed,
+ * actions already queued are not touched
+ */
+uint32_t plan_actions(void (*collect)(void *), void *collect_data,
+		      uint32_t (*cb)(void *, enum dm_actions, const dm_selector, enum dm_action_type), void *cb_data)
+{
+	struct action_tree *saved = exec_chain;
+	struct exec_node *node;
+	uint32_t rc = 0;
+
+	exec_chain = NULL;
+
+	collect(collect_data);
+
+	if (exec_chain)
+		RB_FOREACH(node, action_tree, exec_chain)
+			if ((rc = cb(cb_data, node->action, node->sel, node->type)) != 0)
+				break;
+
+	clear_actions();
+	exec_chain = saved;
+
+	return rc;
+}
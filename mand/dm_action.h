@@ -5,6 +5,8 @@
 #ifndef __DM_ACTION_H
 #define __DM_ACTION_H
 
+#include <stdint.h>
+
 #include "dm_action_table.h"
 
 enum dm_action_type {
@@ -33,6 +35,10 @@ void exec_actions_pre(void);
 void exec_actions(void);
 void clear_actions(void);
 
+const char *action_name(enum dm_actions);
+uint32_t plan_actions(void (*collect)(void *), void *collect_data,
+		      uint32_t (*cb)(void *, enum dm_actions, const dm_selector, enum dm_action_type), void *cb_data);
+
 extern const struct dm_action *dm_actions[];
 
 #endif
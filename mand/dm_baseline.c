@@ -0,0 +1,396 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+/*
+ * baseline of a differential config
+ *
+ * The config directories are parsed with the change list parser of the
+ * directory load and replayed on a map keyed by selector instead of the
+ * store. Instances without an id get one the way dm_add_instance() would
+ * pick it, so the map holds what a boot without user config loads.
+ *
+ * The map is kept between dumps and only rebuilt when the stamp of the
+ * directories changes, the same stamp the base image is checked with.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <sys/tree.h>
+
+//#define SDEBUG
+#include "debug.h"
+
+#include "dm_token.h"
+#include "dm_store.h"
+#include "dm_notify.h"
+#include "dm_strings.h"
+#include "dm_deserialize.h"
+#include "dm_binconfig.h"
+#include "dm_baseline.h"
+
+struct baseline_entry {
+	RB_ENTRY(baseline_entry) node;
+
+	dm_selector sel;
+	const struct dm_element *kw;	/* the object of an instance */
+	int instance;
+	DM_VALUE value;			/* leaves only */
+};
+
+RB_HEAD(baseline_tree, baseline_entry);
+
+struct dm_baseline {
+	struct baseline_tree entries;
+
+	/* parser position, selector ids each open element added */
+	dm_selector sel;
+	int len;
+	int depth;
+	uint8_t pushed[DM_SELECTOR_LEN + 1];
+	struct baseline_entry *leaf;
+	int failed;
+};
+
+static int
+baseline_compare(struct baseline_entry *a, struct baseline_entry *b)
+{
+	return dm_selcmp(a->sel, b->sel, DM_SELECTOR_LEN);
+}
+
+RB_PROTOTYPE(baseline_tree, baseline_entry, node, baseline_compare);
+RB_GENERATE(baseline_tree, baseline_entry, node, baseline_compare);
+
+/* first entry at or after key */
+static struct baseline_entry *baseline_nfind(struct dm_baseline *b, struct baseline_entry *key)
+{
+	struct baseline_entry *e = RB_ROOT(&b->entries);
+	struct baseline_entry *res = NULL;
+
+	while (e) {
+		int comp = baseline_compare(key, e);
+
+		if (comp < 0) {
+			res = e;
+			e = RB_LEFT(e, node);
+		} else if (comp > 0)
+			e = RB_RIGHT(e, node);
+		else
+			return e;
+	}
+
+	return res;
+}
+
+static const char *const *baseline_dirs;
+
+/* built on first use, rebuilt when the files change */
+static struct dm_baseline *baseline;
+static uint64_t baseline_stamp;
+
+static void baseline_free(struct dm_baseline *);
+
+void dm_baseline_set_dirs(const char *const dirs[])
+{
+	baseline_dirs = dirs;
+
+	baseline_free(baseline);
+	baseline = NULL;
+}
+
+static struct baseline_entry *baseline_find(struct dm_baseline *b, const dm_selector sel)
+{
+	struct baseline_entry key;
+
+	dm_selcpy(key.sel, sel);
+	return RB_FIND(baseline_tree, &b->entries, &key);
+}
+
+static struct baseline_entry *baseline_get(struct dm_baseline *b, const struct dm_element *kw, int instance)
+{
+	struct baseline_entry *e;
+
+	if ((e = baseline_find(b, b->sel)))
+		return e;
+
+	if (!(e = calloc(1, sizeof(struct baseline_entry)))) {
+		b->failed = 1;
+		return NULL;
+	}
+
+	dm_selcpy(e->sel, b->sel);
+	e->kw = kw;
+	e->instance = instance;
+	if (!instance) {
+		e->value.notify = notify_default(kw);
+		DM_parity_update(e->value);
+	}
+	RB_INSERT(baseline_tree, &b->entries, e);
+
+	return e;
+}
+
+static void baseline_entry_free(struct baseline_entry *e)
+{
+	if (!e->instance)
+		dm_free_any_value(e->kw, &e->value);
+	free(e);
+}
+
+/* append id to the position, 0 when the selector is full */
+static int baseline_push(struct dm_baseline *b, dm_id id)
+{
+	if (b->len == DM_SELECTOR_LEN) {
+		b->failed = 1;
+		return 0;
+	}
+
+	b->sel[b->len++] = id;
+	if (b->len < DM_SELECTOR_LEN)
+		b->sel[b->len] = 0;
+	return 1;
+}
+
+/* the id dm_add_instance() gives instance xid of the object at the position */
+static dm_id baseline_instance_id(struct dm_baseline *b, int xid)
+{
+	dm_id id = xid;
+
+	if (xid > 0 && baseline_push(b, id)) {
+		int found = baseline_find(b, b->sel) != NULL;
+
+		b->sel[--b->len] = 0;
+		if (found)
+			return id;
+	}
+
+	if (!(id & DM_ID_MASK))
+		for (id++; baseline_push(b, id); id++) {
+			int found = baseline_find(b, b->sel) != NULL;
+
+			b->sel[--b->len] = 0;
+			if (!found)
+				break;
+		}
+
+	return id;
+}
+
+static void baseline_start(void *data, const struct dm_element *kw, dm_id id, int xid, int ntfy)
+{
+	struct dm_baseline *b = data;
+	int len = b->len;
+
+	b->leaf = NULL;
+
+	if (b->depth == DM_SELECTOR_LEN) {
+		b->failed = 1;
+		return;
+	}
+
+	if (baseline_push(b, id)) {
+		switch (kw->type) {
+		case T_TOKEN:
+			break;
+
+		case T_OBJECT:
+			if (baseline_push(b, baseline_instance_id(b, xid)))
+				baseline_get(b, kw, 1);
+			break;
+
+		default:
+			if ((b->leaf = baseline_get(b, kw, 0)) && ntfy >= 0)
+				set_notify_single_slot_element(kw, &b->leaf->value, 0, ntfy);
+			break;
+		}
+	}
+
+	b->pushed[b->depth++] = b->len - len;
+}
+
+static void baseline_end(void *data, const char *text)
+{
+	struct dm_baseline *b = data;
+
+	if (b->leaf)
+		dm_string2value(b->leaf->kw, text, 0, &b->leaf->value);
+	b->leaf = NULL;
+
+	if (b->depth == 0)
+		return;
+
+	b->len -= b->pushed[--b->depth];
+	b->sel[b->len] = 0;
+}
+
+/* drop instance xid and everything below it */
+static void baseline_del(void *data, const struct dm_element *kw __attribute__ ((unused)), dm_id id, int xid)
+{
+	struct dm_baseline *b = data;
+	struct baseline_entry key, *e;
+	int len = b->len;
+
+	if (!baseline_push(b, id) || !baseline_push(b, xid)) {
+		b->len = len;
+		b->sel[b->len] = 0;
+		return;
+	}
+
+	dm_selcpy(key.sel, b->sel);
+	while ((e = baseline_nfind(b, &key)) &&
+	       dm_selcmp(e->sel, key.sel, b->len) == 0) {
+		RB_REMOVE(baseline_tree, &b->entries, e);
+		baseline_entry_free(e);
+	}
+
+	b->len = len;
+	b->sel[b->len] = 0;
+}
+
+static struct dm_baseline *baseline_load(void)
+{
+	struct dm_baseline *b;
+	struct dm_deserialize_visitor v = {
+		.start = baseline_start,
+		.end = baseline_end,
+		.del = baseline_del,
+	};
+
+	if (!(b = calloc(1, sizeof(struct dm_baseline))))
+		return NULL;
+
+	RB_INIT(&b->entries);
+	v.data = b;
+
+	/* missing directories are fine, like at boot */
+	for (const char *const *dir = baseline_dirs; dir && *dir; dir++)
+		dm_deserialize_directory_visit(*dir, &v);
+
+	if (b->failed) {
+		debug("(): out of memory or nested too deep");
+		baseline_free(b);
+		return NULL;
+	}
+
+	return b;
+}
+
+static void baseline_free(struct dm_baseline *b)
+{
+	struct baseline_entry *e;
+
+	if (!b)
+		return;
+
+	while ((e = RB_ROOT(&b->entries))) {
+		RB_REMOVE(baseline_tree, &b->entries, e);
+		baseline_entry_free(e);
+	}
+	free(b);
+}
+
+struct dm_baseline *dm_baseline_get(void)
+{
+	uint64_t stamp;
+
+	if (!baseline_dirs)
+		stamp = 0;
+	else
+		stamp = dm_base_image_stamp(baseline_dirs);
+
+	if (baseline && stamp == baseline_stamp)
+		return baseline;
+
+	baseline_free(baseline);
+	baseline = baseline_load();
+	baseline_stamp = stamp;
+
+	return baseline;
+}
+
+/* NULL and empty strings, binaries and selectors are the same to a config */
+static int value_empty(const struct dm_element *elem, const DM_VALUE *value)
+{
+	switch (elem->type) {
+	case T_STR:
+		return !DM_STRING(*value) || !*DM_STRING(*value);
+
+	case T_BINARY:
+	case T_BASE64:
+		return !DM_BINARY(*value) || DM_BINARY(*value)->len == 0;
+
+	case T_SELECTOR:
+		return !DM_SELECTOR(*value) || !(*DM_SELECTOR(*value))[0];
+
+	default:
+		return 0;
+	}
+}
+
+int dm_baseline_changed(struct dm_baseline *b, const dm_selector sel, const struct dm_element *elem, const DM_VALUE value)
+{
+	struct baseline_entry *e = baseline_find(b, sel);
+	DM_VALUE live = value;
+	DM_VALUE base;
+
+	if (e)
+		base = e->value;
+	else {
+		/* a leaf no file sets keeps the value of a new table */
+		memset(&base, 0, sizeof(DM_VALUE));
+		base.notify = notify_default(elem);
+	}
+
+	if ((live.notify & 0x0003) != (base.notify & 0x0003))
+		return 1;
+
+	if (elem->type == T_COUNTER)
+		return 0;
+
+	if (value_empty(elem, &live) || value_empty(elem, &base))
+		return value_empty(elem, &live) != value_empty(elem, &base);
+
+	return dm_compare_values(elem->type, &live, &base) != 0;
+}
+
+int dm_baseline_covers(struct dm_baseline *b, const dm_selector sel)
+{
+	struct baseline_entry key, *e;
+
+	dm_selcpy(key.sel, sel);
+	e = baseline_nfind(b, &key);
+
+	return e && dm_selcmp(e->sel, sel, dm_sellen(sel)) == 0;
+}
+
+dm_id dm_baseline_next_instance(struct dm_baseline *b, const dm_selector sel, dm_id id)
+{
+	struct baseline_entry key, *e;
+	size_t len = dm_sellen(sel);
+
+	if (len == DM_SELECTOR_LEN || id == (dm_id)~0)
+		return 0;
+
+	dm_selcpy(key.sel, sel);
+	key.sel[len] = id + 1;
+	if (len + 1 < DM_SELECTOR_LEN)
+		key.sel[len + 1] = 0;
+
+	while ((e = baseline_nfind(b, &key)) &&
+	       dm_selcmp(e->sel, sel, len) == 0) {
+		/* the entry of an instance comes before everything below it */
+		if (e->instance && dm_sellen(e->sel) == len + 1)
+			return e->sel[len];
+
+		if (e->sel[len] == (dm_id)~0)
+			break;
+		key.sel[len] = e->sel[len] + 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,35 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef __DM_BASELINE_H
+#define __DM_BASELINE_H
+
+#include "dm.h"
+#include "dm_token.h"
+
+/*
+ * baseline of a differential config
+ *
+ * The base and default config files parsed into a map of the leaves and
+ * instances they set, the store is not touched. dm_serialize_store() with
+ * S_DIFF compares the live store to it.
+ */
+struct dm_baseline;
+
+/* NULL terminated list of the config directories in load order, has to stay valid */
+void dm_baseline_set_dirs(const char *const dirs[]);
+
+/* the baseline of the current files, owned by the module, NULL when it could not be built */
+struct dm_baseline *dm_baseline_get(void);
+
+/* value or notify level of the leaf differ from the baseline, counters only compare the notify level */
+int dm_baseline_changed(struct dm_baseline *, const dm_selector sel, const struct dm_element *elem, const DM_VALUE value);
+
+/* the baseline sets a leaf or an instance at or below sel */
+int dm_baseline_covers(struct dm_baseline *, const dm_selector sel);
+
+/* next instance of the object at sel after id in the baseline, 0 when there is none */
+dm_id dm_baseline_next_instance(struct dm_baseline *, const dm_selector sel, dm_id id);
+
+#endif /* __DM_BASELINE_H */
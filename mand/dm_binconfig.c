@@ -0,0 +1,2029 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+/*
+ * compact binary config format
+ *
+ * header:
+ *   "DMBC", uint32 format version, uint32 config version, uint64 schema hash,
+ *   uint64 generation
+ *
+ * records:
+ *   uint8 type, uint8 prefix, uint8 count, count * uint16 id
+ *
+ *   the selector of a record shares its first prefix ids with the selector
+ *   of the record before it, only the remaining ids are stored.
+ *   REC_VALUE records are followed by uint8 notify, a varint length and
+ *   the value, REC_END has no selector and terminates the file. REC_DELETE
+ *   only appears in the journal.
+ *
+ *   REC_LAZY takes the place of the record of a table or object marked with
+ *   dm_binconfig_set_lazy(). It is followed by uint32 length and uint32
+ *   FNV-1a hash of the span, the records of the subtree. The first one is
+ *   prefixed against the selector of the REC_LAZY record, so is the record
+ *   after the span.
+ *
+ * Integers are little endian. Records are written in the order of the
+ * XML serializer and with the same filter, so both formats hold the
+ * same config.
+ *
+ * base image:
+ *   "DMBI" header with the stamp of the base config files as generation,
+ *   uint64 offset of the blob section, uint32 end of the records, padding
+ *
+ *   records as above with all values of the store, strings and binaries
+ *   are stored as uint64 offsets into the blob section. The blob section
+ *   holds NUL terminated strings and binary_t structures in host byte
+ *   order, so the mapped image is used by the store as it is.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include <dirent.h>
+#include <arpa/inet.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/param.h>
+#include <sys/queue.h>
+
+#include "dm.h"
+#include "dm_token.h"
+#include "dm_store.h"
+#include "dm_store_priv.h"
+#include "dm_index.h"
+#include "dm_notify.h"
+#include "dm_strings.h"
+#include "dm_serialize.h"
+#include "dm_deserialize.h"
+#include "dm_cfgversion.h"
+#include "dm_binconfig.h"
+#include "dm_snapshot.h"
+
+//#define SDEBUG
+#include "debug.h"
+
+#define BIN_MAGIC	"DMBC"
+#define JOURNAL_MAGIC	"DMBJ"
+#define IMAGE_MAGIC	"DMBI"
+#define BIN_HEADER_SIZE	(4 + 4 + 4 + 8 + 8)
+#define IMAGE_HEADER_SIZE	(BIN_HEADER_SIZE + 8 + 4 + 4)
+
+enum {
+	REC_END = 0,
+	REC_TABLE,
+	REC_INSTANCE,
+	REC_INSTANCE_END,
+	REC_VALUE,
+	REC_DELETE,
+	REC_LAZY,
+
+	REC_OBJECT,		/* not a record, a selector that ends at an object */
+};
+
+/* generation of the binary config on disk, a journal only applies to its own generation */
+static uint64_t binconfig_generation;
+static uint64_t binconfig_saved_generation;
+
+/* unique across reboots, so that an old journal never matches a new file */
+static uint64_t binconfig_next_generation(void)
+{
+	uint64_t generation = (uint64_t)time(NULL) << 16;
+
+	if (generation <= binconfig_generation)
+		generation = binconfig_generation + 1;
+	return generation;
+}
+
+static uint8_t *put_le(uint8_t *p, uint64_t v, int bytes)
+{
+	for (int i = 0; i < bytes; i++, v >>= 8)
+		*p++ = v & 0xff;
+	return p;
+}
+
+static uint64_t get_le(const uint8_t *p, int bytes)
+{
+	uint64_t v = 0;
+
+	for (int i = bytes - 1; i >= 0; i--)
+		v = (v << 8) | p[i];
+	return v;
+}
+
+/*
+ * schema hash
+ */
+
+static uint64_t schema_hash;
+static pthread_once_t schema_once = PTHREAD_ONCE_INIT;
+
+static uint64_t fnv1a(uint64_t h, const void *data, size_t len)
+{
+	const uint8_t *p = data;
+
+	while (len--) {
+		h ^= *p++;
+		h *= 0x100000001b3ULL;
+	}
+	return h;
+}
+
+static uint32_t fnv1a32(const void *data, size_t len)
+{
+	const uint8_t *p = data;
+	uint32_t h = 0x811c9dc5;
+
+	while (len--) {
+		h ^= *p++;
+		h *= 0x01000193;
+	}
+	return h;
+}
+
+static uint64_t schema_hash_table(uint64_t h, const struct dm_table *kw)
+{
+	for (int i = 0; i < kw->size; i++) {
+		const struct dm_element *elem = &kw->table[i];
+		uint8_t type[2];
+
+		put_le(type, elem->type, sizeof(type));
+		h = fnv1a(h, elem->key, strlen(elem->key) + 1);
+		h = fnv1a(h, type, sizeof(type));
+
+		switch (elem->type) {
+		case T_TOKEN:
+		case T_OBJECT:
+			h = schema_hash_table(h, elem->u.t.table);
+			break;
+
+		case T_ENUM: {
+			/* enums are stored by index */
+			const char *s = elem->u.e.data;
+
+			for (int j = 0; j < elem->u.e.cnt; j++, s += strlen(s) + 1)
+				h = fnv1a(h, s, strlen(s) + 1);
+			break;
+		}
+		}
+	}
+
+	/* end of table, keeps nesting apart from order */
+	return fnv1a(h, "\377", 1);
+}
+
+static void schema_hash_init(void)
+{
+	schema_hash = schema_hash_table(0xcbf29ce484222325ULL, &dm_root);
+}
+
+uint64_t dm_binconfig_schema_hash(void)
+{
+	pthread_once(&schema_once, schema_hash_init);
+	return schema_hash;
+}
+
+static void bin_put_header(FILE *stream, const char *magic, uint64_t generation)
+{
+	uint8_t hdr[BIN_HEADER_SIZE];
+	uint8_t *p = hdr;
+
+	memcpy(p, magic, 4);
+	p = put_le(p + 4, DM_BINCONFIG_VERSION, 4);
+	p = put_le(p, CFG_VERSION, 4);
+	p = put_le(p, dm_binconfig_schema_hash(), 8);
+	p = put_le(p, generation, 8);
+	fwrite(hdr, p - hdr, 1, stream);
+}
+
+/* returns the generation, 0 when the file was not written for this schema */
+static uint64_t bin_check_header(const uint8_t *buf, size_t len, const char *magic)
+{
+	if (len < BIN_HEADER_SIZE || memcmp(buf, magic, 4) != 0) {
+		debug("(): not a binary config");
+		return 0;
+	}
+
+	if (get_le(buf + 4, 4) != DM_BINCONFIG_VERSION ||
+	    get_le(buf + 8, 4) != CFG_VERSION ||
+	    get_le(buf + 12, 8) != dm_binconfig_schema_hash()) {
+		debug("(): binary config was written for another version or schema");
+		return 0;
+	}
+
+	return get_le(buf + 20, 8);
+}
+
+/*
+ * lazy subtrees
+ *
+ * A span is registered for each REC_LAZY record of a binary config loaded
+ * with dm_binconfig_load_file(), the file stays mapped until all its spans
+ * are loaded.
+ */
+
+struct lazy_map {
+	uint8_t *addr;
+	size_t size;
+	int refs;			/* spans in the mapping */
+};
+
+struct lazy_span {
+	LIST_ENTRY(lazy_span) next;
+
+	dm_selector sel;
+	int len;
+	int flags;			/* DS_* flags of the load */
+	int loading;
+
+	struct lazy_map *map;
+	const uint8_t *data;
+	uint32_t size;
+	uint32_t hash;
+};
+
+static LIST_HEAD(lazy_list, lazy_span) lazy_spans = LIST_HEAD_INITIALIZER(lazy_spans);
+
+/* recursive, loading a span looks up its own root, set up on first use */
+static pthread_mutex_t lazy_lock;
+static pthread_once_t lazy_once = PTHREAD_ONCE_INIT;
+
+/* the event loop thread that loaded the config, only it loads spans */
+static pthread_t lazy_owner;
+
+/* set while a span is applied, loading is no change */
+int dm_lazy_loading;
+
+/* marked for the next save */
+static dm_selector *lazy_sels;
+static int lazy_cnt;
+
+static void lazy_lock_init(void)
+{
+	pthread_mutexattr_t attr;
+
+	pthread_mutexattr_init(&attr);
+	pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+	pthread_mutex_init(&lazy_lock, &attr);
+	pthread_mutexattr_destroy(&attr);
+}
+
+static pthread_mutex_t *lazy_mutex(void)
+{
+	pthread_once(&lazy_once, lazy_lock_init);
+	return &lazy_lock;
+}
+
+void dm_binconfig_set_lazy(const char *const paths[])
+{
+	int cnt = 0;
+
+	free(lazy_sels);
+	lazy_sels = NULL;
+	lazy_cnt = 0;
+
+	for (; paths && paths[cnt]; cnt++)
+		;
+	if (!cnt || !(lazy_sels = calloc(cnt, sizeof(dm_selector))))
+		return;
+
+	for (int i = 0; i < cnt; i++) {
+		dm_selector sel;
+
+		if (!dm_name2sel(paths[i], &sel) || !sel[0]) {
+			debug("(): unknown lazy path %s", paths[i]);
+			continue;
+		}
+		dm_selcpy(lazy_sels[lazy_cnt++], sel);
+	}
+}
+
+/* called with the lazy lock held */
+static struct lazy_span *lazy_find(const dm_id *sel, int len)
+{
+	struct lazy_span *s;
+
+	LIST_FOREACH(s, &lazy_spans, next)
+		if (s->len == len && dm_selcmp(s->sel, sel, len) == 0)
+			return s;
+
+	return NULL;
+}
+
+/* called with the lazy lock held, a span at sel or below it */
+static struct lazy_span *lazy_find_below(const dm_id *sel, int len)
+{
+	struct lazy_span *s;
+
+	LIST_FOREACH(s, &lazy_spans, next)
+		if (s->len >= len && dm_selcmp(s->sel, sel, len) == 0)
+			return s;
+
+	return NULL;
+}
+
+static void lazy_unref(struct lazy_map *map)
+{
+	if (--map->refs == 0) {
+		munmap(map->addr, map->size);
+		free(map);
+	}
+}
+
+/* called with the lazy lock held */
+static void lazy_remove(struct lazy_span *s)
+{
+	LIST_REMOVE(s, next);
+	lazy_unref(s->map);
+	free(s);
+}
+
+/*
+ * writer
+ */
+
+struct bin_writer {
+	FILE *stream;
+	int flags;
+
+	int depth;
+	dm_selector sel;		/* walk position */
+
+	int last_len;
+	dm_selector last;		/* selector of the previous record */
+
+	FILE *blobs;			/* blob section of a base image */
+
+	int lazy;			/* write marked subtrees as spans */
+	int span_depth;			/* walk depth of the open span, 0 when there is none */
+	FILE *outer;			/* stream the span is written to once it is closed */
+	char *span;
+	size_t span_size;
+	uint8_t span_hdr[3 + DM_SELECTOR_LEN * 2];
+	size_t span_hdr_len;
+	int failed;
+};
+
+static uint8_t *bin_put_record(struct bin_writer *w, uint8_t *p, int type, const dm_id *sel, int len)
+{
+	int prefix = 0;
+
+	while (prefix < len && prefix < w->last_len && sel[prefix] == w->last[prefix])
+		prefix++;
+
+	*p++ = type;
+	*p++ = prefix;
+	*p++ = len - prefix;
+	for (int i = prefix; i < len; i++)
+		p = put_le(p, sel[i], 2);
+
+	memcpy(w->last, sel, len * sizeof(dm_id));
+	w->last_len = len;
+
+	return p;
+}
+
+/* append data to the blob section, ref gets its offset */
+static size_t bin_put_blob(struct bin_writer *w, uint8_t *ref, const void *data, size_t size)
+{
+	long off = ftell(w->blobs);
+
+	/* binary_t is used in place */
+	for (; off % 8 != 0; off++)
+		fputc(0, w->blobs);
+	fwrite(data, size, 1, w->blobs);
+
+	put_le(ref, off, 8);
+	return 8;
+}
+
+static void bin_record(struct bin_writer *w, int type)
+{
+	uint8_t buf[3 + DM_SELECTOR_LEN * 2];
+	uint8_t *p;
+
+	p = bin_put_record(w, buf, type, w->sel, w->depth);
+	fwrite(buf, p - buf, 1, w->stream);
+}
+
+static void bin_value(struct bin_writer *w, const struct dm_element *elem, const DM_VALUE value)
+{
+	uint8_t buf[3 + DM_SELECTOR_LEN * 2 + 1 + 10];
+	uint8_t fixed[DM_SELECTOR_LEN * 2];
+	const void *data = fixed;
+	size_t size = 0;
+	uint8_t *p;
+
+	switch (elem->type) {
+	case T_BOOL:
+		fixed[0] = !!DM_BOOL(value);
+		size = 1;
+		break;
+
+	case T_ENUM:
+		put_le(fixed, DM_ENUM(value), size = 4);
+		break;
+
+	case T_INT:
+		put_le(fixed, DM_INT(value), size = 4);
+		break;
+
+	case T_UINT:
+		put_le(fixed, DM_UINT(value), size = 4);
+		break;
+
+	case T_INT64:
+		put_le(fixed, DM_INT64(value), size = 8);
+		break;
+
+	case T_UINT64:
+		put_le(fixed, DM_UINT64(value), size = 8);
+		break;
+
+	case T_TICKS:
+		put_le(fixed, DM_TICKS(value), size = 8);
+		break;
+
+	case T_DATE:
+		put_le(fixed, (int64_t)DM_TIME(value), size = 8);
+		break;
+
+	case T_STR:
+		if (DM_STRING(value) && w->blobs)
+			size = bin_put_blob(w, fixed, DM_STRING(value), strlen(DM_STRING(value)) + 1);
+		else if (DM_STRING(value)) {
+			data = DM_STRING(value);
+			size = strlen(DM_STRING(value));
+		}
+		break;
+
+	case T_BINARY:
+	case T_BASE64:
+		if (DM_BINARY(value) && w->blobs)
+			size = bin_put_blob(w, fixed, DM_BINARY(value), sizeof(binary_t) + DM_BINARY(value)->len);
+		else if (DM_BINARY(value)) {
+			data = DM_BINARY(value)->data;
+			size = DM_BINARY(value)->len;
+		}
+		break;
+
+	case T_SELECTOR:
+		if (DM_SELECTOR(value))
+			for (int i = 0; i < DM_SELECTOR_LEN && (*DM_SELECTOR(value))[i]; i++, size += 2)
+				put_le(fixed + size, (*DM_SELECTOR(value))[i], 2);
+		break;
+
+	case T_IPADDR4:
+		memcpy(fixed, DM_IP4_REF(value), size = sizeof(struct in_addr));
+		break;
+
+	case T_IPADDR6:
+		memcpy(fixed, DM_IP6_REF(value), size = sizeof(struct in6_addr));
+		break;
+
+	case T_COUNTER:
+		/* don't serialize counters, only their notify attribute */
+		if (!(value.notify & 0x0003))
+			return;
+		break;
+
+	default:
+		/* the base image takes internal elements as well, runtime only types are skipped */
+		if (!w->blobs)
+			fprintf(stderr, "unexpected element type: %s: %d (%p)\n", elem->key, elem->type, elem);
+		return;
+	}
+
+	p = bin_put_record(w, buf, REC_VALUE, w->sel, w->depth + 1);
+	*p++ = value.notify & 0x0003;
+	for (size_t v = size; ; v >>= 7) {
+		*p++ = (v & 0x7f) | (v > 0x7f ? 0x80 : 0);
+		if (v <= 0x7f)
+			break;
+	}
+
+	fwrite(buf, p - buf, 1, w->stream);
+	if (size)
+		fwrite(data, size, 1, w->stream);
+}
+
+enum {
+	SPAN_NONE,
+	SPAN_OPEN,
+	SPAN_COPIED,
+};
+
+/* the walk position is marked lazy */
+static int bin_lazy_marked(const struct bin_writer *w)
+{
+	for (int i = 0; i < lazy_cnt; i++)
+		if (dm_sellen(lazy_sels[i]) == (size_t)w->depth &&
+		    dm_selcmp(lazy_sels[i], w->sel, w->depth) == 0)
+			return 1;
+
+	return 0;
+}
+
+/* write the span of a container that was not loaded yet as it is */
+static int bin_span_copy(struct bin_writer *w)
+{
+	struct lazy_span *s;
+	uint8_t buf[3 + DM_SELECTOR_LEN * 2 + 8];
+	uint8_t *p;
+
+	pthread_mutex_lock(lazy_mutex());
+
+	if ((s = lazy_find(w->sel, w->depth))) {
+		p = bin_put_record(w, buf, REC_LAZY, w->sel, w->depth);
+		p = put_le(p, s->size, 4);
+		p = put_le(p, s->hash, 4);
+		fwrite(buf, p - buf, 1, w->stream);
+		fwrite(s->data, s->size, 1, w->stream);
+	}
+
+	pthread_mutex_unlock(&lazy_lock);
+
+	return s != NULL;
+}
+
+/* called with the table or object on the walk position, the records below it go to a span */
+static int bin_span_start(struct bin_writer *w, const DM_VALUE value)
+{
+	FILE *stream;
+
+	if (!w->lazy || w->span_depth)
+		return SPAN_NONE;
+
+	if (value.flags & DV_LAZY)
+		/* without its span the walk loads it and writes the records */
+		return bin_span_copy(w) ? SPAN_COPIED : SPAN_NONE;
+
+	if (!bin_lazy_marked(w) || !(stream = open_memstream(&w->span, &w->span_size)))
+		return SPAN_NONE;
+
+	w->span_hdr_len = bin_put_record(w, w->span_hdr, REC_LAZY, w->sel, w->depth) - w->span_hdr;
+	w->outer = w->stream;
+	w->stream = stream;
+	w->span_depth = w->depth;
+
+	return SPAN_OPEN;
+}
+
+static void bin_span_end(struct bin_writer *w)
+{
+	uint8_t buf[8];
+
+	if (!w->span_depth || w->depth != w->span_depth)
+		return;
+
+	if (fclose(w->stream) != 0)
+		w->failed = 1;
+	else {
+		put_le(buf, w->span_size, 4);
+		put_le(buf + 4, fnv1a32(w->span, w->span_size), 4);
+		fwrite(w->span_hdr, w->span_hdr_len, 1, w->outer);
+		fwrite(buf, sizeof(buf), 1, w->outer);
+		fwrite(w->span, w->span_size, 1, w->outer);
+	}
+	free(w->span);
+
+	w->span = NULL;
+	w->stream = w->outer;
+	w->outer = NULL;
+	w->span_depth = 0;
+
+	/* the record after the span is prefixed against its root, like the loader sees it */
+	memcpy(w->last, w->sel, w->depth * sizeof(dm_id));
+	w->last_len = w->depth;
+}
+
+static int binconfig_walk_cb(void *userData, CB_type type, dm_id id,
+			     const struct dm_element *elem, const DM_VALUE value)
+{
+	struct bin_writer *w = (struct bin_writer *)userData;
+	int sys = (w->flags & S_SYS) != 0;
+
+	if ((elem->flags & F_INTERNAL) != 0 && !w->blobs)
+		return 0;
+
+	if ((value.flags & (DV_UPDATED | DV_NOTIFY)) == 0 && !sys)
+		return 0;
+
+	switch (type) {
+	case CB_table_start:
+		if ((elem->flags & F_SYSTEM) != 0 && !sys)
+			return 0;
+
+		w->sel[w->depth++] = id;
+		switch (bin_span_start(w, value)) {
+		case SPAN_NONE:
+			bin_record(w, REC_TABLE);
+			break;
+
+		case SPAN_COPIED:
+			w->depth--;
+			return 0;
+		}
+		break;
+
+	case CB_object_start:
+		w->sel[w->depth++] = id;
+		if (bin_span_start(w, value) == SPAN_COPIED) {
+			w->depth--;
+			return 0;
+		}
+		break;
+
+	case CB_object_instance_start:
+		if (((id & DM_ID_AUTO_OBJECT) == DM_ID_AUTO_OBJECT ||
+		     (elem->flags & F_SYSTEM) != 0) && !sys)
+			return 0;
+
+		w->sel[w->depth++] = id;
+		bin_record(w, REC_INSTANCE);
+		break;
+
+	case CB_object_instance_end:
+		bin_record(w, REC_INSTANCE_END);
+		/* FALL THROUGH */
+
+	case CB_table_end:
+	case CB_object_end:
+		bin_span_end(w);
+		w->depth--;
+		break;
+
+	case CB_element:
+		if (((elem->flags & F_WRITE) != 0 &&
+		     (elem->flags & F_SYSTEM) == 0) || sys) {
+			w->sel[w->depth] = id;
+			bin_value(w, elem, value);
+		}
+		break;
+	}
+
+	return 1;
+}
+
+int dm_binconfig_save(FILE *stream, int flags)
+{
+	struct bin_writer w;
+	uint64_t generation;
+
+	memset(&w, 0, sizeof(w));
+	w.stream = stream;
+	w.flags = flags;
+	w.lazy = 1;
+
+	/* a save in a forked child uses the generation its parent picked */
+	if (binconfig_saved_generation <= binconfig_generation)
+		binconfig_saved_generation = binconfig_next_generation();
+	generation = binconfig_saved_generation;
+
+	dm_update_flags();
+
+	bin_put_header(stream, BIN_MAGIC, generation);
+
+	dm_walk_table_cb(DM_SELECTOR_LEN, &w, binconfig_walk_cb, &dm_root, dm_value_store);
+
+	fputc(REC_END, stream);
+
+	return fflush(stream) != 0 || ferror(stream) || w.failed;
+}
+
+/*
+ * loader
+ *
+ * The file is read into memory and parsed twice, the first pass only checks
+ * the records against the keyword tree so that a damaged file is rejected
+ * before the store is touched.
+ */
+
+struct bin_reader {
+	const uint8_t *p;
+	const uint8_t *end;
+
+	int flags;
+	int apply;
+	int batch;			/* journal batch, ends without REC_END */
+
+	int len;
+	dm_selector sel;
+
+	char *scratch;
+	size_t scratch_size;
+
+	const uint8_t *blobs;		/* blob section of a base image */
+	size_t blobs_size;
+
+	int span;			/* records of a span, end without REC_END */
+	struct lazy_map *map;		/* register spans instead of loading them */
+};
+
+static int bin_get_selector(struct bin_reader *r)
+{
+	int prefix, cnt;
+
+	if (r->end - r->p < 2)
+		return -1;
+
+	prefix = *r->p++;
+	cnt = *r->p++;
+	if (prefix > r->len || prefix + cnt == 0 || prefix + cnt > DM_SELECTOR_LEN ||
+	    r->end - r->p < cnt * 2)
+		return -1;
+
+	for (int i = prefix; i < prefix + cnt; i++, r->p += 2)
+		if (!(r->sel[i] = get_le(r->p, 2)))
+			return -1;
+
+	r->len = prefix + cnt;
+	if (r->len < DM_SELECTOR_LEN)
+		r->sel[r->len] = 0;
+
+	return 0;
+}
+
+/*
+ * walk the selector of the current record through the keyword tree and,
+ * with create set, through the store, adding missing tables and instances
+ *
+ * returns REC_TABLE, REC_OBJECT, REC_INSTANCE or REC_VALUE for the kind of
+ * the last step and -1 when the selector does not match the schema
+ */
+static int bin_resolve(struct bin_reader *r, int create, const struct dm_element **elem,
+		       DM_VALUE **value, struct dm_instance_node **node)
+{
+	const struct dm_table *kw = &dm_root;
+	struct dm_value_table *st = dm_value_store;
+	int kind = -1;
+
+	for (int i = 0; i < r->len; i++) {
+		dm_id id = r->sel[i];
+		DM_VALUE *val = NULL;
+
+		if (!kw || id > kw->size)
+			return -1;
+
+		*elem = &kw->table[id - 1];
+		if (create) {
+			/* a journal record below a subtree that is still on disk */
+			if ((*elem)->type == T_TOKEN || (*elem)->type == T_OBJECT)
+				dm_lazy_load(st, id);
+			val = dm_get_value_ref_by_id(st, id);
+		}
+
+		switch ((*elem)->type) {
+		case T_TOKEN:
+			kind = REC_TABLE;
+			kw = (*elem)->u.t.table;
+
+			if (!create)
+				break;
+
+			if (!DM_TABLE(*val)) {
+				set_DM_TABLE(*val, dm_alloc_table(kw, st, st->id, id));
+				if (r->flags & DS_USERCONFIG)
+					val->flags |= DV_UPDATED;
+				DM_parity_update(*val);
+			}
+			st = DM_TABLE(*val);
+			break;
+
+		case T_OBJECT:
+			/* the object itself, only deletes address it */
+			if (++i == r->len) {
+				kind = REC_OBJECT;
+				kw = NULL;
+				break;
+			}
+
+			kind = REC_INSTANCE;
+			kw = (*elem)->u.t.table;
+
+			if (!create)
+				break;
+
+			if (!(*node = dm_get_instance_node_by_id(DM_INSTANCE(*val), r->sel[i]))) {
+				dm_selector basesel;
+
+				dm_selcpy(basesel, st->id);
+				dm_selcat(basesel, id);
+
+				*node = dm_add_instance(*elem, DM_INSTANCE(*val), basesel, r->sel[i]);
+				if (!*node)
+					return -1;
+
+				if (r->flags & DS_USERCONFIG) {
+					val->flags |= DV_UPDATED;
+					DM_parity_update(*val);
+					(*node)->table.flags |= DV_UPDATED;
+					DM_parity_update((*node)->table);
+				}
+			}
+			val = &(*node)->table;
+			st = DM_TABLE(*val);
+			break;
+
+		default:
+			if (i != r->len - 1)
+				return -1;
+			kind = REC_VALUE;
+			kw = NULL;
+			break;
+		}
+
+		if (create && !st)
+			return -1;
+		*value = val;
+	}
+
+	return kind;
+}
+
+static const char *bin_string(struct bin_reader *r, const uint8_t *data, size_t size)
+{
+	if (size + 1 > r->scratch_size) {
+		char *s;
+
+		if (!(s = realloc(r->scratch, size + 1)))
+			return NULL;
+		r->scratch = s;
+		r->scratch_size = size + 1;
+	}
+
+	memcpy(r->scratch, data, size);
+	r->scratch[size] = '\0';
+
+	return r->scratch;
+}
+
+/* string or binary_t at offset off of the blob section, NULL when it is out of bounds */
+static const void *bin_blob(struct bin_reader *r, int type, uint64_t off)
+{
+	const binary_t *b;
+
+	if (off >= r->blobs_size)
+		return NULL;
+
+	if (type == T_STR)
+		return memchr(r->blobs + off, '\0', r->blobs_size - off) ? r->blobs + off : NULL;
+
+	if (off % 8 != 0 || r->blobs_size - off < sizeof(binary_t))
+		return NULL;
+
+	b = (const binary_t *)(r->blobs + off);
+	return b->len <= r->blobs_size - off - sizeof(binary_t) ? b : NULL;
+}
+
+static int bin_get_value(struct bin_reader *r, const struct dm_element *elem, DM_VALUE *value)
+{
+	const uint8_t *data;
+	uint64_t size = 0;
+	int notify;
+	DM_RESULT res = DM_OK;
+
+	if (r->p == r->end)
+		return -1;
+	notify = *r->p++;
+	if (notify > ACTIVE_NOTIFY)
+		return -1;
+
+	for (int shift = 0; ; shift += 7) {
+		if (r->p == r->end || shift > 28)
+			return -1;
+		size |= (uint64_t)(*r->p & 0x7f) << shift;
+		if (!(*r->p++ & 0x80))
+			break;
+	}
+
+	if ((uint64_t)(r->end - r->p) < size)
+		return -1;
+	data = r->p;
+	r->p += size;
+
+	switch (elem->type) {
+	case T_BOOL:
+		if (size != 1)
+			return -1;
+		break;
+
+	case T_ENUM:
+	case T_INT:
+	case T_UINT:
+		if (size != 4)
+			return -1;
+		break;
+
+	case T_INT64:
+	case T_UINT64:
+	case T_TICKS:
+	case T_DATE:
+		if (size != 8)
+			return -1;
+		break;
+
+	case T_SELECTOR:
+		if (size % 2 != 0 || size > DM_SELECTOR_LEN * 2)
+			return -1;
+		break;
+
+	case T_IPADDR4:
+		if (size != sizeof(struct in_addr))
+			return -1;
+		break;
+
+	case T_IPADDR6:
+		if (size != sizeof(struct in6_addr))
+			return -1;
+		break;
+
+	case T_COUNTER:
+		if (size != 0)
+			return -1;
+		break;
+
+	case T_STR:
+	case T_BINARY:
+	case T_BASE64:
+		if (r->blobs && size != 0 && (size != 8 || !bin_blob(r, elem->type, get_le(data, 8))))
+			return -1;
+		break;
+
+	default:
+		return -1;
+	}
+
+	if (!r->apply)
+		return 0;
+
+	switch (elem->type) {
+	case T_BOOL:
+		set_DM_BOOL(*value, data[0] != 0);
+		break;
+
+	case T_ENUM:
+		set_DM_ENUM(*value, (int32_t)get_le(data, 4));
+		break;
+
+	case T_INT:
+		set_DM_INT(*value, (int32_t)get_le(data, 4));
+		break;
+
+	case T_UINT:
+		set_DM_UINT(*value, (uint32_t)get_le(data, 4));
+		break;
+
+	case T_INT64:
+		set_DM_INT64(*value, (int64_t)get_le(data, 8));
+		break;
+
+	case T_UINT64:
+		set_DM_UINT64(*value, get_le(data, 8));
+		break;
+
+	case T_TICKS:
+		set_DM_TICKS(*value, (ticks_t)get_le(data, 8));
+		break;
+
+	case T_DATE:
+		set_DM_TIME(*value, (time_t)(int64_t)get_le(data, 8));
+		break;
+
+	case T_STR: {
+		const char *s;
+
+		if (r->blobs) {
+			/* points into the mapping until it is overwritten */
+			dm_free_string_value(value);
+			if (size) {
+				set_DM_STRING(*value, (char *)bin_blob(r, T_STR, get_le(data, 8)));
+			}
+		} else if ((s = bin_string(r, data, size)))
+			res = dm_set_string_value(value, s);
+		else
+			res = DM_OOM;
+		break;
+	}
+
+	case T_BINARY:
+	case T_BASE64:
+		if (r->blobs) {
+			dm_free_binary_value(value);
+			if (size) {
+				set_DM_BINARY(*value, (binary_t *)bin_blob(r, elem->type, get_le(data, 8)));
+			}
+		} else
+			res = dm_set_binary_data(value, size, data);
+		break;
+
+	case T_SELECTOR: {
+		dm_selector sel;
+
+		memset(&sel, 0, sizeof(dm_selector));
+		for (unsigned int i = 0; i < size / 2; i++)
+			sel[i] = get_le(data + i * 2, 2);
+		res = dm_set_selector_value(value, sel);
+		break;
+	}
+
+	case T_IPADDR4: {
+		struct in_addr addr;
+
+		memcpy(&addr, data, sizeof(addr));
+		set_DM_IP4(*value, addr);
+		break;
+	}
+
+	case T_IPADDR6: {
+		struct in6_addr addr;
+
+		memcpy(&addr, data, sizeof(addr));
+		set_DM_IP6(*value, addr);
+		break;
+	}
+	}
+
+	if (res != DM_OK)
+		debug("(): failed to restore %s, %d (DM_RESULT)", elem->key, res);
+	else if (elem->type != T_COUNTER && (r->flags & DS_USERCONFIG))
+		value->flags |= DV_UPDATED;
+	DM_parity_update(*value);
+
+	if (notify)
+		set_notify_single_slot_element(elem, value, 0, notify);
+
+	return 0;
+}
+
+static int bin_parse(struct bin_reader *r, const uint8_t *start, const uint8_t *end);
+
+/* the records of a span, prefixed against the current selector */
+static int bin_span(struct bin_reader *r, const uint8_t *data, size_t size)
+{
+	const uint8_t *end = r->end;
+	dm_selector sel;
+	int len = r->len;
+	int rc;
+
+	memcpy(sel, r->sel, sizeof(dm_selector));
+
+	r->span = 1;
+	rc = bin_parse(r, data, data + size);
+	r->span = 0;
+
+	memcpy(r->sel, sel, sizeof(dm_selector));
+	r->len = len;
+	r->p = data + size;
+	r->end = end;
+
+	return rc;
+}
+
+/* register the span of a REC_LAZY record, value is its table or object */
+static int bin_lazy_add(struct bin_reader *r, DM_VALUE *value, const uint8_t *data, uint32_t size, uint32_t hash)
+{
+	struct lazy_span *s;
+
+	if (!(s = calloc(1, sizeof(struct lazy_span))))
+		return -1;
+
+	memcpy(s->sel, r->sel, sizeof(dm_selector));
+	s->len = r->len;
+	s->flags = r->flags;
+	s->map = r->map;
+	s->data = data;
+	s->size = size;
+	s->hash = hash;
+
+	pthread_mutex_lock(lazy_mutex());
+	r->map->refs++;
+	LIST_INSERT_HEAD(&lazy_spans, s, next);
+	pthread_mutex_unlock(&lazy_lock);
+
+	/* the span was written because something below it was */
+	value->flags |= DV_LAZY;
+	if (r->flags & DS_USERCONFIG)
+		value->flags |= DV_UPDATED;
+	DM_parity_update(*value);
+
+	return 0;
+}
+
+static int bin_lazy(struct bin_reader *r, DM_VALUE *value)
+{
+	const uint8_t *data;
+	uint32_t size, hash;
+
+	/* spans do not nest */
+	if (r->span || r->end - r->p < 8)
+		return -1;
+
+	size = get_le(r->p, 4);
+	hash = get_le(r->p + 4, 4);
+	r->p += 8;
+	if ((size_t)(r->end - r->p) < size)
+		return -1;
+	data = r->p;
+	r->p += size;
+
+	/* the span is checked when it is loaded, boot does not touch it */
+	if (r->map && (!r->apply || bin_lazy_add(r, value, data, size, hash) == 0))
+		return 0;
+
+	if (fnv1a32(data, size) != hash)
+		return -1;
+
+	return bin_span(r, data, size);
+}
+
+static int bin_records(struct bin_reader *r, const uint8_t *start, const uint8_t *end)
+{
+	r->len = 0;
+	return bin_parse(r, start, end);
+}
+
+static int bin_parse(struct bin_reader *r, const uint8_t *start, const uint8_t *end)
+{
+	r->p = start;
+	r->end = end;
+
+	while (r->p < r->end) {
+		const struct dm_element *elem = NULL;
+		DM_VALUE *value = NULL;
+		struct dm_instance_node *node = NULL;
+		int type = *r->p++;
+		int kind;
+
+		if (type == REC_END)
+			return !r->batch && !r->span && r->p == r->end ? 0 : -1;
+
+		if (bin_get_selector(r) < 0)
+			return -1;
+
+		kind = bin_resolve(r, r->apply && type != REC_DELETE, &elem, &value, &node);
+
+		switch (type) {
+		case REC_TABLE:
+		case REC_INSTANCE:
+			if (kind != type)
+				return -1;
+			break;
+
+		case REC_INSTANCE_END:
+			if (kind != REC_INSTANCE)
+				return -1;
+			if (r->apply)
+				update_instance_node_index(node);
+			break;
+
+		case REC_VALUE:
+			if (kind != REC_VALUE || bin_get_value(r, elem, value) < 0)
+				return -1;
+			/* a full config updates the index at the end of the instance, the journal here */
+			if (r->apply && r->batch && node && (elem->flags & F_INDEX))
+				update_instance_node_index(node);
+			break;
+
+		case REC_DELETE:
+			if (kind < 0)
+				return -1;
+			if (r->apply)
+				dm_drop_table_by_selector(r->sel);
+			break;
+
+		case REC_LAZY:
+			if ((kind != REC_TABLE && kind != REC_OBJECT) || bin_lazy(r, value) < 0)
+				return -1;
+			break;
+
+		default:
+			return -1;
+		}
+	}
+
+	/* a full config without REC_END is truncated */
+	return r->batch || r->span ? 0 : -1;
+}
+
+static uint8_t *bin_slurp(FILE *stream, size_t *len)
+{
+	uint8_t *buf = NULL;
+	size_t size = 0;
+
+	*len = 0;
+	do {
+		if (*len == size) {
+			uint8_t *n;
+
+			size = size ? size * 2 : 64 * 1024;
+			if (!(n = realloc(buf, size))) {
+				free(buf);
+				return NULL;
+			}
+			buf = n;
+		}
+		*len += fread(buf + *len, 1, size - *len, stream);
+	} while (!feof(stream) && !ferror(stream));
+
+	if (ferror(stream)) {
+		free(buf);
+		return NULL;
+	}
+	return buf;
+}
+
+/* spans are loaded right away without map, else they are registered and loaded on first access */
+static int bin_load(const uint8_t *buf, size_t len, int flags, struct lazy_map *map)
+{
+	struct bin_reader r;
+	uint64_t generation;
+	int rc = 1;
+
+	memset(&r, 0, sizeof(r));
+	r.flags = flags;
+	r.map = map;
+
+	if (!(generation = bin_check_header(buf, len, BIN_MAGIC)))
+		goto out;
+
+	if (bin_records(&r, buf + BIN_HEADER_SIZE, buf + len) < 0) {
+		debug("(): binary config is damaged");
+		goto out;
+	}
+
+	if (!dm_value_store)
+		dm_value_store = dm_alloc_table(&dm_root, NULL, (dm_selector){ 0, }, 0);
+	dm_set_cfg_version(CFG_VERSION);
+
+	/* only fails when out of memory, the store is partly loaded then */
+	r.apply = 1;
+	rc = bin_records(&r, buf + BIN_HEADER_SIZE, buf + len) < 0 ? -1 : 0;
+	if (!rc)
+		binconfig_generation = generation;
+
+out:
+	free(r.scratch);
+
+	return rc;
+}
+
+int dm_binconfig_load(FILE *stream, int flags)
+{
+	uint8_t *buf;
+	size_t len;
+	int rc;
+
+	if (!(buf = bin_slurp(stream, &len)))
+		return 1;
+
+	rc = bin_load(buf, len, flags, NULL);
+	free(buf);
+
+	return rc;
+}
+
+int dm_binconfig_load_file(const char *fname, int flags)
+{
+	struct lazy_map *map;
+	struct stat st;
+	int fd;
+	int rc;
+
+	debug("load %s", fname);
+
+	lazy_owner = pthread_self();
+
+	if ((fd = open(fname, O_RDONLY)) < 0)
+		return 1;
+
+	if (fstat(fd, &st) < 0 || st.st_size == 0 || !(map = calloc(1, sizeof(struct lazy_map)))) {
+		close(fd);
+		return 1;
+	}
+
+	/* saves rename a new file into place, the mapping stays valid */
+	map->size = st.st_size;
+	map->addr = mmap(NULL, map->size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map->addr == MAP_FAILED) {
+		free(map);
+		return 1;
+	}
+
+	map->refs = 1;
+	rc = bin_load(map->addr, map->size, flags, map);
+
+	pthread_mutex_lock(lazy_mutex());
+	if (rc) {
+		/* the caller loads the XML config instead */
+		struct lazy_span *s, *n;
+
+		for (s = LIST_FIRST(&lazy_spans); s; s = n) {
+			n = LIST_NEXT(s, next);
+			if (s->map == map)
+				lazy_remove(s);
+		}
+	}
+	lazy_unref(map);
+	pthread_mutex_unlock(&lazy_lock);
+
+	return rc;
+}
+
+/*
+ * journal
+ *
+ * Changes recorded between dm_journal_begin() and dm_journal_end() are
+ * collected in memory and appended to the journal file on save, so a save
+ * costs O(changes). The journal file starts with the header of the binary
+ * config it belongs to, followed by batches of records:
+ *
+ *   uint32 length, uint32 FNV-1a hash of the records, records
+ *
+ * Each batch starts with an empty selector prefix. A batch cut short by a
+ * crash fails the hash and is dropped on replay together with the rest of
+ * the file.
+ *
+ * Config changes outside of the brackets bump the config version without
+ * being recorded, the journal is stale then and the next save has to write
+ * the full binary config. Changes to status values and auto objects only
+ * bump the store version and leave the journal valid.
+ */
+
+static struct {
+	pthread_mutex_t lock;
+
+	int started;
+	int stale;
+	int depth;
+	uint64_t version;		/* config version after the last recorded change */
+
+	struct bin_writer w;
+	char *buf;
+	size_t size;
+} journal = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+};
+
+/* called with the journal lock held */
+static void journal_discard(void)
+{
+	if (journal.w.stream)
+		fclose(journal.w.stream);
+	free(journal.buf);
+
+	journal.w.stream = NULL;
+	journal.buf = NULL;
+	journal.size = 0;
+}
+
+/* called with the journal lock held */
+static FILE *journal_stream(const dm_selector sel)
+{
+	if (!journal.w.stream) {
+		journal.w.stream = open_memstream(&journal.buf, &journal.size);
+		journal.w.last_len = 0;
+	}
+
+	for (journal.w.depth = 0; journal.w.depth < DM_SELECTOR_LEN && sel[journal.w.depth]; journal.w.depth++)
+		journal.w.sel[journal.w.depth] = sel[journal.w.depth];
+
+	return journal.w.stream;
+}
+
+void dm_journal_begin(void)
+{
+	if (!journal.started)
+		return;
+
+	pthread_mutex_lock(&journal.lock);
+	if (journal.depth++ == 0 && dm_config_current() != journal.version)
+		journal.stale = 1;
+	pthread_mutex_unlock(&journal.lock);
+}
+
+void dm_journal_end(void)
+{
+	if (!journal.started)
+		return;
+
+	pthread_mutex_lock(&journal.lock);
+	if (--journal.depth == 0)
+		journal.version = dm_config_current();
+	pthread_mutex_unlock(&journal.lock);
+}
+
+void dm_journal_value(const dm_selector sel, const struct dm_element *elem, const DM_VALUE value)
+{
+	if (!journal.started)
+		return;
+
+	pthread_mutex_lock(&journal.lock);
+
+	if (!journal.stale && dm_config_selector(sel)) {
+		/* a setter may keep the value elsewhere */
+		if ((elem->flags & (F_SET | F_GET)) || !journal_stream(sel))
+			journal.stale = 1;
+		else {
+			journal.w.depth--;
+			bin_value(&journal.w, elem, value);
+		}
+	}
+
+	pthread_mutex_unlock(&journal.lock);
+}
+
+void dm_journal_instance(const dm_selector sel)
+{
+	if (!journal.started)
+		return;
+
+	pthread_mutex_lock(&journal.lock);
+
+	if (!journal.stale && dm_config_selector(sel)) {
+		if (!journal_stream(sel))
+			journal.stale = 1;
+		else {
+			bin_record(&journal.w, REC_INSTANCE);
+			bin_record(&journal.w, REC_INSTANCE_END);
+		}
+	}
+
+	pthread_mutex_unlock(&journal.lock);
+}
+
+void dm_journal_delete(const dm_selector sel)
+{
+	if (!journal.started)
+		return;
+
+	pthread_mutex_lock(&journal.lock);
+
+	if (!journal.stale && dm_config_selector(sel)) {
+		if (!journal_stream(sel))
+			journal.stale = 1;
+		else
+			bin_record(&journal.w, REC_DELETE);
+	}
+
+	pthread_mutex_unlock(&journal.lock);
+}
+
+void dm_journal_start(int valid)
+{
+	pthread_mutex_lock(&journal.lock);
+
+	journal_discard();
+	journal.stale = !valid || !binconfig_generation;
+	journal.version = dm_config_current();
+	journal.started = 1;
+
+	pthread_mutex_unlock(&journal.lock);
+}
+
+void dm_journal_reset(void)
+{
+	pthread_mutex_lock(&journal.lock);
+
+	journal_discard();
+	binconfig_generation = binconfig_saved_generation;
+	journal.stale = 0;
+	journal.version = dm_config_current();
+
+	pthread_mutex_unlock(&journal.lock);
+}
+
+/*
+ * a save in a forked child takes the recorded changes along, the parent
+ * starts a new batch on top of them and learns from dm_journal_fork_done()
+ * whether the child appended them or wrote a full binary config
+ *
+ * only the forking thread exists in the child, every lock the save takes
+ * is held across the fork so that no other thread owns it at that moment,
+ * in the order snapshot readers and lazy loads take them
+ */
+void dm_journal_fork_prepare(void)
+{
+	dm_snapshot_lock();
+	pthread_mutex_lock(lazy_mutex());
+	pthread_mutex_lock(&journal.lock);
+
+	/* a full save in the child has to use the generation the parent expects */
+	binconfig_saved_generation = binconfig_next_generation();
+}
+
+void dm_journal_fork_parent(int forked)
+{
+	if (forked) {
+		journal_discard();
+		journal.stale = 0;
+		journal.version = dm_config_current();
+	}
+
+	pthread_mutex_unlock(&journal.lock);
+	pthread_mutex_unlock(&lazy_lock);
+	dm_snapshot_unlock();
+}
+
+void dm_journal_fork_child(void)
+{
+	pthread_mutex_unlock(&journal.lock);
+	pthread_mutex_unlock(&lazy_lock);
+	dm_snapshot_unlock();
+}
+
+void dm_journal_fork_done(int full, int ok)
+{
+	pthread_mutex_lock(&journal.lock);
+
+	if (!ok)
+		/* the changes that went with the child are lost, only a full save has them */
+		journal.stale = 1;
+	else if (full)
+		binconfig_generation = binconfig_saved_generation;
+
+	pthread_mutex_unlock(&journal.lock);
+}
+
+int dm_journal_flush(const char *fname, size_t limit)
+{
+	uint8_t hdr[BIN_HEADER_SIZE];
+	uint8_t batch[8];
+	struct stat st;
+	FILE *fout;
+	int fd;
+	int r = 1;
+
+	pthread_mutex_lock(&journal.lock);
+
+	if (!journal.started || journal.stale)
+		goto out;
+
+	if (!journal.w.stream) {
+		/* nothing changed */
+		r = 0;
+		goto out;
+	}
+
+	if (fflush(journal.w.stream) != 0)
+		goto out;
+
+	if ((fd = open(fname, O_RDWR | O_CREAT, 0644)) < 0)
+		goto out;
+
+	if (fstat(fd, &st) < 0) {
+		close(fd);
+		goto out;
+	}
+
+	/* a journal left over from another binary config (e.g. by a crash during a full save) starts over */
+	if (st.st_size < BIN_HEADER_SIZE ||
+	    pread(fd, hdr, sizeof(hdr), 0) != sizeof(hdr) ||
+	    bin_check_header(hdr, sizeof(hdr), JOURNAL_MAGIC) != binconfig_generation) {
+		if (ftruncate(fd, 0) < 0) {
+			close(fd);
+			goto out;
+		}
+		st.st_size = 0;
+	}
+
+	if (st.st_size + sizeof(batch) + journal.size > limit ||
+	    lseek(fd, 0, SEEK_END) < 0 ||
+	    !(fout = fdopen(fd, "a"))) {
+		close(fd);
+		goto out;
+	}
+
+	if (st.st_size == 0)
+		bin_put_header(fout, JOURNAL_MAGIC, binconfig_generation);
+
+	put_le(batch, journal.size, 4);
+	put_le(batch + 4, fnv1a32(journal.buf, journal.size), 4);
+	fwrite(batch, sizeof(batch), 1, fout);
+	fwrite(journal.buf, journal.size, 1, fout);
+
+	if (fflush(fout) == 0 && !ferror(fout) && fsync(fd) == 0) {
+		journal_discard();
+		r = 0;
+	}
+	fclose(fout);
+
+out:
+	pthread_mutex_unlock(&journal.lock);
+
+	return r;
+}
+
+int dm_journal_replay_file(const char *fname, int flags)
+{
+	struct bin_reader r;
+	uint8_t *buf;
+	size_t len, pos;
+	FILE *fin;
+	int rc = 0;
+
+	if (!(fin = fopen(fname, "r")))
+		/* no changes since the last full save */
+		return 0;
+
+	buf = bin_slurp(fin, &len);
+	fclose(fin);
+	if (!buf)
+		return 1;
+
+	if (!binconfig_generation ||
+	    bin_check_header(buf, len, JOURNAL_MAGIC) != binconfig_generation) {
+		debug("(): journal does not belong to the binary config");
+		free(buf);
+		return 1;
+	}
+
+	memset(&r, 0, sizeof(r));
+	r.flags = flags;
+	r.batch = 1;
+
+	for (pos = BIN_HEADER_SIZE; len - pos >= 8; ) {
+		size_t size = get_le(buf + pos, 4);
+		const uint8_t *rec = buf + pos + 8;
+
+		if (len - pos - 8 < size || get_le(buf + pos + 4, 4) != fnv1a32(rec, size))
+			break;
+
+		r.apply = 0;
+		if (bin_records(&r, rec, rec + size) < 0)
+			break;
+
+		r.apply = 1;
+		if (bin_records(&r, rec, rec + size) < 0) {
+			rc = 1;
+			break;
+		}
+
+		pos += 8 + size;
+	}
+
+	if (pos < len) {
+		debug("(): dropping %zd bytes at the end of the journal", len - pos);
+		if (truncate(fname, pos) < 0)
+			rc = 1;
+	}
+
+	free(r.scratch);
+	free(buf);
+
+	return rc;
+}
+
+/*
+ * load a lazy subtree
+ *
+ * called on first access to a container flagged DV_LAZY, see dm_lazy_load()
+ *
+ * Other threads only read the store, they do not load the container and
+ * get -1. The span is applied under the snapshot lock so readers never
+ * walk a half loaded instance tree.
+ */
+int __dm_lazy_load(struct dm_value_table *st, dm_id id)
+{
+	struct bin_reader r;
+	struct lazy_span *s;
+	const struct dm_element *elem = NULL;
+	DM_VALUE *value = NULL;
+	struct dm_instance_node *node = NULL;
+	uint64_t version;
+	int kind;
+
+	if (!pthread_equal(pthread_self(), lazy_owner)) {
+		debug("(): not loading %d outside of the event loop", id);
+		return -1;
+	}
+
+	dm_snapshot_lock();
+	pthread_mutex_lock(lazy_mutex());
+
+	memcpy(r.sel, st->id, sizeof(dm_selector));
+	r.len = dm_sellen(st->id);
+	if (r.len == DM_SELECTOR_LEN)
+		goto out;
+	r.sel[r.len++] = id;
+
+	if (!(s = lazy_find(r.sel, r.len))) {
+		/* the span was dropped with a failed load */
+		__atomic_fetch_and(&st->values[id - 1].flags, (uint16_t)~DV_LAZY, __ATOMIC_RELEASE);
+		DM_parity_update(st->values[id - 1]);
+		goto out;
+	}
+	if (s->loading)
+		goto out;
+	s->loading = 1;
+
+	debug("(): loading %u bytes below %d", s->size, id);
+
+	memset(&r, 0, sizeof(r));
+	r.flags = s->flags;
+	r.apply = 1;
+	memcpy(r.sel, s->sel, sizeof(dm_selector));
+	r.len = s->len;
+
+	/* the live container, st can be the copy a snapshot keeps */
+	version = dm_config_current();
+	kind = bin_resolve(&r, 1, &elem, &value, &node);
+
+	if (kind != REC_TABLE && kind != REC_OBJECT)
+		debug("(): lazy subtree is gone");
+	else {
+		if (fnv1a32(s->data, s->size) != s->hash)
+			debug("(): lazy subtree is damaged");
+		else {
+			r.apply = 0;
+			if (bin_span(&r, s->data, s->size) < 0)
+				debug("(): lazy subtree is damaged");
+			else {
+				r.apply = 1;
+				dm_lazy_loading++;
+				if (bin_span(&r, s->data, s->size) < 0)
+					debug("(): failed to load lazy subtree");
+				dm_lazy_loading--;
+			}
+		}
+
+		__atomic_fetch_and(&value->flags, (uint16_t)~DV_LAZY, __ATOMIC_RELEASE);
+		DM_parity_update(*value);
+	}
+
+	/* loading is no change, the journal stays valid */
+	pthread_mutex_lock(&journal.lock);
+	if (journal.version == version && !journal.depth)
+		journal.version = dm_config_current();
+	pthread_mutex_unlock(&journal.lock);
+
+	free(r.scratch);
+	lazy_remove(s);
+
+out:
+	pthread_mutex_unlock(&lazy_lock);
+	dm_snapshot_unlock();
+
+	return 1;
+}
+
+int dm_lazy_pending(void)
+{
+	int r;
+
+	pthread_mutex_lock(lazy_mutex());
+	r = !LIST_EMPTY(&lazy_spans);
+	pthread_mutex_unlock(&lazy_lock);
+
+	return r;
+}
+
+void dm_lazy_load_below(const dm_selector sel)
+{
+	struct dm_element_ref ref;
+	struct lazy_span *s;
+	int len = dm_sellen(sel);
+
+	if (!pthread_equal(pthread_self(), lazy_owner))
+		return;
+
+	dm_snapshot_lock();
+	pthread_mutex_lock(lazy_mutex());
+
+	/* entering sel loads the spans on the path to it */
+	if (len)
+		dm_get_element_ref(sel, &ref);
+
+	while ((s = lazy_find_below(sel, len))) {
+		dm_selector path;
+		int plen = s->len;
+
+		memset(path, 0, sizeof(dm_selector));
+		memcpy(path, s->sel, plen * sizeof(dm_id));
+
+		/* entering the container loads it */
+		dm_get_element_ref(path, &ref);
+
+		/* its path is gone, the flag is cleared on the next access */
+		if ((s = lazy_find(path, plen)))
+			lazy_remove(s);
+	}
+
+	pthread_mutex_unlock(&lazy_lock);
+	dm_snapshot_unlock();
+}
+
+void dm_lazy_forget(const struct dm_value_table *st, dm_id id)
+{
+	struct lazy_span *s;
+	dm_selector sel;
+	int len = dm_sellen(st->id);
+
+	if (len == DM_SELECTOR_LEN)
+		return;
+
+	memcpy(sel, st->id, sizeof(dm_selector));
+	sel[len++] = id;
+
+	pthread_mutex_lock(lazy_mutex());
+	while ((s = lazy_find_below(sel, len)))
+		lazy_remove(s);
+	pthread_mutex_unlock(&lazy_lock);
+}
+
+/*
+ * base image
+ *
+ * The base config is parsed from XML once and written as an image that
+ * the following boots map read-only. Strings and binaries in the store
+ * point into the mapping, dm_free_string_value() and friends leave them
+ * alone, so a value is only copied to the heap when it is overwritten
+ * and untouched values share the page cache with the image file.
+ */
+
+/* stamp of the files in the base config directories, changes when one is added, removed or replaced */
+uint64_t dm_base_image_stamp(const char *const dirs[])
+{
+	uint64_t h = 0xcbf29ce484222325ULL;
+
+	for (int d = 0; dirs[d]; d++) {
+		struct dirent **namelist;
+		int n;
+
+		h = fnv1a(h, dirs[d], strlen(dirs[d]) + 1);
+
+		if ((n = scandir(dirs[d], &namelist, 0, alphasort)) < 0)
+			continue;
+
+		for (int i = 0; i < n; i++) {
+			if (namelist[i]->d_name[0] != '.') {
+				char fname[MAXPATHLEN];
+				struct stat st;
+				uint8_t buf[24];
+
+				snprintf(fname, sizeof(fname), "%s/%s", dirs[d], namelist[i]->d_name);
+				if (stat(fname, &st) == 0) {
+					put_le(buf, st.st_size, 8);
+					put_le(buf + 8, st.st_mtime, 8);
+					put_le(buf + 16, st.st_ino, 8);
+					h = fnv1a(h, namelist[i]->d_name, strlen(namelist[i]->d_name) + 1);
+					h = fnv1a(h, buf, sizeof(buf));
+				}
+			}
+			free(namelist[i]);
+		}
+		free(namelist);
+	}
+
+	/* 0 is no valid generation */
+	return h ? h : 1;
+}
+
+int dm_base_image_save(const char *fname, uint64_t stamp)
+{
+	static const uint8_t pad[8];
+	struct bin_writer w;
+	uint8_t ext[IMAGE_HEADER_SIZE - BIN_HEADER_SIZE];
+	char *tmp;
+	char *blobs = NULL;
+	size_t blobs_size = 0;
+	long end;
+	int fd;
+	FILE *fout;
+	int rc = 1;
+
+	if (!dm_value_store)
+		return 1;
+
+	if (asprintf(&tmp, "%s.XXXXXX", fname) < 0)
+		return 1;
+
+	if ((fd = mkstemp(tmp)) < 0) {
+		free(tmp);
+		return 1;
+	}
+
+	if (!(fout = fdopen(fd, "w"))) {
+		close(fd);
+		goto out;
+	}
+
+	memset(&w, 0, sizeof(w));
+	w.stream = fout;
+	w.flags = S_SYS;
+	if (!(w.blobs = open_memstream(&blobs, &blobs_size))) {
+		fclose(fout);
+		goto out;
+	}
+
+	bin_put_header(fout, IMAGE_MAGIC, stamp);
+	memset(ext, 0, sizeof(ext));
+	fwrite(ext, sizeof(ext), 1, fout);
+
+	dm_walk_table_cb(DM_SELECTOR_LEN, &w, binconfig_walk_cb, &dm_root, dm_value_store);
+
+	fputc(REC_END, fout);
+	end = ftell(fout);
+
+	if (fclose(w.blobs) == 0 && end > 0) {
+		long off = (end + 7) & ~7L;
+
+		fwrite(pad, off - end, 1, fout);
+		fwrite(blobs, blobs_size, 1, fout);
+
+		put_le(ext, off, 8);
+		put_le(ext + 8, end, 4);
+		if (fseek(fout, BIN_HEADER_SIZE, SEEK_SET) == 0)
+			rc = fwrite(ext, sizeof(ext), 1, fout) != 1;
+	}
+
+	if (fflush(fout) != 0 || ferror(fout) || fsync(fd) != 0)
+		rc = 1;
+	if (fclose(fout) != 0)
+		rc = 1;
+
+	if (!rc)
+		rc = rename(tmp, fname) != 0;
+
+out:
+	if (rc)
+		unlink(tmp);
+	free(tmp);
+	free(blobs);
+
+	return rc;
+}
+
+int dm_base_image_load(const char *fname, uint64_t stamp)
+{
+	struct bin_reader r;
+	struct stat st;
+	uint8_t *map;
+	uint64_t blobs, end;
+	int fd;
+	int rc = 1;
+
+	if (dm_base_image)
+		return 1;
+
+	if ((fd = open(fname, O_RDONLY)) < 0)
+		return 1;
+
+	if (fstat(fd, &st) < 0 || st.st_size < IMAGE_HEADER_SIZE) {
+		close(fd);
+		return 1;
+	}
+
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED)
+		return 1;
+
+	if (bin_check_header(map, st.st_size, IMAGE_MAGIC) != stamp) {
+		debug("(): base image is out of date");
+		goto unmap;
+	}
+
+	blobs = get_le(map + BIN_HEADER_SIZE, 8);
+	end = get_le(map + BIN_HEADER_SIZE + 8, 4);
+	if (end < IMAGE_HEADER_SIZE || end > blobs || blobs > (uint64_t)st.st_size || blobs % 8 != 0)
+		goto unmap;
+
+	memset(&r, 0, sizeof(r));
+	r.flags = DS_BASECONFIG;
+	r.blobs = map + blobs;
+	r.blobs_size = st.st_size - blobs;
+
+	if (bin_records(&r, map + IMAGE_HEADER_SIZE, map + end) < 0) {
+		debug("(): base image is damaged");
+		goto unmap;
+	}
+
+	/* the store references the mapping from here on, it stays mapped */
+	dm_base_image = map;
+	dm_base_image_size = st.st_size;
+
+	if (!dm_value_store)
+		dm_value_store = dm_alloc_table(&dm_root, NULL, (dm_selector){ 0, }, 0);
+	dm_set_cfg_version(CFG_VERSION);
+
+	r.apply = 1;
+	rc = bin_records(&r, map + IMAGE_HEADER_SIZE, map + end) < 0 ? -1 : 0;
+
+	free(r.scratch);
+	return rc;
+
+unmap:
+	munmap(map, st.st_size);
+	return rc;
+}
@@ -0,0 +1,127 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef __DM_BINCONFIG_H
+#define __DM_BINCONFIG_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "compiler.h"
+#include "dm.h"
+#include "dm_token.h"
+
+#define DM_BINCONFIG_VERSION	3
+
+/* hash over the keyword tree, a file written for another schema is rejected */
+uint64_t dm_binconfig_schema_hash(void);
+
+/* flags are the S_* flags of dm_serialize_store() */
+int dm_binconfig_save(FILE *stream, int flags);
+
+/*
+ * flags are the DS_* flags of dm_deserialize_store(), DS_VERSIONCHECK is implied:
+ * a file with another config version or schema is rejected without touching
+ * the store and 1 is returned, the caller has to fall back to the XML config
+ * then. -1: the load failed halfway, the caller has to dm_reset_store() first
+ */
+int dm_binconfig_load(FILE *stream, int flags);
+int dm_binconfig_load_file(const char *fname, int flags);
+
+/*
+ * journal of committed changes
+ *
+ * Store changes between dm_journal_begin() and dm_journal_end() are recorded
+ * with dm_journal_value(), dm_journal_instance() and dm_journal_delete(),
+ * any other change to the saved config makes the journal stale until the
+ * next full save.
+ */
+void dm_journal_begin(void);
+void dm_journal_end(void);
+void dm_journal_value(const dm_selector sel, const struct dm_element *elem, const DM_VALUE value);
+void dm_journal_instance(const dm_selector sel);
+void dm_journal_delete(const dm_selector sel);
+
+/* start recording once the config is loaded, valid = 0 forces a full save first */
+void dm_journal_start(int valid);
+
+/*
+ * append the recorded changes to the journal file, returns 1 when the
+ * journal is stale or would grow beyond limit and a full save is needed
+ */
+int dm_journal_flush(const char *fname, size_t limit);
+
+/* the binary config written by the last dm_binconfig_save() is in place, the journal file is gone */
+void dm_journal_reset(void);
+
+/*
+ * save in a forked child
+ *
+ * prepare before the fork, the parent and the child call their part right
+ * after it. Once the child is done, the parent reports whether it wrote a
+ * full binary config and whether it succeeded.
+ */
+void dm_journal_fork_prepare(void);
+void dm_journal_fork_parent(int forked);
+void dm_journal_fork_child(void);
+void dm_journal_fork_done(int full, int ok);
+
+/* replay the journal of the loaded binary config, returns 1 when it does not belong to it */
+int dm_journal_replay_file(const char *fname, int flags);
+
+/*
+ * lazy subtrees
+ *
+ * dm_binconfig_save() writes the tables and objects at the marked paths
+ * as spans that dm_binconfig_load_file() skips. The file stays mapped and
+ * the container is flagged DV_LAZY until the first dm_get_element_ref()
+ * or walk that enters it loads the span, so boot time and memory follow
+ * what is actually used. paths is NULL terminated, instances are numbered.
+ */
+void dm_binconfig_set_lazy(const char *const paths[]);
+
+/*
+ * Only the event loop thread that loaded the config loads spans, and
+ * without add callbacks, notifications or version bumps. On any other
+ * thread a container that is still on disk cannot be entered,
+ * dm_get_element_ref() fails and walks skip it. A thread that reads a
+ * subtree off the loop has the loop load it with dm_lazy_load_below()
+ * first.
+ */
+extern int dm_lazy_loading;
+
+int dm_lazy_pending(void);
+
+/* load the spans on the path to sel and below it, on the event loop thread */
+void dm_lazy_load_below(const dm_selector sel) __attribute__((nonnull (1)));
+
+/* drop the span of container id of st, it is deleted before it was loaded */
+void dm_lazy_forget(const struct dm_value_table *st, dm_id id);
+
+int __dm_lazy_load(struct dm_value_table *st, dm_id id);
+
+/*
+ * load the table or object id of st when it is still on disk, returns 1
+ * when it was and -1 when it stays on disk because this thread cannot load it
+ */
+static inline int dm_lazy_load(struct dm_value_table *st, dm_id id)
+{
+	if (likely(!(__atomic_load_n(&st->values[id - 1].flags, __ATOMIC_ACQUIRE) & DV_LAZY)))
+		return 0;
+
+	return __dm_lazy_load(st, id);
+}
+
+/*
+ * memory-mapped base config
+ *
+ * dirs is the NULL terminated list of base config directories, an image
+ * is only loaded when it was written from the same files, returns 1 when
+ * the store is untouched and -1 like dm_binconfig_load() when it failed halfway
+ */
+uint64_t dm_base_image_stamp(const char *const dirs[]);
+int dm_base_image_save(const char *fname, uint64_t stamp);
+int dm_base_image_load(const char *fname, uint64_t stamp);
+
+#endif /* __DM_BINCONFIG_H */
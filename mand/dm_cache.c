@@ -7,7 +7,8 @@
 #endif
 
 #include <stdlib.h>
-#include <sys/tree.h>
+#include <string.h>
+#include <sys/queue.h>
 
 #define SDEBUG
 #include "debug.h"
@@ -20,62 +21,303 @@
 #include "dm_notify.h"
 #include "dm_action.h"
 #include "dm_cache.h"
+#include "dm_snapshot.h"
+#include "dm_binconfig.h"
 
-struct cache cache;
+/* all open configure session caches */
+static LIST_HEAD(cache_list, cache) caches = LIST_HEAD_INITIALIZER(caches);
+
+#define CACHE_HASH_MIN		64
 
 static int
-cache_compare(struct cache_item *a, struct cache_item *b)
+cache_compare(const void *a, const void *b)
 {
-        return dm_selcmp(a->sb, b->sb, DM_SELECTOR_LEN);
+	return dm_selcmp((*(struct cache_item * const *)a)->sb, (*(struct cache_item * const *)b)->sb, DM_SELECTOR_LEN);
 }
 
-RB_GENERATE(cache, cache_item, node, cache_compare);
+/* FNV-1a over the selector ids */
+static uint32_t cache_hash(const dm_selector sb)
+{
+	uint32_t h = 2166136261U;
+
+	for (int i = 0; i < DM_SELECTOR_LEN && sb[i]; i++) {
+		h ^= sb[i];
+		h *= 16777619U;
+	}
+	return h;
+}
 
-void cache_free()
+static struct cache_item *cache_find(struct cache *c, const dm_selector sb)
 {
 	struct cache_item *item;
+	uint32_t h;
 
-	while ((item = RB_ROOT(&cache))) {
-		RB_REMOVE(cache, &cache, item);
+	if (!c->hash)
+		return NULL;
 
-		dm_free_any_value(item->elem, &item->new_value);
-		free(item);
+	h = cache_hash(sb);
+	for (item = c->hash[h & (c->hash_size - 1)]; item; item = item->next)
+		if (item->hash == h && dm_selcmp(item->sb, sb, DM_SELECTOR_LEN) == 0)
+			return item;
+
+	return NULL;
+}
+
+/* double the bucket array and rehash, keeps the load factor <= 1 */
+static int cache_grow(struct cache *c)
+{
+	unsigned int size = c->hash_size ? c->hash_size * 2 : CACHE_HASH_MIN;
+	struct cache_item **hash;
+	struct cache_item *item;
+
+	if (!(hash = calloc(size, sizeof(struct cache_item *))))
+		return 0;
+
+	TAILQ_FOREACH(item, &c->items, list) {
+		item->next = hash[item->hash & (size - 1)];
+		hash[item->hash & (size - 1)] = item;
 	}
+
+	free(c->hash);
+	c->hash = hash;
+	c->hash_size = size;
+
+	return 1;
+}
+
+static int cache_insert(struct cache *c, struct cache_item *item)
+{
+	struct cache_item **bucket;
+
+	if (c->count >= c->hash_size && !cache_grow(c))
+		return 0;
+
+	item->hash = cache_hash(item->sb);
+	bucket = &c->hash[item->hash & (c->hash_size - 1)];
+	item->next = *bucket;
+	*bucket = item;
+
+	TAILQ_INSERT_TAIL(&c->items, item, list);
+	c->count++;
+
+	return 1;
 }
 
-void cache_reset()
+static void cache_remove(struct cache *c, struct cache_item *item)
+{
+	struct cache_item **p;
+
+	for (p = &c->hash[item->hash & (c->hash_size - 1)]; *p; p = &(*p)->next)
+		if (*p == item) {
+			*p = item->next;
+			break;
+		}
+
+	TAILQ_REMOVE(&c->items, item, list);
+	c->count--;
+}
+
+/* unlink all items, the caller owns them until they are freed */
+static void cache_clear(struct cache *c)
+{
+	TAILQ_INIT(&c->items);
+	c->count = 0;
+
+	free(c->hash);
+	c->hash = NULL;
+	c->hash_size = 0;
+}
+
+static DM_RESULT cache_copy_value(const struct dm_element *elem, DM_VALUE *dst, const DM_VALUE *src)
+{
+	*dst = *src;
+
+	switch (elem->type) {
+	case T_STR:
+		set_DM_STRING(*dst, NULL);
+		DM_parity_update(*dst);
+		return dm_set_string_value(dst, DM_STRING(*src));
+
+	case T_BINARY:
+	case T_BASE64:
+		set_DM_BINARY(*dst, NULL);
+		DM_parity_update(*dst);
+		return dm_set_binary_value(dst, DM_BINARY(*src));
+
+	case T_SELECTOR:
+		set_DM_SELECTOR(*dst, NULL);
+		DM_parity_update(*dst);
+		return DM_SELECTOR(*src) ? dm_set_selector_value(dst, *DM_SELECTOR(*src)) : DM_OK;
+	}
+
+	return DM_OK;
+}
+
+static void cache_free_value(const struct dm_element *elem, DM_VALUE *st)
+{
+	if (elem->type == T_BASE64)
+		dm_free_binary_value(st);
+	else
+		dm_free_any_value(elem, st);
+}
+
+/* the orig_value is a plain copy of the store value, so byte compare all scalar types */
+static int cache_value_changed(const struct dm_element *elem, DM_VALUE *a, DM_VALUE *b)
+{
+	switch (elem->type) {
+	case T_STR:
+	case T_BINARY:
+	case T_BASE64:
+	case T_SELECTOR:
+		return dm_compare_values(elem->type, a, b) != 0;
+
+	default:
+		return memcmp(&a->_v, &b->_v, sizeof(a->_v)) != 0;
+	}
+}
+
+/* check whether any other configure session has a pending change for sb */
+static int cache_is_pending(struct cache *self, const dm_selector sb)
+{
+	struct cache *c;
+
+	LIST_FOREACH(c, &caches, list)
+		if (c != self && cache_find(c, sb))
+			return 1;
+
+	return 0;
+}
+
+/*
+ * the store value might have been deleted by another session,
+ * only touch it when the selector still resolves to the same value
+ */
+static DM_VALUE *cache_lookup_value(struct cache_item *item)
+{
+	struct dm_element_ref ref;
+
+	if (!dm_get_element_ref(item->sb, &ref) || ref.st_value != item->old_value)
+		return NULL;
+
+	return ref.st_value;
+}
+
+static void cache_clear_pending(struct cache *c, struct cache_item *item, DM_VALUE *st)
+{
+	if (cache_is_pending(c, item->sb))
+		return;
+
+	st->flags &= ~DV_UPDATE_PENDING;
+	DM_parity_update(*st);
+}
+
+/* drop the undo log and all savepoints, the items must still exist */
+static void cache_undo_free(struct cache *c)
+{
+	struct cache_undo *u;
+
+	while ((u = SLIST_FIRST(&c->undo))) {
+		SLIST_REMOVE_HEAD(&c->undo, list);
+
+		if (u->item && !u->created)
+			cache_free_value(u->item->elem, &u->new_value);
+		free(u);
+	}
+	c->savepoints = 0;
+}
+
+static void cache_undo_entry(struct cache *c, struct cache_undo *u)
+{
+	struct cache_item *item = u->item;
+	DM_VALUE *st;
+
+	cache_free_value(item->elem, &item->new_value);
+
+	if (!u->created) {
+		item->new_value = u->new_value;
+		item->code = u->code;
+		item->msg = u->msg;
+		return;
+	}
+
+	cache_remove(c, item);
+
+	if ((st = cache_lookup_value(item)))
+		cache_clear_pending(c, item, st);
+
+	cache_free_value(item->elem, &item->orig_value);
+	free(item);
+}
+
+void cache_init(struct cache *c)
+{
+	TAILQ_INIT(&c->items);
+	c->count = 0;
+	c->hash_size = 0;
+	c->hash = NULL;
+	SLIST_INIT(&c->undo);
+	c->savepoints = 0;
+
+	LIST_INSERT_HEAD(&caches, c, list);
+}
+
+void cache_free(struct cache *c)
+{
+	cache_reset(c);
+	LIST_REMOVE(c, list);
+}
+
+void cache_reset(struct cache *c)
 {
 	struct cache_item *item;
 
-	while ((item = RB_ROOT(&cache))) {
-		RB_REMOVE(cache, &cache, item);
+	cache_undo_free(c);
 
-		dm_free_any_value(item->elem, &item->new_value);
-		item->old_value->flags &= ~DV_UPDATE_PENDING;
-		DM_parity_update(*item->old_value);
+	while ((item = TAILQ_FIRST(&c->items))) {
+		DM_VALUE *st;
+
+		TAILQ_REMOVE(&c->items, item, list);
+
+		if ((st = cache_lookup_value(item)))
+			cache_clear_pending(c, item, st);
+
+		cache_free_value(item->elem, &item->new_value);
+		cache_free_value(item->elem, &item->orig_value);
 		free(item);
 	}
+
+	cache_clear(c);
 }
 
-void cache_add(const dm_selector sb, const char *name,
+void cache_add(struct cache *c, const dm_selector sb, const char *name,
 	       const struct dm_element *elem,
 	       struct dm_value_table *base,
 	       DM_VALUE *old_value, DM_VALUE new_value,
 	       unsigned int code, char *msg)
 {
 	dm_id id = 1;
-	struct cache_item si, *item;
+	struct cache_item *item;
+	struct cache_undo *u = NULL;
 
 	if (!name)
 		return;
 
-	dm_selcpy(si.sb, sb);
+	if (c->savepoints && !(u = malloc(sizeof(struct cache_undo))))
+		return;
 
-	item = RB_FIND(cache, &cache, &si);
+	item = cache_find(c, sb);
 	if (!item) {
 		item = malloc(sizeof(struct cache_item));
-		if (!item)
+		if (!item) {
+			free(u);
 			return;
+		}
+
+		if (cache_copy_value(elem, &item->orig_value, old_value) != DM_OK) {
+			free(item);
+			free(u);
+			return;
+		}
 
 		for (int i = 0; i < DM_SELECTOR_LEN; i++) {
 			if (sb[i] == 0)
@@ -88,26 +330,155 @@ void cache_add(const dm_selector sb, const char *name,
 		item->name = name;
 		item->elem = elem;
 		item->base = base;
+		item->version = base ? base->version : 0;
 		item->old_value = old_value;
 		item->new_value = new_value;
 		item->code = code;
 		item->msg = msg;
 
-		RB_INSERT(cache, &cache, item);
+		if (!cache_insert(c, item)) {
+			cache_free_value(elem, &item->orig_value);
+			free(item);
+			free(u);
+			return;
+		}
+
+		old_value->flags |= DV_UPDATE_PENDING;
+		DM_parity_update(*old_value);
+
+		if (u)
+			u->created = 1;
 	} else {
+		if (u) {
+			/* keep the replaced value for a rollback */
+			u->created = 0;
+			u->new_value = item->new_value;
+			u->code = item->code;
+			u->msg = item->msg;
+		} else
+			cache_free_value(item->elem, &item->new_value);
+
 		item->new_value = new_value;
 		item->code = code;
 		item->msg = msg;
 	}
 	DM_parity_update(item->new_value);
+
+	if (u) {
+		u->item = item;
+		SLIST_INSERT_HEAD(&c->undo, u, list);
+	}
+}
+
+/* queue the actions cache_apply() would trigger, without applying anything */
+void cache_queue_actions(struct cache *c)
+{
+	struct cache_item *item;
+
+	TAILQ_FOREACH(item, &c->items, list)
+		action_sel(item->elem->action, item->sb, DM_CHANGE);
+}
+
+/* returns the id of the new savepoint, 0 when out of memory */
+unsigned int cache_savepoint(struct cache *c)
+{
+	struct cache_undo *u;
+
+	if (!(u = calloc(1, sizeof(struct cache_undo))))
+		return 0;
+
+	SLIST_INSERT_HEAD(&c->undo, u, list);
+	return ++c->savepoints;
+}
+
+/*
+ * undo all changes since the savepoint, the savepoint itself stays
+ * valid, all savepoints set after it are released
+ */
+int cache_rollback(struct cache *c, unsigned int savepoint)
+{
+	struct cache_undo *u;
+
+	if (savepoint == 0 || savepoint > c->savepoints)
+		return 0;
+
+	while ((u = SLIST_FIRST(&c->undo))) {
+		if (!u->item && c->savepoints == savepoint)
+			break;
+
+		SLIST_REMOVE_HEAD(&c->undo, list);
+
+		if (u->item)
+			cache_undo_entry(c, u);
+		else
+			c->savepoints--;
+		free(u);
+	}
+
+	return 1;
+}
+
+/*
+ * release the savepoint and all savepoints set after it, the changes
+ * stay and remain recorded for an enclosing savepoint
+ */
+int cache_release(struct cache *c, unsigned int savepoint)
+{
+	struct cache_undo **p = &SLIST_FIRST(&c->undo);
+	struct cache_undo *u;
+
+	if (savepoint == 0 || savepoint > c->savepoints)
+		return 0;
+
+	if (savepoint == 1) {
+		cache_undo_free(c);
+		return 1;
+	}
+
+	while (c->savepoints >= savepoint && (u = *p)) {
+		if (u->item) {
+			p = &SLIST_NEXT(u, list);
+			continue;
+		}
+
+		*p = SLIST_NEXT(u, list);
+		c->savepoints--;
+		free(u);
+	}
+
+	return 1;
 }
 
-int cache_validate()
+/*
+ * optimistic concurrency check, returns 0 when any value touched by
+ * this session has been changed or deleted since it was first set
+ *
+ * an unchanged table version proves the value is unchanged, otherwise
+ * some value in the table changed and the value itself has to be compared
+ */
+int cache_is_current(struct cache *c)
+{
+	struct cache_item *item;
+
+	TAILQ_FOREACH(item, &c->items, list) {
+		if (!cache_lookup_value(item))
+			return 0;
+
+		if (item->base && item->base->version == item->version)
+			continue;
+
+		if (cache_value_changed(item->elem, item->old_value, &item->orig_value))
+			return 0;
+	}
+	return 1;
+}
+
+int cache_validate(struct cache *c)
 {
 	int r = 1;
 	struct cache_item *item;
 
-	RB_FOREACH(item, cache, &cache) {
+	TAILQ_FOREACH(item, &c->items, list) {
 		if (item->elem &&
 		    item->code == 0 &&
 		    item->elem->fkts.value.validate)
@@ -116,35 +487,77 @@ int cache_validate()
 	return r;
 }
 
-void cache_apply(int slot)
+static void cache_apply_item(struct cache *c, struct cache_item *item, int slot)
+{
+	dm_snapshot_preserve(item->base);
+
+	if (item->elem->flags & F_SET) {
+		item->elem->fkts.value.set(item->base, item->id, item->elem, item->old_value, item->new_value);
+
+		cache_free_value(item->elem, &item->new_value);
+	} else
+		memcpy(&item->old_value->_v,  &item->new_value._v, sizeof(item->new_value._v));
+
+	if (!cache_is_pending(c, item->sb))
+		item->old_value->flags &= ~DV_UPDATE_PENDING;
+	item->old_value->flags |= DV_UPDATED;
+	DM_parity_update(*item->old_value);
+	dm_touch_by_selector(item->sb);
+	dm_config_touch(item->sb);
+	dm_journal_value(item->sb, item->elem, *item->old_value);
+
+	if (item->elem->flags & F_INDEX)
+		update_index(item->id, cast_table2node(item->base));
+
+	notify_sel(slot, item->sb, *item->old_value, NOTIFY_CHANGE);
+	action_sel(item->elem->action, item->sb, DM_CHANGE);
+
+	cache_free_value(item->elem, &item->orig_value);
+	free(item);
+}
+
+void cache_apply(struct cache *c, int slot)
 {
+	struct cache_item **sorted;
 	struct cache_item *item;
+	unsigned int i = 0;
 
-	while ((item = RB_ROOT(&cache))) {
-		RB_REMOVE(cache, &cache, item);
+	cache_undo_free(c);
 
-		if (item->elem->flags & F_SET) {
-			item->elem->fkts.value.set(item->base, item->id, item->elem, item->old_value, item->new_value);
+	if (cache_is_empty(c))
+		return;
 
-			dm_free_any_value(item->elem, &item->new_value);
-		} else
-			memcpy(&item->old_value->_v,  &item->new_value._v, sizeof(item->new_value._v));
+	dm_journal_begin();
 
-		item->old_value->flags &= ~DV_UPDATE_PENDING;
-		item->old_value->flags |= DV_UPDATED;
-		DM_parity_update(*item->old_value);
+	/*
+	 * apply in selector order, so that actions and notifications see
+	 * the changes sorted by path, fall back to set order without memory
+	 */
+	if ((sorted = malloc(c->count * sizeof(struct cache_item *)))) {
+		TAILQ_FOREACH(item, &c->items, list)
+			sorted[i++] = item;
+		qsort(sorted, c->count, sizeof(struct cache_item *), cache_compare);
 
-		if (item->elem->flags & F_INDEX)
-			update_index(item->id, cast_table2node(item->base));
+		for (i = 0; i < c->count; i++)
+			cache_apply_item(c, sorted[i], slot);
 
-		notify_sel(slot, item->sb, *item->old_value, NOTIFY_CHANGE);
-		action_sel(item->elem->action, item->sb, DM_CHANGE);
+		free(sorted);
+	} else
+		while ((item = TAILQ_FIRST(&c->items))) {
+			TAILQ_REMOVE(&c->items, item, list);
+			cache_apply_item(c, item, slot);
+		}
 
-		free(item);
-	}
+	cache_clear(c);
+
+	dm_journal_end();
 }
 
-DM_VALUE dm_cache_get_any_value_by_id(const struct dm_value_table *ift, dm_id id)
+/*
+ * DV_UPDATE_PENDING only says that some configure session has a pending
+ * change, fall back to the store value when it is not ours
+ */
+DM_VALUE dm_cache_get_any_value_by_id(struct cache *c, const struct dm_value_table *ift, dm_id id)
 {
 	DM_VALUE val = { _init_DM_type(T_ANY) };
 
@@ -152,21 +565,21 @@ DM_VALUE dm_cache_get_any_value_by_id(const struct dm_value_table *ift, dm_id id
 		return val;
 
 	if (unlikely((ift->values[id - 1].flags & DV_UPDATE_PENDING) == DV_UPDATE_PENDING)) {
-		struct cache_item item, *i;
+		struct cache_item *i;
+		dm_selector sb;
 
-		dm_selcpy(item.sb, ift->id);
-		dm_selcat(item.sb, id);
+		dm_selcpy(sb, ift->id);
+		dm_selcat(sb, id);
 
-		i = RB_FIND(cache, &cache, &item);
-		if (!i)
-			return val;
+		i = cache_find(c, sb);
+		if (i)
+			return i->new_value;
+	}
 
-		return i->new_value;
-	} else
-		return ift->values[id - 1];
+	return ift->values[id - 1];
 }
 
-DM_VALUE dm_cache_get_any_value_by_selector(const dm_selector sel, int type)
+DM_VALUE dm_cache_get_any_value_by_selector(struct cache *c, const dm_selector sel, int type)
 {
 	struct dm_element_ref ref;
 	DM_VALUE val = { _init_DM_type(T_ANY) };
@@ -179,16 +592,13 @@ DM_VALUE dm_cache_get_any_value_by_selector(const dm_selector sel, int type)
 		if (ref.st_value &&
 		    unlikely((ref.st_value->flags & DV_UPDATE_PENDING) == DV_UPDATE_PENDING))
 		{
-			struct cache_item item, *i;
+			struct cache_item *i;
 
-			dm_selcpy(item.sb, sel);
-
-			i = RB_FIND(cache, &cache, &item);
-			if (!i)
-				return val;
-
-			DM_parity_assert(i->new_value);
-			return i->new_value;
+			i = cache_find(c, sel);
+			if (i) {
+				DM_parity_assert(i->new_value);
+				return i->new_value;
+			}
 		}
 		return dm_get_element_value(type, &ref);
 	}
@@ -196,7 +606,7 @@ DM_VALUE dm_cache_get_any_value_by_selector(const dm_selector sel, int type)
 	return val;
 }
 
-DM_RESULT dm_cache_get_value_by_selector_cb(const dm_selector sel, int type, void *userData,
+DM_RESULT dm_cache_get_value_by_selector_cb(struct cache *c, const dm_selector sel, int type, void *userData,
 					    DM_RESULT (*cb)(void *, const dm_selector, const struct dm_element *, int st_type, const DM_VALUE))
 {
 	struct dm_element_ref ref;
@@ -214,16 +624,13 @@ DM_RESULT dm_cache_get_value_by_selector_cb(const dm_selector sel, int type, voi
 
 		if (unlikely((ref.st_value->flags & DV_UPDATE_PENDING) == DV_UPDATE_PENDING))
 		{
-			struct cache_item item, *i;
-
-			dm_selcpy(item.sb, sel);
-
-			i = RB_FIND(cache, &cache, &item);
-			if (!i)
-				return DM_VALUE_NOT_FOUND;
+			struct cache_item *i;
 
-			DM_parity_assert(i->new_value);
-			return cb(userData, sel, ref.kw_elem, ref.st_type, i->new_value);
+			i = cache_find(c, sel);
+			if (i) {
+				DM_parity_assert(i->new_value);
+				return cb(userData, sel, ref.kw_elem, ref.st_type, i->new_value);
+			}
 		}
 
 		DM_VALUE val = dm_get_element_value(type, &ref);
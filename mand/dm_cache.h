@@ -6,12 +6,14 @@
 #define __DM_CACHE_H
 
 #include <stdint.h>
-#include <sys/tree.h>
+#include <sys/queue.h>
 
 #include "dm_store.h"
 
 struct cache_item {
-        RB_ENTRY (cache_item) node;
+	TAILQ_ENTRY(cache_item) list;	/* in order of the first set */
+	struct cache_item *next;	/* hash chain */
+	uint32_t hash;
 
 	dm_id id;
 	dm_selector sb;
@@ -20,36 +22,76 @@ struct cache_item {
 	struct dm_value_table *base;
 
 	DM_VALUE *old_value;
+	uint64_t version;		/* version of base when the item was added */
+	DM_VALUE orig_value;		/* copy of *old_value when the item was added */
 	DM_VALUE new_value;
 
 	unsigned int code;
 	char *msg;
 };
 
-RB_HEAD(cache, cache_item);
-RB_PROTOTYPE(cache, cache_item, node, cache_compare);
+TAILQ_HEAD(cache_items, cache_item);
 
-extern struct cache cache;
+/* undo record of one cache_add() after a savepoint, item == NULL marks the savepoint itself */
+struct cache_undo {
+	SLIST_ENTRY(cache_undo) list;
 
-void cache_free(void);
-void cache_reset(void);
-int cache_validate(void);
-void cache_apply(int slot);
-void cache_add(const dm_selector sb, const char *name,
+	struct cache_item *item;
+	int created;			/* item was created, otherwise the values before the set */
+	DM_VALUE new_value;
+	unsigned int code;
+	char *msg;
+};
+
+SLIST_HEAD(cache_undo_log, cache_undo);
+
+/*
+ * pending changes of one configure session
+ *
+ * items are hashed by selector for O(1) set and get,
+ * cache_apply() sorts them by selector once
+ *
+ * while a savepoint is set every change is recorded in the undo log,
+ * rolling back pops the log down to the savepoint
+ */
+struct cache {
+	LIST_ENTRY(cache) list;
+
+	struct cache_items items;
+	unsigned int count;
+
+	unsigned int hash_size;		/* power of 2 */
+	struct cache_item **hash;
+
+	unsigned int savepoints;
+	struct cache_undo_log undo;
+};
+
+void cache_init(struct cache *);
+void cache_free(struct cache *);
+void cache_reset(struct cache *);
+int cache_is_current(struct cache *);
+int cache_validate(struct cache *);
+void cache_apply(struct cache *, int slot);
+void cache_queue_actions(struct cache *);
+unsigned int cache_savepoint(struct cache *);
+int cache_rollback(struct cache *, unsigned int savepoint);
+int cache_release(struct cache *, unsigned int savepoint);
+void cache_add(struct cache *, const dm_selector sb, const char *name,
 	       const struct dm_element *elem,
 	       struct dm_value_table *base,
 	       DM_VALUE *old_value, DM_VALUE new_value,
-	       unsigned int code, char *msg) __attribute__((nonnull (1)));
-DM_VALUE dm_cache_get_any_value_by_id(const struct dm_value_table *, dm_id);
-DM_VALUE dm_cache_get_any_value_by_selector(const dm_selector, int) __attribute__((nonnull (1)));
+	       unsigned int code, char *msg) __attribute__((nonnull (1, 2)));
+DM_VALUE dm_cache_get_any_value_by_id(struct cache *, const struct dm_value_table *, dm_id);
+DM_VALUE dm_cache_get_any_value_by_selector(struct cache *, const dm_selector, int) __attribute__((nonnull (1, 2)));
 
-DM_RESULT dm_cache_get_value_by_selector_cb(const dm_selector sel, int type, void *userData,
-					       DM_RESULT (*cb)(void *, const dm_selector, const struct dm_element *, int st_type, const DM_VALUE))
-	__attribute__((nonnull (1)));
+DM_RESULT dm_cache_get_value_by_selector_cb(struct cache *, const dm_selector sel, int type, void *userData,
+					    DM_RESULT (*cb)(void *, const dm_selector, const struct dm_element *, int st_type, const DM_VALUE))
+	__attribute__((nonnull (1, 2)));
 
-static inline uint8_t cache_is_empty(void)
+static inline uint8_t cache_is_empty(struct cache *c)
 {
-	return RB_ROOT(&cache) ? 0 : 1;
+	return TAILQ_EMPTY(&c->items) ? 1 : 0;
 }
 
 /*
@@ -59,122 +101,122 @@ static inline uint8_t cache_is_empty(void)
 /*
  * ANY
  */
-static inline DM_VALUE dm_cache_get_by_selector(const dm_selector sel) __attribute__((nonnull (1)));
-DM_VALUE dm_cache_get_by_selector(const dm_selector sel)
+static inline DM_VALUE dm_cache_get_by_selector(struct cache *c, const dm_selector sel) __attribute__((nonnull (1, 2)));
+DM_VALUE dm_cache_get_by_selector(struct cache *c, const dm_selector sel)
 {
-	return dm_cache_get_any_value_by_selector(sel, T_ANY);
+	return dm_cache_get_any_value_by_selector(c, sel, T_ANY);
 };
 
 /*
  * BOOL
  */
-static inline char dm_cache_get_bool_by_selector(const dm_selector sel) __attribute__((nonnull (1)));
-char dm_cache_get_bool_by_selector(const dm_selector sel)
+static inline char dm_cache_get_bool_by_selector(struct cache *c, const dm_selector sel) __attribute__((nonnull (1, 2)));
+char dm_cache_get_bool_by_selector(struct cache *c, const dm_selector sel)
 {
-	return DM_BOOL(dm_cache_get_any_value_by_selector(sel, T_BOOL));
+	return DM_BOOL(dm_cache_get_any_value_by_selector(c, sel, T_BOOL));
 };
 
-static inline char dm_cache_get_bool_by_id(struct dm_value_table *ift, dm_id id)
+static inline char dm_cache_get_bool_by_id(struct cache *c, struct dm_value_table *ift, dm_id id)
 {
-	return DM_BOOL(dm_cache_get_any_value_by_id(ift, id));
+	return DM_BOOL(dm_cache_get_any_value_by_id(c, ift, id));
 };
 
 /*
  * STRING
  */
-static inline const char *dm_cache_get_string_by_selector(const dm_selector sel) __attribute__((nonnull (1)));
-const char *dm_cache_get_string_by_selector(const dm_selector sel)
+static inline const char *dm_cache_get_string_by_selector(struct cache *c, const dm_selector sel) __attribute__((nonnull (1, 2)));
+const char *dm_cache_get_string_by_selector(struct cache *c, const dm_selector sel)
 {
-	return DM_STRING(dm_cache_get_any_value_by_selector(sel, T_STR));
+	return DM_STRING(dm_cache_get_any_value_by_selector(c, sel, T_STR));
 };
 
-static inline const char *dm_cache_get_string_by_id(struct dm_value_table *ift, dm_id id)
+static inline const char *dm_cache_get_string_by_id(struct cache *c, struct dm_value_table *ift, dm_id id)
 {
-	return DM_STRING(dm_cache_get_any_value_by_id(ift, id));
+	return DM_STRING(dm_cache_get_any_value_by_id(c, ift, id));
 };
 
 /*
  * ENUM
  */
-static inline int dm_cache_get_enum_by_selector(const dm_selector sel) __attribute__((nonnull (1)));
-int dm_cache_get_enum_by_selector(const dm_selector sel)
+static inline int dm_cache_get_enum_by_selector(struct cache *c, const dm_selector sel) __attribute__((nonnull (1, 2)));
+int dm_cache_get_enum_by_selector(struct cache *c, const dm_selector sel)
 {
-	return DM_ENUM(dm_cache_get_any_value_by_selector(sel, T_ENUM));
+	return DM_ENUM(dm_cache_get_any_value_by_selector(c, sel, T_ENUM));
 };
 
-static inline int dm_cache_get_enum_by_id(struct dm_value_table *ift, dm_id id)
+static inline int dm_cache_get_enum_by_id(struct cache *c, struct dm_value_table *ift, dm_id id)
 {
-	return DM_ENUM(dm_cache_get_any_value_by_id(ift, id));
+	return DM_ENUM(dm_cache_get_any_value_by_id(c, ift, id));
 };
 
 /*
  * INT
  */
-static inline int dm_cache_get_int_by_selector(const dm_selector sel) __attribute__((nonnull (1)));
-int dm_cache_get_int_by_selector(const dm_selector sel)
+static inline int dm_cache_get_int_by_selector(struct cache *c, const dm_selector sel) __attribute__((nonnull (1, 2)));
+int dm_cache_get_int_by_selector(struct cache *c, const dm_selector sel)
 {
-	return DM_INT(dm_cache_get_any_value_by_selector(sel, T_INT));
+	return DM_INT(dm_cache_get_any_value_by_selector(c, sel, T_INT));
 };
 
-static inline int dm_cache_get_int_by_id(const struct dm_value_table *ift, dm_id id)
+static inline int dm_cache_get_int_by_id(struct cache *c, const struct dm_value_table *ift, dm_id id)
 {
-	return DM_INT(dm_cache_get_any_value_by_id(ift, id));
+	return DM_INT(dm_cache_get_any_value_by_id(c, ift, id));
 };
 
 /*
  * UINT
  */
-static inline int dm_cache_get_uint_by_selector(const dm_selector sel) __attribute__((nonnull (1)));
-int dm_cache_get_uint_by_selector(const dm_selector sel)
+static inline int dm_cache_get_uint_by_selector(struct cache *c, const dm_selector sel) __attribute__((nonnull (1, 2)));
+int dm_cache_get_uint_by_selector(struct cache *c, const dm_selector sel)
 {
-	return DM_UINT(dm_cache_get_any_value_by_selector(sel, T_UINT));
+	return DM_UINT(dm_cache_get_any_value_by_selector(c, sel, T_UINT));
 };
 
-static inline int dm_cache_get_uint_by_id(const struct dm_value_table *ift, dm_id id)
+static inline int dm_cache_get_uint_by_id(struct cache *c, const struct dm_value_table *ift, dm_id id)
 {
-	return DM_UINT(dm_cache_get_any_value_by_id(ift, id));
+	return DM_UINT(dm_cache_get_any_value_by_id(c, ift, id));
 };
 
 /*
  * TIME
  */
-static inline time_t dm_cache_get_time_by_selector(const dm_selector sel) __attribute__((nonnull (1)));
-time_t dm_cache_get_time_by_selector(const dm_selector sel)
+static inline time_t dm_cache_get_time_by_selector(struct cache *c, const dm_selector sel) __attribute__((nonnull (1, 2)));
+time_t dm_cache_get_time_by_selector(struct cache *c, const dm_selector sel)
 {
-	return DM_TIME(dm_cache_get_any_value_by_selector(sel, T_DATE));
+	return DM_TIME(dm_cache_get_any_value_by_selector(c, sel, T_DATE));
 };
 
-static inline time_t dm_cache_get_time_by_id(const struct dm_value_table *ift, dm_id id)
+static inline time_t dm_cache_get_time_by_id(struct cache *c, const struct dm_value_table *ift, dm_id id)
 {
-	return DM_TIME(dm_cache_get_any_value_by_id(ift, id));
+	return DM_TIME(dm_cache_get_any_value_by_id(c, ift, id));
 };
 
 /*
  * IPv4 Address
  */
-static inline struct in_addr dm_cache_get_ipv4_by_selector(const dm_selector sel) __attribute__((nonnull (1)));
-struct in_addr dm_cache_get_ipv4_by_selector(const dm_selector sel)
+static inline struct in_addr dm_cache_get_ipv4_by_selector(struct cache *c, const dm_selector sel) __attribute__((nonnull (1, 2)));
+struct in_addr dm_cache_get_ipv4_by_selector(struct cache *c, const dm_selector sel)
 {
-	return DM_IP4(dm_cache_get_any_value_by_selector(sel, T_IPADDR4));
+	return DM_IP4(dm_cache_get_any_value_by_selector(c, sel, T_IPADDR4));
 };
 
-static inline struct in_addr dm_cache_get_ipv4_by_id(const struct dm_value_table *ift, dm_id id)
+static inline struct in_addr dm_cache_get_ipv4_by_id(struct cache *c, const struct dm_value_table *ift, dm_id id)
 {
-	return DM_IP4(dm_cache_get_any_value_by_id(ift, id));
+	return DM_IP4(dm_cache_get_any_value_by_id(c, ift, id));
 };
 
 /*
  * IPv6 Address
  */
-static inline struct in6_addr dm_cache_get_ipv6_by_selector(const dm_selector sel) __attribute__((nonnull (1)));
-struct in6_addr dm_cache_get_ipv6_by_selector(const dm_selector sel)
+static inline struct in6_addr dm_cache_get_ipv6_by_selector(struct cache *c, const dm_selector sel) __attribute__((nonnull (1, 2)));
+struct in6_addr dm_cache_get_ipv6_by_selector(struct cache *c, const dm_selector sel)
 {
-	return DM_IP6(dm_cache_get_any_value_by_selector(sel, T_IPADDR6));
+	return DM_IP6(dm_cache_get_any_value_by_selector(c, sel, T_IPADDR6));
 };
 
-static inline struct in6_addr dm_cache_get_ipv6_by_id(const struct dm_value_table *ift, dm_id id)
+static inline struct in6_addr dm_cache_get_ipv6_by_id(struct cache *c, const struct dm_value_table *ift, dm_id id)
 {
-	return DM_IP6(dm_cache_get_any_value_by_id(ift, id));
+	return DM_IP6(dm_cache_get_any_value_by_id(c, ift, id));
 };
 
 #endif
@@ -6,11 +6,15 @@
 #include "config.h"
 #endif
 
+#include <stdio.h>
 #include <string.h>
+#include <unistd.h>
 
 #include "dm_cfg_bkrst.h"
 #include "dm_signature.h"
 #include "dm_validate.h"
+#include "dm_serialize.h"
+#include "dmd.h"
 
 #include "process.h"
 
@@ -18,12 +22,31 @@
 #include "debug.h"
 
 #define SIGNED_CONFIG	"/tmp/signed.cfg"
+#define EXPORT_CONFIG	"/tmp/dm.xml"
 #define DM_CONFIG	"/jffs/etc/dm.xml"
+#define DM_CONFIG_BIN	"/jffs/etc/dm.bin"
+#define DM_JOURNAL	"/jffs/etc/dm.journal"
+
+/* the saved config is binary, export the current store as XML for the backup */
+static int export_conf(const char *fname)
+{
+	FILE *fout;
+
+	if (!(fout = fopen(fname, "w")))
+		return -1;
+
+	dm_serialize_store(fout, S_CFG);
+	if (fclose(fout) != 0) {
+		unlink(fname);
+		return -1;
+	}
+	return 0;
+}
 
 DM_RESULT save_conf(char *url)
 {
 	char *host, *path;
-	int port, rc;
+	int port, rc, signed_rc;
 
 	ENTER(": url: \"%s\"", url);
 
@@ -34,7 +57,14 @@ DM_RESULT save_conf(char *url)
 	}
 	debug("(): host: \"%s\", path: \"%s\", port: %d", host, path, port);
 
-	if (sign_file(DM_CONFIG, SIGNED_CONFIG)) {
+	if (export_conf(EXPORT_CONFIG)) {
+		EXIT();
+		return DM_ERROR;
+	}
+
+	signed_rc = sign_file(EXPORT_CONFIG, SIGNED_CONFIG);
+	unlink(EXPORT_CONFIG);
+	if (signed_rc) {
 		EXIT();
 		return DM_FILE_NOT_FOUND;
 	}
@@ -82,6 +112,14 @@ DM_RESULT restore_conf(char *url)
 
 	unlink(SIGNED_CONFIG);
 
+	/* the binary config takes precedence at boot */
+	if (!rc) {
+		/* a background save must not bring it back */
+		dm_save_wait();
+		unlink(DM_CONFIG_BIN);
+		unlink(DM_JOURNAL);
+	}
+
 	EXIT_MSG(": rc: %d", rc);
 	return rc ? DM_FILE_NOT_FOUND : DM_OK;
 }
@@ -7,9 +7,12 @@
 #endif
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 #include <dirent.h>
 #include <errno.h>
+#include <pthread.h>
 #include <sys/param.h>
 
 #include "expat.h"
@@ -22,6 +25,7 @@
 #include "dm_luaif.h"
 #include "dm_cfgversion.h"
 #include "dm_index.h"
+#include "dm_json.h"
 
 #define SDEBUG
 #include "debug.h"
@@ -33,18 +37,23 @@
 #define xml_debug(format, ...) do {} while (0)
 #endif
 
-static uint16_t flags;
-
 struct dm_enum notify_attr = {
 	.data = "None\000Passive\000Active",
 	.cnt = 3
 };
 
+/* workers for dm_deserialize_directory(), 0: one per CPU */
+int dm_deserialize_workers = 0;
+
 #define XML_VALID   (1 << 0)
 #define XML_ESCAPED (1 << 1)
 #define XML_UPGRADE (1 << 2)
 #define XML_ROOT    (1 << 3)
 
+#define XML_DEPTH   10
+
+#define DS_MAX_WORKERS 8
+
 struct XMLstate {
 	char *base;
 	const struct dm_element *element;
@@ -55,27 +64,211 @@ struct XMLstate {
 	struct dm_instance_node *node;
 };
 
+/*
+ * change list of a parsed file
+ *
+ * A file parsed on a worker thread does not touch the store, the parser
+ * records the valid elements it enters and leaves instead and the list
+ * is applied on the calling thread afterwards.
+ */
+enum {
+	OP_START,
+	OP_END,
+	OP_DELETE,
+	OP_VERSION,
+};
+
+struct XMLop {
+	int type;
+	const struct dm_element *kw;	/* OP_START, OP_DELETE */
+	dm_id id;
+	int xid;			/* OP_START, OP_DELETE: instance, OP_VERSION: config version */
+	int ntfy;
+	char *text;			/* OP_END */
+};
+
+struct XMLops {
+	struct XMLop *op;
+	int cnt;
+	int size;
+	int failed;
+};
+
+struct XMLparser {
+	struct XMLstate *state;
+	struct XMLstate *last;		/* top of the state stack */
+	int skip;			/* elements open beyond it */
+	int overflow;
+	int flags;
+	struct XMLops *ops;		/* NULL: change the store right away */
+};
+
+static struct XMLop *ops_add(struct XMLops *ops, int type)
+{
+	struct XMLop *op;
+
+	/* keep the list a consistent prefix of the file */
+	if (ops->failed)
+		return NULL;
+
+	if (ops->cnt == ops->size) {
+		int size = ops->size ? ops->size * 2 : 256;
+
+		if (!(op = realloc(ops->op, size * sizeof(struct XMLop)))) {
+			ops->failed = 1;
+			return NULL;
+		}
+		ops->op = op;
+		ops->size = size;
+	}
+
+	op = &ops->op[ops->cnt++];
+	memset(op, 0, sizeof(struct XMLop));
+	op->type = type;
+
+	return op;
+}
+
+static void ops_free(struct XMLops *ops)
+{
+	for (int i = 0; i < ops->cnt; i++)
+		free(ops->op[i].text);
+	free(ops->op);
+	memset(ops, 0, sizeof(struct XMLops));
+}
+
+static void set_version(struct XMLparser *p, int version)
+{
+	struct XMLop *op;
+
+	if (!p->ops)
+		dm_set_cfg_version(version);
+	else if ((op = ops_add(p->ops, OP_VERSION)))
+		op->xid = version;
+}
+
+/* enter element kw (id in the table of parent) in the store */
+static void apply_start(struct XMLstate *parent, struct XMLstate *state, int flags,
+			const struct dm_element *kw, dm_id id, int xid, int ntfy)
+{
+	DM_VALUE *value = parent->value;
+	DM_VALUE *val;
+
+	val = dm_get_value_ref_by_id(DM_TABLE(*value), id);
+
+	xml_debug("enter: %s = %p, (%p, %p)\n", kw->key, state, kw, val);
+
+	state->element = kw;
+	if (kw->type == T_OBJECT) {
+		struct dm_instance *inst = DM_INSTANCE(*val);
+		struct dm_instance_node *node = NULL;
+
+		/** FIXME: this should be easier */
+		if (xid > 0)
+			node = dm_get_instance_node_by_id(inst, xid);
+		if (!node) {
+			dm_selector basesel;
+
+			dm_selcpy(basesel, DM_TABLE(*value)->id);
+			dm_selcat(basesel, id);
+
+			node = dm_add_instance(kw, inst, basesel, xid);
+			dm_assert(node);
+
+			if (flags & DS_USERCONFIG) {
+				val->flags |= DV_UPDATED;
+				DM_parity_update(*val);
+				node->table.flags |= DV_UPDATED;
+				DM_parity_update(node->table);
+			}
+		}
+
+		val = &node->table;
+
+		state->inst = inst;
+		state->node = node;
+
+	} else if (kw->type == T_TOKEN) {
+		if (DM_TABLE(*val) == NULL) {
+			set_DM_TABLE(*val, dm_alloc_table(kw->u.t.table, DM_TABLE(*value), DM_TABLE(*value)->id, id));
+
+			if (flags & DS_USERCONFIG)
+				val->flags |= DV_UPDATED;
+			xml_debug("adding table for token \"%s\" with %d elements: %p\n", kw->key,
+				  kw->u.t.table->size, DM_TABLE(*val));
+			DM_parity_update(*val);
+		}
+	}
+	state->value = val;
+	if (ntfy >= 0)
+		set_notify_single_slot_element(kw, state->value, 0, ntfy);
+}
+
+/* remove instance xid of object kw (id in the table of parent) from the store */
+static void apply_delete(struct XMLstate *parent, const struct dm_element *kw, dm_id id, int xid)
+{
+	DM_VALUE *val = dm_get_value_ref_by_id(DM_TABLE(*parent->value), id);
+	dm_selector sel;
+
+	xml_debug("delete: %s.%d\n", kw->key, xid);
+
+	if (!DM_INSTANCE(*val) || !dm_get_instance_node_by_id(DM_INSTANCE(*val), xid))
+		return;
+
+	dm_selcpy(sel, DM_TABLE(*parent->value)->id);
+	dm_selcat(sel, id);
+	dm_selcat(sel, xid);
+	dm_del_object_by_selector(sel);
+}
+
+/* leave the element of state, text is its content */
+static void apply_end(struct XMLstate *state, int flags, const char *text)
+{
+	DM_RESULT res __attribute__ ((unused));
+
+	xml_debug("handling data: %s\n", text ? : "NOTHING");
+
+	res = dm_string2value(state->element, text, flags & DS_USERCONFIG, state->value);
+#ifdef XML_DEBUG
+	if (res != DM_OK)
+		xml_debug("dm_string2value returned %d (DM_RESULT)\n", res);
+#endif
+
+	if (state->inst)
+		update_instance_node_index(state->node);
+}
+
 static void XMLCALL
 startElement(void *userData, const char *name, const char **atts)
 {
+	struct XMLparser *p = userData;
 	const struct dm_element *kw = NULL;
-	DM_VALUE *val = NULL;
 
-	struct XMLstate **state = userData;
+	struct XMLstate *parent = p->state;
+	struct XMLstate *state;
 
-	const char *base = (*state)->base;
-	int valid = ((*state)->flags & XML_VALID) == XML_VALID;
-	int is_root = ((*state)->flags & XML_ROOT) == XML_ROOT;
-	const struct dm_element *element = (*state)->element;
-	DM_VALUE *value = (*state)->value;
+	const char *base = parent->base;
+	int valid = (parent->flags & XML_VALID) == XML_VALID;
+	int is_root = (parent->flags & XML_ROOT) == XML_ROOT;
+	const struct dm_element *element = parent->element;
 
 	int xid = 0;
 	int ntfy = 0;
-	dm_id id;
+	int deleted = 0;
+	dm_id id = DM_ERR;
+
+	/* deeper than the state stack, skipped and reported as an error */
+	if (p->skip || p->state == p->last) {
+		if (!p->skip)
+			debug("(): %s is nested too deep", name);
+		p->overflow = 1;
+		p->skip++;
+		return;
+	}
 
-	(*state)++;
+	state = ++p->state;
 	if (!is_root)
-		memset(*state, 0, sizeof(struct XMLstate));
+		memset(state, 0, sizeof(struct XMLstate));
 
 	for (int i = 0; atts[i]; i += 2) {
 		if (strcasecmp("instance", atts[i]) == 0) {
@@ -90,18 +283,23 @@ startElement(void *userData, const char *name, const char **atts)
 		else if (strcasecmp("encoding", atts[i]) == 0) {
 			xml_debug("%s: encoding: %s\n", name, atts[i + 1]);
 			if (strcasecmp(atts[i+1], "escaped") == 0)
-				(*state)->flags |= XML_ESCAPED;
+				state->flags |= XML_ESCAPED;
 		}
 		else if (strcasecmp("version", atts[i]) == 0) {
 			xml_debug("%s: config version: %s\n", name, atts[i + 1]);
-			dm_set_cfg_version(atoi(atts[i + 1]));
+			set_version(p, atoi(atts[i + 1]));
+		}
+		else if (strcasecmp("deleted", atts[i]) == 0) {
+			xml_debug("%s: deleted: %s\n", name, atts[i + 1]);
+			deleted = strcasecmp(atts[i + 1], "true") == 0;
 		}
 	}
 
 	if (is_root) {
-		if (flags & DS_VERSIONCHECK &&
+		/* only parsed in place, see dm_deserialize_directory() */
+		if (p->flags & DS_VERSIONCHECK &&
 		    dm_get_cfg_version() != CFG_VERSION) {
-			(*state)->flags |= XML_UPGRADE;
+			state->flags |= XML_UPGRADE;
 
 			lua_pushinteger(lua_environment, CFG_VERSION);
 			lua_pushinteger(lua_environment, dm_get_cfg_version());
@@ -109,10 +307,12 @@ startElement(void *userData, const char *name, const char **atts)
 				debug("(): Error during Lua function execution");
 		}
 	} else {
+		struct XMLop *op;
+
 		if (xid != 0)
-			asprintf(&(*state)->base, "%s.%s.%d", base, name, xid);
+			asprintf(&state->base, "%s.%s.%d", base, name, xid);
 		else
-			asprintf(&(*state)->base, "%s.%s", base, name);
+			asprintf(&state->base, "%s.%s", base, name);
 
 		if (valid) {
 			const struct dm_table *table = element->u.t.table;
@@ -120,65 +320,43 @@ startElement(void *userData, const char *name, const char **atts)
 			id = dm_get_element_id_by_name(name, strlen(name), table);
 			if (id != DM_ERR) {
 				kw = &(table->table[id - 1]);
-				val = dm_get_value_ref_by_id(DM_TABLE(*value), id);
-				(*state)->flags |= XML_VALID;
+				state->flags |= XML_VALID;
 			} else {
 				printf("Element '%s' not found in table '%s'\n", name, element->key);
 				valid = 0;
 			}
 		}
 
-		if (!valid || !((*state)->flags & XML_VALID)) {
-			debug("enter invalid: %s\n", (*state)->base);
+		if (!valid || !(state->flags & XML_VALID)) {
+			debug("enter invalid: %s\n", state->base);
 			return;
 		}
 
-		xml_debug("enter: %s = %p, (%p, %p)\n", name, *state, kw, val);
-
-		(*state)->element = kw;
-		if (kw->type == T_OBJECT) {
-			struct dm_instance *inst = DM_INSTANCE(*val);
-			struct dm_instance_node *node = NULL;
-
-			/** FIXME: this should be easier */
-			if (xid > 0)
-				node = dm_get_instance_node_by_id(inst, xid);
-			if (!node) {
-				dm_selector basesel;
-
-				dm_selcpy(basesel, DM_TABLE(*value)->id);
-				dm_selcat(basesel, id);
-
-				node = dm_add_instance(kw, inst, basesel, xid);
-				dm_assert(node);
-
-				if (flags & DS_USERCONFIG) {
-					val->flags |= DV_UPDATED;
-					DM_parity_update(*val);
-					node->table.flags |= DV_UPDATED;
-					DM_parity_update(node->table);
-				}
+		/* a differential config removes the instance, the element itself is ignored */
+		if (deleted) {
+			state->flags &= ~XML_VALID;
+			if (kw->type != T_OBJECT || xid <= 0)
+				return;
+
+			if (!p->ops)
+				apply_delete(parent, kw, id, xid);
+			else if ((op = ops_add(p->ops, OP_DELETE))) {
+				op->kw = kw;
+				op->id = id;
+				op->xid = xid;
 			}
+			return;
+		}
 
-			val = &node->table;
-
-			(*state)->inst = inst;
-			(*state)->node = node;
-
-		} else if (kw->type == T_TOKEN) {
-			if (DM_TABLE(*val) == NULL) {
-				set_DM_TABLE(*val, dm_alloc_table(kw->u.t.table, DM_TABLE(*value)->id, id));
-
-				if (flags & DS_USERCONFIG)
-					val->flags |= DV_UPDATED;
-				xml_debug("adding table for token \"%s\" with %d elements: %p\n", name,
-					  kw->u.t.table->size, DM_TABLE(*val));
-				DM_parity_update(*val);
-			}
+		state->element = kw;
+		if (!p->ops)
+			apply_start(parent, state, p->flags, kw, id, xid, ntfy);
+		else if ((op = ops_add(p->ops, OP_START))) {
+			op->kw = kw;
+			op->id = id;
+			op->xid = xid;
+			op->ntfy = ntfy;
 		}
-		(*state)->value = val;
-		if (ntfy >= 0)
-			set_notify_single_slot_element(kw, (*state)->value, 0, ntfy);
 	}
 }
 
@@ -216,90 +394,90 @@ static void string_unescape(char *text, const char *s, int len)
 static void XMLCALL
 charElement(void *userData, const XML_Char *s, int len)
 {
-	struct XMLstate **state = userData;
+	struct XMLparser *p = userData;
+	struct XMLstate *state = p->state;
 
-	if (!(*state)->text) {
-		(*state)->text = calloc(len + 1, 1);
+	if (p->skip)
+		return;
+
+	if (!state->text) {
+		state->text = calloc(len + 1, 1);
 	} else
-		(*state)->text = realloc((*state)->text, strlen((*state)->text) + len + 1);
+		state->text = realloc(state->text, strlen(state->text) + len + 1);
 
-	if (!(*state)->text)
+	if (!state->text)
 		return;
 
-	if (((*state)->flags & XML_ESCAPED) == XML_ESCAPED)
-		string_unescape((*state)->text, s, len);
+	if ((state->flags & XML_ESCAPED) == XML_ESCAPED)
+		string_unescape(state->text, s, len);
 	else
-		strncat((*state)->text, s, len);
-}
-
-static void handleElement(struct XMLstate *state)
-{
-	DM_RESULT res __attribute__ ((unused));
-
-	xml_debug("handling data: %s\n", state->text ? : "NOTHING");
-
-	res = dm_string2value(state->element, state->text, flags & DS_USERCONFIG, state->value);
-#ifdef XML_DEBUG
-	if (res != DM_OK)
-		xml_debug("dm_string2value returned %d (DM_RESULT)\n", res);
-#endif
+		strncat(state->text, s, len);
 }
 
 static void XMLCALL
 endElement(void *userData, const char *name __attribute__ ((unused)))
 {
-	struct XMLstate **state = userData;
+	struct XMLparser *p = userData;
+	struct XMLstate *state = p->state;
 
-	if (((*state)->flags & XML_ROOT) != XML_VALID) {
-		if (((*state)->flags & XML_VALID) == XML_VALID) {
-			handleElement(*state);
+	if (p->skip) {
+		p->skip--;
+		return;
+	}
 
-			if ((*state)->inst)
-				update_instance_node_index((*state)->node);
+	if ((state->flags & XML_ROOT) != XML_VALID) {
+		if ((state->flags & XML_VALID) == XML_VALID) {
+			struct XMLop *op;
+
+			if (!p->ops)
+				apply_end(state, p->flags, state->text);
+			else if ((op = ops_add(p->ops, OP_END))) {
+				/* the change list takes the text */
+				op->text = state->text;
+				state->text = NULL;
+			}
 		} else {
-			debug("handle invalid: %s = '%s'\n", (*state)->base, (*state)->text ? : "NOTHING");
+			debug("handle invalid: %s = '%s'\n", state->base, state->text ? : "NOTHING");
 		}
 	}
 
-	if (((*state)->flags & XML_UPGRADE) == XML_UPGRADE) {
+	if ((state->flags & XML_UPGRADE) == XML_UPGRADE) {
 		lua_pushinteger(lua_environment, CFG_VERSION);
 		lua_pushinteger(lua_environment, dm_get_cfg_version());
 		if (fp_Lua_function("fncPostVersionCheck", 2))
 			debug("(): Error during Lua function execution");
 	}
 
-	free((*state)->text);
-	free((*state)->base);
-	(*state)--;
+	free(state->text);
+	free(state->base);
+	p->state--;
 
-	xml_debug("exit: %s = %p\n", name, *state);
+	xml_debug("exit: %s = %p\n", name, state);
 }
 
-int dm_deserialize_store(FILE *stream, int _flags)
+static const struct dm_element root_element = {
+	.type = T_TOKEN,
+	.u.t = { .table = &dm_root, .max = 0 }
+};
+
+/* the value of the root element */
+static void root_value(DM_VALUE *value)
+{
+	if (!dm_value_store)
+		dm_value_store = dm_alloc_table(&dm_root, NULL, (dm_selector){ 0, }, 0);
+
+	set_DM_TABLE(*value, dm_value_store);
+	DM_parity_update(*value);
+}
+
+static int xml_parse(FILE *stream, struct XMLparser *p)
 {
 	char buf[BUFSIZ];
 	XML_Parser parser = XML_ParserCreate(NULL);
 	int done;
-	int old_flags;
 	int r = 0;
 
-	const struct dm_element element = { .type = T_TOKEN, .u.t = {.table = &dm_root, .max = 0 }};
-	DM_VALUE dm_value_root;
-
-	struct XMLstate stateStk[10] = { { .base = "", .flags = XML_ROOT },
-					 { .element = &element, .value = &dm_value_root, .base = NULL, .flags = XML_VALID } };
-	struct XMLstate *state = &stateStk[0];
-
-	old_flags = flags;
-	flags = _flags;
-
-	if (!dm_value_store)
-		dm_value_store = dm_alloc_table(&dm_root, (dm_selector){ 0, }, 0);
-
-	set_DM_TABLE(dm_value_root, dm_value_store);
-	DM_parity_update(dm_value_root);
-
-	XML_SetUserData(parser, &state);
+	XML_SetUserData(parser, p);
 	XML_SetElementHandler(parser, startElement, endElement);
 	XML_SetCharacterDataHandler(parser, charElement);
 
@@ -316,11 +494,127 @@ int dm_deserialize_store(FILE *stream, int _flags)
 		}
 	} while (!done);
 	XML_ParserFree(parser);
-	flags = old_flags;
 
 	return r;
 }
 
+/* JSON configs start with an object, XML ones with a tag */
+static int is_json(FILE *stream)
+{
+	int c;
+
+	do {
+		c = getc(stream);
+	} while (c == ' ' || c == '\t' || c == '\r' || c == '\n');
+	ungetc(c, stream);
+
+	return c == '{';
+}
+
+/* with ops set, the changes are recorded instead of applied */
+static int deserialize_stream(FILE *stream, int _flags, struct XMLops *ops)
+{
+	int r;
+
+	DM_VALUE dm_value_root;
+
+	struct XMLstate stateStk[XML_DEPTH] = { { .base = "", .flags = XML_ROOT },
+						{ .element = &root_element, .value = &dm_value_root, .base = NULL, .flags = XML_VALID } };
+	struct XMLparser p = {
+		.state = &stateStk[0],
+		.last = &stateStk[XML_DEPTH - 1],
+		.flags = _flags,
+		.ops = ops,
+	};
+
+	if (!ops)
+		root_value(&dm_value_root);
+
+	if (is_json(stream))
+		r = dm_json_parse(stream, &p, startElement, charElement, endElement);
+	else
+		r = xml_parse(stream, &p);
+
+	/* elements left open by a parse error */
+	for (; p.state > &stateStk[0]; p.state--) {
+		free(p.state->text);
+		free(p.state->base);
+	}
+
+	return r || p.overflow || (ops && ops->failed);
+}
+
+/* report the change list of a parsed file to v instead, elements left open by a parse error end without text */
+static void visit_ops(const struct XMLops *ops, const struct dm_deserialize_visitor *v)
+{
+	int depth = 0;
+
+	for (int i = 0; i < ops->cnt; i++) {
+		const struct XMLop *op = &ops->op[i];
+
+		switch (op->type) {
+		case OP_START:
+			v->start(v->data, op->kw, op->id, op->xid, op->ntfy);
+			depth++;
+			break;
+
+		case OP_END:
+			v->end(v->data, op->text);
+			depth--;
+			break;
+
+		case OP_DELETE:
+			v->del(v->data, op->kw, op->id, op->xid);
+			break;
+		}
+	}
+
+	for (; depth > 0; depth--)
+		v->end(v->data, NULL);
+}
+
+/* replay the change list of a parsed file on the store */
+static void apply_ops(const struct XMLops *ops, int flags)
+{
+	DM_VALUE dm_value_root;
+
+	struct XMLstate stateStk[XML_DEPTH] = { { .flags = XML_ROOT },
+						{ .element = &root_element, .value = &dm_value_root, .flags = XML_VALID } };
+	struct XMLstate *state = &stateStk[1];
+
+	root_value(&dm_value_root);
+
+	for (int i = 0; i < ops->cnt; i++) {
+		const struct XMLop *op = &ops->op[i];
+
+		switch (op->type) {
+		case OP_VERSION:
+			dm_set_cfg_version(op->xid);
+			break;
+
+		case OP_START:
+			state++;
+			memset(state, 0, sizeof(struct XMLstate));
+			apply_start(state - 1, state, flags, op->kw, op->id, op->xid, op->ntfy);
+			break;
+
+		case OP_END:
+			apply_end(state, flags, op->text);
+			state--;
+			break;
+
+		case OP_DELETE:
+			apply_delete(state, op->kw, op->id, op->xid);
+			break;
+		}
+	}
+}
+
+int dm_deserialize_store(FILE *stream, int _flags)
+{
+	return deserialize_stream(stream, _flags, NULL);
+}
+
 int dm_deserialize_file(const char *fname, int _flags)
 {
 	int r = 1;
@@ -336,10 +630,116 @@ int dm_deserialize_file(const char *fname, int _flags)
 	return r;
 }
 
-int dm_deserialize_directory(const char *dir, int _flags)
+/*
+ * parallel directory load
+ *
+ * The files of a directory are parsed into change lists by worker threads,
+ * the calling thread applies the lists in the order of the file names as
+ * soon as each one is ready, so the store ends up as with a sequential
+ * load while parsing runs on all CPUs.
+ */
+
+struct ds_file {
+	char fname[MAXPATHLEN];
+	struct XMLops ops;
+	int r;
+	int done;
+};
+
+struct ds_pool {
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+
+	struct ds_file *files;
+	int cnt;
+	int next;
+	int flags;
+};
+
+static void *ds_worker(void *arg)
+{
+	struct ds_pool *pool = arg;
+
+	for (;;) {
+		struct ds_file *file;
+		FILE *fin;
+
+		pthread_mutex_lock(&pool->lock);
+		file = pool->next < pool->cnt ? &pool->files[pool->next++] : NULL;
+		pthread_mutex_unlock(&pool->lock);
+
+		if (!file)
+			break;
+
+		debug("deserialize %s", file->fname);
+
+		file->r = 1;
+		if ((fin = fopen(file->fname, "r"))) {
+			file->r = deserialize_stream(fin, pool->flags, &file->ops);
+			fclose(fin);
+		}
+
+		pthread_mutex_lock(&pool->lock);
+		file->done = 1;
+		pthread_cond_broadcast(&pool->cond);
+		pthread_mutex_unlock(&pool->lock);
+	}
+
+	return NULL;
+}
+
+static int deserialize_parallel(struct ds_file *files, int cnt, int workers, int _flags,
+				const struct dm_deserialize_visitor *v)
+{
+	struct ds_pool pool = {
+		.lock = PTHREAD_MUTEX_INITIALIZER,
+		.cond = PTHREAD_COND_INITIALIZER,
+		.files = files,
+		.cnt = cnt,
+		.flags = _flags,
+	};
+	pthread_t threads[DS_MAX_WORKERS];
+	int started = 0;
+	int r = 0;
+
+	while (started < workers &&
+	       pthread_create(&threads[started], NULL, ds_worker, &pool) == 0)
+		started++;
+
+	/* no thread, parse everything here first */
+	if (!started)
+		ds_worker(&pool);
+
+	for (int i = 0; i < cnt; i++) {
+		pthread_mutex_lock(&pool.lock);
+		while (!files[i].done)
+			pthread_cond_wait(&pool.cond, &pool.lock);
+		pthread_mutex_unlock(&pool.lock);
+
+		/* a file with a parse error is applied up to the error, like a sequential load */
+		if (v)
+			visit_ops(&files[i].ops, v);
+		else
+			apply_ops(&files[i].ops, _flags);
+		ops_free(&files[i].ops);
+		r |= files[i].r;
+	}
+
+	for (int i = 0; i < started; i++)
+		pthread_join(threads[i], NULL);
+
+	pthread_mutex_destroy(&pool.lock);
+	pthread_cond_destroy(&pool.cond);
+
+	return r;
+}
+
+static int deserialize_directory(const char *dir, int _flags, const struct dm_deserialize_visitor *v)
 {
 	struct dirent **namelist;
-	int n;
+	struct ds_file *files = NULL;
+	int workers = dm_deserialize_workers;
+	int n, cnt = 0;
 	int r = 0;
 
 	n = scandir(dir, &namelist, 0, alphasort);
@@ -350,16 +750,46 @@ int dm_deserialize_directory(const char *dir, int _flags)
 		return 1;
 	}
 
+	if (workers <= 0)
+		workers = sysconf(_SC_NPROCESSORS_ONLN);
+	if (workers > DS_MAX_WORKERS)
+		workers = DS_MAX_WORKERS;
+
+	/* the version check runs Lua hooks while parsing, that has to stay on this thread */
+	if (v || (n > 1 && workers > 1 && !(_flags & DS_VERSIONCHECK)))
+		if (!(files = calloc(n, sizeof(struct ds_file))) && v)
+			r = 1;
+
 	for (int i = 0; i < n; i++) {
 		if (namelist[i]->d_name[0] != '.') {
 			char fname[MAXPATHLEN];
 
 			snprintf(fname, sizeof(fname), "%s/%s", dir, namelist[i]->d_name);
-			r |= dm_deserialize_file(fname, _flags);
+			if (files)
+				strcpy(files[cnt++].fname, fname);
+			else if (!v)
+				r |= dm_deserialize_file(fname, _flags);
 		}
 		free(namelist[i]);
 	}
 	free(namelist);
 
+	if (files) {
+		if (workers > cnt)
+			workers = cnt;
+		r |= deserialize_parallel(files, cnt, workers, _flags, v);
+		free(files);
+	}
+
 	return r;
 }
+
+int dm_deserialize_directory(const char *dir, int _flags)
+{
+	return deserialize_directory(dir, _flags, NULL);
+}
+
+int dm_deserialize_directory_visit(const char *dir, const struct dm_deserialize_visitor *v)
+{
+	return deserialize_directory(dir, 0, v);
+}
@@ -16,8 +16,27 @@ extern struct dm_enum notify_attr;
 #define DS_USERCONFIG   (1 << 1)
 #define DS_VERSIONCHECK (1 << 2)
 
+/* threads parsing the files of a directory, 0: one per CPU, 1: parse sequentially */
+extern int dm_deserialize_workers;
+
 int dm_deserialize_store(FILE *, int);
 int dm_deserialize_file(const char *, int);
 int dm_deserialize_directory(const char *, int);
 
+/*
+ * parse the files of a directory without touching the store
+ *
+ * The elements are reported in file order instead: start and end nest like
+ * the elements of the files, text is the content of the element, del is an
+ * instance a differential config removes.
+ */
+struct dm_deserialize_visitor {
+	void (*start)(void *data, const struct dm_element *kw, dm_id id, int xid, int ntfy);
+	void (*end)(void *data, const char *text);
+	void (*del)(void *data, const struct dm_element *kw, dm_id id, int xid);
+	void *data;
+};
+
+int dm_deserialize_directory_visit(const char *dir, const struct dm_deserialize_visitor *v);
+
 #endif /* __DM_DESERIALIZE_H */
@@ -60,6 +60,7 @@
 #include "dmd.h"
 #include "dm_token.h"
 #include "dm_store.h"
+#include "dm_store_priv.h"
 #include "dm_index.h"
 #include "dm_cache.h"
 #include "dm_serialize.h"
@@ -83,7 +84,7 @@
 #define dm_EXIT(sid) dm_debug(sid, "%s, %d", "exit", __LINE__)
 
 int libdmconfigSocketType;
-uint32_t cfg_session_id;
+unsigned int cfg_session_cnt;
 
 static DMCONTEXT *accept_socket;
 
@@ -94,6 +95,61 @@ static uint32_t session_counter;
 static uint32_t req_hopid;
 static uint32_t req_endid;
 
+static void dump_free(SOCKCONTEXT *ctx);
+
+/*
+ * a db save is answered once the config is on disk, the config is written
+ * by a forked child (see dm_save_async()) so the loop keeps serving requests,
+ * or on the loop when mand runs other threads
+ */
+struct save_request {
+	TAILQ_ENTRY(save_request) list;
+
+	SOCKCONTEXT *ctx;
+	DMC_REQUEST req;
+};
+
+/*
+ * commit pipeline
+ *
+ * a commit validates and applies the write cache and answers right away,
+ * the action and notification stages of that commit run from the next
+ * loop iteration. commit_flush() runs them synchronously, it is called
+ * before anything else changes the store, so the actions of a commit
+ * always run before the next commit is validated and applied
+ */
+static struct ev_loop *commit_loop;
+static ev_timer commit_stage_ev;
+static int commit_stage_pending = 0;
+
+static void
+commit_flush(void)
+{
+	if (!commit_stage_pending)
+		return;
+
+	commit_stage_pending = 0;
+	ev_timer_stop(commit_loop, &commit_stage_ev);
+
+	exec_actions();
+	exec_pending_notifications();
+}
+
+static void
+commitStageEvent(struct ev_loop *loop __attribute__((unused)), ev_timer *w __attribute__((unused)),
+		 int revents __attribute__((unused)))
+{
+	commit_flush();
+}
+
+static void
+commit_defer_stages(void)
+{
+	commit_stage_pending = 1;
+	ev_timer_set(&commit_stage_ev, 0., 0.);
+	ev_timer_start(commit_loop, &commit_stage_ev);
+}
+
 void
 end_session(SOCKCONTEXT *ctx)
 {
@@ -105,14 +161,25 @@ end_session(SOCKCONTEXT *ctx)
 	if (ctx->notify_slot)
 		free_slot(ctx->notify_slot);
 
-	if (cfg_session_id == ctx->id) {
-		cfg_session_id = 0;
-		cache_reset();
+	if (ctx->flags & CMD_FLAG_CONFIGURE) {
+		cfg_session_cnt--;
+		cache_free(&ctx->cache);
+	}
+
+	/* nobody left to answer */
+	while (!TAILQ_EMPTY(&ctx->saves)) {
+		struct save_request *sr = TAILQ_FIRST(&ctx->saves);
+
+		TAILQ_REMOVE(&ctx->saves, sr, list);
+		dm_save_cancel(sr);
 	}
 
+	dump_free(ctx);
+
 	TAILQ_REMOVE(&socket_head, ctx, list);
 	talloc_free(ctx);
 
+	commit_flush();
 	exec_actions_pre();
 	exec_actions();
 	exec_pending_notifications();
@@ -155,6 +222,8 @@ accept_cb(DMCONFIG_EVENT event, DMCONTEXT *socket, void *userdata)
 	ev_timer_init(&ctx->session_timer_ev, sessionTimeoutEvent, 0., 0.);
 	ctx->session_timer_ev.data = ctx;
 
+	TAILQ_INIT(&ctx->saves);
+
 	/* ev_timer_start(socket->ev, &ctx->session_timer_ev); */
 
 	TAILQ_INSERT_TAIL(&socket_head, ctx, list);
@@ -182,12 +251,19 @@ request_cb(DMCONTEXT *socket, DM_PACKET *pkt, DM2_AVPGRP *grp, void *userdata)
 	if (ev_is_active(&ctx->session_timer_ev))
 		ev_timer_again(socket->ev, &ctx->session_timer_ev);
 
+	ctx->req = &req;
+	ctx->answer_deferred = 0;
+
 	if ((rpc_dmconfig_switch(ctx, &req, grp, &answer)) == RC_ERR_ALLOC) {
 		shutdown_session(ctx);
 		return;
 	}
 
-	if (answer)
+	ctx->req = NULL;
+
+	if (ctx->answer_deferred)
+		talloc_free(answer);
+	else if (answer)
 		dm_enqueue(socket, answer, REPLY, NULL, NULL);
 }
 
@@ -203,6 +279,9 @@ init_libdmconfig_server(struct ev_loop *base)
 		return RC_ERR_ALLOC;
 	dm_context_init(accept_socket, base, libdmconfigSocketType, NULL, accept_cb, request_cb);
 
+	commit_loop = base;
+	ev_timer_init(&commit_stage_ev, commitStageEvent, 0., 0.);
+
 	/* initiate session counter & hop2hop/end2end ids (random value between 1 and MAX_INT) */
 	srand((unsigned int)time(NULL));
 	session_counter = 1;
@@ -773,11 +852,9 @@ dmconfig_set_cb(void *data, const dm_selector sel,
 	if ((r = dmconfig_avp2value(value, elem, &new_value)) != DM_OK)
 		return r;
 
-	if (ctx->flags & CMD_FLAG_CONFIGURE) {
-		st->flags |= DV_UPDATE_PENDING;
-		DM_parity_update(*st);
-		cache_add(sel, "", elem, base, st, new_value, 0, NULL);
-	} else {
+	if (ctx->flags & CMD_FLAG_CONFIGURE)
+		cache_add(&ctx->cache, sel, "", elem, base, st, new_value, 0, NULL);
+	else {
 		new_value.flags |= DV_UPDATED;
 		DM_parity_update(new_value);
 		r = dm_overwrite_any_value_by_selector(sel, elem->type, new_value, ctx->notify_slot ? : -1);
@@ -924,59 +1001,154 @@ dmconfig_retrieve_enums_cb(void *data,
 	return DM_OK;
 }
 
-/* Note: this kind of encoding should normally got into dm_dmclient_rpc_stub
+/* check whether sel lies below the instance selector base of length len */
+static inline int
+sel_is_below(const dm_selector base, size_t len, const dm_selector sel)
+{
+	return len < DM_SELECTOR_LEN && sel[len] != 0 && dm_selcmp(base, sel, len) == 0;
+}
+
+/* add the location of a notification event
+ *
+ * by default as dotted name string, or as raw selector ids (uint16, network
+ * order) when the subscriber negotiated NOTIFY_FLAG_SELECTOR. The first skip
+ * components of the selector are omitted, a relative name is send as AVP_NAME.
  */
 static uint32_t
-build_notify_events(struct notify_queue *queue, int level, DM2_REQUEST *notify)
+add_notify_path(DM2_REQUEST *req, uint32_t flags, const dm_selector sel, size_t skip)
 {
-	uint32_t rc;
+	char buffer[MAX_PARAM_NAME_LEN];
+	char *path;
+
+	if (flags & NOTIFY_FLAG_SELECTOR) {
+		uint16_t ids[DM_SELECTOR_LEN];
+		size_t len = dm_sellen(sel);
+
+		for (size_t i = skip; i < len; i++)
+			ids[i - skip] = htons(sel[i]);
+
+		return dm_add_raw(req, AVP_SELECTOR, VP_TRAVELPING, ids, (len - skip) * sizeof(uint16_t));
+	}
+
+	if (!(path = dm_sel2name(sel, buffer, sizeof(buffer))))
+		return RC_ERR_ALLOC;
+
+	if (!skip)
+		return dm_add_string(req, AVP_PATH, VP_TRAVELPING, path);
+
+	for (; skip && path; skip--)
+		if ((path = strchr(path, '.')))
+			path++;
+	if (!path)
+		return RC_ERR_MISC;
+
+	return dm_add_string(req, AVP_NAME, VP_TRAVELPING, path);
+}
+
+/* fold the pending value changes below a new instance into its creation event
+ *
+ * descendants sort directly behind the instance in the queue tree, each of them
+ * is encoded as a group of name (relative to the instance), type and value
+ */
+static uint32_t
+build_instance_values(struct notify_queue *queue, struct notify_item *inst, uint32_t flags, DM2_REQUEST *notify)
+{
+	size_t len = dm_sellen(inst->sb);
 	struct notify_item *next;
+	uint32_t rc;
 
-	for (struct notify_item *item = RB_MIN(notify_queue, queue); item; item = next) {
-		char buffer[MAX_PARAM_NAME_LEN];
-		char *path;
+	for (struct notify_item *item = RB_NEXT(notify_tree, &queue->tree, inst);
+	     item && sel_is_below(inst->sb, len, item->sb); item = next) {
+		struct dm_element *elem;
 
-		next = RB_NEXT(notify_queue, queue, item);
+		next = RB_NEXT(notify_tree, &queue->tree, item);
 
-		if (item->level != level)
+		if (item->level != inst->level || item->type != NOTIFY_CHANGE)
 			continue;
 
-		/* active notification */
+		if (dm_get_element_by_selector(item->sb, &elem) == T_NONE)
+			return RC_ERR_MISC;
 
-		if (!(path = dm_sel2name(item->sb, buffer, sizeof(buffer))))
-			return RC_ERR_ALLOC;
+		if ((rc = dm_add_object(notify)) != RC_OK
+		    || (rc = add_notify_path(notify, flags, item->sb, len)) != RC_OK
+		    || (rc = dm_add_uint32(notify, AVP_TYPE, VP_TRAVELPING, avp_type_map(elem->type))) != RC_OK
+		    || (rc = dm_add_avp(notify, elem, T_ELEMENT, item->value)) != RC_OK
+		    || (rc = dm_finalize_group(notify)) != RC_OK)
+			return rc;
+
+		notify_release(queue, item);
+	}
+
+	return RC_OK;
+}
+
+/* pending events below a deleted instance are covered by the delete event */
+static void
+drop_instance_events(struct notify_queue *queue, struct notify_item *inst)
+{
+	size_t len = dm_sellen(inst->sb);
+	struct notify_item *next;
+
+	for (struct notify_item *item = RB_NEXT(notify_tree, &queue->tree, inst);
+	     item && sel_is_below(inst->sb, len, item->sb); item = next) {
+		next = RB_NEXT(notify_tree, &queue->tree, item);
+
+		if (item->level == inst->level)
+			notify_release(queue, item);
+	}
+}
+
+/* Note: this kind of encoding should normally got into dm_dmclient_rpc_stub
+ *
+ * drains up to max (0 = all) events of the given level from the queue,
+ * events of the other level are not touched
+ */
+static uint32_t
+build_notify_events(struct notify_queue *queue, int level, uint32_t max, uint32_t flags, DM2_REQUEST *notify)
+{
+	uint32_t rc;
+	struct notify_list *list = notify_level_list(queue, level);
+	struct notify_item *item;
+
+	for (uint32_t cnt = 0; (!max || cnt < max) && (item = TAILQ_FIRST(list)); cnt++) {
+#if defined(SDEBUG) && !defined(NDEBUG)
+		char b1[MAX_PARAM_NAME_LEN];
+#endif
 
 		if ((rc = dm_add_object(notify) != RC_OK))
 			return rc;
 
 		switch (item->type) {
 		case NOTIFY_ADD:
-			debug(": instance added: %s", path);
+			debug(": instance added: %s", sel2str(b1, item->sb));
 
 			if (((rc = dm_add_uint32(notify, AVP_NOTIFY_TYPE, VP_TRAVELPING, NOTIFY_INSTANCE_CREATED)) != RC_OK)
-			    || (rc = dm_add_string(notify, AVP_PATH, VP_TRAVELPING, path)) != RC_OK)
+			    || (rc = add_notify_path(notify, flags, item->sb, 0)) != RC_OK
+			    || (rc = build_instance_values(queue, item, flags, notify)) != RC_OK)
 				return rc;
 			break;
 
 		case NOTIFY_DEL:
-			debug(": instance removed: %s", path);
+			debug(": instance removed: %s", sel2str(b1, item->sb));
 
 			if ((rc = dm_add_uint32(notify, AVP_NOTIFY_TYPE, VP_TRAVELPING, NOTIFY_INSTANCE_DELETED)) != RC_OK
-			    || (rc = dm_add_string(notify, AVP_PATH, VP_TRAVELPING, path)) != RC_OK)
+			    || (rc = add_notify_path(notify, flags, item->sb, 0)) != RC_OK)
 				return rc;
+
+			drop_instance_events(queue, item);
 			break;
 
 		case NOTIFY_CHANGE: {
 			struct dm_element *elem;
 
-			debug(": parameter changed: %s", path);
+			debug(": parameter changed: %s", sel2str(b1, item->sb));
 
 			if (dm_get_element_by_selector(item->sb, &elem) == T_NONE)
 				/* this should never, ever, ever happen....*/
 				return RC_ERR_MISC;
 
 			if ((rc = dm_add_uint32(notify, AVP_NOTIFY_TYPE, VP_TRAVELPING, NOTIFY_PARAMETER_CHANGED)) != RC_OK
-			    || (rc = dm_add_string(notify, AVP_PATH, VP_TRAVELPING, path)) != RC_OK
+			    || (rc = add_notify_path(notify, flags, item->sb, 0)) != RC_OK
 			    || (rc = dm_add_uint32(notify, AVP_TYPE, VP_TRAVELPING, avp_type_map(elem->type))) != RC_OK
 			    || (rc = dm_add_avp(notify, elem, T_ELEMENT, item->value)) != RC_OK)
 				return rc;
@@ -986,8 +1158,45 @@ build_notify_events(struct notify_queue *queue, int level, DM2_REQUEST *notify)
 		if ((rc = dm_finalize_group(notify)) != RC_OK)
 			return rc;
 
-		RB_REMOVE(notify_queue, queue, item);
-		free(item);
+		notify_release(queue, item);
+	}
+
+	return RC_OK;
+}
+
+/* add the schema below kw, ids are the selector ids used in notifications */
+static uint32_t
+build_schema_map(const struct dm_table *kw, DM2_REQUEST *answer)
+{
+	uint32_t rc;
+
+	for (int i = 0; i < kw->size; i++) {
+		const struct dm_element *elem = &kw->table[i];
+		uint32_t code;
+
+		if (!elem->key)
+			continue;
+
+		switch (elem->type) {
+		case T_TOKEN:	code = AVP_OBJECT; break;
+		case T_OBJECT:	code = AVP_TABLE; break;
+		default:	code = AVP_ELEMENT; break;
+		}
+
+		if ((rc = dm_new_group(answer, code, VP_TRAVELPING)) != RC_OK
+		    || (rc = dm_add_uint16(answer, AVP_UINT16, VP_TRAVELPING, i + 1)) != RC_OK
+		    || (rc = dm_add_string(answer, AVP_NAME, VP_TRAVELPING, elem->key)) != RC_OK)
+			return rc;
+
+		if (code == AVP_ELEMENT)
+			rc = dm_add_uint32(answer, AVP_TYPE, VP_TRAVELPING, avp_type_map(elem->type));
+		else
+			rc = build_schema_map(elem->u.t.table, answer);
+		if (rc != RC_OK)
+			return rc;
+
+		if ((rc = dm_finalize_group(answer)) != RC_OK)
+			return rc;
 	}
 
 	return RC_OK;
@@ -1004,6 +1213,23 @@ static SOCKCONTEXT *find_role(const char *role)
 	return srch;
 }
 
+/* the last encoded active notification packet
+ *
+ * subscribers that get an identical set of events in the same notification
+ * round (same subtree subscriptions, same encoding flags) reuse the packet,
+ * it is referenced by every socket it is queued on instead of being encoded
+ * and copied once per subscriber. The first of them finds the others by
+ * comparing the pending queues, a subscriber without peers encodes its
+ * events directly.
+ */
+static struct {
+	void *ctx;
+	unsigned int round;
+	uint32_t flags;
+	uint16_t peers;			/* slots the packet is for */
+	DM2_REQUEST *req;
+} shared_notify;
+
 /* Note: this kind of encoding should normally got into dm_dmclient_rpc_stub
  */
 static void
@@ -1011,13 +1237,46 @@ dmconfig_notify_cb(void *data, struct notify_queue *queue)
 {
 	SOCKCONTEXT *ctx = data;
 	DM2_REQUEST *req;
+	uint16_t peers;
 
-	if (!(req = dm_new_request(ctx, CMD_CLIENT_ACTIVE_NOTIFY, CMD_FLAG_REQUEST, 0, 0))
-	    || build_notify_events(queue, ACTIVE_NOTIFY, req) != RC_OK
+	if (TAILQ_EMPTY(&queue->active))
+		/* only passive notifications pending */
+		return;
+
+	if (shared_notify.req
+	    && shared_notify.round == get_notify_round()
+	    && shared_notify.flags == ctx->notify_flags
+	    && (shared_notify.peers & (1 << get_notify_slot()))) {
+		clear_notify_level(queue, ACTIVE_NOTIFY);
+		dm_enqueue(ctx->socket, shared_notify.req, ONE_WAY | SHARED, NULL, NULL);
+		return;
+	}
+
+	if (!(peers = get_notify_peers(queue))) {
+		/* no sharing possible, encode for this subscriber only */
+		if (!(req = dm_new_request(ctx, CMD_CLIENT_ACTIVE_NOTIFY, CMD_FLAG_REQUEST, 0, 0))
+		    || build_notify_events(queue, ACTIVE_NOTIFY, 0, ctx->notify_flags, req) != RC_OK
+		    || dm_finalize_packet(req) != RC_OK)
+			return;
+
+		dm_enqueue(ctx->socket, req, ONE_WAY, NULL, NULL);
+		return;
+	}
+
+	talloc_free(shared_notify.ctx);
+	memset(&shared_notify, 0, sizeof(shared_notify));
+
+	if (!(shared_notify.ctx = talloc_new(NULL))
+	    || !(req = dm_new_request(shared_notify.ctx, CMD_CLIENT_ACTIVE_NOTIFY, CMD_FLAG_REQUEST, 0, 0))
+	    || build_notify_events(queue, ACTIVE_NOTIFY, 0, ctx->notify_flags, req) != RC_OK
 	    || dm_finalize_packet(req) != RC_OK)
 		return;
 
-	dm_enqueue(ctx->socket, req, ONE_WAY, NULL, NULL);
+	shared_notify.round = get_notify_round();
+	shared_notify.flags = ctx->notify_flags;
+	shared_notify.peers = peers;
+	shared_notify.req = req;
+	dm_enqueue(ctx->socket, req, ONE_WAY | SHARED, NULL, NULL);
 }
 
 /*
@@ -1033,11 +1292,8 @@ rpc_startsession(void *data, uint32_t flags, int32_t timeout, DM2_REQUEST *answe
 		return RC_ERR_INVALID_SESSIONID;
 
 	if (flags & CMD_FLAG_CONFIGURE) {
-		if (cfg_session_id)
-			/* there is already an active config session */
-			return RC_ERR_CANNOT_OPEN_CFGSESSION;
-
-		cfg_session_id = session_counter;
+		cache_init(&ctx->cache);
+		cfg_session_cnt++;
 	}
 
 	/* start the session */
@@ -1065,17 +1321,14 @@ rpc_switchsession(void *data, uint32_t flags, int32_t timeout, DM2_REQUEST *answ
 	if (!ctx->id)
 		return RC_ERR_INVALID_SESSIONID;
 
-	if (flags & CMD_FLAG_CONFIGURE) {
-		if (cfg_session_id && cfg_session_id != ctx->id)
-			/* there is already an active config session */
-			return RC_ERR_CANNOT_OPEN_CFGSESSION;
-
-		cfg_session_id = ctx->id;
+	if ((flags & CMD_FLAG_CONFIGURE) && !(ctx->flags & CMD_FLAG_CONFIGURE)) {
+		cache_init(&ctx->cache);
+		cfg_session_cnt++;
 		dm_debug(ctx->id, "CMD: SWITCH SESSION (r/w to cfg)");
 	}
-	else if (cfg_session_id == ctx->id) {
-		cfg_session_id = 0;
-		cache_reset();
+	else if (!(flags & CMD_FLAG_CONFIGURE) && (ctx->flags & CMD_FLAG_CONFIGURE)) {
+		cfg_session_cnt--;
+		cache_free(&ctx->cache);
 		dm_debug(ctx->id, "CMD: SWITCH SESSION (cfg to r/w)");
 	}
 
@@ -1122,15 +1375,16 @@ rpc_cfgsessioninfo(void *data __attribute__((unused)), DM2_REQUEST *answer)
 
 	dm_debug(ctx->id, "CMD: %s... ", "GET CONFIGURE SESSION INFO");
 
+	/* report the oldest of the open configure sessions */
 	TAILQ_FOREACH(srch, &socket_head, list)
-		if (srch->id == cfg_session_id)
+		if (srch->id && (srch->flags & CMD_FLAG_CONFIGURE))
 			break;
 
 	if (!srch)
 		return RC_ERR_INVALID_SESSIONID;
 
 
-	if ((rc = dm_add_uint32(answer, AVP_SESSIONID, VP_TRAVELPING, cfg_session_id)) != RC_OK
+	if ((rc = dm_add_uint32(answer, AVP_SESSIONID, VP_TRAVELPING, srch->id)) != RC_OK
 	    || (rc = dm_add_uint32(answer, AVP_UINT32, VP_TRAVELPING, srch->flags)) != RC_OK)
 		return rc;
 
@@ -1138,18 +1392,47 @@ rpc_cfgsessioninfo(void *data __attribute__((unused)), DM2_REQUEST *answer)
 }
 
 uint32_t
-rpc_subscribe_notify(void *data, DM2_REQUEST *answer __attribute__((unused)))
+rpc_subscribe_notify(void *data, uint32_t flags, DM2_REQUEST *answer __attribute__((unused)))
 {
 	SOCKCONTEXT *ctx = data;
 
-	dm_debug(ctx->id, "CMD: %s... ", "SUBSCRIBE NOTIFY");
+	dm_debug(ctx->id, "CMD: %s (flags: %08x)... ", "SUBSCRIBE NOTIFY", flags);
 
 	if (ctx->notify_slot || (ctx->notify_slot = alloc_slot(dmconfig_notify_cb, ctx)) == -1)
 		return RC_ERR_CANNOT_SUBSCRIBE_NOTIFY;
 
+	ctx->notify_flags = flags;
+
 	return RC_OK;
 }
 
+uint32_t
+rpc_get_schema_map(void *data, dm_selector path, DM2_REQUEST *answer)
+{
+	SOCKCONTEXT *ctx = data;
+	const struct dm_table *kw = &dm_root;
+	char b1[128];
+
+	dm_debug(ctx->id, "CMD: %s \"%s\"", "GET SCHEMA MAP", sel2str(b1, path));
+
+	if (path[0]) {
+		struct dm_element *elem;
+
+		switch (dm_get_element_by_selector(path, &elem)) {
+		case T_TOKEN:
+		case T_OBJECT:
+			kw = elem->u.t.table;
+			break;
+		case T_NONE:
+			return RC_ERR_VALUE_NOT_FOUND;
+		default:
+			return RC_ERR_MISC;
+		}
+	}
+
+	return build_schema_map(kw, answer);
+}
+
 uint32_t
 rpc_unsubscribe_notify(void *data, DM2_REQUEST *answer __attribute__((unused)))
 {
@@ -1207,18 +1490,77 @@ rpc_recursive_param_notify(void *data, uint32_t notify, dm_selector path, DM2_RE
 }
 
 uint32_t
-rpc_get_passive_notifications(void *data, DM2_REQUEST *answer)
+rpc_param_notify_filter(void *data, dm_selector path, uint32_t predicate, struct dm2_avp *operand,
+			DM2_REQUEST *answer __attribute__((unused)))
+{
+	SOCKCONTEXT *ctx = data;
+	struct dm_element *elem;
+	DM_VALUE value;
+	DM_RESULT r;
+	char b1[128];
+
+	dm_debug(ctx->id, "CMD: %s \"%s\" (predicate: %u)... ", "PARAM NOTIFY FILTER", sel2str(b1, path), predicate);
+
+	if (!ctx->notify_slot)
+		return RC_ERR_REQUIRES_NOTIFY;
+
+	memset(&value, 0, sizeof(DM_VALUE));
+
+	switch (predicate) {
+	case NOTIFY_PREDICATE_NONE:
+		r = dm_set_notify_filter_by_selector(path, ctx->notify_slot, PREDICATE_NONE, value);
+		break;
+
+	case NOTIFY_PREDICATE_EQUALS:
+	case NOTIFY_PREDICATE_NOT_EQUALS:
+	case NOTIFY_PREDICATE_CROSSES:
+	case NOTIFY_PREDICATE_DELTA:
+		if (!operand)
+			return RC_ERR_AVP_MISFORMED;
+
+		if (dm_get_element_by_selector(path, &elem) == T_NONE)
+			return RC_ERR_VALUE_NOT_FOUND;
+
+		if ((r = dmconfig_avp2value(operand, elem, &value)) != DM_OK)
+			break;
+
+		/* predicate enums map 1:1 to enum notify_predicate */
+		if ((r = dm_set_notify_filter_by_selector(path, ctx->notify_slot, predicate, value)) != DM_OK)
+			dm_free_any_value(elem, &value);
+		break;
+
+	default:
+		return RC_ERR_MISC;
+	}
+
+	switch (r) {
+	case DM_OK:
+		return RC_OK;
+	case DM_OOM:
+		return RC_ERR_ALLOC;
+	case DM_VALUE_NOT_FOUND:
+		return RC_ERR_VALUE_NOT_FOUND;
+	case DM_INVALID_TYPE:
+	case DM_INVALID_VALUE:
+		return RC_ERR_INVALID_AVP_TYPE;
+	default:
+		return RC_ERR_MISC;
+	}
+}
+
+uint32_t
+rpc_get_passive_notifications(void *data, uint32_t max, DM2_REQUEST *answer)
 {
 	SOCKCONTEXT *ctx = data;
 	struct notify_queue *queue;
 
-	dm_debug(ctx->id, "CMD: %s... ", "GET PASSIVE NOTIFICATIONS");
+	dm_debug(ctx->id, "CMD: %s (max: %u)... ", "GET PASSIVE NOTIFICATIONS", max);
 
 	if (!ctx->notify_slot)
 		return RC_ERR_REQUIRES_NOTIFY;
 
 	queue = get_notify_queue(ctx->notify_slot);
-	return build_notify_events(queue, PASSIVE_NOTIFY, answer);
+	return build_notify_events(queue, PASSIVE_NOTIFY, max, ctx->notify_flags, answer);
 }
 
 uint32_t
@@ -1232,6 +1574,8 @@ rpc_db_addinstance(void *data __attribute__((unused)), dm_selector path, dm_id i
 	dm_debug(ctx->id, "CMD: %s \"%s\"", "DB ADD INSTANCE", sel2str(b1, path));
 	dm_debug(ctx->id, "CMD: %s id = 0x%hX", "DB ADD INSTANCE", id);
 
+	commit_flush();
+
 	if (!dm_add_instance_by_selector(path, &id))
 		return RC_ERR_MISC;
 
@@ -1250,92 +1594,276 @@ rpc_db_delinstance(void *data __attribute__((unused)), dm_selector path, DM2_REQ
 	/* improvised: check whether this is a table */
 	dm_debug(ctx->id, "CMD: %s \"%s\"", "DB DELETE INSTANCE", sel2str(b1, path));
 
+	commit_flush();
+
 	if (!dm_del_table_by_selector(path))
 		return RC_ERR_MISC;
 
 	return RC_OK;
 }
 
-uint32_t
-rpc_db_set(void *data, int pvcnt, struct rpc_db_set_path_value *values, DM2_REQUEST *answer __attribute__((unused)))
+static uint32_t
+dmconfig_set_rc(int rc)
 {
-	SOCKCONTEXT *ctx = data;
-	int i, rc;
-
-	dm_debug(ctx->id, "CMD: %s", "DB SET");
-
-	for (i = 0; i < pvcnt; i++) {
-		rc = dm_get_value_ref_by_selector_cb(values[i].path, &values[i].value, ctx, dmconfig_set_cb);
-		switch (rc) {
-		case RC_OK:
-			continue;
+	switch (rc) {
+	case RC_OK:
+		return RC_OK;
 
-		case DM_OOM:
-			return RC_ERR_ALLOC;
+	case DM_OOM:
+		return RC_ERR_ALLOC;
 
-		case DM_INVALID_VALUE:
-		case DM_INVALID_TYPE:
-			return RC_ERR_INVALID_AVP_TYPE;
+	case DM_INVALID_VALUE:
+	case DM_INVALID_TYPE:
+		return RC_ERR_INVALID_AVP_TYPE;
 
-		case DM_VALUE_NOT_FOUND:
-			return RC_ERR_VALUE_NOT_FOUND;
+	case DM_VALUE_NOT_FOUND:
+		return RC_ERR_VALUE_NOT_FOUND;
 
-		case 0x8000 ... 0x8FFF:
-			return rc;
+	case 0x8000 ... 0x8FFF:
+		return rc;
 
-		default:
-			return RC_ERR_MISC;
-		}
+	default:
+		return RC_ERR_MISC;
 	}
-
-	return RC_OK;
 }
 
 uint32_t
-rpc_db_get(void *data, int pcnt, dm_selector *values, DM2_REQUEST *answer)
+rpc_db_set(void *data, int pvcnt, struct rpc_db_set_path_value *values, DM2_REQUEST *answer __attribute__((unused)))
 {
-	uint32_t rc;
 	SOCKCONTEXT *ctx = data;
-	GET_BY_SELECTOR_CB get_value;
+	uint32_t rc;
 	int i;
 
-	get_value = cfg_session_id && ctx->id == cfg_session_id ? dm_cache_get_value_by_selector_cb : dm_get_value_by_selector_cb;
+	dm_debug(ctx->id, "CMD: %s", "DB SET");
 
-	for (i = 0; i < pcnt; i++) {
-		char b1[128];
+	/* outside of a configure session the values go straight to the store */
+	if (!(ctx->flags & CMD_FLAG_CONFIGURE))
+		commit_flush();
 
-		dm_debug(ctx->id, "CMD: %s \"%s\"", "DB GET", sel2str(b1, values[i]));
+	for (i = 0; i < pvcnt; i++)
+		if ((rc = dmconfig_set_rc(dm_get_value_ref_by_selector_cb(values[i].path, &values[i].value, ctx, dmconfig_set_cb))) != RC_OK)
+			return rc;
 
-		rc = get_value(values[i], T_ANY, answer, dmconfig_get_cb);
-		switch (rc) {
-		case RC_OK:
-			continue;
+	return RC_OK;
+}
 
-		case DM_OOM:
-			return RC_ERR_ALLOC;
+/*
+ * columnar write to the instances of one table, the table and the column
+ * names are resolved once, each cell goes through dmconfig_set_cb()
+ *
+ * *created is set when the row created its instance
+ */
+static uint32_t
+dmconfig_bulk_set_row(SOCKCONTEXT *ctx, const dm_selector path, struct dm_element_ref *ref, uint8_t create,
+		      int ccnt, const dm_id *cols, DM2_AVPGRP *row, dm_id *instance, int *created)
+{
+	const struct dm_table *kw = ref->kw_elem->u.t.table;
+	struct dm_instance_node *node = NULL;
+	struct dm_value_table *base;
+	dm_selector sel;
+	dm_id id;
+	uint32_t rc;
+	int len;
 
-		case DM_INVALID_VALUE:
-		case DM_INVALID_TYPE:
-			return RC_ERR_INVALID_AVP_TYPE;
+	*created = 0;
 
-		case DM_VALUE_NOT_FOUND:
+	if ((rc = dm_expect_uint16_type(row, AVP_UINT16, VP_TRAVELPING, &id)) != RC_OK)
+		return rc;
+
+	if (id & DM_ID_MASK)
+		node = dm_get_instance_node_by_id(DM_INSTANCE(*ref->st_value), id);
+	if (!node) {
+		if (!create)
 			return RC_ERR_VALUE_NOT_FOUND;
+		if (!(node = dm_add_instance_by_selector(path, &id)))
+			return RC_ERR_MISC;
+		*created = 1;
+	}
+	base = DM_TABLE(node->table);
+	*instance = node->instance;
+
+	dm_selcpy(sel, path);
+	dm_selcat(sel, node->instance);
+	for (len = 0; len < DM_SELECTOR_LEN && sel[len]; len++)
+		;
+	if (len >= DM_SELECTOR_LEN - 1)
+		return RC_ERR_MISC;
 
-		case 0x8000 ... 0x8FFF:
+	for (int i = 0; i < ccnt; i++) {
+		struct dm2_avp value;
+
+		if ((rc = dm_expect_value(row, &value)) != RC_OK)
 			return rc;
 
-		default:
-			return RC_ERR_MISC;
-		}
+		sel[len] = cols[i];
+		sel[len + 1] = 0;
+
+		if ((rc = dmconfig_set_rc(dmconfig_set_cb(ctx, sel, &kw->table[cols[i] - 1], base, &value,
+							  dm_get_value_ref_by_index(base, cols[i] - 1)))) != RC_OK)
+			return rc;
 	}
 
-	return RC_OK;
+	return dm_expect_group_end(row);
 }
 
-uint32_t
-rpc_db_list(void *data __attribute__((unused)), int level, dm_selector path, DM2_REQUEST *answer)
+/* undo a failed bulk set, the pending changes first, they still point into the new instances */
+static void
+dmconfig_bulk_set_undo(SOCKCONTEXT *ctx, const dm_selector path, unsigned int savepoint,
+		       const dm_id *ids, const uint8_t *created, int rcnt)
 {
-	SOCKCONTEXT *ctx __attribute__((unused)) = data;
+	dm_selector sel;
+
+	if (savepoint) {
+		cache_rollback(&ctx->cache, savepoint);
+		cache_release(&ctx->cache, savepoint);
+	}
+
+	for (int i = rcnt - 1; i >= 0; i--) {
+		if (!created[i])
+			continue;
+
+		dm_selcpy(sel, path);
+		dm_selcat(sel, ids[i]);
+		dm_del_table_by_selector(sel);
+	}
+}
+
+uint32_t
+rpc_db_bulk_set(void *data, const dm_selector path, uint8_t create, int ccnt, struct dm_bin *columns,
+		DM2_AVPGRP *rows, DM2_REQUEST *answer)
+{
+	SOCKCONTEXT *ctx = data;
+	struct dm_element_ref ref;
+	const struct dm_table *kw;
+	unsigned int savepoint = 0;
+	dm_id *cols, *ids = NULL;
+	uint8_t *created = NULL;
+	int rcnt = 0, rsize = 0;
+	uint32_t rc = RC_OK;
+	char b1[128];
+
+	dm_debug(ctx->id, "CMD: %s \"%s\" (%d columns)", "DB BULK SET", sel2str(b1, path), ccnt);
+
+	/* instances are created in the store right away */
+	commit_flush();
+
+	if (!dm_get_element_ref(path, &ref) || ref.kw_elem->type != T_OBJECT || ref.st_type != T_OBJECT)
+		return RC_ERR_VALUE_NOT_FOUND;
+	kw = ref.kw_elem->u.t.table;
+
+	if (!(cols = talloc_array(NULL, dm_id, ccnt)))
+		return RC_ERR_ALLOC;
+
+	for (int i = 0; i < ccnt && rc == RC_OK; i++) {
+		if ((cols[i] = dm_get_element_id_by_name(columns[i].data, columns[i].size, kw)) == DM_ERR)
+			rc = RC_ERR_VALUE_NOT_FOUND;
+		else if (kw->table[cols[i] - 1].type == T_TOKEN ||
+			 (kw->table[cols[i] - 1].type == T_OBJECT && !(kw->table[cols[i] - 1].flags & F_ARRAY)))
+			rc = RC_ERR_INVALID_AVP_TYPE;
+	}
+	if (rc != RC_OK) {
+		talloc_free(cols);
+		return rc;
+	}
+
+	if ((ctx->flags & CMD_FLAG_CONFIGURE) && !(savepoint = cache_savepoint(&ctx->cache))) {
+		talloc_free(cols);
+		return RC_ERR_ALLOC;
+	}
+
+	while (rc == RC_OK && dm_expect_end(rows) != RC_OK) {
+		DM2_AVPGRP row;
+		int new;
+
+		if (rcnt == rsize) {
+			dm_id *nids;
+			uint8_t *ncreated;
+
+			rsize = rsize ? rsize * 2 : 16;
+			if (!(nids = talloc_realloc(cols, ids, dm_id, rsize))) {
+				rc = RC_ERR_ALLOC;
+				break;
+			}
+			ids = nids;
+			if (!(ncreated = talloc_realloc(cols, created, uint8_t, rsize))) {
+				rc = RC_ERR_ALLOC;
+				break;
+			}
+			created = ncreated;
+		}
+
+		ids[rcnt] = 0;
+		if ((rc = dm_expect_object(rows, &row)) == RC_OK)
+			rc = dmconfig_bulk_set_row(ctx, path, &ref, create, ccnt, cols, &row, &ids[rcnt], &new);
+		else
+			new = 0;
+		created[rcnt++] = new;
+	}
+
+	if (rc != RC_OK) {
+		/* all or nothing, answer with the index of the failing row */
+		dmconfig_bulk_set_undo(ctx, path, savepoint, ids, created, rcnt);
+		if (rcnt && dm_add_uint32(answer, AVP_UINT32, VP_TRAVELPING, rcnt - 1) != RC_OK)
+			rc = RC_ERR_ALLOC;
+		talloc_free(cols);
+		return rc;
+	}
+
+	if (savepoint)
+		cache_release(&ctx->cache, savepoint);
+
+	for (int i = 0; i < rcnt && rc == RC_OK; i++)
+		rc = dm_add_uint16(answer, AVP_UINT16, VP_TRAVELPING, ids[i]);
+
+	talloc_free(cols);
+	return rc;
+}
+
+uint32_t
+rpc_db_get(void *data, int pcnt, dm_selector *values, DM2_REQUEST *answer)
+{
+	uint32_t rc;
+	SOCKCONTEXT *ctx = data;
+	int i;
+
+	for (i = 0; i < pcnt; i++) {
+		char b1[128];
+
+		dm_debug(ctx->id, "CMD: %s \"%s\"", "DB GET", sel2str(b1, values[i]));
+
+		if (ctx->flags & CMD_FLAG_CONFIGURE)
+			rc = dm_cache_get_value_by_selector_cb(&ctx->cache, values[i], T_ANY, answer, dmconfig_get_cb);
+		else
+			rc = dm_get_value_by_selector_cb(values[i], T_ANY, answer, dmconfig_get_cb);
+		switch (rc) {
+		case RC_OK:
+			continue;
+
+		case DM_OOM:
+			return RC_ERR_ALLOC;
+
+		case DM_INVALID_VALUE:
+		case DM_INVALID_TYPE:
+			return RC_ERR_INVALID_AVP_TYPE;
+
+		case DM_VALUE_NOT_FOUND:
+			return RC_ERR_VALUE_NOT_FOUND;
+
+		case 0x8000 ... 0x8FFF:
+			return rc;
+
+		default:
+			return RC_ERR_MISC;
+		}
+	}
+
+	return RC_OK;
+}
+
+uint32_t
+rpc_db_list(void *data __attribute__((unused)), int level, dm_selector path, DM2_REQUEST *answer)
+{
+	SOCKCONTEXT *ctx __attribute__((unused)) = data;
 	struct list_ctx list_ctx;
 
 	dm_debug(ctx->id, "CMD: %s", "DB LIST");
@@ -1374,62 +1902,270 @@ rpc_db_retrieve_enum(void *data, dm_selector path, DM2_REQUEST *answer)
 	return RC_OK;
 }
 
-uint32_t
-rpc_db_dump(void *data, char *path, DM2_REQUEST *answer)
-{
-	SOCKCONTEXT *ctx __attribute__((unused)) = data;
+/*
+ * a whole dump is serialized straight into a String AVP of the answer
+ *
+ * a chunked dump is serialized once into a buffer of the session when
+ * the chunk at offset 0 is asked for, the following chunks are cut from
+ * that buffer, so all chunks are from the same store state and the dump
+ * is serialized only once. A chunk past offset 0 without a matching
+ * buffer fails with RC_ERR_DUMP_RESTART, the client has to start over.
+ *
+ * The buffer is freed with the last chunk, when the next dump starts or
+ * when the client did not ask for a chunk for DUMP_IDLE_TIMEOUT seconds.
+ */
+
+/* the packet length has 24 bits, leave room for the header and the RC */
+#define DUMP_MAX_SIZE	(0xffffff - 64)
+
+#define DUMP_IDLE_TIMEOUT	30.
+
+struct dump_chunk {
+	DM2_REQUEST *answer;
+	size_t left;
+	uint32_t rc;
+};
+
+struct dump_cursor {
+	SOCKCONTEXT *ctx;
+	struct ev_loop *loop;
+	ev_timer idle_ev;
+
+	char *path;
+	uint32_t format;
+
 	char *buf;
-	long tsize;
-	size_t r = 0;
-	FILE *tf;
+	size_t size;
+	size_t alloc;
+};
 
-	dm_debug(ctx->id, "CMD: %s \"%s\"", "DB DUMP", path);
+static int
+dump_write(const void *data, size_t len, void *userData)
+{
+	struct dump_chunk *c = userData;
 
-	tf = tmpfile();
-	if (!tf)
-		return RC_ERR_MISC;
+	/* a whole dump has to fit into one answer */
+	if (len > c->left) {
+		c->rc = RC_ERR_MISC;
+		return 1;
+	}
+
+	if (dm_put_data(c->answer, data, len) != RC_OK) {
+		c->rc = RC_ERR_ALLOC;
+		return 1;
+	}
+	c->left -= len;
+
+	return 0;
+}
+
+static int
+dump_buffer_write(const void *data, size_t len, void *userData)
+{
+	struct dump_cursor *d = userData;
+
+	if (d->size + len > d->alloc) {
+		size_t alloc = d->alloc ? d->alloc : 64 * 1024;
+		char *buf;
+
+		while (alloc < d->size + len)
+			alloc *= 2;
+		if (!(buf = talloc_realloc_size(d, d->buf, alloc)))
+			return 1;
+		d->buf = buf;
+		d->alloc = alloc;
+	}
 
+	memcpy(d->buf + d->size, data, len);
+	d->size += len;
+
+	return 0;
+}
+
+static int
+dump_serialize(const char *path, int flags, int (*cb)(const void *, size_t, void *), void *userData)
+{
 	if (path && *path)
-		dm_serialize_element(tf, path, S_ALL);
-	else
-		dm_serialize_store(tf, S_ALL);
+		return dm_serialize_element_cb(path, cb, userData, flags);
+	return dm_serialize_store_cb(cb, userData, flags);
+}
+
+static void
+dump_free(SOCKCONTEXT *ctx)
+{
+	struct dump_cursor *d = ctx->dump;
 
-	tsize = ftell(tf);
-	fseek(tf, 0, SEEK_SET);
+	if (!d)
+		return;
 
-	if (!tsize) {
-		fclose(tf);
-		return RC_ERR_MISC;
+	ev_timer_stop(d->loop, &d->idle_ev);
+	talloc_free(d);
+	ctx->dump = NULL;
+}
+
+static void
+dumpIdleEvent(struct ev_loop *loop __attribute__((unused)), ev_timer *w,
+	      int revents __attribute__((unused)))
+{
+	struct dump_cursor *d = w->data;
+
+	dm_debug(d->ctx->id, "dump of \"%s\" not read for %.0fs, dropped", d->path, DUMP_IDLE_TIMEOUT);
+	dump_free(d->ctx);
+}
+
+/* serialize the dump the chunks are cut from */
+static uint32_t
+dump_start(SOCKCONTEXT *ctx, const char *path, uint32_t format, int flags)
+{
+	struct dump_cursor *d;
+
+	dump_free(ctx);
+
+	if (!(d = talloc_zero(ctx, struct dump_cursor)) ||
+	    !(d->path = talloc_strdup(d, path ? : ""))) {
+		talloc_free(d);
+		return RC_ERR_ALLOC;
 	}
+	d->format = format;
 
-	buf = malloc(tsize);
-	if (buf)
-		r = fread(buf, tsize, 1, tf);
-	fclose(tf);
-	if (r != 1) {
-		free(buf);
+	if (dump_serialize(path, flags, dump_buffer_write, d) != 0) {
+		talloc_free(d);
 		return RC_ERR_MISC;
 	}
 
-	if (dm_add_raw(answer, AVP_STRING, VP_TRAVELPING, buf, tsize))
-		return RC_ERR_ALLOC;
+	d->ctx = ctx;
+	d->loop = ctx->socket->ev;
+	ev_timer_init(&d->idle_ev, dumpIdleEvent, 0., DUMP_IDLE_TIMEOUT);
+	d->idle_ev.data = d;
+	ev_timer_again(d->loop, &d->idle_ev);
+
+	ctx->dump = d;
+	return RC_OK;
+}
+
+uint32_t
+rpc_db_dump(void *data, char *path, uint64_t offset, uint32_t size, uint32_t format, DM2_REQUEST *answer)
+{
+	SOCKCONTEXT *ctx = data;
+	struct dump_chunk c = {
+		.answer = answer,
+		.left = DUMP_MAX_SIZE,
+		.rc = RC_OK,
+	};
+	struct dump_cursor *d;
+	int flags = S_ALL;
+	uint32_t rc;
+	size_t len;
+	int r;
+
+	dm_debug(ctx->id, "CMD: %s \"%s\" %" PRIu64 " %u %u", "DB DUMP", path, offset, size, format);
+
+	switch (format) {
+	case CONFIG_FORMAT_XML:
+		break;
+	case CONFIG_FORMAT_JSON:
+		flags |= S_JSON;
+		break;
+	/* only the config, status values have no baseline */
+	case CONFIG_FORMAT_XML_DIFF:
+		flags = S_CFG | S_DIFF;
+		break;
+	case CONFIG_FORMAT_JSON_DIFF:
+		flags = S_CFG | S_DIFF | S_JSON;
+		break;
+	default:
+		return RC_ERR_AVP_MISFORMED;
+	}
+
+	/* a chunk has to fit into one answer, a shorter one would end the dump */
+	if (size > DUMP_MAX_SIZE)
+		return RC_ERR_AVP_MISFORMED;
+
+	if (size == 0) {
+		if ((rc = dm_new_group(answer, AVP_STRING, VP_TRAVELPING)) != RC_OK)
+			return rc;
+
+		r = dump_serialize(path, flags, dump_write, &c);
+
+		if ((rc = dm_finalize_group(answer)) != RC_OK)
+			return rc;
+
+		return r != 0 && c.rc == RC_OK ? RC_ERR_MISC : c.rc;
+	}
+
+	if (offset == 0 && (rc = dump_start(ctx, path, format, flags)) != RC_OK)
+		return rc;
+
+	d = ctx->dump;
+	if (!d || d->format != format || strcmp(d->path, path ? : "") != 0 || offset > d->size)
+		return RC_ERR_DUMP_RESTART;
+
+	len = d->size - offset;
+	if (len > size)
+		len = size;
+
+	if ((rc = dm_add_raw(answer, AVP_STRING, VP_TRAVELPING, d->buf + offset, len)) != RC_OK)
+		return rc;
+
+	/* a short chunk is the last one */
+	if (len < size)
+		dump_free(ctx);
+	else
+		ev_timer_again(d->loop, &d->idle_ev);
 
-	free(buf);
 	return RC_OK;
 }
 
 /* saves running config to persistent storage */
+static void
+save_done(void *data, int r)
+{
+	struct save_request *sr = data;
+	SOCKCONTEXT *ctx = sr->ctx;
+	DM2_REQUEST *answer;
+
+	TAILQ_REMOVE(&ctx->saves, sr, list);
+
+	if (!(answer = dm_new_request(ctx, sr->req.code, 0, sr->req.hop2hop, sr->req.end2end)) ||
+	    dm_add_uint32(answer, AVP_RC, VP_TRAVELPING, r == 0 ? RC_OK : RC_ERR_MISC) != RC_OK ||
+	    dm_finalize_packet(answer) != RC_OK) {
+		talloc_free(answer);
+		talloc_free(sr);
+		shutdown_session(ctx);
+		return;
+	}
+
+	talloc_free(sr);
+	dm_enqueue(ctx->socket, answer, REPLY, NULL, NULL);
+}
+
 uint32_t
 rpc_db_save(void *data, DM2_REQUEST *answer __attribute__((unused)))
 {
 	SOCKCONTEXT *ctx = data;
+	struct save_request *sr;
 
 	dm_debug(ctx->id, "CMD: %s", "DB SAVE");
 
-	if (ctx->id == cfg_session_id && !cache_is_empty())		/* cache not empty */
+	if ((ctx->flags & CMD_FLAG_CONFIGURE) && !cache_is_empty(&ctx->cache))		/* cache not empty */
 		return RC_ERR_MISC;
 
-	dm_save();
+	if (!(sr = talloc(ctx, struct save_request)))
+		return RC_ERR_ALLOC;
+
+	sr->ctx = ctx;
+	sr->req = *ctx->req;
+
+	if (dm_save_async(save_done, sr) != 0) {
+		/* no background save, block the loop */
+		talloc_free(sr);
+		dm_save();
+		return RC_OK;
+	}
+
+	TAILQ_INSERT_TAIL(&ctx->saves, sr, list);
+	ctx->answer_deferred = 1;
+
 	return RC_OK;
 }
 
@@ -1441,20 +2177,108 @@ rpc_db_commit(void *data, DM2_REQUEST *answer __attribute__((unused)))
 
 	dm_debug(ctx->id, "CMD: %s", "DB COMMIT");
 
-	if (ctx->id != cfg_session_id)
+	if (!(ctx->flags & CMD_FLAG_CONFIGURE))
 		return RC_ERR_REQUIRES_CFGSESSION;
 
-	if (cache_validate()) {
-		exec_actions_pre();
-		cache_apply(ctx->notify_slot ? : -1);
-		exec_actions();
-		exec_pending_notifications();
-	} else
+	/* the previous commit's actions run on the store it produced */
+	commit_flush();
+
+	if (!cache_is_current(&ctx->cache)) {
+		/* another session changed a value we touched, discard our changes */
+		cache_reset(&ctx->cache);
+		return RC_ERR_COMMIT_CONFLICT;
+	}
+
+	if (!cache_validate(&ctx->cache))
 		return RC_ERR_MISC;
 
+	exec_actions_pre();
+	cache_apply(&ctx->cache, ctx->notify_slot ? : -1);
+
+	/* answer now, actions and notifications follow from the event loop */
+	commit_defer_stages();
+
 	return RC_OK;
 }
 
+struct action_plan {
+	DM2_REQUEST *answer;
+	int action;			/* action of the open Container, -1 for none */
+	uint32_t count;
+};
+
+static void dry_run_collect(void *data)
+{
+	cache_queue_actions(data);
+}
+
+static uint32_t dry_run_close_action(struct action_plan *plan)
+{
+	uint32_t rc;
+
+	if (plan->action < 0)
+		return RC_OK;
+
+	if ((rc = dm_add_uint32(plan->answer, AVP_COUNTER, VP_TRAVELPING, plan->count)) != RC_OK)
+		return rc;
+
+	return dm_finalize_group(plan->answer);
+}
+
+static uint32_t dry_run_action_cb(void *data, enum dm_actions action, const dm_selector sel, enum dm_action_type type)
+{
+	struct action_plan *plan = data;
+	char buffer[MAX_PARAM_NAME_LEN];
+	char *path;
+	uint32_t rc;
+
+	/* actions arrive sorted, one Container per action */
+	if ((int)action != plan->action) {
+		if ((rc = dry_run_close_action(plan)) != RC_OK
+		    || (rc = dm_add_object(plan->answer)) != RC_OK
+		    || (rc = dm_add_string(plan->answer, AVP_NAME, VP_TRAVELPING, action_name(action))) != RC_OK)
+			return rc;
+
+		plan->action = action;
+		plan->count = 0;
+	}
+
+	if (!(path = dm_sel2name(sel, buffer, sizeof(buffer))))
+		return RC_ERR_MISC;
+
+	plan->count++;
+	if ((rc = dm_add_string(plan->answer, AVP_PATH, VP_TRAVELPING, path)) != RC_OK
+	    || (rc = dm_add_uint32(plan->answer, AVP_EVENT_TYPE, VP_TRAVELPING, type)) != RC_OK)
+		return rc;
+
+	return RC_OK;
+}
+
+/* validate the pending changes and report the actions a commit would run */
+uint32_t
+rpc_db_commit_dry_run(void *data, DM2_REQUEST *answer)
+{
+	SOCKCONTEXT *ctx = data;
+	struct action_plan plan = { .answer = answer, .action = -1 };
+	uint32_t rc;
+
+	dm_debug(ctx->id, "CMD: %s", "DB COMMIT DRY RUN");
+
+	if (!(ctx->flags & CMD_FLAG_CONFIGURE))
+		return RC_ERR_REQUIRES_CFGSESSION;
+
+	if (!cache_is_current(&ctx->cache))
+		return RC_ERR_COMMIT_CONFLICT;
+
+	if (!cache_validate(&ctx->cache))
+		return RC_ERR_MISC;
+
+	if ((rc = plan_actions(dry_run_collect, &ctx->cache, dry_run_action_cb, &plan)) != RC_OK)
+		return rc;
+
+	return dry_run_close_action(&plan);
+}
+
 uint32_t
 rpc_db_cancel(void *data, DM2_REQUEST *answer __attribute__((unused)))
 {
@@ -1462,10 +2286,147 @@ rpc_db_cancel(void *data, DM2_REQUEST *answer __attribute__((unused)))
 
 	dm_debug(ctx->id, "CMD: %s", "DB CANCEL");
 
-	if (ctx->id != cfg_session_id)
+	if (!(ctx->flags & CMD_FLAG_CONFIGURE))
 		return RC_ERR_REQUIRES_CFGSESSION;
 
-	cache_reset();
+	cache_reset(&ctx->cache);
+	return RC_OK;
+}
+
+/* set a value without a configure session, only when it still has the expected value */
+uint32_t
+rpc_db_compare_and_set(void *data, const dm_selector path, const struct dm2_avp *expected, const struct dm2_avp *value,
+		       DM2_REQUEST *answer)
+{
+	SOCKCONTEXT *ctx = data;
+	struct dm_element *elem;
+	DM_VALUE exp_value, new_value;
+	DM_RESULT r;
+	char b1[128];
+
+	dm_debug(ctx->id, "CMD: %s \"%s\"", "DB COMPARE AND SET", sel2str(b1, path));
+
+	commit_flush();
+
+	if (dm_get_element_by_selector(path, &elem) == T_NONE)
+		return RC_ERR_VALUE_NOT_FOUND;
+
+	if (elem->flags & F_ARRAY)
+		return RC_ERR_INVALID_AVP_TYPE;
+
+	memset(&exp_value, 0, sizeof(DM_VALUE));
+	memset(&new_value, 0, sizeof(DM_VALUE));
+
+	if ((r = dmconfig_avp2value(expected, elem, &exp_value)) == DM_OK) {
+		if ((r = dmconfig_avp2value(value, elem, &new_value)) == DM_OK) {
+			r = dm_compare_and_set_by_selector(path, elem->type, exp_value, new_value, ctx->notify_slot ? : -1);
+			dm_free_any_value(elem, &new_value);
+		}
+		dm_free_any_value(elem, &exp_value);
+	}
+
+	switch (r) {
+	case DM_OK:
+		break;
+
+	case DM_VALUE_MISMATCH:
+		/* hand the current value back, the client can retry with it */
+		if (dm_get_value_by_selector_cb(path, T_ANY, answer, dmconfig_get_cb) == RC_ERR_ALLOC)
+			return RC_ERR_ALLOC;
+		return RC_ERR_VALUE_MISMATCH;
+
+	case DM_OOM:
+		return RC_ERR_ALLOC;
+
+	case DM_INVALID_VALUE:
+	case DM_INVALID_TYPE:
+		return RC_ERR_INVALID_AVP_TYPE;
+
+	case DM_VALUE_NOT_FOUND:
+		return RC_ERR_VALUE_NOT_FOUND;
+
+	default:
+		return RC_ERR_MISC;
+	}
+
+	exec_actions_pre();
+	exec_actions();
+	exec_pending_notifications();
+
+	return RC_OK;
+}
+
+/* add delta to an integer value without a configure session, answers the new value */
+uint32_t
+rpc_db_atomic_add(void *data, const dm_selector path, int64_t delta, DM2_REQUEST *answer)
+{
+	SOCKCONTEXT *ctx = data;
+	DM_VALUE value;
+	uint32_t rc;
+	char b1[128];
+
+	dm_debug(ctx->id, "CMD: %s \"%s\" (%" PRIi64 ")", "DB ATOMIC ADD", sel2str(b1, path), delta);
+
+	commit_flush();
+
+	switch (dm_atomic_add_by_selector(path, delta, &value, ctx->notify_slot ? : -1)) {
+	case DM_OK:
+		break;
+
+	case DM_OOM:
+		return RC_ERR_ALLOC;
+
+	case DM_INVALID_VALUE:
+	case DM_INVALID_TYPE:
+		return RC_ERR_INVALID_AVP_TYPE;
+
+	case DM_VALUE_NOT_FOUND:
+		return RC_ERR_VALUE_NOT_FOUND;
+
+	default:
+		return RC_ERR_MISC;
+	}
+
+	if ((rc = dm_get_value_by_selector_cb(path, T_ANY, answer, dmconfig_get_cb)) != RC_OK)
+		return rc;
+
+	exec_actions_pre();
+	exec_actions();
+	exec_pending_notifications();
+
+	return RC_OK;
+}
+
+uint32_t
+rpc_db_savepoint(void *data, DM2_REQUEST *answer)
+{
+	SOCKCONTEXT *ctx = data;
+	unsigned int savepoint;
+
+	dm_debug(ctx->id, "CMD: %s", "DB SAVEPOINT");
+
+	if (!(ctx->flags & CMD_FLAG_CONFIGURE))
+		return RC_ERR_REQUIRES_CFGSESSION;
+
+	if (!(savepoint = cache_savepoint(&ctx->cache)))
+		return RC_ERR_ALLOC;
+
+	return dm_add_uint32(answer, AVP_SAVEPOINT, VP_TRAVELPING, savepoint);
+}
+
+uint32_t
+rpc_db_rollback_savepoint(void *data, uint32_t savepoint, DM2_REQUEST *answer __attribute__((unused)))
+{
+	SOCKCONTEXT *ctx = data;
+
+	dm_debug(ctx->id, "CMD: %s %u", "DB ROLLBACK SAVEPOINT", savepoint);
+
+	if (!(ctx->flags & CMD_FLAG_CONFIGURE))
+		return RC_ERR_REQUIRES_CFGSESSION;
+
+	if (!cache_rollback(&ctx->cache, savepoint))
+		return RC_ERR_INVALID_SAVEPOINT;
+
 	return RC_OK;
 }
 
@@ -15,6 +15,7 @@
 #include "dm_token.h"
 #include "dm_store.h"
 #include "dm_action.h"
+#include "dm_cache.h"
 
 			/* this could be in a separate header file to avoid duplicate code (dmconfig.h) */
 
@@ -49,13 +50,22 @@ struct sockContext {
 	uint32_t id;
 	uint32_t flags;
 	int notify_slot;
+	uint32_t notify_flags;
+
+	struct cache cache;		/* pending changes of a configure session */
 
 	char *role;
+
+	struct dump_cursor *dump;	/* chunked dump being read, see rpc_db_dump() */
+
+	const DMC_REQUEST *req;		/* request being handled */
+	int answer_deferred;		/* the handler answers req later */
+	TAILQ_HEAD(, save_request) saves;	/* db saves waiting for the background save */
 };
 
 /* headers */
 
-extern uint32_t cfg_session_id;
+extern unsigned int cfg_session_cnt;
 
 uint32_t init_libdmconfig_server(struct ev_loop *base);
 void dm_event_broadcast(const dm_selector sel, enum dm_action_type type);
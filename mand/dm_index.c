@@ -982,7 +982,8 @@ struct dm_instance_node *find_instance(struct dm_instance *inst, dm_id id, int t
 	return FIND(inst->instance, idx, val);
 }
 
-struct dm_instance_node *dm_alloc_instance_node(const struct dm_table *kw, const dm_selector base, dm_id id)
+struct dm_instance_node *dm_alloc_instance_node(const struct dm_table *kw, struct dm_value_table *parent,
+						const dm_selector base, dm_id id)
 {
 	ENTER();
 
@@ -1013,7 +1014,7 @@ struct dm_instance_node *dm_alloc_instance_node(const struct dm_table *kw, const
 	init_struct_magic(node, NODE_MAGIC);
 	assert_index_magic(node, INDEX_FREE_MAGIC);      /* structure pointer sanity check */
 
-	dm_init_table(kw, (struct dm_value_table *)(node + 1), base, id);
+	dm_init_table(kw, (struct dm_value_table *)(node + 1), parent, base, id);
 	set_DM_TABLE(node->table, (struct dm_value_table *)(node + 1));
 	DM_parity_update(node->table);
 
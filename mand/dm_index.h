@@ -34,7 +34,7 @@ struct dm_instance_node *find_instance(struct dm_instance *, dm_id, int, DM_VALU
 struct dm_instance_tree *dm_alloc_instance(const struct dm_element *, struct dm_instance *);
 void dm_free_instance(struct dm_instance *);
 void dm_instance_set_counter(struct dm_instance *, struct dm_value_table *, dm_id);
-struct dm_instance_node *dm_alloc_instance_node(const struct dm_table *, const dm_selector, dm_id);
+struct dm_instance_node *dm_alloc_instance_node(const struct dm_table *, struct dm_value_table *, const dm_selector, dm_id);
 void dm_free_instance_node(const struct dm_table *, struct dm_instance_node *);
 
 static inline struct dm_instance_node *
@@ -0,0 +1,479 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "dm_json.h"
+
+//#define SDEBUG
+#include "debug.h"
+
+#define JSON_MAX_DEPTH	32
+#define JSON_MAX_TOKEN	64
+
+/* the attributes known to the deserializer, "instance" has to be the last one */
+static const char *const json_attr_names[] = { "notify", "encoding", "version", "deleted", "instance" };
+#define JSON_ATTRS	(sizeof(json_attr_names) / sizeof(json_attr_names[0]))
+
+struct json_attrs {
+	char *value[JSON_ATTRS];
+};
+
+struct json_str {
+	char *buf;
+	size_t len;
+	size_t size;
+};
+
+struct json_parser {
+	FILE *stream;
+	int line;
+	int depth;
+	int error;
+
+	void *userData;
+	dm_json_start *start;
+	dm_json_text *text;
+	dm_json_end *end;
+};
+
+static void json_error(struct json_parser *p, const char *msg)
+{
+	if (!p->error)
+		fprintf(stderr, "JSON: %s at line %d\n", msg, p->line);
+	p->error = 1;
+}
+
+static inline int json_getc(struct json_parser *p)
+{
+	int c = getc(p->stream);
+
+	if (c == '\n')
+		p->line++;
+	return c;
+}
+
+static inline void json_ungetc(struct json_parser *p, int c)
+{
+	if (c == '\n')
+		p->line--;
+	ungetc(c, p->stream);
+}
+
+/* next character that is not white space */
+static int json_next(struct json_parser *p)
+{
+	int c;
+
+	do {
+		c = json_getc(p);
+	} while (c == ' ' || c == '\t' || c == '\r' || c == '\n');
+
+	return c;
+}
+
+static int str_put(struct json_str *s, const char *data, size_t len)
+{
+	if (s->len + len + 1 > s->size) {
+		size_t size = s->size ? s->size * 2 : 64;
+		char *buf;
+
+		while (size < s->len + len + 1)
+			size *= 2;
+		if (!(buf = realloc(s->buf, size)))
+			return -1;
+		s->buf = buf;
+		s->size = size;
+	}
+	memcpy(s->buf + s->len, data, len);
+	s->len += len;
+	s->buf[s->len] = '\0';
+
+	return 0;
+}
+
+static int str_put_utf8(struct json_str *s, unsigned int cp)
+{
+	char u[4];
+	int n;
+
+	if (cp < 0x80) {
+		u[0] = cp;
+		n = 1;
+	} else if (cp < 0x800) {
+		u[0] = 0xc0 | (cp >> 6);
+		u[1] = 0x80 | (cp & 0x3f);
+		n = 2;
+	} else if (cp < 0x10000) {
+		u[0] = 0xe0 | (cp >> 12);
+		u[1] = 0x80 | ((cp >> 6) & 0x3f);
+		u[2] = 0x80 | (cp & 0x3f);
+		n = 3;
+	} else {
+		u[0] = 0xf0 | (cp >> 18);
+		u[1] = 0x80 | ((cp >> 12) & 0x3f);
+		u[2] = 0x80 | ((cp >> 6) & 0x3f);
+		u[3] = 0x80 | (cp & 0x3f);
+		n = 4;
+	}
+
+	return str_put(s, u, n);
+}
+
+static int json_hex4(struct json_parser *p)
+{
+	int v = 0;
+
+	for (int i = 0; i < 4; i++) {
+		int c = json_getc(p);
+
+		if (!isxdigit(c))
+			return -1;
+		v = (v << 4) | (isdigit(c) ? c - '0' : (tolower(c) - 'a' + 10));
+	}
+	return v;
+}
+
+/* the rest of a string after the opening quote */
+static int json_string(struct json_parser *p, struct json_str *s)
+{
+	s->len = 0;
+	if (str_put(s, "", 0) != 0)
+		goto oom;
+
+	for (;;) {
+		int c = json_getc(p);
+		char ch;
+
+		/* EOF included */
+		if (c < 0x20) {
+			json_error(p, "unterminated string");
+			return -1;
+		}
+		if (c == '"')
+			return 0;
+
+		if (c == '\\') {
+			int cp;
+
+			switch ((c = json_getc(p))) {
+			case '"':
+			case '\\':
+			case '/':
+				break;
+			case 'b': c = '\b'; break;
+			case 'f': c = '\f'; break;
+			case 'n': c = '\n'; break;
+			case 'r': c = '\r'; break;
+			case 't': c = '\t'; break;
+			case 'u':
+				if ((cp = json_hex4(p)) < 0) {
+					json_error(p, "invalid \\u escape");
+					return -1;
+				}
+				/* surrogate pair */
+				if (cp >= 0xd800 && cp < 0xdc00) {
+					int lo;
+
+					if (json_getc(p) != '\\' || json_getc(p) != 'u' ||
+					    (lo = json_hex4(p)) < 0xdc00 || lo >= 0xe000) {
+						json_error(p, "invalid surrogate pair");
+						return -1;
+					}
+					cp = 0x10000 + ((cp - 0xd800) << 10) + (lo - 0xdc00);
+				}
+				if (str_put_utf8(s, cp) != 0)
+					goto oom;
+				continue;
+			default:
+				json_error(p, "invalid escape");
+				return -1;
+			}
+		}
+
+		ch = c;
+		if (str_put(s, &ch, 1) != 0)
+			goto oom;
+	}
+
+ oom:
+	json_error(p, "out of memory");
+	return -1;
+}
+
+/* number or literal, c is its first character */
+static int json_token(struct json_parser *p, int c, char *buf, size_t size)
+{
+	size_t len = 0;
+
+	while (isalnum(c) || c == '-' || c == '+' || c == '.') {
+		if (len + 1 >= size) {
+			json_error(p, "token too long");
+			return -1;
+		}
+		buf[len++] = c;
+		c = json_getc(p);
+	}
+	json_ungetc(p, c);
+	buf[len] = '\0';
+
+	if (len == 0 ||
+	    (isalpha(buf[0]) && strcmp(buf, "true") != 0 &&
+	     strcmp(buf, "false") != 0 && strcmp(buf, "null") != 0)) {
+		json_error(p, "invalid token");
+		return -1;
+	}
+	return 0;
+}
+
+/* {"name": value, ...}, c is the opening brace */
+static void json_attrs(struct json_parser *p, int c, struct json_attrs *a)
+{
+	struct json_str key = { NULL, 0, 0 };
+	struct json_str val = { NULL, 0, 0 };
+
+	if (c != '{') {
+		json_error(p, "attributes have to be an object");
+		return;
+	}
+
+	if ((c = json_next(p)) == '}')
+		return;
+
+	for (;;) {
+		char tok[JSON_MAX_TOKEN];
+		const char *v = tok;
+
+		if (c != '"' || json_string(p, &key) != 0 || json_next(p) != ':') {
+			json_error(p, "invalid attribute");
+			break;
+		}
+
+		c = json_next(p);
+		if (c == '"') {
+			if (json_string(p, &val) != 0)
+				break;
+			v = val.buf;
+		} else if (json_token(p, c, tok, sizeof(tok)) != 0)
+			break;
+
+		for (unsigned int i = 0; i < JSON_ATTRS; i++)
+			if (strcmp(key.buf, json_attr_names[i]) == 0) {
+				free(a->value[i]);
+				a->value[i] = strdup(v);
+			}
+
+		c = json_next(p);
+		if (c == '}')
+			break;
+		if (c != ',') {
+			json_error(p, "expected ',' or '}'");
+			break;
+		}
+		c = json_next(p);
+	}
+
+	free(key.buf);
+	free(val.buf);
+}
+
+static void attrs_free(struct json_attrs *a)
+{
+	for (unsigned int i = 0; i < JSON_ATTRS; i++) {
+		free(a->value[i]);
+		a->value[i] = NULL;
+	}
+}
+
+/* NULL terminated name/value list as passed to the start handler */
+static const char **attrs_list(const struct json_attrs *a, const char **atts)
+{
+	int n = 0;
+
+	for (unsigned int i = 0; i < JSON_ATTRS; i++)
+		if (a->value[i]) {
+			atts[n++] = json_attr_names[i];
+			atts[n++] = a->value[i];
+		}
+	atts[n] = NULL;
+
+	return atts;
+}
+
+static void json_value(struct json_parser *p, int c, const char *name, const char **atts);
+
+static void json_array(struct json_parser *p, const char *name, const char **atts)
+{
+	int c;
+
+	if ((c = json_next(p)) == ']')
+		return;
+
+	for (;;) {
+		json_value(p, c, name, atts);
+		if (p->error)
+			return;
+
+		c = json_next(p);
+		if (c == ']')
+			return;
+		if (c != ',') {
+			json_error(p, "expected ',' or ']'");
+			return;
+		}
+		c = json_next(p);
+	}
+}
+
+/* members of an object, name is NULL for the document itself */
+static void json_object(struct json_parser *p, const char *name, const char **atts)
+{
+	struct json_str key = { NULL, 0, 0 };
+	struct json_attrs own = { { NULL, } };
+	struct json_attrs next = { { NULL, } };
+	const char *list[2 * JSON_ATTRS + 1];
+	char *next_name = NULL;
+	int started = name == NULL;
+	int c;
+
+	if (++p->depth > JSON_MAX_DEPTH) {
+		json_error(p, "nested too deep");
+		return;
+	}
+
+	if ((c = json_next(p)) != '}')
+		for (;;) {
+			if (c != '"' || json_string(p, &key) != 0) {
+				json_error(p, "expected member name");
+				break;
+			}
+			if (json_next(p) != ':') {
+				json_error(p, "expected ':'");
+				break;
+			}
+			c = json_next(p);
+
+			if (strcmp(key.buf, "@") == 0) {
+				/* attributes of this element, ignored once it is started */
+				json_attrs(p, c, &own);
+				if (!started)
+					atts = attrs_list(&own, list);
+			} else if (key.buf[0] == '@') {
+				attrs_free(&next);
+				free(next_name);
+				json_attrs(p, c, &next);
+				next_name = strdup(key.buf + 1);
+			} else {
+				const char *next_list[2 * JSON_ATTRS + 1];
+
+				if (!started) {
+					p->start(p->userData, name, atts);
+					started = 1;
+				}
+
+				json_value(p, c, key.buf,
+					   next_name && strcmp(next_name, key.buf) == 0 ? attrs_list(&next, next_list) : NULL);
+
+				attrs_free(&next);
+				free(next_name);
+				next_name = NULL;
+			}
+			if (p->error)
+				break;
+
+			c = json_next(p);
+			if (c == '}')
+				break;
+			if (c != ',') {
+				json_error(p, "expected ',' or '}'");
+				break;
+			}
+			c = json_next(p);
+		}
+
+	if (!p->error) {
+		if (!started)
+			p->start(p->userData, name, atts);
+		if (name)
+			p->end(p->userData, name);
+	}
+
+	attrs_free(&own);
+	attrs_free(&next);
+	free(next_name);
+	free(key.buf);
+	p->depth--;
+}
+
+static void json_value(struct json_parser *p, int c, const char *name, const char **atts)
+{
+	static const char *no_atts[] = { NULL };
+	struct json_str s = { NULL, 0, 0 };
+	char tok[JSON_MAX_TOKEN];
+
+	if (!atts)
+		atts = no_atts;
+
+	switch (c) {
+	case '{':
+		json_object(p, name, atts);
+		break;
+
+	case '[':
+		json_array(p, name, atts);
+		break;
+
+	case '"':
+		if (json_string(p, &s) != 0)
+			break;
+
+		p->start(p->userData, name, atts);
+		if (s.len)
+			p->text(p->userData, s.buf, s.len);
+		p->end(p->userData, name);
+		break;
+
+	default:
+		if (json_token(p, c, tok, sizeof(tok)) != 0)
+			break;
+
+		p->start(p->userData, name, atts);
+		if (strcmp(tok, "null") != 0)
+			p->text(p->userData, tok, strlen(tok));
+		p->end(p->userData, name);
+		break;
+	}
+
+	free(s.buf);
+}
+
+int dm_json_parse(FILE *stream, void *userData,
+		  dm_json_start *start, dm_json_text *text, dm_json_end *end)
+{
+	struct json_parser p = {
+		.stream = stream,
+		.line = 1,
+		.userData = userData,
+		.start = start,
+		.text = text,
+		.end = end,
+	};
+
+	if (json_next(&p) != '{')
+		json_error(&p, "expected an object");
+	else
+		json_object(&p, NULL, NULL);
+
+	if (!p.error && json_next(&p) != EOF)
+		json_error(&p, "data after the document");
+
+	return p.error;
+}
@@ -0,0 +1,31 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef __DM_JSON_H
+#define __DM_JSON_H
+
+#include <stdio.h>
+
+/*
+ * JSON config reader
+ *
+ * Reads the JSON written by dm_serialize_store() with S_JSON and reports
+ * it as the element events an XML parser would produce for the same
+ * config, so that dm_deserialize_store() handles both formats alike:
+ *
+ *   "key": {...}          start "key", members, end "key"
+ *   "key": [{...}, ...]   one "key" element per array entry
+ *   "key": value          start "key", value as text, end "key" (null: no text)
+ *   "@": {...}            attributes of the enclosing element, has to be its first member
+ *   "@key": {...}         attributes of the following member "key"
+ */
+typedef void dm_json_start(void *userData, const char *name, const char **atts);
+typedef void dm_json_text(void *userData, const char *s, int len);
+typedef void dm_json_end(void *userData, const char *name);
+
+/* returns 0 on success, 1 on a syntax error */
+int dm_json_parse(FILE *stream, void *userData,
+		  dm_json_start *start, dm_json_text *text, dm_json_end *end);
+
+#endif /* __DM_JSON_H */
@@ -26,6 +26,8 @@
 #include "debug.h"
 
 static int notify_pending = 0;
+static unsigned int notify_round = 0;
+static int notify_slot;		/* slot exec_pending_notifications() runs */
 
 static int
 notify_compare(struct notify_item *a, struct notify_item *b)
@@ -33,13 +35,29 @@ notify_compare(struct notify_item *a, struct notify_item *b)
         return dm_selcmp(a->sb, b->sb, DM_SELECTOR_LEN);
 }
 
-RB_GENERATE(notify_queue, notify_item, node, notify_compare);
+RB_GENERATE(notify_tree, notify_item, node, notify_compare);
+
+static int
+notify_filter_compare(struct notify_filter *a, struct notify_filter *b)
+{
+        return dm_selcmp(a->sb, b->sb, DM_SELECTOR_LEN);
+}
+
+RB_GENERATE(notify_filter_tree, notify_filter, node, notify_filter_compare);
 
 static void dm_notify(void *data, struct notify_queue *queue);
 
 static uint16_t slot_map = 0x0001;
 static int slot_cnt = 1;
-static struct slot slots[16] = { { .cb = dm_notify }, };
+static struct slot slots[16] = {
+	{
+		.cb = dm_notify,
+		.queue = {
+			.active = TAILQ_HEAD_INITIALIZER(slots[0].queue.active),
+			.passive = TAILQ_HEAD_INITIALIZER(slots[0].queue.passive),
+		},
+	},
+};
 
 static int notify_is_valid(const struct dm_element *elem, int ntfy)
 {
@@ -52,6 +70,13 @@ static int notify_is_valid(const struct dm_element *elem, int ntfy)
 	return 1;
 }
 
+static void init_notify_queue(struct notify_queue *queue)
+{
+	RB_INIT(&queue->tree);
+	TAILQ_INIT(&queue->active);
+	TAILQ_INIT(&queue->passive);
+}
+
 static void reset_notify_table(const struct dm_table *kw, struct dm_value_table *st, uint32_t mask);
 static void reset_notify_object(const struct dm_element *elem, struct dm_instance *base, uint32_t mask);
 
@@ -129,10 +154,28 @@ int alloc_slot(notify_cb *cb, void *data)
 	slot_cnt++;
 	slots[slot].data = data;
 	slots[slot].cb = cb;
+	init_notify_queue(&slots[slot].queue);
+	RB_INIT(&slots[slot].filters);
 
 	return slot;
 }
 
+static void free_notify_filter(struct notify_filter *filter)
+{
+	dm_free_any_value(filter->elem, &filter->operand);
+	free(filter);
+}
+
+static void clear_notify_filters(struct notify_filter_tree *filters)
+{
+	struct notify_filter *filter;
+
+	while ((filter = RB_ROOT(filters))) {
+		RB_REMOVE(notify_filter_tree, filters, filter);
+		free_notify_filter(filter);
+	}
+}
+
 void free_slot(int slot)
 {
 	if (slot < 1 || slot > 15)
@@ -144,6 +187,7 @@ void free_slot(int slot)
 		return;
 
 	clear_notify_queue(get_notify_queue(slot));
+	clear_notify_filters(&slots[slot].filters);
 
 	slot_map &= ~(1 << slot);
 	slot_cnt--;
@@ -168,6 +212,150 @@ void notify(int slot, const dm_selector sel, dm_id id,
 	notify_sel(slot, nsl, value, type);
 }
 
+/* the signed range shifted onto the unsigned one, order and distances are kept */
+#define KEY_SIGN (1ULL << 63)
+
+/*
+ * scalar value as an order preserving unsigned key, for threshold and
+ * delta predicates. Returns 1 for signed types, 0 for unsigned ones and
+ * -1 for types without an order.
+ */
+static int value2key(const struct dm_element *elem, const DM_VALUE *value, uint64_t *key)
+{
+	int64_t num;
+
+	switch (elem->type) {
+	case T_UINT:
+	case T_COUNTER:
+		*key = value->_v.uint_val;
+		return 0;
+	case T_BOOL:
+		*key = value->_v.bool_val;
+		return 0;
+	case T_UINT64:
+		*key = value->_v.uint64_val;
+		return 0;
+	case T_INT:
+	case T_ENUM:
+		num = value->_v.int_val;
+		break;
+	case T_INT64:
+		num = value->_v.int64_val;
+		break;
+	case T_DATE:
+		num = value->_v.time_val;
+		break;
+	case T_TICKS:
+		num = value->_v.ticks_val;
+		break;
+	default:
+		return -1;
+	}
+
+	*key = (uint64_t)num ^ KEY_SIGN;
+	return 1;
+}
+
+/* evaluate the predicate of a slot for a changed value, updates the filter state */
+static int notify_filter_match(struct notify_filter *filter, const DM_VALUE *value)
+{
+	uint64_t new, last, op;
+	int match;
+
+	switch (filter->predicate) {
+	case PREDICATE_EQUALS:
+		return dm_compare_values(filter->elem->type, &filter->operand, (DM_VALUE *)value) == 0;
+
+	case PREDICATE_NOT_EQUALS:
+		return dm_compare_values(filter->elem->type, &filter->operand, (DM_VALUE *)value) != 0;
+
+	case PREDICATE_CROSSES:
+		value2key(filter->elem, value, &new);
+		value2key(filter->elem, &filter->last, &last);
+		value2key(filter->elem, &filter->operand, &op);
+
+		match = (last < op && new >= op) || (last >= op && new < op);
+		filter->last._v = value->_v;
+		return match;
+
+	case PREDICATE_DELTA:
+		value2key(filter->elem, value, &new);
+		value2key(filter->elem, &filter->last, &last);
+
+		if ((new > last ? new - last : last - new) <= filter->delta)
+			return 0;
+		filter->last._v = value->_v;
+		return 1;
+
+	default:
+		return 1;
+	}
+}
+
+DM_RESULT dm_set_notify_filter_by_selector(const dm_selector sel, int slot,
+					   enum notify_predicate predicate, const DM_VALUE operand)
+{
+	struct notify_filter_tree *filters;
+	struct notify_filter si, *filter, *old;
+	struct dm_element_ref ref;
+	uint64_t key;
+	int sign;
+
+	if (slot < 1 || slot > 15 || !(slot_map & (1 << slot)))
+		return DM_ERROR;
+
+	filters = &slots[slot].filters;
+	dm_selcpy(si.sb, sel);
+	old = RB_FIND(notify_filter_tree, filters, &si);
+
+	if (predicate == PREDICATE_NONE) {
+		if (old) {
+			RB_REMOVE(notify_filter_tree, filters, old);
+			free_notify_filter(old);
+		}
+		return DM_OK;
+	}
+
+	/* a failed replace keeps the old filter */
+	if (!dm_get_element_ref(sel, &ref))
+		return DM_VALUE_NOT_FOUND;
+
+	switch (ref.kw_elem->type) {
+	case T_TOKEN:
+	case T_OBJECT:
+		return DM_INVALID_TYPE;
+
+	default:
+		break;
+	}
+
+	sign = value2key(ref.kw_elem, &operand, &key);
+	if ((predicate == PREDICATE_CROSSES || predicate == PREDICATE_DELTA) && sign < 0)
+		return DM_INVALID_TYPE;
+
+	/* a delta is a distance */
+	if (predicate == PREDICATE_DELTA && sign && (key ^ KEY_SIGN) & KEY_SIGN)
+		return DM_INVALID_VALUE;
+
+	if (!(filter = malloc(sizeof(struct notify_filter))))
+		return DM_OOM;
+
+	dm_selcpy(filter->sb, sel);
+	filter->elem = ref.kw_elem;
+	filter->predicate = predicate;
+	filter->operand = operand;
+	filter->delta = sign > 0 ? key ^ KEY_SIGN : key;
+	filter->last = *ref.st_value;
+
+	if (old) {
+		RB_REMOVE(notify_filter_tree, filters, old);
+		free_notify_filter(old);
+	}
+	RB_INSERT(notify_filter_tree, filters, filter);
+
+	return DM_OK;
+}
+
 void notify_sel(int slot, const dm_selector sel,
 		const DM_VALUE value, enum notify_type type)
 {
@@ -186,28 +374,42 @@ void notify_sel(int slot, const dm_selector sel,
 
 	dm_selcpy(si.sb, sel);
 
-	for (int i = 0; i < 16; i++) {
-		/* skip notify for slot */
-		if (i != slot) {
-			int level = ntfy & 0x0003;
-			if (level) {
-				struct notify_item *item;
-				item = RB_FIND(notify_queue, &slots[i].queue, &si);
-				if (!item) {
-					item = malloc(sizeof(struct notify_item));
-					if (!item)
-						continue;
-					dm_selcpy(item->sb, sel);
-
-					RB_INSERT(notify_queue, &slots[i].queue, item);
-					notify_pending = 1;
-				}
-				item->level = level;
-				item->type = type;
-				item->value = value;
-			}
+	for (int i = 0; i < 16; i++, ntfy >>= 2) {
+		struct notify_queue *queue = &slots[i].queue;
+		struct notify_item *item;
+		int level = ntfy & 0x0003;
+
+		/* skip notify for slot and for unused slots */
+		if (i == slot || !level || !(slot_map & (1 << i)))
+			continue;
+
+		if (type == NOTIFY_CHANGE && RB_ROOT(&slots[i].filters)) {
+			struct notify_filter fs, *filter;
+
+			dm_selcpy(fs.sb, sel);
+			if ((filter = RB_FIND(notify_filter_tree, &slots[i].filters, &fs))
+			    && !notify_filter_match(filter, &value))
+				continue;
+		}
+
+		item = RB_FIND(notify_tree, &queue->tree, &si);
+		if (!item) {
+			item = malloc(sizeof(struct notify_item));
+			if (!item)
+				continue;
+			dm_selcpy(item->sb, sel);
+
+			RB_INSERT(notify_tree, &queue->tree, item);
+			TAILQ_INSERT_TAIL(notify_level_list(queue, level), item, list);
+			notify_pending = 1;
+		} else if (item->level != level) {
+			/* move to the end of the other level */
+			TAILQ_REMOVE(notify_level_list(queue, item->level), item, list);
+			TAILQ_INSERT_TAIL(notify_level_list(queue, level), item, list);
 		}
-		ntfy >>= 2;
+		item->level = level;
+		item->type = type;
+		item->value = value;
 	}
 }
 
@@ -216,16 +418,39 @@ struct notify_queue *get_notify_queue(int slot)
 	return &slots[slot].queue;
 }
 
-void clear_notify_queue(struct notify_queue *queue)
+void notify_release(struct notify_queue *queue, struct notify_item *item)
+{
+	TAILQ_REMOVE(notify_level_list(queue, item->level), item, list);
+	RB_REMOVE(notify_tree, &queue->tree, item);
+	free(item);
+}
+
+static void clear_notify_list(struct notify_list *head)
 {
 	struct notify_item *item;
 
-	while ((item = RB_ROOT(queue))) {
-		RB_REMOVE(notify_queue, queue, item);
+	while ((item = TAILQ_FIRST(head))) {
+		TAILQ_REMOVE(head, item, list);
 		free(item);
 	}
 }
 
+void clear_notify_level(struct notify_queue *queue, int level)
+{
+	struct notify_list *list = notify_level_list(queue, level);
+	struct notify_item *item;
+
+	while ((item = TAILQ_FIRST(list)))
+		notify_release(queue, item);
+}
+
+void clear_notify_queue(struct notify_queue *queue)
+{
+	clear_notify_list(&queue->active);
+	clear_notify_list(&queue->passive);
+	RB_INIT(&queue->tree);
+}
+
 void exec_pending_notifications(void)
 {
 	if (!notify_pending)
@@ -233,15 +458,58 @@ void exec_pending_notifications(void)
 
 	ENTER();
 
-	for (int i = 0; i < 16; i++) {
-		if (slots[i].cb && RB_ROOT(&slots[i].queue))
-			slots[i].cb(slots[i].data, &slots[i].queue);
+	notify_round++;
+	for (notify_slot = 0; notify_slot < 16; notify_slot++) {
+		if (slots[notify_slot].cb && !notify_queue_empty(&slots[notify_slot].queue))
+			slots[notify_slot].cb(slots[notify_slot].data, &slots[notify_slot].queue);
 	}
 	notify_pending = 0;
 
 	EXIT();
 }
 
+/* changes with every run of exec_pending_notifications() */
+unsigned int get_notify_round(void)
+{
+	return notify_round;
+}
+
+/* slot whose callback exec_pending_notifications() runs */
+int get_notify_slot(void)
+{
+	return notify_slot;
+}
+
+static int notify_list_equal(const struct notify_list *a, const struct notify_list *b)
+{
+	const struct notify_item *x, *y;
+
+	for (x = TAILQ_FIRST(a), y = TAILQ_FIRST(b);
+	     x && y;
+	     x = TAILQ_NEXT(x, list), y = TAILQ_NEXT(y, list))
+		if (x->type != y->type
+		    || dm_selcmp(x->sb, y->sb, DM_SELECTOR_LEN) != 0
+		    || memcmp(&x->value._v, &y->value._v, sizeof(x->value._v)) != 0)
+			return 0;
+
+	return !x && !y;
+}
+
+/*
+ * slots after the running one whose pending active events equal those of
+ * queue, as bit mask. Compares the live queues, nothing is copied.
+ */
+uint16_t get_notify_peers(struct notify_queue *queue)
+{
+	uint16_t peers = 0;
+
+	for (int i = notify_slot + 1; i < 16; i++)
+		if (slots[i].cb && notify_list_equal(&queue->active, &slots[i].queue.active))
+			peers |= 1 << i;
+
+	return peers;
+}
+
 DM_RESULT set_notify_single_slot_element(const struct dm_element *elem, DM_VALUE *value, int slot, uint32_t ntfy)
 {
 	uint32_t mask = ~(0x0003 << (slot * 2));
@@ -291,9 +559,20 @@ DM_RESULT dm_set_notify_by_selector(const dm_selector sel, int slot, int value)
 			}
 			/* FALL THROUGH */
 
-		default:
+		default: {
+			DM_RESULT r;
+
+			r = set_notify_single_slot_element(ref.kw_elem, ref.st_value, slot, value);
+
+			/* slot 0 is saved with the config */
+			if (r == DM_OK && slot == 0) {
+				dm_touch_by_selector(sel);
+				dm_config_bump();
+			}
+
 			EXIT();
-			return set_notify_single_slot_element(ref.kw_elem, ref.st_value, slot, value);
+			return r;
+		}
 		}
 	}
 
@@ -411,7 +690,7 @@ static void dm_notify(void *data __attribute__ ((unused)), struct notify_queue *
 	char buf[MAX_PARAM_NAME_LEN];
 	struct notify_item *item;
 
-	RB_FOREACH(item, notify_queue, queue) {
+	RB_FOREACH(item, notify_tree, &queue->tree) {
 		char *s = NULL;
 
 		s = dm_sel2name(item->sb, buf, sizeof(buf));
@@ -428,7 +707,7 @@ static ev_prepare notify_ev;
 static void notify_prepare_cb(EV_P __attribute__ ((unused)), ev_prepare *w __attribute__ ((unused)),
 			      int revents __attribute__ ((unused)))
 {
-        if (!cfg_session_id) {
+        if (!cfg_session_cnt) {
 		debug(": exec_pending_notifications");
                 exec_pending_notifications();
 	}
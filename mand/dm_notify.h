@@ -6,6 +6,7 @@
 #define __DM_NOTIFY_H
 
 #include <sys/tree.h>
+#include <sys/queue.h>
 #include <ev.h>
 
 #include "dm_token.h"
@@ -18,6 +19,7 @@ enum notify_type {
 
 struct notify_item {
 	RB_ENTRY (notify_item) node;
+	TAILQ_ENTRY (notify_item) list;
 
 	int level;
 	dm_selector sb;
@@ -26,7 +28,44 @@ struct notify_item {
 	DM_VALUE value;
 };
 
-RB_HEAD(notify_queue, notify_item);
+/* value predicates, only matching changes are queued for a slot */
+enum notify_predicate {
+	PREDICATE_NONE,
+	PREDICATE_EQUALS,		/* new value == operand */
+	PREDICATE_NOT_EQUALS,		/* new value != operand */
+	PREDICATE_CROSSES,		/* old and new value on different sides of operand */
+	PREDICATE_DELTA			/* new value differs by more than operand from the last reported one */
+};
+
+struct notify_filter {
+	RB_ENTRY (notify_filter) node;
+
+	dm_selector sb;
+	const struct dm_element *elem;
+
+	enum notify_predicate predicate;
+	DM_VALUE operand;
+	uint64_t delta;			/* PREDICATE_DELTA, the operand as a distance */
+	DM_VALUE last;
+};
+
+RB_HEAD(notify_filter_tree, notify_filter);
+
+RB_HEAD(notify_tree, notify_item);
+TAILQ_HEAD(notify_list, notify_item);
+
+/* pending notifications of one slot
+ *
+ * the tree is only used to merge repeated changes of the same selector,
+ * the per level lists hold the items in queueing order and are drained
+ * without having to look at items of the other level
+ */
+struct notify_queue {
+	struct notify_tree tree;
+
+	struct notify_list active;
+	struct notify_list passive;
+};
 
 typedef void notify_cb(void *data, struct notify_queue *queue);
 
@@ -35,9 +74,11 @@ struct slot {
 	void *data;
 
 	struct notify_queue queue;
+	struct notify_filter_tree filters;
 };
 
-RB_PROTOTYPE(notify_queue, notify_item, node, notify_compare);
+RB_PROTOTYPE(notify_tree, notify_item, node, notify_compare);
+RB_PROTOTYPE(notify_filter_tree, notify_filter, node, notify_filter_compare);
 
 int alloc_slot(notify_cb *cb, void *data);
 void free_slot(int slot);
@@ -45,6 +86,8 @@ void free_slot(int slot);
 DM_RESULT set_notify_single_slot_element(const struct dm_element *elem, DM_VALUE *value, int slot, uint32_t ntfy);
 DM_RESULT dm_set_notify_by_selector(const dm_selector sel, int slot, int value) __attribute__((nonnull (1)));
 DM_RESULT dm_set_notify_by_selector_recursive(const dm_selector sel, int slot, int value) __attribute__((nonnull (1)));
+DM_RESULT dm_set_notify_filter_by_selector(const dm_selector sel, int slot,
+					   enum notify_predicate predicate, const DM_VALUE operand) __attribute__((nonnull (1)));
 
 static inline
 uint32_t notify_default(const struct dm_element *elem)
@@ -61,9 +104,27 @@ void notify_sel(int slot, const dm_selector sel,
 		const DM_VALUE value, enum notify_type type) __attribute__((nonnull (2)));
 
 void exec_pending_notifications(void);
+unsigned int get_notify_round(void);
+int get_notify_slot(void);
+uint16_t get_notify_peers(struct notify_queue *queue);
 
 struct notify_queue *get_notify_queue(int slot);
 void clear_notify_queue(struct notify_queue *queue);
+void clear_notify_level(struct notify_queue *queue, int level);
+
+static inline
+struct notify_list *notify_level_list(struct notify_queue *queue, int level)
+{
+	return level == ACTIVE_NOTIFY ? &queue->active : &queue->passive;
+}
+
+static inline
+int notify_queue_empty(struct notify_queue *queue)
+{
+	return TAILQ_EMPTY(&queue->active) && TAILQ_EMPTY(&queue->passive);
+}
+
+void notify_release(struct notify_queue *queue, struct notify_item *item);
 
 void dm_notify_init(EV_P);
 
@@ -8,6 +8,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <time.h>
 #include <arpa/inet.h>
 
@@ -17,6 +18,7 @@
 #include "dm_serialize.h"
 #include "dm_strings.h"
 #include "dm_cfgversion.h"
+#include "dm_baseline.h"
 
 #include "utils/binary.h"
 
@@ -25,16 +27,172 @@
 
 #define XML_INDENT "    "
 
-static void findent(FILE *stream, int level)
+/*
+ * output buffer
+ *
+ * The serializer formats into a large buffer that is handed to the sink
+ * in big chunks, numbers and addresses are formatted by hand instead of
+ * going through stdio for every leaf. Once the sink asks to stop, the
+ * rest of the walk is skipped.
+ */
+#define XML_BUFSIZE (64 * 1024)
+
+struct xml_out {
+	dm_serialize_write *write;
+	void *data;
+	int stop;
+	size_t len;
+	char buf[XML_BUFSIZE];
+};
+
+static void out_write(struct xml_out *o, const void *data, size_t len)
+{
+	if (!o->stop && o->write(data, len, o->data) != 0)
+		o->stop = 1;
+}
+
+static void out_flush(struct xml_out *o)
+{
+	if (o->len)
+		out_write(o, o->buf, o->len);
+	o->len = 0;
+}
+
+/* room for n bytes at the end of the buffer, n has to be small */
+static char *out_reserve(struct xml_out *o, size_t n)
+{
+	if (n > sizeof(o->buf) - o->len)
+		out_flush(o);
+	return o->buf + o->len;
+}
+
+static void out_mem(struct xml_out *o, const void *data, size_t len)
+{
+	if (len > sizeof(o->buf) - o->len) {
+		out_flush(o);
+		if (len >= sizeof(o->buf)) {
+			out_write(o, data, len);
+			return;
+		}
+	}
+	memcpy(o->buf + o->len, data, len);
+	o->len += len;
+}
+
+static inline void out_str(struct xml_out *o, const char *s)
+{
+	out_mem(o, s, strlen(s));
+}
+
+static inline void out_char(struct xml_out *o, char c)
+{
+	*out_reserve(o, 1) = c;
+	o->len++;
+}
+
+static void out_uint(struct xml_out *o, uint64_t v)
+{
+	char tmp[20];
+	char *p = tmp + sizeof(tmp);
+
+	do {
+		*--p = '0' + v % 10;
+		v /= 10;
+	} while (v);
+
+	out_mem(o, p, tmp + sizeof(tmp) - p);
+}
+
+static void out_int(struct xml_out *o, int64_t v)
+{
+	if (v < 0) {
+		out_char(o, '-');
+		out_uint(o, -(uint64_t)v);
+	} else
+		out_uint(o, v);
+}
+
+static void out_ip4(struct xml_out *o, const struct in_addr *addr)
+{
+	const uint8_t *b = (const uint8_t *)&addr->s_addr;
+
+	for (int i = 0; i < 4; i++) {
+		if (i)
+			out_char(o, '.');
+		out_uint(o, b[i]);
+	}
+}
+
+static void findent(struct xml_out *o, int level)
 {
-	for (; level > 0; level--)
-		fprintf(stream, XML_INDENT);
+	static const char spaces[] = XML_INDENT XML_INDENT XML_INDENT XML_INDENT
+				     XML_INDENT XML_INDENT XML_INDENT XML_INDENT;
+	const int step = (sizeof(spaces) - 1) / (sizeof(XML_INDENT) - 1);
+
+	for (; level > 0; level -= step)
+		out_mem(o, spaces, (level < step ? level : step) * (sizeof(XML_INDENT) - 1));
 }
 
+/* " notify="..."" when the element has one */
+static void out_notify(struct xml_out *o, const char *notify)
+{
+	if (!notify)
+		return;
+
+	out_mem(o, " notify=\"", 9);
+	out_str(o, notify);
+	out_char(o, '"');
+}
+
+/* "<key notify="...">" */
+static void out_open(struct xml_out *o, int indent, const char *key, const char *notify)
+{
+	findent(o, indent);
+	out_char(o, '<');
+	out_str(o, key);
+	out_notify(o, notify);
+	out_char(o, '>');
+}
+
+static void out_close(struct xml_out *o, const char *key)
+{
+	out_mem(o, "</", 2);
+	out_str(o, key);
+	out_mem(o, ">\n", 2);
+}
+
+static void out_empty(struct xml_out *o, int indent, const char *key, const char *notify)
+{
+	findent(o, indent);
+	out_char(o, '<');
+	out_str(o, key);
+	out_notify(o, notify);
+	out_mem(o, " />\n", 4);
+}
+
+/* JSON nesting depth for which containers are tracked */
+#define JSON_DEPTH (DM_SELECTOR_LEN * 2 + 4)
+
 struct walk_data {
-	FILE *stream;
+	struct xml_out out;
 	int flags;
 	int indent;
+
+	/* S_JSON: no member written in the current container yet, containers that are arrays */
+	int first;
+	uint8_t array[JSON_DEPTH];
+
+	/* S_DIFF: position in the store, the containers entered and how many of them are written */
+	struct dm_baseline *base;
+	dm_selector sel;
+	int len;
+	int depth;
+	int written;
+	struct {
+		CB_type type;
+		dm_id id;
+		const struct dm_element *elem;
+	} stack[DM_SELECTOR_LEN];
 };
 
 #if defined (SDEBUG)
@@ -89,47 +247,73 @@ static int validate_cdata(const char *str, int len)
 	return r;
 }
 
-static void string_escape(FILE *stream, const char *key, const char *nfbuf, const char *value, int len)
+static void string_escape(struct xml_out *o, const char *value, int len)
 {
-	fprintf(stream, "<%s%s encoding=\"escaped\">", key, nfbuf);
 	while (len) {
-		if (*value > 'z' || *value < ' ' ||
-		    *value == '<' || *value == '&' || *value == '>') {
-			fprintf(stream, "\\%03o", *value);
+		uint8_t c = *value;
+
+		if (c > 'z' || c < ' ' ||
+		    c == '<' || c == '&' || c == '>') {
+			char *p = out_reserve(o, 4);
+
+			p[0] = '\\';
+			p[1] = '0' + (c >> 6);
+			p[2] = '0' + ((c >> 3) & 7);
+			p[3] = '0' + (c & 7);
+			o->len += 4;
 		} else
-			fprintf(stream, "%c", *value);
+			out_char(o, c);
 		value++;
 		len--;
 	}
-	fprintf(stream, "</%s>\n", key);
 }
 
-static void serialize_binary(FILE *stream, const char *key, const char *nfbuf, const uint8_t *value, int len)
+static void serialize_binary(struct xml_out *o, const uint8_t *value, int len)
 {
-	fprintf(stream, "<%s%s>", key, nfbuf);
+	static const char hex[] = "0123456789ABCDEF";
+
 	while (len) {
 		if (*value == '<') {
-			fprintf(stream, "&lt;");
+			out_mem(o, "&lt;", 4);
 		} else if (*value == '&') {
-			fprintf(stream, "&amp;");
+			out_mem(o, "&amp;", 5);
 		} else if (*value == '>') {
-			fprintf(stream, "&gt;");
+			out_mem(o, "&gt;", 4);
 		} else if (*value > 'z' || *value < ' ') {
-			fprintf(stream, "&#x%02X;", *value);
+			char *p = out_reserve(o, 6);
+
+			memcpy(p, "&#x", 3);
+			p[3] = hex[*value >> 4];
+			p[4] = hex[*value & 0x0f];
+			p[5] = ';';
+			o->len += 6;
 		} else
-			fprintf(stream, "%c", *value);
+			out_char(o, *value);
 		value++;
 		len--;
 	}
-	fprintf(stream, "</%s>\n", key);
 }
 
-static void serialize_element(FILE *stream,
+/* 64 characters per line, encoded straight into the output buffer */
+static void serialize_base64(struct xml_out *o, int indent, const uint8_t *value, int len)
+{
+	for (int i = 0; i < len; i += 48) {
+		int n = len - i < 48 ? len - i : 48;
+
+		findent(o, indent);
+		/* dm_to64() terminates the string */
+		dm_to64(value + i, n, out_reserve(o, 64 + 1));
+		o->len += (n + 2) / 3 * 4;
+		out_char(o, '\n');
+	}
+}
+
+static void serialize_element(struct xml_out *o,
 			      int flags __attribute__ ((unused)),
 			      int indent,
 			      const struct dm_element *elem, const DM_VALUE value)
 {
-	char nfbuf[64] = "";
+	const char *notify = NULL;
 
 	/*
 	if (!(elem->flags & F_WRITE))
@@ -137,58 +321,43 @@ static void serialize_element(FILE *stream,
 	*/
 
 	if (value.notify & 0x0003)
-		snprintf(nfbuf, sizeof(nfbuf), " notify=\"%s\"", dm_int2enum(&notify_attr, value.notify & 0x0003));
+		notify = dm_int2enum(&notify_attr, value.notify & 0x0003);
 
 	switch(elem->type) {
 		case T_BOOL:
-			findent(stream, indent);
-			fprintf(stream, "<%s%s>%s</%s>\n", elem->key, nfbuf, DM_BOOL(value) ? "true" : "false", elem->key);
+			out_open(o, indent, elem->key, notify);
+			out_str(o, DM_BOOL(value) ? "true" : "false");
+			out_close(o, elem->key);
 			break;
 		case T_COUNTER:
 			/* don't serialize counters */
-			if (value.notify & 0x0003) {
-				findent(stream, indent);
-				fprintf(stream, "<%s%s />\n", elem->key, nfbuf);
-			}
+			if (value.notify & 0x0003)
+				out_empty(o, indent, elem->key, notify);
 			break;
 
 		case T_BINARY:
-			findent(stream, indent);
-			if (DM_BINARY(value) && DM_BINARY(value)->len != 0)
-				serialize_binary(stream, elem->key, nfbuf, DM_BINARY(value)->data, DM_BINARY(value)->len);
-			else
-				fprintf(stream, "<%s%s />\n", elem->key, nfbuf);
+			if (DM_BINARY(value) && DM_BINARY(value)->len != 0) {
+				out_open(o, indent, elem->key, notify);
+				serialize_binary(o, DM_BINARY(value)->data, DM_BINARY(value)->len);
+				out_close(o, elem->key);
+			} else
+				out_empty(o, indent, elem->key, notify);
 			break;
 
 		case T_BASE64:
 			if (DM_BINARY(value) && DM_BINARY(value)->len != 0) {
-				char *buf;
-				int r;
+				debug(": base64 len: %d", DM_BINARY(value)->len);
 
-				r = ((DM_BINARY(value)->len + 3) * 4) / 3;
-				buf = malloc(r);
-				if (buf) {
-					debug(": base64 len: %d, buffer: %d", DM_BINARY(value)->len, r);
-					dm_to64(DM_BINARY(value)->data, DM_BINARY(value)->len, buf);
-					debug(": base64 result len: %d", strlen(buf));
-
-					findent(stream, indent);
-					fprintf(stream, "<%s%s >\n", elem->key, nfbuf);
-					for (int i = 0; i < r; i += 64) {
-						findent(stream, indent + 1);
-						if (fprintf(stream, "%.64s\n", &buf[i]) < 0)
-							break;
-					}
-					findent(stream, indent);
-					fprintf(stream, "</%s>\n", elem->key);
-
-					free(buf);
-					break;
-				}
-			}
-
-			findent(stream, indent);
-			fprintf(stream, "<%s%s />\n", elem->key, nfbuf);
+				findent(o, indent);
+				out_char(o, '<');
+				out_str(o, elem->key);
+				out_notify(o, notify);
+				out_mem(o, " >\n", 3);
+				serialize_base64(o, indent + 1, DM_BINARY(value)->data, DM_BINARY(value)->len);
+				findent(o, indent);
+				out_close(o, elem->key);
+			} else
+				out_empty(o, indent, elem->key, notify);
 			break;
 
 		case T_DATE: {
@@ -200,79 +369,104 @@ static void serialize_element(FILE *stream,
 			gmtime_r(DM_TIME_REF(value), &tm);
 			strftime(buf, sizeof(buf), "%Y-%m-%dT%H:%M:%SZ", &tm);
 */
-			findent(stream, indent); fprintf(stream, "<%s%s>%s</%s>\n", elem->key, nfbuf, buf, elem->key);
+			out_open(o, indent, elem->key, notify);
+			out_str(o, buf);
+			out_close(o, elem->key);
 			break;
 		}
 		case T_TICKS: {
+			out_open(o, indent, elem->key, notify);
 			if (elem->flags & F_DATETIME) {
 				char buf[40];
 
 				ticks2str(buf, sizeof(buf), ticks2realtime(DM_TICKS(value)));
-				findent(stream, indent); fprintf(stream, "<%s%s>%s</%s>\n", elem->key, nfbuf, buf, elem->key);
-			} else {
-				findent(stream, indent); fprintf(stream, "<%s%s>%" PRItick "</%s>\n", elem->key, nfbuf, DM_TICKS(value), elem->key);
-			}
+				out_str(o, buf);
+			} else
+				out_int(o, DM_TICKS(value));
+			out_close(o, elem->key);
 			break;
 		}
 		case T_UINT:
-			findent(stream, indent); fprintf(stream, "<%s%s>%u</%s>\n", elem->key, nfbuf, DM_UINT(value), elem->key);
+			out_open(o, indent, elem->key, notify);
+			out_uint(o, DM_UINT(value));
+			out_close(o, elem->key);
 			break;
 		case T_INT:
-			findent(stream, indent); fprintf(stream, "<%s%s>%d</%s>\n", elem->key, nfbuf, DM_INT(value), elem->key);
+			out_open(o, indent, elem->key, notify);
+			out_int(o, DM_INT(value));
+			out_close(o, elem->key);
 			break;
 		case T_UINT64:
-			findent(stream, indent); fprintf(stream, "<%s%s>%"PRIu64"</%s>\n", elem->key, nfbuf, DM_UINT64(value), elem->key);
+			out_open(o, indent, elem->key, notify);
+			out_uint(o, DM_UINT64(value));
+			out_close(o, elem->key);
 			break;
 		case T_INT64:
-			findent(stream, indent); fprintf(stream, "<%s%s>%"PRId64"</%s>\n", elem->key, nfbuf, DM_INT64(value), elem->key);
+			out_open(o, indent, elem->key, notify);
+			out_int(o, DM_INT64(value));
+			out_close(o, elem->key);
 			break;
 		case T_ENUM:
-			findent(stream, indent); fprintf(stream, "<%s%s>%s</%s>\n",
-							 elem->key, nfbuf, dm_int2enum(&elem->u.e, DM_ENUM(value)), elem->key);
+			out_open(o, indent, elem->key, notify);
+			out_str(o, dm_int2enum(&elem->u.e, DM_ENUM(value)));
+			out_close(o, elem->key);
 			break;
 		case T_STR:
-			findent(stream, indent);
-			if (DM_STRING(value) && strlen(DM_STRING(value)) != 0) {
+			if (DM_STRING(value) && *DM_STRING(value)) {
+				const char *s = DM_STRING(value);
+				int len = strlen(s);
 				int r;
 
-				r = validate_cdata(DM_STRING(value), strlen(DM_STRING(value)));
-				if (r == 0)
-					fprintf(stream, "<%s%s>%s</%s>\n", elem->key, nfbuf, DM_STRING(value), elem->key);
-				else if ((r & 2) == 2)
-					string_escape(stream, elem->key, nfbuf, DM_STRING(value), strlen(DM_STRING(value)));
-				else if ((r & 1) == 1)
-					fprintf(stream, "<%s%s><![CDATA[%s]]></%s>\n", elem->key, nfbuf, DM_STRING(value), elem->key);
-				else if (r < 0)
-					fprintf(stream, "<%s%s>%s</%s>\n", elem->key, nfbuf, "invalid CDATA content", elem->key);
-
+				r = validate_cdata(s, len);
+				if (r == 0) {
+					out_open(o, indent, elem->key, notify);
+					out_mem(o, s, len);
+				} else if ((r & 2) == 2) {
+					findent(o, indent);
+					out_char(o, '<');
+					out_str(o, elem->key);
+					out_notify(o, notify);
+					out_str(o, " encoding=\"escaped\">");
+					string_escape(o, s, len);
+				} else if ((r & 1) == 1) {
+					out_open(o, indent, elem->key, notify);
+					out_mem(o, "<![CDATA[", 9);
+					out_mem(o, s, len);
+					out_mem(o, "]]>", 3);
+				} else {
+					out_open(o, indent, elem->key, notify);
+					out_str(o, "invalid CDATA content");
+				}
+				out_close(o, elem->key);
 			} else
-				fprintf(stream, "<%s%s />\n", elem->key, nfbuf);
+				out_empty(o, indent, elem->key, notify);
 			break;
 		case T_SELECTOR: {
 			char buf[MAX_PARAM_NAME_LEN];
 			char *s = NULL;
 
-			findent(stream, indent);
 			if (DM_SELECTOR(value))
 				s = dm_sel2name(*DM_SELECTOR(value), buf, sizeof(buf));
 			if (s) {
-				fprintf(stream, "<%s%s>%s</%s>\n", elem->key, nfbuf, s, elem->key);
+				out_open(o, indent, elem->key, notify);
+				out_str(o, s);
+				out_close(o, elem->key);
 			} else
-				fprintf(stream, "<%s%s />\n", elem->key, nfbuf);
+				out_empty(o, indent, elem->key, notify);
 			break;
 		}
-	        case T_IPADDR4: {
-			char s[INET_ADDRSTRLEN];
-
-			inet_ntop(AF_INET, DM_IP4_REF(value), s, sizeof(s));
-			findent(stream, indent); fprintf(stream, "<%s%s>%.*s</%s>\n", elem->key, nfbuf, INET_ADDRSTRLEN, s, elem->key);
+	        case T_IPADDR4:
+			out_open(o, indent, elem->key, notify);
+			out_ip4(o, DM_IP4_REF(value));
+			out_close(o, elem->key);
 			break;
-		}
 	        case T_IPADDR6: {
 			char s[INET6_ADDRSTRLEN];
 
 			inet_ntop(AF_INET6, DM_IP6_REF(value), s, sizeof(s));
-			findent(stream, indent); fprintf(stream, "<%s%s>%.*s</%s>\n", elem->key, nfbuf, INET6_ADDRSTRLEN, s, elem->key);
+			out_open(o, indent, elem->key, notify);
+			out_str(o, s);
+			out_close(o, elem->key);
 			break;
 		}
 		case T_TOKEN:
@@ -284,6 +478,379 @@ static void serialize_element(FILE *stream,
 	}
 }
 
+/*
+ * JSON output
+ *
+ * RFC 7951 style: tables are objects, multi-instance objects are arrays
+ * of their instances and 64 bit numbers are strings. The XML attributes
+ * become "@" metadata members, see dm_json.h for the reader.
+ */
+
+/* length of the valid multi-byte UTF-8 sequence at p, 0 for anything else */
+static int utf8_seq(const uint8_t *p, int len)
+{
+	int n;
+
+	if (p[0] < 0xc2 || p[0] > 0xf4)
+		return 0;
+
+	n = p[0] < 0xe0 ? 2 : p[0] < 0xf0 ? 3 : 4;
+	if (len < n)
+		return 0;
+	for (int i = 1; i < n; i++)
+		if ((p[i] & 0xc0) != 0x80)
+			return 0;
+
+	/* overlong forms, surrogates and beyond U+10FFFF */
+	if ((p[0] == 0xe0 && p[1] < 0xa0) || (p[0] == 0xed && p[1] >= 0xa0) ||
+	    (p[0] == 0xf0 && p[1] < 0x90) || (p[0] == 0xf4 && p[1] >= 0x90))
+		return 0;
+
+	return n;
+}
+
+/* UTF-8 is copied, control characters and other bytes are escaped */
+static void json_string(struct xml_out *o, const char *str, int len)
+{
+	static const char hex[] = "0123456789abcdef";
+	const uint8_t *s = (const uint8_t *)str;
+
+	out_char(o, '"');
+	while (len > 0) {
+		int n = utf8_seq(s, len);
+
+		if (n) {
+			out_mem(o, s, n);
+		} else if (*s == '"' || *s == '\\') {
+			char *p = out_reserve(o, 2);
+
+			p[0] = '\\';
+			p[1] = *s;
+			o->len += 2;
+			n = 1;
+		} else if (*s < 0x20 || *s >= 0x7f) {
+			char *p = out_reserve(o, 6);
+
+			memcpy(p, "\\u00", 4);
+			p[4] = hex[*s >> 4];
+			p[5] = hex[*s & 0x0f];
+			o->len += 6;
+			n = 1;
+		} else {
+			out_char(o, *s);
+			n = 1;
+		}
+		s += n;
+		len -= n;
+	}
+	out_char(o, '"');
+}
+
+/* all of str is UTF-8 or printable ASCII */
+static int json_utf8(const char *str, int len)
+{
+	const uint8_t *s = (const uint8_t *)str;
+
+	while (len > 0) {
+		int n = *s < 0x80 ? 1 : utf8_seq(s, len);
+
+		if (!n)
+			return 0;
+		s += n;
+		len -= n;
+	}
+	return 1;
+}
+
+/* the octal escapes of string_escape() for the deserializer's encoding="escaped", in a JSON string */
+static void json_string_escaped(struct xml_out *o, const char *str, int len)
+{
+	const uint8_t *s = (const uint8_t *)str;
+
+	out_char(o, '"');
+	for (; len > 0; s++, len--) {
+		if (*s < 0x20 || *s >= 0x7f || *s == '\\' || *s == '"') {
+			char *p = out_reserve(o, 5);
+
+			p[0] = '\\';
+			p[1] = '\\';
+			p[2] = '0' + (*s >> 6);
+			p[3] = '0' + ((*s >> 3) & 7);
+			p[4] = '0' + (*s & 7);
+			o->len += 5;
+		} else
+			out_char(o, *s);
+	}
+	out_char(o, '"');
+}
+
+/* start a member, prefix and key are NULL for an array entry */
+static void json_key(struct walk_data *w, const char *prefix, const char *key)
+{
+	struct xml_out *o = &w->out;
+
+	if (!w->first)
+		out_char(o, ',');
+	out_char(o, '\n');
+	findent(o, w->indent);
+	w->first = 0;
+
+	if (key) {
+		out_char(o, '"');
+		if (prefix)
+			out_str(o, prefix);
+		out_str(o, key);
+		out_mem(o, "\": ", 3);
+	}
+}
+
+static void json_open(struct walk_data *w, const char *key, char c)
+{
+	json_key(w, NULL, key);
+	out_char(&w->out, c);
+	w->first = 1;
+	w->indent++;
+	if (w->indent < JSON_DEPTH)
+		w->array[w->indent] = c == '[';
+}
+
+static void json_close(struct walk_data *w, char c)
+{
+	w->indent--;
+	if (!w->first) {
+		out_char(&w->out, '\n');
+		findent(&w->out, w->indent);
+	}
+	out_char(&w->out, c);
+	w->first = 0;
+}
+
+static inline int json_in_array(struct walk_data *w)
+{
+	return w->indent < JSON_DEPTH && w->array[w->indent];
+}
+
+/* "@key": {"attr": , the caller writes the value and the closing brace */
+static void json_meta(struct walk_data *w, const char *key, const char *attr)
+{
+	json_key(w, "@", key ? : "");
+	out_mem(&w->out, "{\"", 2);
+	out_str(&w->out, attr);
+	out_mem(&w->out, "\": ", 3);
+}
+
+static void json_element(struct walk_data *w, const struct dm_element *elem, const DM_VALUE value)
+{
+	struct xml_out *o = &w->out;
+	const char *notify = NULL;
+	int escaped = 0;
+
+	/* JSON strings are Unicode, other bytes would not come back */
+	if (elem->type == T_STR && DM_STRING(value))
+		escaped = !json_utf8(DM_STRING(value), strlen(DM_STRING(value)));
+
+	if (value.notify & 0x0003) {
+		notify = dm_int2enum(&notify_attr, value.notify & 0x0003);
+
+		json_meta(w, elem->key, "notify");
+		json_string(o, notify, strlen(notify));
+		if (escaped)
+			out_str(o, ", \"encoding\": \"escaped\"");
+		out_char(o, '}');
+	} else if (escaped) {
+		json_meta(w, elem->key, "encoding");
+		out_str(o, "\"escaped\"}");
+	}
+
+	/* don't serialize counters */
+	if (elem->type == T_COUNTER) {
+		if (notify) {
+			json_key(w, NULL, elem->key);
+			out_mem(o, "null", 4);
+		}
+		return;
+	}
+
+	json_key(w, NULL, elem->key);
+
+	switch(elem->type) {
+		case T_BOOL:
+			out_str(o, DM_BOOL(value) ? "true" : "false");
+			break;
+
+		case T_BINARY:
+			if (DM_BINARY(value) && DM_BINARY(value)->len != 0)
+				json_string(o, (const char *)DM_BINARY(value)->data, DM_BINARY(value)->len);
+			else
+				out_mem(o, "null", 4);
+			break;
+
+		case T_BASE64:
+			if (DM_BINARY(value) && DM_BINARY(value)->len != 0) {
+				const uint8_t *data = DM_BINARY(value)->data;
+				int len = DM_BINARY(value)->len;
+
+				out_char(o, '"');
+				for (int i = 0; i < len; i += 48) {
+					int n = len - i < 48 ? len - i : 48;
+
+					dm_to64(data + i, n, out_reserve(o, 64 + 1));
+					o->len += (n + 2) / 3 * 4;
+				}
+				out_char(o, '"');
+			} else
+				out_mem(o, "null", 4);
+			break;
+
+		case T_DATE: {
+			char buf[40];
+
+			ticks2str(buf, sizeof(buf), time2ticks(DM_TIME(value)));
+			json_string(o, buf, strlen(buf));
+			break;
+		}
+		case T_TICKS:
+			if (elem->flags & F_DATETIME) {
+				char buf[40];
+
+				ticks2str(buf, sizeof(buf), ticks2realtime(DM_TICKS(value)));
+				json_string(o, buf, strlen(buf));
+			} else
+				out_int(o, DM_TICKS(value));
+			break;
+
+		case T_UINT:
+			out_uint(o, DM_UINT(value));
+			break;
+		case T_INT:
+			out_int(o, DM_INT(value));
+			break;
+		case T_UINT64:
+			out_char(o, '"');
+			out_uint(o, DM_UINT64(value));
+			out_char(o, '"');
+			break;
+		case T_INT64:
+			out_char(o, '"');
+			out_int(o, DM_INT64(value));
+			out_char(o, '"');
+			break;
+
+		case T_ENUM: {
+			const char *s = dm_int2enum(&elem->u.e, DM_ENUM(value));
+
+			json_string(o, s, strlen(s));
+			break;
+		}
+		case T_STR:
+			if (escaped)
+				json_string_escaped(o, DM_STRING(value), strlen(DM_STRING(value)));
+			else if (DM_STRING(value) && *DM_STRING(value))
+				json_string(o, DM_STRING(value), strlen(DM_STRING(value)));
+			else
+				out_mem(o, "null", 4);
+			break;
+
+		case T_SELECTOR: {
+			char buf[MAX_PARAM_NAME_LEN];
+			char *s = NULL;
+
+			if (DM_SELECTOR(value))
+				s = dm_sel2name(*DM_SELECTOR(value), buf, sizeof(buf));
+			if (s)
+				json_string(o, s, strlen(s));
+			else
+				out_mem(o, "null", 4);
+			break;
+		}
+		case T_IPADDR4:
+			out_char(o, '"');
+			out_ip4(o, DM_IP4_REF(value));
+			out_char(o, '"');
+			break;
+		case T_IPADDR6: {
+			char s[INET6_ADDRSTRLEN];
+
+			inet_ntop(AF_INET6, DM_IP6_REF(value), s, sizeof(s));
+			json_string(o, s, strlen(s));
+			break;
+		}
+		default:
+			out_mem(o, "null", 4);
+			fprintf(stderr, "unexpected element type: %s: %d (%p)\n", elem->key, elem->type, elem);
+			break;
+	}
+}
+
+/* write the start of the container a CB_*_start callback enters */
+static void container_open(struct walk_data *w, CB_type type, dm_id id, const struct dm_element *elem)
+{
+	switch (type) {
+		case CB_object_start:
+			if (w->flags & S_JSON)
+				json_open(w, elem->key, '[');
+			break;
+		case CB_object_instance_start:
+			if (w->flags & S_JSON) {
+				/* an instance dumped by itself is a member */
+				json_open(w, json_in_array(w) ? NULL : elem->key, '{');
+				json_meta(w, NULL, "instance");
+				out_uint(&w->out, id);
+				out_char(&w->out, '}');
+				break;
+			}
+			findent(&w->out, w->indent);
+			out_char(&w->out, '<');
+			out_str(&w->out, elem->key);
+			out_mem(&w->out, " instance='", 11);
+			out_uint(&w->out, id);
+			out_mem(&w->out, "'>\n", 3);
+			w->indent++;
+			break;
+		case CB_table_start:
+			if (w->flags & S_JSON) {
+				json_open(w, elem->key, '{');
+				if (elem->flags & F_VERSION) {
+					json_meta(w, NULL, "version");
+					out_int(&w->out, CFG_VERSION);
+					out_char(&w->out, '}');
+				}
+				break;
+			}
+			findent(&w->out, w->indent);
+			out_char(&w->out, '<');
+			out_str(&w->out, elem->key);
+			if (elem->flags & F_VERSION) {
+				out_mem(&w->out, " version=\"", 10);
+				out_int(&w->out, CFG_VERSION);
+				out_char(&w->out, '"');
+			}
+			out_mem(&w->out, ">\n", 2);
+			w->indent++;
+			break;
+		default:
+			break;
+	}
+}
+
+/* write the end of the container, type is the callback that entered it */
+static void container_close(struct walk_data *w, CB_type type, const struct dm_element *elem)
+{
+	if (type == CB_object_start) {
+		if (w->flags & S_JSON)
+			json_close(w, ']');
+		return;
+	}
+
+	if (w->flags & S_JSON) {
+		json_close(w, '}');
+		return;
+	}
+	w->indent--;
+	findent(&w->out, w->indent);
+	out_close(&w->out, elem->key);
+}
+
 static int serialize_walk_cb(void *userData, CB_type type, dm_id id,
 			     const struct dm_element *elem, const DM_VALUE value)
 {
@@ -298,44 +865,50 @@ static int serialize_walk_cb(void *userData, CB_type type, dm_id id,
 	if ((elem->flags & F_INTERNAL) != 0)
 		return r;
 
+	if (w->out.stop)
+		return 0;
+
 	if ((value.flags & (DV_UPDATED | DV_NOTIFY)) == 0 && (w->flags & S_SYS) == 0)
 		return 0;
 
 	switch (type) {
+		case CB_object_start:
+			container_open(w, type, id, elem);
+			break;
+		case CB_object_end:
+			container_close(w, CB_object_start, elem);
+			break;
 		case CB_object_instance_start:
 			debug(": %d", id);
 			if (((id & DM_ID_AUTO_OBJECT) != DM_ID_AUTO_OBJECT &&
 			     (elem->flags & F_SYSTEM) == 0) ||
-			    (w->flags & S_SYS) != 0) {
-				findent(w->stream, w->indent);
-				fprintf(w->stream, "<%s instance='%hu'>\n", elem->key, id);
-				w->indent++;
-			} else
+			    (w->flags & S_SYS) != 0)
+				container_open(w, type, id, elem);
+			else
 				r = 0;
 			break;
 		case CB_table_start:
 			if ((elem->flags & F_SYSTEM) == 0 ||
-			    (w->flags & S_SYS) != 0) {
-				findent(w->stream, w->indent);
-				if (elem->flags & F_VERSION)
-					fprintf(w->stream, "<%s version=\"%d\">\n", elem->key, CFG_VERSION);
-				else
-					fprintf(w->stream, "<%s>\n", elem->key);
-				w->indent++;
-			} else
+			    (w->flags & S_SYS) != 0)
+				container_open(w, type, id, elem);
+			else
 				r = 0;
 			break;
 		case CB_table_end:
+			container_close(w, CB_table_start, elem);
+			break;
 		case CB_object_instance_end:
-			w->indent--;
-			findent(w->stream, w->indent);
-			fprintf(w->stream, "</%s>\n", elem->key);
+			container_close(w, CB_object_instance_start, elem);
 			break;
 		case CB_element:
 			if (((elem->flags & F_WRITE) != 0 &&
 			     (elem->flags & F_SYSTEM) == 0) ||
-			    (w->flags & S_SYS) != 0)
-				serialize_element(w->stream, w->flags, w->indent, elem, value);
+			    (w->flags & S_SYS) != 0) {
+				if (w->flags & S_JSON)
+					json_element(w, elem, value);
+				else
+					serialize_element(&w->out, w->flags, w->indent, elem, value);
+			}
 			break;
 		default:
 			break;
@@ -343,39 +916,279 @@ static int serialize_walk_cb(void *userData, CB_type type, dm_id id,
 	return r;
 }
 
-void dm_serialize_store(FILE *stream, int flags)
+/*
+ * differential output
+ *
+ * Containers are only written once something below them differs from
+ * the baseline, until then they wait on the stack. Instances the
+ * baseline has but the store lost are written as deleted markers.
+ */
+
+/* enter a container, 0 when the selector is full */
+static int diff_push(struct walk_data *w, CB_type type, dm_id id, const struct dm_element *elem)
 {
-	struct walk_data w;
+	if (w->len == DM_SELECTOR_LEN)
+		return 0;
 
-	w.stream = stream;
-	w.flags = flags;
-	w.indent = 1;
+	w->stack[w->depth].type = type;
+	w->stack[w->depth].id = id;
+	w->stack[w->depth].elem = elem;
+	w->depth++;
+
+	w->sel[w->len++] = id;
+	if (w->len < DM_SELECTOR_LEN)
+		w->sel[w->len] = 0;
+
+	return 1;
+}
+
+/* write the containers still waiting on the stack */
+static void diff_flush(struct walk_data *w)
+{
+	for (; w->written < w->depth; w->written++)
+		container_open(w, w->stack[w->written].type, w->stack[w->written].id, w->stack[w->written].elem);
+}
+
+static void diff_pop(struct walk_data *w)
+{
+	w->depth--;
+	w->sel[--w->len] = 0;
+
+	if (w->written > w->depth) {
+		container_close(w, w->stack[w->depth].type, w->stack[w->depth].elem);
+		w->written = w->depth;
+	}
+}
+
+static void diff_deleted(struct walk_data *w, const struct dm_element *elem, DM_VALUE value)
+{
+	struct dm_instance *inst = DM_INSTANCE(value);
+
+	if ((elem->flags & F_SYSTEM) != 0 && (w->flags & S_SYS) == 0)
+		return;
+
+	for (dm_id id = dm_baseline_next_instance(w->base, w->sel, 0);
+	     id != 0;
+	     id = dm_baseline_next_instance(w->base, w->sel, id)) {
+		if (dm_get_instance_node_by_id(inst, id))
+			continue;
+
+		diff_flush(w);
+		if (w->flags & S_JSON) {
+			json_open(w, NULL, '{');
+			json_meta(w, NULL, "deleted");
+			out_mem(&w->out, "true, \"instance\": ", 18);
+			out_uint(&w->out, id);
+			out_char(&w->out, '}');
+			json_close(w, '}');
+		} else {
+			findent(&w->out, w->indent);
+			out_char(&w->out, '<');
+			out_str(&w->out, elem->key);
+			out_mem(&w->out, " deleted=\"true\" instance='", 26);
+			out_uint(&w->out, id);
+			out_mem(&w->out, "' />\n", 5);
+		}
+	}
+}
+
+static int serialize_diff_cb(void *userData, CB_type type, dm_id id,
+			     const struct dm_element *elem, const DM_VALUE value)
+{
+	struct walk_data *w = (struct walk_data *)userData;
+	int updated = (value.flags & (DV_UPDATED | DV_NOTIFY)) != 0;
+	int changed;
+
+	if ((elem->flags & F_INTERNAL) != 0)
+		return 1;
+
+	if (w->out.stop)
+		return 0;
+
+	switch (type) {
+		case CB_object_instance_start:
+			if ((id & DM_ID_AUTO_OBJECT) == DM_ID_AUTO_OBJECT && (w->flags & S_SYS) == 0)
+				return 0;
+			/* fall through */
+		case CB_table_start:
+			if ((elem->flags & F_SYSTEM) != 0 && (w->flags & S_SYS) == 0)
+				return 0;
+			/* fall through */
+		case CB_object_start:
+			if (!diff_push(w, type, id, elem))
+				return 0;
+
+			/* nothing below was changed and the baseline has nothing there either */
+			if (!updated && !dm_baseline_covers(w->base, w->sel)) {
+				diff_pop(w);
+				return 0;
+			}
+
+			/* an instance the baseline lacks is written even without values */
+			if (type == CB_object_instance_start && !dm_baseline_covers(w->base, w->sel))
+				diff_flush(w);
+			break;
+
+		case CB_object_end:
+			diff_deleted(w, elem, value);
+			diff_pop(w);
+			break;
+		case CB_table_end:
+		case CB_object_instance_end:
+			diff_pop(w);
+			break;
+
+		case CB_element:
+			if ((((elem->flags & F_WRITE) == 0 || (elem->flags & F_SYSTEM) != 0) &&
+			     (w->flags & S_SYS) == 0) ||
+			    w->len == DM_SELECTOR_LEN)
+				break;
+
+			w->sel[w->len] = id;
+			if (w->len + 1 < DM_SELECTOR_LEN)
+				w->sel[w->len + 1] = 0;
+			changed = (updated || dm_baseline_covers(w->base, w->sel)) &&
+				dm_baseline_changed(w->base, w->sel, elem, value);
+			w->sel[w->len] = 0;
+
+			if (changed) {
+				diff_flush(w);
+				if (w->flags & S_JSON)
+					json_element(w, elem, value);
+				else
+					serialize_element(&w->out, w->flags, w->indent, elem, value);
+			}
+			break;
+
+		default:
+			break;
+	}
+	return 1;
+}
+
+static struct walk_data *walk_data_new(dm_serialize_write *write, void *data, int flags)
+{
+	struct walk_data *w;
+
+	if (!(w = malloc(sizeof(struct walk_data))))
+		return NULL;
+
+	w->out.write = write;
+	w->out.data = data;
+	w->out.stop = 0;
+	w->out.len = 0;
+	w->flags = flags;
+	w->indent = 1;
+	w->first = 1;
+	memset(w->array, 0, sizeof(w->array));
+
+	w->base = NULL;
+	memset(w->sel, 0, sizeof(w->sel));
+	w->len = 0;
+	w->depth = 0;
+	w->written = 0;
+
+	if ((flags & S_DIFF) && !(w->base = dm_baseline_get())) {
+		free(w);
+		return NULL;
+	}
+
+	return w;
+}
+
+static void walk_data_free(struct walk_data *w)
+{
+	free(w);
+}
+
+static int file_write(const void *data, size_t len, void *stream)
+{
+	return fwrite(data, len, 1, stream) != 1;
+}
+
+int dm_serialize_store_cb(dm_serialize_write *write, void *data, int flags)
+{
+	walk_cb *cb = (flags & S_DIFF) ? serialize_diff_cb : serialize_walk_cb;
+	struct walk_data *w;
+
+	if (!(w = walk_data_new(write, data, flags)))
+		return -1;
 
 	dm_update_flags();
 
-	fprintf(stream, "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n");
-	fprintf(stream, "<OpenCPE version=\"%d\">\n", CFG_VERSION);
-	dm_walk_table_cb(DM_SELECTOR_LEN, &w, serialize_walk_cb, &dm_root, dm_value_store);
-	fprintf(stream, "</OpenCPE>\n");
+	if (flags & S_JSON) {
+		out_char(&w->out, '{');
+		json_open(w, "OpenCPE", '{');
+		json_meta(w, NULL, "version");
+		out_int(&w->out, CFG_VERSION);
+		out_char(&w->out, '}');
+		dm_walk_table_cb(DM_SELECTOR_LEN, w, cb, &dm_root, dm_value_store);
+		json_close(w, '}');
+		json_close(w, '}');
+		out_char(&w->out, '\n');
+	} else {
+		out_str(&w->out, "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n");
+		out_str(&w->out, "<OpenCPE version=\"");
+		out_int(&w->out, CFG_VERSION);
+		out_str(&w->out, "\">\n");
+		dm_walk_table_cb(DM_SELECTOR_LEN, w, cb, &dm_root, dm_value_store);
+		out_str(&w->out, "</OpenCPE>\n");
+	}
+
+	out_flush(&w->out);
+	walk_data_free(w);
+
+	return 0;
 }
 
-void dm_serialize_element(FILE *stream, const char *element, int flags)
+int dm_serialize_element_cb(const char *element, dm_serialize_write *write, void *data, int flags)
 {
-	struct walk_data w;
+	walk_cb *cb = (flags & S_DIFF) ? serialize_diff_cb : serialize_walk_cb;
+	struct walk_data *w;
 	dm_selector sel;
 
 	if (!dm_name2sel(element, &sel))
-		return;
+		return -1;
+
+	if (!(w = walk_data_new(write, data, flags)))
+		return -1;
+
+	/* the walk starts with the element itself */
+	if (flags & S_DIFF) {
+		dm_selcpy(w->sel, sel);
+		w->len = dm_sellen(sel);
+		if (w->len)
+			w->sel[--w->len] = 0;
+	}
 
 	dm_update_flags();
 
-	w.stream = stream;
-	w.flags = flags;
-	w.indent = 1;
+	if (flags & S_JSON) {
+		out_char(&w->out, '{');
+		json_open(w, "data", '{');
+		dm_walk_by_selector_cb(sel, DM_SELECTOR_LEN, w, cb);
+		json_close(w, '}');
+		json_close(w, '}');
+		out_char(&w->out, '\n');
+	} else {
+		out_str(&w->out, "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n");
+		out_str(&w->out, "<data>\n");
+		dm_walk_by_selector_cb(sel, DM_SELECTOR_LEN, w, cb);
+		out_str(&w->out, "</data>\n");
+	}
+
+	out_flush(&w->out);
+	walk_data_free(w);
+
+	return 0;
+}
 
-	fprintf(stream, "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n");
-	fprintf(stream, "<data>\n");
-	dm_walk_by_selector_cb(sel, DM_SELECTOR_LEN, &w, serialize_walk_cb);
-	fprintf(stream, "</data>\n");
+void dm_serialize_store(FILE *stream, int flags)
+{
+	dm_serialize_store_cb(file_write, stream, flags);
 }
 
+void dm_serialize_element(FILE *stream, const char *element, int flags)
+{
+	dm_serialize_element_cb(element, file_write, stream, flags);
+}
@@ -15,9 +15,30 @@
 #define S_SYS  (1 << 2)
 #define S_ALL  (S_CFG | S_ACS | S_SYS)
 
+/* write JSON instead of XML, dm_deserialize_store() reads both */
+#define S_JSON (1 << 3)
+
+/*
+ * only write what differs from the base and default config, see
+ * dm_baseline.h: changed leaves, added instances and deleted markers
+ * for removed ones. Loaded on top of that config it restores the store.
+ */
+#define S_DIFF (1 << 4)
+
 struct dm_enum notify_attr;
 
 void dm_serialize_store(FILE *stream, int flags);
 void dm_serialize_element(FILE *stream, const char *element, int flags);
 
+/*
+ * serialize into a sink instead of a stream
+ *
+ * write is called with consecutive chunks of the output, a non-zero
+ * return stops the serialization. Returns -1 when element is unknown.
+ */
+typedef int dm_serialize_write(const void *data, size_t len, void *userData);
+
+int dm_serialize_store_cb(dm_serialize_write *write, void *data, int flags);
+int dm_serialize_element_cb(const char *element, dm_serialize_write *write, void *data, int flags);
+
 #endif /* __DM_SERIALIZE_H */
@@ -0,0 +1,437 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+/*
+ * copy-on-write snapshots of the value store
+ *
+ * A snapshot does not copy anything when it is pinned. Before a writer
+ * modifies or deletes a table, the values of that table are copied into
+ * every pinned snapshot that does not yet hold the table. Tables added
+ * after the snapshot get an empty marker. Readers of a snapshot take the
+ * preserved copy when there is one and the live table otherwise, so they
+ * see the store as it was at pin time while writers only pay for the
+ * tables they touch.
+ *
+ * Values kept in the store by other means than the dm_set_* functions
+ * (counter references, F_GET elements) are read live.
+ *
+ * Readers resolve a selector through the live instance trees, writers
+ * hold the snapshot lock while they insert or remove instances and
+ * tables. The lock is recursive, the store hooks run inside those
+ * sections. A writer that tested dm_snapshot_cnt before a snapshot was
+ * pinned on another thread may still finish its value change unpreserved,
+ * pin on the writer thread when that matters.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include <sys/queue.h>
+#include <sys/tree.h>
+
+#define SDEBUG
+#include "debug.h"
+
+#include "dm_token.h"
+#include "dm_store.h"
+#include "dm_store_priv.h"
+#include "dm_index.h"
+#include "dm_snapshot.h"
+
+struct snapshot_table {
+	RB_ENTRY(snapshot_table) node;
+
+	dm_selector id;
+	const struct dm_table *kw;
+	DM_VALUE *values;		/* NULL: the table did not exist when the snapshot was pinned */
+};
+
+RB_HEAD(snapshot_tree, snapshot_table);
+
+struct dm_snapshot {
+	LIST_ENTRY(dm_snapshot) list;
+
+	uint64_t version;
+	struct snapshot_tree tables;
+};
+
+static int
+snapshot_table_compare(struct snapshot_table *a, struct snapshot_table *b)
+{
+	return dm_selcmp(a->id, b->id, DM_SELECTOR_LEN);
+}
+
+RB_PROTOTYPE(snapshot_tree, snapshot_table, node, snapshot_table_compare);
+RB_GENERATE(snapshot_tree, snapshot_table, node, snapshot_table_compare);
+
+volatile int dm_snapshot_cnt = 0;
+
+/* recursive, set up on first use */
+static pthread_mutex_t snapshot_lock;
+static pthread_once_t snapshot_once = PTHREAD_ONCE_INIT;
+static LIST_HEAD(snapshot_list, dm_snapshot) snapshots = LIST_HEAD_INITIALIZER(snapshots);
+
+static void snapshot_lock_init(void)
+{
+	pthread_mutexattr_t attr;
+
+	pthread_mutexattr_init(&attr);
+	pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+	pthread_mutex_init(&snapshot_lock, &attr);
+	pthread_mutexattr_destroy(&attr);
+}
+
+static pthread_mutex_t *snapshot_mutex(void)
+{
+	pthread_once(&snapshot_once, snapshot_lock_init);
+	return &snapshot_lock;
+}
+
+/* keyword table of the value table with the given id */
+static const struct dm_table *snapshot_kw(const dm_selector sel)
+{
+	const struct dm_table *kw = &dm_root;
+	int t = T_TOKEN;
+
+	for (int i = 0; i < DM_SELECTOR_LEN && sel[i] && kw; i++) {
+		const struct dm_element *elem;
+
+		if (t == T_OBJECT) {
+			t = T_TOKEN;
+			continue;
+		}
+
+		if (sel[i] > kw->size)
+			return NULL;
+
+		elem = kw->table + sel[i] - 1;
+		t = elem->type;
+		if (t != T_TOKEN && t != T_OBJECT)
+			return NULL;
+		kw = elem->u.t.table;
+	}
+
+	return t == T_OBJECT ? NULL : kw;
+}
+
+static struct snapshot_table *snapshot_find(struct dm_snapshot *s, const dm_selector id)
+{
+	struct snapshot_table key;
+
+	dm_selcpy(key.id, id);
+	return RB_FIND(snapshot_tree, &s->tables, &key);
+}
+
+static void snapshot_free_values(struct snapshot_table *t)
+{
+	if (!t->values)
+		return;
+
+	for (int i = 0; i < t->kw->size; i++) {
+		switch (t->kw->table[i].type) {
+		case T_STR:
+			dm_free_string_value(&t->values[i]);
+			break;
+
+		case T_BINARY:
+		case T_BASE64:
+			dm_free_binary_value(&t->values[i]);
+			break;
+
+		case T_SELECTOR:
+			dm_free_selector_value(&t->values[i]);
+			break;
+		}
+	}
+	free(t->values);
+}
+
+static DM_VALUE *snapshot_copy_values(const struct dm_table *kw, const struct dm_value_table *st)
+{
+	DM_VALUE *values;
+	DM_RESULT r = DM_OK;
+
+	if (!(values = calloc(kw->size, sizeof(DM_VALUE))))
+		return NULL;
+
+	for (int i = 0; i < kw->size && r == DM_OK; i++) {
+		const DM_VALUE *src = &st->values[i];
+		DM_VALUE *dst = &values[i];
+
+		*dst = *src;
+
+		switch (kw->table[i].type) {
+		case T_STR:
+			set_DM_STRING(*dst, NULL);
+			DM_parity_update(*dst);
+			r = dm_set_string_value(dst, DM_STRING(*src));
+			break;
+
+		case T_BINARY:
+		case T_BASE64:
+			set_DM_BINARY(*dst, NULL);
+			DM_parity_update(*dst);
+			r = dm_set_binary_value(dst, DM_BINARY(*src));
+			break;
+
+		case T_SELECTOR:
+			set_DM_SELECTOR(*dst, NULL);
+			DM_parity_update(*dst);
+			if (DM_SELECTOR(*src))
+				r = dm_set_selector_value(dst, *DM_SELECTOR(*src));
+			break;
+
+		case T_TOKEN:
+		case T_OBJECT:
+			/* structure is resolved through the live store and the markers */
+			memset(&dst->_v, 0, sizeof(dst->_v));
+			DM_parity_update(*dst);
+			break;
+		}
+	}
+
+	if (r != DM_OK) {
+		struct snapshot_table t = { .kw = kw, .values = values };
+
+		snapshot_free_values(&t);
+		return NULL;
+	}
+
+	return values;
+}
+
+/* called with the snapshot lock held */
+static void snapshot_preserve_table(struct dm_snapshot *s, const struct dm_table *kw, struct dm_value_table *st)
+{
+	struct snapshot_table *t;
+
+	if (!kw || snapshot_find(s, st->id))
+		return;
+
+	if (!(t = calloc(1, sizeof(struct snapshot_table))))
+		return;
+
+	dm_selcpy(t->id, st->id);
+	t->kw = kw;
+	if (!(t->values = snapshot_copy_values(kw, st))) {
+		debug("(): out of memory, snapshot %p loses table", s);
+		free(t);
+		return;
+	}
+
+	RB_INSERT(snapshot_tree, &s->tables, t);
+}
+
+static void snapshot_preserve_tree(struct dm_snapshot *s, const struct dm_table *kw, struct dm_value_table *st)
+{
+	if (!st)
+		return;
+
+	snapshot_preserve_table(s, kw, st);
+
+	for (int i = 0; i < kw->size; i++) {
+		const struct dm_element *elem = &kw->table[i];
+		struct dm_instance_node *node;
+
+		switch (elem->type) {
+		case T_TOKEN:
+			snapshot_preserve_tree(s, elem->u.t.table, DM_TABLE(st->values[i]));
+			break;
+
+		case T_OBJECT:
+			for (node = dm_instance_first(DM_INSTANCE(st->values[i]));
+			     node;
+			     node = dm_instance_next(DM_INSTANCE(st->values[i]), node))
+				snapshot_preserve_tree(s, elem->u.t.table, DM_TABLE(node->table));
+			break;
+		}
+	}
+}
+
+void __dm_snapshot_preserve(struct dm_value_table *st)
+{
+	const struct dm_table *kw;
+	struct dm_snapshot *s;
+
+	pthread_mutex_lock(snapshot_mutex());
+
+	kw = snapshot_kw(st->id);
+	LIST_FOREACH(s, &snapshots, list)
+		snapshot_preserve_table(s, kw, st);
+
+	pthread_mutex_unlock(&snapshot_lock);
+}
+
+void __dm_snapshot_preserve_ref(const struct dm_element_ref *ref)
+{
+	const struct dm_element *elem = ref->kw_elem;
+	struct dm_snapshot *s;
+	struct dm_instance_node *node;
+
+	pthread_mutex_lock(snapshot_mutex());
+
+	LIST_FOREACH(s, &snapshots, list) {
+		switch (ref->st_type) {
+		case T_INSTANCE:
+			snapshot_preserve_tree(s, elem->u.t.table, DM_TABLE(*ref->st_value));
+			break;
+
+		case T_OBJECT:
+			for (node = dm_instance_first(DM_INSTANCE(*ref->st_value));
+			     node;
+			     node = dm_instance_next(DM_INSTANCE(*ref->st_value), node))
+				snapshot_preserve_tree(s, elem->u.t.table, DM_TABLE(node->table));
+			break;
+
+		case T_TOKEN:
+			snapshot_preserve_tree(s, elem->u.t.table, DM_TABLE(*ref->st_value));
+			break;
+
+		default:
+			snapshot_preserve_table(s, ref->kw_base, ref->st_base);
+			break;
+		}
+	}
+
+	pthread_mutex_unlock(&snapshot_lock);
+}
+
+void __dm_snapshot_created(struct dm_value_table *st)
+{
+	struct dm_snapshot *s;
+	struct snapshot_table *t;
+
+	pthread_mutex_lock(snapshot_mutex());
+
+	LIST_FOREACH(s, &snapshots, list) {
+		if (snapshot_find(s, st->id))
+			continue;
+
+		if (!(t = calloc(1, sizeof(struct snapshot_table))))
+			continue;
+
+		dm_selcpy(t->id, st->id);
+		RB_INSERT(snapshot_tree, &s->tables, t);
+	}
+
+	pthread_mutex_unlock(&snapshot_lock);
+}
+
+void dm_snapshot_lock(void)
+{
+	pthread_mutex_lock(snapshot_mutex());
+}
+
+void dm_snapshot_unlock(void)
+{
+	pthread_mutex_unlock(&snapshot_lock);
+}
+
+struct dm_snapshot *dm_snapshot_pin(void)
+{
+	struct dm_snapshot *s;
+
+	if (!(s = malloc(sizeof(struct dm_snapshot))))
+		return NULL;
+
+	RB_INIT(&s->tables);
+
+	pthread_mutex_lock(snapshot_mutex());
+
+	s->version = dm_store_version;
+	LIST_INSERT_HEAD(&snapshots, s, list);
+	dm_snapshot_cnt++;
+
+	pthread_mutex_unlock(&snapshot_lock);
+
+	return s;
+}
+
+void dm_snapshot_release(struct dm_snapshot *s)
+{
+	struct snapshot_table *t;
+
+	if (!s)
+		return;
+
+	pthread_mutex_lock(snapshot_mutex());
+
+	LIST_REMOVE(s, list);
+	dm_snapshot_cnt--;
+
+	pthread_mutex_unlock(&snapshot_lock);
+
+	while ((t = RB_ROOT(&s->tables))) {
+		RB_REMOVE(snapshot_tree, &s->tables, t);
+		snapshot_free_values(t);
+		free(t);
+	}
+	free(s);
+}
+
+uint64_t dm_snapshot_version(const struct dm_snapshot *s)
+{
+	return s->version;
+}
+
+DM_RESULT dm_snapshot_get_value_by_selector_cb(struct dm_snapshot *s, const dm_selector sel, int type, void *userData,
+					       DM_RESULT (*cb)(void *, const dm_selector, const struct dm_element *, int st_type, const DM_VALUE))
+{
+	struct dm_element *elem;
+	struct dm_element_ref ref;
+	struct snapshot_table *t = NULL;
+	dm_selector id;
+	DM_RESULT r;
+	int len;
+
+	if (!cb)
+		return DM_INVALID_VALUE;
+
+	switch (dm_get_element_by_selector(sel, &elem)) {
+	case T_NONE:
+		return DM_VALUE_NOT_FOUND;
+
+	case T_TOKEN:
+	case T_OBJECT:
+		return DM_INVALID_TYPE;
+	}
+
+	if (type != T_ANY && elem->type != type)
+		return DM_INVALID_TYPE;
+
+	for (len = 0; len < DM_SELECTOR_LEN && sel[len]; len++)
+		;
+	if (len == 0)
+		return DM_VALUE_NOT_FOUND;
+
+	pthread_mutex_lock(snapshot_mutex());
+
+	/* a marker on the table or any table above it hides tables added later */
+	memset(id, 0, sizeof(dm_selector));
+	for (int i = 0; i < len; i++) {
+		id[i] = 0;
+		if ((t = snapshot_find(s, id)) && !t->values) {
+			pthread_mutex_unlock(&snapshot_lock);
+			return DM_VALUE_NOT_FOUND;
+		}
+		id[i] = sel[i];
+	}
+
+	/* t is the entry of the table holding the value, if there is one */
+	if (t && t->values)
+		r = cb(userData, sel, elem, elem->type, t->values[sel[len - 1] - 1]);
+	else if (dm_get_element_ref(sel, &ref))
+		r = cb(userData, sel, elem, ref.st_type, dm_get_element_value(type, &ref));
+	else
+		r = DM_VALUE_NOT_FOUND;
+
+	pthread_mutex_unlock(&snapshot_lock);
+
+	return r;
+}
@@ -0,0 +1,62 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef __DM_SNAPSHOT_H
+#define __DM_SNAPSHOT_H
+
+#include <stdint.h>
+
+#include "compiler.h"
+#include "dm_store.h"
+
+struct dm_element_ref;
+struct dm_snapshot;
+
+/* number of pinned snapshots, writers only take the snapshot lock when it is not 0 */
+extern volatile int dm_snapshot_cnt;
+
+/* a lazy subtree loaded after the pin was there all along, readers see it as loaded */
+struct dm_snapshot *dm_snapshot_pin(void);
+void dm_snapshot_release(struct dm_snapshot *);
+uint64_t dm_snapshot_version(const struct dm_snapshot *);
+
+/* held by writers while they change the instance trees snapshot readers walk */
+void dm_snapshot_lock(void);
+void dm_snapshot_unlock(void);
+
+/* cb runs with the snapshot lock held and must not modify the store */
+DM_RESULT dm_snapshot_get_value_by_selector_cb(struct dm_snapshot *, const dm_selector sel, int type, void *userData,
+					       DM_RESULT (*cb)(void *, const dm_selector, const struct dm_element *, int st_type, const DM_VALUE))
+	__attribute__((nonnull (1, 2)));
+
+void __dm_snapshot_preserve(struct dm_value_table *);
+void __dm_snapshot_preserve_ref(const struct dm_element_ref *);
+void __dm_snapshot_created(struct dm_value_table *);
+
+/*
+ * store hooks
+ *
+ * dm_snapshot_preserve() has to run before a table is modified,
+ * dm_snapshot_preserve_ref() before the referenced element is deleted and
+ * dm_snapshot_created() after a table was added
+ */
+static inline void dm_snapshot_preserve(struct dm_value_table *t)
+{
+	if (unlikely(dm_snapshot_cnt) && t)
+		__dm_snapshot_preserve(t);
+}
+
+static inline void dm_snapshot_preserve_ref(const struct dm_element_ref *ref)
+{
+	if (unlikely(dm_snapshot_cnt))
+		__dm_snapshot_preserve_ref(ref);
+}
+
+static inline void dm_snapshot_created(struct dm_value_table *t)
+{
+	if (unlikely(dm_snapshot_cnt) && t)
+		__dm_snapshot_created(t);
+}
+
+#endif
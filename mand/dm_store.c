@@ -23,6 +23,8 @@
 #include "dm_action.h"
 #include "dm_store_priv.h"
 #include "dm_serialize.h"
+#include "dm_snapshot.h"
+#include "dm_binconfig.h"
 
 //#define SDEBUG
 #include "debug.h"
@@ -31,6 +33,12 @@ extern const struct dm_table keyword_2_tab;
 
 struct dm_value_table *dm_value_store;
 
+uint64_t dm_store_version;
+uint64_t dm_config_version;
+
+const uint8_t *dm_base_image;
+size_t dm_base_image_size;
+
 #if defined(DM_MEM_ACCOUNTING)
 int dm_mem = 0;
 #endif
@@ -301,12 +309,16 @@ int dm_get_element_by_selector(const dm_selector sel,
 	return t;
 }
 
-void dm_init_table(const struct dm_table *kwt, struct dm_value_table *t,  const dm_selector base, dm_id id)
+void dm_init_table(const struct dm_table *kwt, struct dm_value_table *t, struct dm_value_table *parent,
+		   const dm_selector base, dm_id id)
 {
 	int size = kwt->size;
 
+	t->parent = parent;
+	t->kw = kwt;
 	dm_selcpy(t->id, base);
 	dm_selcat(t->id, id);
+	t->config = dm_config_selector(t->id);
 
 	init_struct_magic_start(t, TABLE_MAGIC);
 	for (int i = 0; i < size; i++) {
@@ -341,7 +353,7 @@ void dm_init_table(const struct dm_table *kwt, struct dm_value_table *t,  const
 			break;
 		}
 		case T_TOKEN:
-			set_DM_TABLE(t->values[i], dm_alloc_table(kwt->table[i].u.t.table, t->id, i + 1));
+			set_DM_TABLE(t->values[i], dm_alloc_table(kwt->table[i].u.t.table, t, t->id, i + 1));
 			break;
 
 		case T_OBJECT:
@@ -364,7 +376,8 @@ void dm_init_table(const struct dm_table *kwt, struct dm_value_table *t,  const
 	}
 }
 
-struct dm_value_table *dm_alloc_table(const struct dm_table *kwt, const dm_selector base, dm_id id)
+struct dm_value_table *dm_alloc_table(const struct dm_table *kwt, struct dm_value_table *parent,
+				      const dm_selector base, dm_id id)
 {
 	dm_assert(kwt);
 	struct dm_value_table *t;
@@ -378,7 +391,7 @@ struct dm_value_table *dm_alloc_table(const struct dm_table *kwt, const dm_selec
 	DM_MEM_ADD(sizeof(struct dm_value_table) + sizeof(DM_VALUE) * size);
 	memset(t, 0, sizeof(struct dm_value_table) + sizeof(DM_VALUE) * size);
 
-	dm_init_table(kwt, t, base, id);
+	dm_init_table(kwt, t, parent, base, id);
 
 	return t;
 }
@@ -437,12 +450,23 @@ struct dm_instance_node *dm_add_instance(const struct dm_element *kw,
 		}
 	}
 
-	ret = dm_alloc_instance_node(kw->u.t.table, basesel, id);
+	ret = dm_alloc_instance_node(kw->u.t.table, baseref.st_base, basesel, id);
 	if (!ret)
 		return NULL;
 
 	debug("(): added table %hx for token %p\n", id, kw->u.t.table);
+	dm_snapshot_lock();
 	insert_instance(base, ret);
+	if (!dm_lazy_loading)
+		dm_snapshot_created(DM_TABLE(ret->table));
+	dm_snapshot_unlock();
+
+	/* a lazy subtree was there all along */
+	if (dm_lazy_loading)
+		return ret;
+
+	dm_touch_by_selector(DM_TABLE(ret->table)->id);
+	dm_config_touch(DM_TABLE(ret->table)->id);
 
 	if ((kw->flags & F_ADD) && kw->fkts.instance.add)
 		kw->fkts.instance.add(kw->u.t.table, ret->instance, base, ret);
@@ -539,6 +563,10 @@ int dm_get_element_ref(const dm_selector sel, struct dm_element_ref *ref)
 			DM_parity_assert(*ref->st_value);
 
 			if (ref->kw_elem->type == T_TOKEN || ref->kw_elem->type == T_OBJECT) {
+				/* first access to a subtree the binary config left on disk */
+				if (dm_lazy_load(ref->st_base, id) < 0)
+					return 0;
+
 				if (ref->st_type == T_TOKEN || ref->st_type == T_INSTANCE) {
 					/* current data type */
 					ref->st_type = ref->kw_elem->type;
@@ -566,6 +594,108 @@ int dm_get_element_ref(const dm_selector sel, struct dm_element_ref *ref)
 	return 0;
 }
 
+/* a change at sel is part of what dm_binconfig_save() writes with S_CFG */
+int dm_config_selector(const dm_selector sel)
+{
+	const struct dm_table *kw = &dm_root;
+
+	for (int i = 0; i < DM_SELECTOR_LEN && sel[i]; i++) {
+		const struct dm_element *elem;
+
+		if (!kw || sel[i] > kw->size)
+			return 0;
+
+		elem = &kw->table[sel[i] - 1];
+		if (elem->flags & (F_INTERNAL | F_SYSTEM))
+			return 0;
+
+		switch (elem->type) {
+		case T_OBJECT:
+			if (i + 1 < DM_SELECTOR_LEN && sel[i + 1] &&
+			    (sel[++i] & DM_ID_AUTO_OBJECT) == DM_ID_AUTO_OBJECT)
+				return 0;
+			/* FALL THROUGH */
+
+		case T_TOKEN:
+			kw = elem->u.t.table;
+			break;
+
+		default:
+			return (elem->flags & F_WRITE) != 0;
+		}
+	}
+
+	return 1;
+}
+
+/* bump the config version when sel is part of the saved config */
+void dm_config_touch(const dm_selector sel)
+{
+	if (dm_config_selector(sel))
+		dm_config_bump();
+}
+
+/* dm_config_touch() for a value of ift, decided from the flag cached on the table */
+void dm_config_touch_by_id(const struct dm_value_table *ift, dm_id id)
+{
+	const struct dm_element *elem;
+
+	if (!ift->config || !id || id > ift->kw->size)
+		return;
+
+	elem = &ift->kw->table[id - 1];
+	if (elem->flags & (F_INTERNAL | F_SYSTEM))
+		return;
+
+	if (elem->type == T_TOKEN || elem->type == T_OBJECT || (elem->flags & F_WRITE))
+		dm_config_bump();
+}
+
+/*
+ * bump the store version and stamp it on the deepest table on sel that
+ * still exists and on every table above it, the same way the *_by_id
+ * setters stamp through dm_touch_table()
+ */
+uint64_t dm_touch_by_selector(const dm_selector sel)
+{
+	const struct dm_table *kw_base = &dm_root;
+	struct dm_value_table *st_base = dm_value_store;
+	struct dm_value_table *last = NULL;
+
+	for (int i = 0; kw_base && st_base; i++) {
+		const struct dm_element *kw_elem;
+		DM_VALUE *st_value;
+
+		last = st_base;
+
+		if (i == DM_SELECTOR_LEN || !sel[i] || sel[i] > kw_base->size)
+			break;
+
+		kw_elem = kw_base->table + sel[i] - 1;
+		st_value = st_base->values + sel[i] - 1;
+
+		switch (kw_elem->type) {
+		case T_TOKEN:
+			st_base = DM_TABLE(*st_value);
+			break;
+
+		case T_OBJECT:
+			/* the instance might be gone already, stop at the parent table then */
+			if (++i == DM_SELECTOR_LEN || !sel[i])
+				return dm_touch_table(last);
+			st_value = dm_get_instance_node_ref_by_id(DM_INSTANCE(*st_value), sel[i]);
+			st_base = st_value ? DM_TABLE(*st_value) : NULL;
+			break;
+
+		default:
+			return dm_touch_table(last);
+		}
+		kw_base = kw_elem->u.t.table;
+	}
+
+	return dm_touch_table(last);
+}
+
 static int dm_get_element_type_from_ref(const struct dm_element_ref *ref)
 {
 	if (!ref || !ref->kw_elem)
@@ -697,7 +827,7 @@ static void value_update_action(const struct dm_element_ref *ref, int slot)
 	action(ref->kw_elem->action, ref->st_base->id, ref->id, DM_CHANGE);
 }
 
-static DM_RESULT dm_set_value(int type, const struct dm_element_ref *ref, const DM_VALUE val)
+static DM_RESULT dm_set_value_slot(int type, const struct dm_element_ref *ref, const DM_VALUE val, int slot)
 {
 	DM_RESULT r = DM_OK;
 
@@ -706,6 +836,7 @@ static DM_RESULT dm_set_value(int type, const struct dm_element_ref *ref, const
 
 	if (ref->kw_elem->type == type) {
 		DM_parity_assert(*ref->st_value);
+		dm_snapshot_preserve(ref->st_base);
 		if (ref->kw_elem->flags & F_SET) {
 			r = ref->kw_elem->fkts.value.set(ref->st_base, ref->id, ref->kw_elem, ref->st_value, val);
 			DM_parity_update(*ref->st_value);
@@ -724,14 +855,23 @@ static DM_RESULT dm_set_value(int type, const struct dm_element_ref *ref, const
 			DM_parity_update(*ref->st_value);
 		}
 
+		if (r == DM_OK) {
+			dm_touch_by_selector(ref->st_base->id);
+			dm_config_touch_by_id(ref->st_base, ref->id);
+		}
 		if (r == DM_OK && (val.flags & DV_UPDATED))
-			value_update_action(ref, -1);
+			value_update_action(ref, slot);
 
 		return r;
 	}
 	return DM_INVALID_TYPE;
 }
 
+static DM_RESULT dm_set_value(int type, const struct dm_element_ref *ref, const DM_VALUE val)
+{
+	return dm_set_value_slot(type, ref, val, -1);
+}
+
 DM_RESULT dm_set_any_value_by_selector(const dm_selector sel, int type, const DM_VALUE val)
 {
 	struct dm_element_ref ref;
@@ -751,6 +891,7 @@ static DM_RESULT dm_overwrite_value(int type, const struct dm_element_ref *ref,
 
 	if (ref->kw_elem->type == type) {
 		DM_parity_assert(*ref->st_value);
+		dm_snapshot_preserve(ref->st_base);
 		if (ref->kw_elem->flags & F_SET) {
 			r = ref->kw_elem->fkts.value.set(ref->st_base, ref->id, ref->kw_elem, ref->st_value, val);
 			if(r == DM_OK)
@@ -760,6 +901,10 @@ static DM_RESULT dm_overwrite_value(int type, const struct dm_element_ref *ref,
 
 		DM_parity_update(*ref->st_value);
 
+		if (r == DM_OK) {
+			dm_touch_by_selector(ref->st_base->id);
+			dm_config_touch_by_id(ref->st_base, ref->id);
+		}
 		if (r == DM_OK && (val.flags & DV_UPDATED))
 			value_update_action(ref, slot);
 
@@ -778,6 +923,90 @@ DM_RESULT dm_overwrite_any_value_by_selector(const dm_selector sel, int type, DM
 	return DM_VALUE_NOT_FOUND;
 }
 
+/*
+ * compare-and-set, only replace the value when it currently equals expected
+ *
+ * the value is copied, val and expected remain owned by the caller
+ */
+DM_RESULT dm_compare_and_set_by_selector(const dm_selector sel, int type, DM_VALUE expected, DM_VALUE val, int slot)
+{
+	struct dm_element_ref ref;
+	DM_VALUE cur;
+
+	if (!dm_get_element_ref(sel, &ref) || !ref.kw_elem || !ref.st_value)
+		return DM_VALUE_NOT_FOUND;
+
+	if (ref.kw_elem->type != type)
+		return DM_INVALID_TYPE;
+
+	cur = dm_get_element_value(type, &ref);
+	if (dm_compare_values(type, &cur, &expected) != 0)
+		return DM_VALUE_MISMATCH;
+
+	val.flags |= DV_UPDATED;
+	return dm_set_value_slot(type, &ref, val, slot);
+}
+
+/*
+ * add delta to an integer value, result holds the new value
+ */
+DM_RESULT dm_atomic_add_by_selector(const dm_selector sel, int64_t delta, DM_VALUE *result, int slot)
+{
+	struct dm_element_ref ref;
+	DM_VALUE val;
+	int64_t n;
+	uint64_t u;
+
+	if (!dm_get_element_ref(sel, &ref) || !ref.kw_elem || !ref.st_value)
+		return DM_VALUE_NOT_FOUND;
+
+	/* computed values can not be modified */
+	if (ref.kw_elem->flags & F_GET)
+		return DM_INVALID_TYPE;
+
+	memset(&val, 0, sizeof(val));
+
+	switch (ref.kw_elem->type) {
+	case T_INT:
+		n = (int64_t)DM_INT(*ref.st_value) + delta;
+		if (n < INT32_MIN || n > INT32_MAX)
+			return DM_INVALID_VALUE;
+		set_DM_INT(val, n);
+		break;
+
+	case T_UINT:
+		n = (int64_t)DM_UINT(*ref.st_value) + delta;
+		if (n < 0 || n > UINT32_MAX)
+			return DM_INVALID_VALUE;
+		set_DM_UINT(val, n);
+		break;
+
+	case T_INT64:
+		n = DM_INT64(*ref.st_value);
+		if ((delta > 0 && n > INT64_MAX - delta) || (delta < 0 && n < INT64_MIN - delta))
+			return DM_INVALID_VALUE;
+		set_DM_INT64(val, n + delta);
+		break;
+
+	case T_UINT64:
+		u = DM_UINT64(*ref.st_value);
+		if (delta >= 0 ? u > UINT64_MAX - (uint64_t)delta : u < -(uint64_t)delta)
+			return DM_INVALID_VALUE;
+		/* unsigned wrap-around does the subtraction for negative deltas */
+		set_DM_UINT64(val, u + (uint64_t)delta);
+		break;
+
+	default:
+		return DM_INVALID_TYPE;
+	}
+
+	val.flags = DV_UPDATED;
+	DM_parity_update(val);
+	*result = val;
+
+	return dm_set_value_slot(ref.kw_elem->type, &ref, val, slot);
+}
+
 int dm_mark_updated_by_selector(const dm_selector sel)
 {
 	struct dm_element_ref ref;
@@ -1016,6 +1245,7 @@ struct dm_instance_node *dm_add_instance_by_selector(const dm_selector sel, dm_i
 	if (dm_get_element_ref(sel, &ref) &&
 	    ref.st_type == T_OBJECT) {
 		debug("(): %p, %p, %d, %p, %d, %p\n", ref.kw_base, ref.st_base, ref.kw_elem->type, ref.st_value, ref.st_type, DM_INSTANCE(*ref.st_value));
+		dm_journal_begin();
 		node = dm_add_instance(ref.kw_elem, DM_INSTANCE(*ref.st_value), sel, *id);
 		if (node) {
 			node->table.flags |= DV_UPDATED;
@@ -1023,8 +1253,12 @@ struct dm_instance_node *dm_add_instance_by_selector(const dm_selector sel, dm_i
 			ref.st_value->flags |= DV_UPDATED;
 			DM_parity_update(*ref.st_value);
 			(*id) = node->instance;
+
+			dm_journal_instance(DM_TABLE(node->table)->id);
+			dm_journal_end();
 			return node;
 		}
+		dm_journal_end();
 	}
 
 	return NULL;
@@ -1037,8 +1271,13 @@ int dm_add_table_by_selector(const dm_selector sel)
 	if (dm_get_element_ref(sel, &ref) &&
 	    ref.kw_elem->type == T_TOKEN &&
 	    !DM_TABLE(*ref.st_value)) {
-		set_DM_TABLE(*ref.st_value, dm_alloc_table(ref.kw_elem->u.t.table, sel, 0));
+		dm_snapshot_lock();
+		set_DM_TABLE(*ref.st_value, dm_alloc_table(ref.kw_elem->u.t.table, ref.st_base, sel, 0));
 		DM_parity_update(*ref.st_value);
+		dm_snapshot_created(DM_TABLE(*ref.st_value));
+		dm_snapshot_unlock();
+		dm_touch_by_selector(sel);
+		dm_config_touch(sel);
 
 		debug("(): adding table for token with %d elements: %p\n",
 		      ref.kw_elem->u.t.table->size, DM_TABLE(*ref.st_value));
@@ -1049,6 +1288,9 @@ int dm_add_table_by_selector(const dm_selector sel)
 
 static void dm_del_table(const struct dm_table *kw, struct dm_value_table *st);
 
+/* set while a loader drops config, no del callbacks, notifications or actions run */
+static int dm_del_quiet;
+
 static void dm_del_instance(const struct dm_element *e,
 			       struct dm_instance *base,
 			       struct dm_instance_node *node)
@@ -1059,13 +1301,15 @@ static void dm_del_instance(const struct dm_element *e,
 
 	remove_instance(base, node);
 
-	if ((e->flags & F_DEL) && e->fkts.instance.del)
+	if (!dm_del_quiet && (e->flags & F_DEL) && e->fkts.instance.del)
 		e->fkts.instance.del(kw, node->instance, base, node);
 
 	node->table.flags |= DV_DELETED;
 	DM_parity_update(node->table);
-	notify_sel(-1, DM_TABLE(node->table)->id, node->table, NOTIFY_DEL);
-	action_sel(e->action, DM_TABLE(node->table)->id, DM_DEL);
+	if (!dm_del_quiet) {
+		notify_sel(-1, DM_TABLE(node->table)->id, node->table, NOTIFY_DEL);
+		action_sel(e->action, DM_TABLE(node->table)->id, DM_DEL);
+	}
 
 	dm_del_table(kw, DM_TABLE(node->table));
 	dm_free_instance_node(kw, node);
@@ -1133,8 +1377,11 @@ static void dm_del_table(const struct dm_table *kw, struct dm_value_table *st)
 	 * the counter will be invalid when we try to decrement the counter
 	 */
 	for (i = kw->size - 1; i >= 0; i--) {
+		if (st->values[i].flags & DV_LAZY)
+			dm_lazy_forget(st, i + 1);
 		dm_del_element(&kw->table[i], &st->values[i]);
-		action(kw->table[i].action, st->id, i + 1, DM_DEL);
+		if (!dm_del_quiet)
+			action(kw->table[i].action, st->id, i + 1, DM_DEL);
 	}
 
 	EXIT();
@@ -1176,7 +1423,15 @@ int dm_del_object_by_selector(const dm_selector sel)
 		debug("(): %p, %p, %p, %p\n", ref.kw_base, ref.st_base, ref.kw_elem, ref.st_value);
 		debug("(): %d, %s, %d, %d\n", ref.id, ref.kw_elem->key, ref.kw_elem->type, ref.st_type);
 
+		dm_journal_begin();
+		dm_snapshot_lock();
+		dm_snapshot_preserve_ref(&ref);
 		dm_del_object_instance(&ref);
+		dm_snapshot_unlock();
+		dm_touch_by_selector(sel);
+		dm_config_touch(sel);
+		dm_journal_delete(sel);
+		dm_journal_end();
 		return 1;
 	}
 	return 0;
@@ -1190,22 +1445,62 @@ int dm_del_table_by_selector(const dm_selector sel)
 		debug("(): %p, %p, %p, %p\n", ref.kw_base, ref.st_base, ref.kw_elem, ref.st_value);
 		debug("(): %d, %s, %d, %d\n", ref.id, ref.kw_elem->key, ref.kw_elem->type, ref.st_type);
 
+		dm_journal_begin();
+		dm_snapshot_lock();
+		dm_snapshot_preserve_ref(&ref);
 		if (ref.st_type == T_INSTANCE) {
 			dm_del_object_instance(&ref);
 		} else if (ref.st_type == T_OBJECT) {
 			/* don't kill the instance element itself,
 			 * otherwise the counter reference will be invalid */
 			dm_del_object(ref.kw_elem, DM_INSTANCE(*ref.st_value));
-			action(ref.kw_elem->action, ref.st_base->id, ref.id, DM_DEL);
+			if (!dm_del_quiet)
+				action(ref.kw_elem->action, ref.st_base->id, ref.id, DM_DEL);
 		} else {
 			dm_del_element(ref.kw_elem, ref.st_value);
-			action(ref.kw_elem->action, ref.st_base->id, ref.id, DM_DEL);
+			if (!dm_del_quiet)
+				action(ref.kw_elem->action, ref.st_base->id, ref.id, DM_DEL);
 		}
+		dm_snapshot_unlock();
+		dm_touch_by_selector(sel);
+		dm_config_touch(sel);
+		dm_journal_delete(sel);
+		dm_journal_end();
 		return 1;
 	}
 	return 0;
 }
 
+int dm_drop_table_by_selector(const dm_selector sel)
+{
+	int r;
+
+	dm_del_quiet++;
+	r = dm_del_table_by_selector(sel);
+	dm_del_quiet--;
+
+	return r;
+}
+
+void dm_reset_store(void)
+{
+	if (!dm_value_store)
+		return;
+
+	dm_del_quiet++;
+	dm_del_table(&dm_root, dm_value_store);
+	dm_free_table(&dm_root, dm_value_store);
+	dm_del_quiet--;
+
+	dm_value_store = NULL;
+	dm_store_version++;
+	dm_config_bump();
+}
+
+static int walk_object(int level, void *userData, walk_cb *cb, dm_id id,
+		       const struct dm_element *kw_elem, DM_VALUE value,
+		       struct dm_value_table *st_base);
+
 static int dm_walk_element_cb(int level, void *userData,
 			      walk_cb *cb,
 			      const struct dm_element_ref *ref)
@@ -1218,14 +1513,17 @@ static int dm_walk_element_cb(int level, void *userData,
 		case T_TOKEN:
 			if (DM_TABLE(value)) {
 				if (cb(userData, CB_table_start, ref->id, ref->kw_elem, value)) {
-					if (level - 1)
+					/* the callback sees DV_LAZY, the table is loaded when it descends */
+					if (dm_lazy_load(ref->st_base, ref->id) < 0)
+						ret = 0;
+					else if (level - 1)
 						ret &= dm_walk_table_cb(level - 1, userData, cb, ref->kw_elem->u.t.table, DM_TABLE(value));
 					cb(userData, CB_table_end, ref->id, ref->kw_elem, value);
 				}
 			}
 			break;
 		case T_OBJECT:
-			ret &= dm_walk_object_cb(level, userData, cb, ref->id, ref->kw_elem, value);
+			ret &= walk_object(level, userData, cb, ref->id, ref->kw_elem, value, ref->st_base);
 			break;
 		default:
 			cb(userData, CB_element, ref->id, ref->kw_elem, value);
@@ -1259,9 +1557,10 @@ int dm_walk_table_cb(int level, void *userData, walk_cb *cb,
 	return ret;
 }
 
-int dm_walk_object_cb(int level, void *userData, walk_cb *cb, dm_id id,
-		      const struct dm_element *kw_elem,
-		      DM_VALUE value)
+/* st_base holds the object, NULL when value is a copy */
+static int walk_object(int level, void *userData, walk_cb *cb, dm_id id,
+		       const struct dm_element *kw_elem, DM_VALUE value,
+		       struct dm_value_table *st_base)
 {
 	int ret = 1;
 	debug("(element: %p, instance: %p)\n", kw_elem, DM_INSTANCE(value));
@@ -1271,8 +1570,14 @@ int dm_walk_object_cb(int level, void *userData, walk_cb *cb, dm_id id,
 
 	if (cb(userData, CB_object_start, id, kw_elem, value)) {
 		struct dm_instance_node *node;
+		int lazy = st_base ? dm_lazy_load(st_base, id) : 0;
+
+		if (lazy > 0)
+			value = st_base->values[id - 1];
 
-		if (level - 1) {
+		if (lazy < 0)
+			ret = 0;
+		else if (level - 1) {
 			for (node = dm_instance_first(DM_INSTANCE(value));
 			     node != NULL;
 			     node = dm_instance_next(DM_INSTANCE(value), node)) {
@@ -1290,6 +1595,13 @@ int dm_walk_object_cb(int level, void *userData, walk_cb *cb, dm_id id,
 	return ret;
 }
 
+int dm_walk_object_cb(int level, void *userData, walk_cb *cb, dm_id id,
+		      const struct dm_element *kw_elem,
+		      DM_VALUE value)
+{
+	return walk_object(level, userData, cb, id, kw_elem, value, NULL);
+}
+
 static int dm_walk_instance_cb(int level, void *userData,
 				  walk_cb *cb, dm_id id,
 				  const struct dm_element *kw_elem,
@@ -1366,6 +1678,10 @@ static int update_flags_element(const struct dm_table *kw, struct dm_value_table
 	elem = &kw->table[index];
 	ret = st->values[index].flags & (DV_UPDATED | DV_NOTIFY);
 
+	/* a subtree on disk keeps the flags it was saved with */
+	if (st->values[index].flags & DV_LAZY)
+		return ret;
+
 	switch(elem->type) {
 		case T_TOKEN:
 			if (DM_TABLE(st->values[index]))
@@ -1491,6 +1807,7 @@ int dm_compare_values(int type, DM_VALUE *a, DM_VALUE *b)
 			return 0;
 
 	case T_UINT:
+	case T_COUNTER:
 		if (DM_UINT(*a) > DM_UINT(*b))
 			return 1;
 		else if (DM_UINT(*a) < DM_UINT(*b))
@@ -1592,6 +1909,7 @@ int dm_compare_values(int type, DM_VALUE *a, DM_VALUE *b)
 void dm_set_bool_by_id(struct dm_value_table *ift, dm_id id, char bool)
 {
 	DM_parity_assert(ift->values[id - 1]);
+	dm_snapshot_preserve(ift);
 	set_DM_BOOL(ift->values[id - 1], bool);
 	DM_parity_update(ift->values[id - 1]);
 	__DM_NOTIFY_BY_ID(ift, id);
@@ -1600,6 +1918,7 @@ void dm_set_bool_by_id(struct dm_value_table *ift, dm_id id, char bool)
 void dm_set_string_by_id(struct dm_value_table *ift, dm_id id, const char *val)
 {
 	DM_parity_assert(ift->values[id - 1]);
+	dm_snapshot_preserve(ift);
 	dm_set_string_value(&ift->values[id - 1], val);
 	__DM_NOTIFY_BY_ID(ift, id);
 }
@@ -1607,6 +1926,7 @@ void dm_set_string_by_id(struct dm_value_table *ift, dm_id id, const char *val)
 void dm_set_binary_by_id(struct dm_value_table *ift, dm_id id, const binary_t *val)
 {
 	DM_parity_assert(ift->values[id - 1]);
+	dm_snapshot_preserve(ift);
 	dm_set_binary_value(&ift->values[id - 1], val);
 	__DM_NOTIFY_BY_ID(ift, id);
 }
@@ -1614,6 +1934,7 @@ void dm_set_binary_by_id(struct dm_value_table *ift, dm_id id, const binary_t *v
 void dm_set_binary_data_by_id(struct dm_value_table *ift, dm_id id, unsigned int len, const uint8_t *data)
 {
 	DM_parity_assert(ift->values[id - 1]);
+	dm_snapshot_preserve(ift);
 	dm_set_binary_data(&ift->values[id - 1], len, data);
 	__DM_NOTIFY_BY_ID(ift, id);
 }
@@ -1628,8 +1949,13 @@ int dm_set_binary_data_by_selector(const dm_selector sel, unsigned int len, uint
 		if (ref.kw_elem->type != T_BINARY && ref.kw_elem->type != T_BASE64)
 			return DM_INVALID_TYPE;
 
+		dm_snapshot_preserve(ref.st_base);
 		r = dm_set_binary_data(ref.st_value, len, data);
 
+		if (r == DM_OK) {
+			dm_touch_by_selector(ref.st_base->id);
+			dm_config_touch_by_id(ref.st_base, ref.id);
+		}
 		if (r == DM_OK && (flags & DV_UPDATED))
 			value_update_action(&ref, -1);
 
@@ -1642,6 +1968,7 @@ int dm_set_binary_data_by_selector(const dm_selector sel, unsigned int len, uint
 void dm_set_enum_by_id(struct dm_value_table *ift, dm_id id, int val)
 {
 	DM_parity_assert(ift->values[id - 1]);
+	dm_snapshot_preserve(ift);
 	set_DM_ENUM(ift->values[id - 1], val);
 	DM_parity_update(ift->values[id - 1]);
 	__DM_NOTIFY_BY_ID(ift, id);
@@ -1650,6 +1977,7 @@ void dm_set_enum_by_id(struct dm_value_table *ift, dm_id id, int val)
 void dm_set_counter_by_id(struct dm_value_table *ift, dm_id id, unsigned int val)
 {
 	DM_parity_assert(ift->values[id - 1]);
+	dm_snapshot_preserve(ift);
 	set_DM_UINT(ift->values[id - 1], val);
 	DM_parity_update(ift->values[id - 1]);
 	__DM_NOTIFY_BY_ID(ift, id);
@@ -1658,6 +1986,7 @@ void dm_set_counter_by_id(struct dm_value_table *ift, dm_id id, unsigned int val
 void dm_set_int_by_id(struct dm_value_table *ift, dm_id id, int val)
 {
 	DM_parity_assert(ift->values[id - 1]);
+	dm_snapshot_preserve(ift);
 	set_DM_INT(ift->values[id - 1], val);
 	DM_parity_update(ift->values[id - 1]);
 	__DM_NOTIFY_BY_ID(ift, id);
@@ -1666,6 +1995,7 @@ void dm_set_int_by_id(struct dm_value_table *ift, dm_id id, int val)
 void dm_set_uint_by_id(struct dm_value_table *ift, dm_id id, unsigned int val)
 {
 	DM_parity_assert(ift->values[id - 1]);
+	dm_snapshot_preserve(ift);
 	set_DM_UINT(ift->values[id - 1], val);
 	DM_parity_update(ift->values[id - 1]);
 	__DM_NOTIFY_BY_ID(ift, id);
@@ -1674,6 +2004,7 @@ void dm_set_uint_by_id(struct dm_value_table *ift, dm_id id, unsigned int val)
 void dm_set_int64_by_id(struct dm_value_table *ift, dm_id id, int64_t val)
 {
 	DM_parity_assert(ift->values[id - 1]);
+	dm_snapshot_preserve(ift);
 	set_DM_INT64(ift->values[id - 1], val);
 	DM_parity_update(ift->values[id - 1]);
 	__DM_NOTIFY_BY_ID(ift, id);
@@ -1682,6 +2013,7 @@ void dm_set_int64_by_id(struct dm_value_table *ift, dm_id id, int64_t val)
 void dm_set_uint64_by_id(struct dm_value_table *ift, dm_id id, uint64_t val)
 {
 	DM_parity_assert(ift->values[id - 1]);
+	dm_snapshot_preserve(ift);
 	set_DM_UINT64(ift->values[id - 1], val);
 	DM_parity_update(ift->values[id - 1]);
 	__DM_NOTIFY_BY_ID(ift, id);
@@ -1690,6 +2022,7 @@ void dm_set_uint64_by_id(struct dm_value_table *ift, dm_id id, uint64_t val)
 void dm_set_time_by_id(struct dm_value_table *ift, dm_id id, time_t t)
 {
 	DM_parity_assert(ift->values[id - 1]);
+	dm_snapshot_preserve(ift);
 	set_DM_TIME(ift->values[id - 1], t);
 	DM_parity_update(ift->values[id - 1]);
 	__DM_NOTIFY_BY_ID(ift, id);
@@ -1698,6 +2031,7 @@ void dm_set_time_by_id(struct dm_value_table *ift, dm_id id, time_t t)
 void dm_set_ticks_by_id(struct dm_value_table *ift, dm_id id, ticks_t val)
 {
 	DM_parity_assert(ift->values[id - 1]);
+	dm_snapshot_preserve(ift);
 	set_DM_TICKS(ift->values[id - 1], val);
 	DM_parity_update(ift->values[id - 1]);
 	__DM_NOTIFY_BY_ID(ift, id);
@@ -1706,6 +2040,7 @@ void dm_set_ticks_by_id(struct dm_value_table *ift, dm_id id, ticks_t val)
 void dm_set_selector_by_id(struct dm_value_table *ift, dm_id id, const dm_selector sel)
 {
 	DM_parity_assert(ift->values[id - 1]);
+	dm_snapshot_preserve(ift);
 	dm_set_selector_value(&ift->values[id - 1], sel);
 	__DM_NOTIFY_BY_ID(ift, id);
 }
@@ -1713,6 +2048,7 @@ void dm_set_selector_by_id(struct dm_value_table *ift, dm_id id, const dm_select
 void dm_set_ipv4_by_id(struct dm_value_table *ift, dm_id id, struct in_addr val)
 {
 	DM_parity_assert(ift->values[id - 1]);
+	dm_snapshot_preserve(ift);
 	set_DM_IP4(ift->values[id - 1], val);
 	DM_parity_update(ift->values[id - 1]);
 	__DM_NOTIFY_BY_ID(ift, id);
@@ -1721,6 +2057,7 @@ void dm_set_ipv4_by_id(struct dm_value_table *ift, dm_id id, struct in_addr val)
 void dm_set_ipv6_by_id(struct dm_value_table *ift, dm_id id, struct in6_addr val)
 {
 	DM_parity_assert(ift->values[id - 1]);
+	dm_snapshot_preserve(ift);
 	set_DM_IP6(ift->values[id - 1], val);
 	DM_parity_update(ift->values[id - 1]);
 	__DM_NOTIFY_BY_ID(ift, id);
@@ -23,6 +23,21 @@ extern int dm_mem;
 #define DM_MEM_SUB(x) do {} while (0)
 #endif
 
+/* global store version, incremented on every change */
+extern uint64_t dm_store_version;
+
+/* incremented on every change to the saved config, see dm_config_selector() */
+extern uint64_t dm_config_version;
+
+/* mapped base config image, strings and binaries pointing into it are not owned by the store */
+extern const uint8_t *dm_base_image;
+extern size_t dm_base_image_size;
+
+static inline int dm_in_base_image(const void *p)
+{
+	return (uintptr_t)p - (uintptr_t)dm_base_image < dm_base_image_size;
+}
+
 #define DM_ID_USER_OBJECT   0x8000
 #define DM_ID_AUTO_OBJECT   0xC000
 #define DM_ID_MASK          0x3FFF
@@ -62,6 +77,8 @@ int dm_listcontains(char *l, char *str);
 /* generic set functions */
 DM_RESULT dm_set_any_value_by_selector(const dm_selector sel, int type, const DM_VALUE val) __attribute__((nonnull (1)));
 DM_RESULT dm_overwrite_any_value_by_selector(const dm_selector sel, int type, DM_VALUE val, int slot) __attribute__((nonnull (1)));
+DM_RESULT dm_compare_and_set_by_selector(const dm_selector sel, int type, DM_VALUE expected, DM_VALUE val, int slot) __attribute__((nonnull (1)));
+DM_RESULT dm_atomic_add_by_selector(const dm_selector sel, int64_t delta, DM_VALUE *result, int slot) __attribute__((nonnull (1, 3)));
 
 /* generic get functions */
 DM_VALUE dm_get_any_value_by_selector(const dm_selector sel, int type) __attribute__((nonnull (1)));
@@ -93,8 +110,8 @@ DM_RESULT dm_get_value_ref_by_selector_cb(const dm_selector sel, void *value,
 									     DM_VALUE *))
 	__attribute__((nonnull (1)));
 
-struct dm_value_table *dm_alloc_table(const struct dm_table *, const dm_selector, dm_id);
-void dm_init_table(const struct dm_table *, struct dm_value_table *, const dm_selector, dm_id);
+struct dm_value_table *dm_alloc_table(const struct dm_table *, struct dm_value_table *, const dm_selector, dm_id);
+void dm_init_table(const struct dm_table *, struct dm_value_table *, struct dm_value_table *, const dm_selector, dm_id);
 struct dm_value_table *dm_extend_table(struct dm_value_table *told, int size);
 
 struct dm_instance_node *dm_add_instance_by_selector(const dm_selector sel, dm_id *id) __attribute__((nonnull (1)));
@@ -103,9 +120,41 @@ int dm_add_table_by_selector(const dm_selector sel) __attribute__((nonnull (1)))
 
 int dm_del_table_by_selector(const dm_selector sel) __attribute__((nonnull (1)));
 int dm_del_object_by_selector(const dm_selector sel) __attribute__((nonnull (1)));
+/* dm_del_table_by_selector() without del callbacks, notifications or actions, for replaying a journal */
+int dm_drop_table_by_selector(const dm_selector sel) __attribute__((nonnull (1)));
+
+/* drop the whole store without del callbacks, notifications or actions, before a config is loaded again */
+void dm_reset_store(void);
 
 void dm_update_flags(void);
 
+uint64_t dm_touch_by_selector(const dm_selector sel) __attribute__((nonnull (1)));
+
+int dm_config_selector(const dm_selector sel) __attribute__((nonnull (1)));
+void dm_config_touch(const dm_selector sel) __attribute__((nonnull (1)));
+void dm_config_touch_by_id(const struct dm_value_table *ift, dm_id id);
+
+/* the save and journal side read dm_config_version off the setter thread */
+static inline void dm_config_bump(void)
+{
+	__atomic_add_fetch(&dm_config_version, 1, __ATOMIC_RELAXED);
+}
+
+static inline uint64_t dm_config_current(void)
+{
+	return __atomic_load_n(&dm_config_version, __ATOMIC_RELAXED);
+}
+
+/* bump the store version and stamp it on this table and every table above it */
+static inline uint64_t dm_touch_table(struct dm_value_table *t)
+{
+	uint64_t version = ++dm_store_version;
+
+	for (; t; t = t->parent)
+		t->version = version;
+	return version;
+}
+
 DM_VALUE *dm_get_instance_node_ref_by_id(struct dm_instance *, dm_id);
 
 struct dm_instance_node *dm_get_instance_node_by_selector(const dm_selector) __attribute__((nonnull (1)));
@@ -311,8 +360,10 @@ int dm_walk_by_selector_cb(const dm_selector, int, void *userData, walk_cb *cb)
 void dm_free_string_value(DM_VALUE *st)
 {
 	if (DM_STRING(*st)) {
-		DM_MEM_SUB(strlen(DM_STRING(*st)));
-		free(DM_STRING(*st));
+		if (!dm_in_base_image(DM_STRING(*st))) {
+			DM_MEM_SUB(strlen(DM_STRING(*st)));
+			free(DM_STRING(*st));
+		}
 		set_DM_STRING(*st, NULL);
 		DM_parity_update(*st);
 	}
@@ -321,8 +372,10 @@ void dm_free_string_value(DM_VALUE *st)
 void dm_free_binary_value(DM_VALUE *st)
 {
 	if (DM_BINARY(*st)) {
-		DM_MEM_SUB(sizeof(binary_t) + DM_BINARY(*st)->len);
-		free(DM_BINARY(*st));
+		if (!dm_in_base_image(DM_BINARY(*st))) {
+			DM_MEM_SUB(sizeof(binary_t) + DM_BINARY(*st)->len);
+			free(DM_BINARY(*st));
+		}
 		set_DM_BINARY(*st, NULL);
 		DM_parity_update(*st);
 	}
@@ -361,6 +414,8 @@ void dm_free_any_value(const struct dm_element *elem, DM_VALUE *st)
 #define __DM_NOTIFY_BY_ID(ift, id)					\
 	ift->values[id - 1].flags |= DV_UPDATED;			\
 	DM_parity_update(ift->values[id - 1]);				\
+	dm_touch_table(ift);						\
+	dm_config_touch_by_id(ift, id);					\
 	notify(-1, ift->id, id, ift->values[id - 1], NOTIFY_CHANGE);
 
 void dm_notify_by_id(struct dm_value_table *ift, dm_id id)
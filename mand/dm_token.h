@@ -106,6 +106,7 @@ typedef enum {
 	DM_INVALID_VALUE,
 	DM_VALUE_NOT_FOUND,
  	DM_FILE_NOT_FOUND,
+	DM_VALUE_MISMATCH,
 } DM_RESULT;
 
 #define DM_SELECTOR_LEN    16
@@ -130,6 +131,7 @@ enum {
 	__DV_UPDATE_PENDING,
 	__DV_UPDATED,
 	__DV_DELETED,
+	__DV_LAZY,
 };
 
 #define DV_NONE            0
@@ -137,6 +139,7 @@ enum {
 #define DV_UPDATE_PENDING  (1 << __DV_UPDATE_PENDING)
 #define DV_UPDATED         (1 << __DV_UPDATED)
 #define DV_DELETED         (1 << __DV_DELETED)
+#define DV_LAZY            (1 << __DV_LAZY)	/* table or object not loaded yet, see dm_lazy_load() */
 
 typedef struct {
 	unsigned int len;
@@ -326,6 +329,10 @@ typedef struct {
 struct dm_value_table {
 	STRUCT_MAGIC_START
 	dm_selector    id;
+	struct dm_value_table *parent;	/* enclosing table, NULL for the root */
+	const struct dm_table *kw;	/* keywords of values */
+	int            config;		/* dm_config_selector() of id, cached for dm_config_touch_by_id() */
+	uint64_t       version;		/* store version of the last change to this table */
 	DM_VALUE          values[0];
 };
 
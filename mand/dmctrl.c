@@ -40,8 +40,11 @@ CTRL_COMMAND		command = DMCTRL_UNDEF;
 char			*base = "";
 char			*what = "";
 int			array_f = 0;
+uint32_t		dump_format = CONFIG_FORMAT_XML;
+int			dump_diff = 0;
 
 #define RETRY_CONN_DELAY 10 /* in seconds */
+#define DUMP_CHUNK_SIZE (256 * 1024)
 
 #define chomp(s) ({ \
         char *c = (s) + strlen((s)) - 1; \
@@ -159,6 +162,8 @@ static void usage(void)
 	   "options:\n"
 	   "  -s <path>         Path to the socket [obsolete and has no effect anymore]\n"
 	   "  -c inet|unix      either try to communicate with a TCP/IP socket (inet) or a local unix socket (unix) (default is unix)\n"
+	   "  -j                dump in JSON instead of XML\n"
+	   "  -d                dump only what differs from the base and default config\n"
 	   "  -h                Print usage\n"
 	   "\n"
 	   "commands:\n"
@@ -172,7 +177,7 @@ void parse_commandline(int argc, char **argv)
 {
     int c;
 
-    while (-1 != (c = getopt(argc, argv, "ac:s:h"))) {
+    while (-1 != (c = getopt(argc, argv, "ac:s:jdh"))) {
         switch(c) {
             case 'h':
                 usage();
@@ -186,6 +191,14 @@ void parse_commandline(int argc, char **argv)
 		array_f = 1;
 		break;
 
+	    case 'j':
+		dump_format = CONFIG_FORMAT_JSON;
+		break;
+
+	    case 'd':
+		dump_diff = 1;
+		break;
+
 	    case 'c':
 	    	if (!strcmp(optarg, "inet"))
 			stype = AF_INET;
@@ -204,6 +217,9 @@ void parse_commandline(int argc, char **argv)
         }
     }
 
+    if (dump_diff)
+	    dump_format = dump_format == CONFIG_FORMAT_JSON ? CONFIG_FORMAT_JSON_DIFF : CONFIG_FORMAT_XML_DIFF;
+
     if ((argc - optind) <= 0) {
 	    usage();
 	    exit(EXCODE_USAGE);
@@ -271,14 +287,25 @@ uint32_t dmctrl_connect_cb(DMCONFIG_EVENT event, DMCONTEXT *socket, void *userda
 
 	switch(command) {
 		case DMCTRL_DUMP: {
-			char *dump;
+			uint64_t offset = 0;
+			size_t len;
 
-			if ((rpc_db_dump(socket, what, answer) != RC_OK)
-			    || dm_expect_string_type(answer, AVP_STRING, VP_TRAVELPING, &dump) != RC_OK)
-				break;
+			/* fetch the dump in chunks, a short chunk is the last one */
+			do {
+				DM2_AVPGRP *chunk;
+				void *dump;
+
+				if (!(chunk = dm_new_avpgrp(socket)))
+					break;
+
+				len = 0;
+				if (rpc_db_dump_chunk(socket, what, offset, DUMP_CHUNK_SIZE, dump_format, chunk) == RC_OK
+				    && dm_expect_raw(chunk, AVP_STRING, VP_TRAVELPING, &dump, &len) == RC_OK)
+					fwrite(dump, len, 1, stdout);
 
-			printf("%s", dump);
-			talloc_free(dump);
+				dm_free_avpgrp(chunk);
+				offset += len;
+			} while (len == DUMP_CHUNK_SIZE);
 
 			break;
 		}
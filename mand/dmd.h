@@ -8,4 +8,9 @@
 void dm_dump(int fd, const char *element);
 void dm_save(void);
 
+/* save in a forked child, returns -1 when no child could be started (e.g. other threads run) */
+int dm_save_async(void (*cb)(void *, int), void *data);
+void dm_save_cancel(void *data);
+void dm_save_wait(void);
+
 #endif
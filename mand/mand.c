@@ -14,8 +14,11 @@
 #include <stdlib.h>
 #include <syslog.h>
 #include <libgen.h>
+#include <fcntl.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/queue.h>
 #include <sys/param.h>
 #include <sys/time.h>
 #include <sys/resource.h>
@@ -27,6 +30,8 @@
 #include "dm_store.h"
 #include "dm_serialize.h"
 #include "dm_deserialize.h"
+#include "dm_binconfig.h"
+#include "dm_baseline.h"
 
 #include "dm_dmconfig.h"
 #include "dm_luaif.h"
@@ -36,10 +41,24 @@
 #define DM_BASE_CONFIG "/etc/dm"
 #define IPKG_BASE_CONFIG  "/jffs/etc/dm"
 
+/* the base config compiled for mapping, rebuilt when a base config file changes */
+#define DM_BASE_IMAGE "/jffs/etc/dm.base"
+
 #define DM_DEFAULT_CONFIG "/etc/defaults/dm"
 #define IPKG_DEFAULT_CONFIG  "/jffs/etc/defaults/dm"
 
 #define DM_CONFIG   "/jffs/etc/dm.xml"
+#define DM_CONFIG_BIN "/jffs/etc/dm.bin"
+
+/* differential config restored on top of the default config, see S_DIFF */
+#define DM_CONFIG_DIFF "/jffs/etc/dm.diff"
+#define DM_JOURNAL    "/jffs/etc/dm.journal"
+
+/* the journal is compacted into the binary config once it outgrows this or half the config */
+#define DM_JOURNAL_LIMIT (64 * 1024)
+
+/* a save child that takes longer is considered hung and killed, in seconds */
+#define DM_SAVE_TIMEOUT 60
 
 #define SDEBUG
 #include "debug.h"
@@ -53,29 +72,355 @@ extern int libdmconfigSocketType;
 #define EV_P_UNUSED_
 #endif
 
-void dm_save(void)
-{
-	static pthread_mutex_t save_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t save_mutex = PTHREAD_MUTEX_INITIALIZER;
 
+/* called with the save mutex held */
+static int dm_write_config(const char *path, int binary)
+{
 	char *fname;
 	int fd;
 	FILE *fout;
+	int rc = -1;
 
-	pthread_mutex_lock(&save_mutex);
+	if (asprintf(&fname, "%s.XXXXXX", path) < 0)
+		return -1;
 
-	fname = strdup(DM_CONFIG ".XXXXXX");
-	if (fname && (fd = mkstemp(fname)) != -1) {
+	if ((fd = mkstemp(fname)) != -1) {
 		fout = fdopen(fd, "w");
 		if (fout) {
-			dm_serialize_store(fout, S_CFG);
-			fclose(fout);
-			rename(fname, DM_CONFIG);
+			int r = 0;
+
+			if (binary)
+				r = dm_binconfig_save(fout, S_CFG);
+			else
+				dm_serialize_store(fout, S_CFG);
+
+			/* the journal is dropped once the new config is in place */
+			if (fflush(fout) != 0 || fsync(fd) != 0)
+				r = -1;
+
+			if (fclose(fout) != 0 || r)
+				unlink(fname);
+			else
+				rc = rename(fname, path);
 		} else {
 			close(fd);
+			unlink(fname);
 		}
 	}
 	free(fname);
 
+	return rc;
+}
+
+enum {
+	SAVE_JOURNAL,
+	SAVE_FULL,
+	SAVE_FAILED,
+};
+
+/*
+ * append the changes since the last save to the journal, compact when needed
+ *
+ * called with the save mutex held
+ */
+static int dm_save_files(void)
+{
+	struct stat st;
+	size_t limit = DM_JOURNAL_LIMIT;
+
+	if (stat(DM_CONFIG_BIN, &st) == 0 && (size_t)st.st_size / 2 > limit)
+		limit = st.st_size / 2;
+
+	if (dm_journal_flush(DM_JOURNAL, limit) == 0)
+		return SAVE_JOURNAL;
+
+	if (dm_write_config(DM_CONFIG_BIN, 1) != 0)
+		return SAVE_FAILED;
+
+	unlink(DM_JOURNAL);
+	return SAVE_FULL;
+}
+
+/*
+ * background save
+ *
+ * A forked child writes the config while the event loop keeps serving
+ * requests, copy-on-write pages give it the store as it was at the fork.
+ * The child reports the outcome through a pipe, the waiters are called
+ * from the event loop then. Saves requested while a child runs are
+ * collected and written by the next child, so every waiter gets answered
+ * with a config that holds the store at the time of its request.
+ *
+ * fork() only copies the calling thread, a lock another thread holds at
+ * that moment (malloc, stdio, the store locks) would stay locked in the
+ * child. A child is only forked while mand runs a single thread, with
+ * the AgentX thread up the config is saved on the event loop instead.
+ * A child that does not answer within DM_SAVE_TIMEOUT is killed, its
+ * waiters get a failed save.
+ */
+
+struct save_waiter {
+	TAILQ_ENTRY(save_waiter) list;
+
+	void (*cb)(void *, int);
+	void *data;
+};
+
+TAILQ_HEAD(save_list, save_waiter);
+
+static struct {
+	pid_t pid;
+	ev_io io_ev;
+	ev_timer timeout_ev;
+
+	struct save_list running;	/* covered by the running child */
+	struct save_list queued;	/* requested after the fork */
+} bg_save = {
+	.pid = -1,
+	.running = TAILQ_HEAD_INITIALIZER(bg_save.running),
+	.queued = TAILQ_HEAD_INITIALIZER(bg_save.queued),
+};
+
+static void save_io_cb(EV_P_ ev_io *w, int revents);
+static void save_timeout_cb(EV_P_ ev_timer *w, int revents);
+
+/* the next child covers all queued waiters */
+static void save_take_queued(void)
+{
+	struct save_waiter *w;
+
+	while ((w = TAILQ_FIRST(&bg_save.queued))) {
+		TAILQ_REMOVE(&bg_save.queued, w, list);
+		TAILQ_INSERT_TAIL(&bg_save.running, w, list);
+	}
+}
+
+/* no other thread can hold a lock the child needs */
+static int save_can_fork(void)
+{
+	struct stat st;
+
+	/* the task directory links to itself, its parent and every thread */
+	return stat("/proc/self/task", &st) == 0 && st.st_nlink == 3;
+}
+
+static int save_start(void)
+{
+	int fds[2];
+	pid_t pid;
+
+	if (!save_can_fork() || pipe(fds) < 0)
+		return -1;
+	fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+	fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+
+	pthread_mutex_lock(&save_mutex);
+	dm_journal_fork_prepare();
+
+	if ((pid = fork()) == 0) {
+		uint8_t status;
+
+		dm_journal_fork_child();
+		close(fds[0]);
+
+		status = dm_save_files();
+		if (write(fds[1], &status, 1) != 1)
+			_exit(1);
+		_exit(0);
+	}
+
+	dm_journal_fork_parent(pid > 0);
+	pthread_mutex_unlock(&save_mutex);
+
+	close(fds[1]);
+	if (pid < 0) {
+		debug("(): fork failed: %s", strerror(errno));
+		close(fds[0]);
+		return -1;
+	}
+
+	bg_save.pid = pid;
+	ev_io_init(&bg_save.io_ev, save_io_cb, fds[0], EV_READ);
+	ev_io_start(EV_DEFAULT_UC_ &bg_save.io_ev);
+	ev_timer_init(&bg_save.timeout_ev, save_timeout_cb, DM_SAVE_TIMEOUT, 0.);
+	ev_timer_start(EV_DEFAULT_UC_ &bg_save.timeout_ev);
+
+	return 0;
+}
+
+static void save_notify(int status)
+{
+	struct save_waiter *w;
+
+	while ((w = TAILQ_FIRST(&bg_save.running))) {
+		TAILQ_REMOVE(&bg_save.running, w, list);
+		w->cb(w->data, status == SAVE_FAILED ? -1 : 0);
+		free(w);
+	}
+}
+
+/* start a child for the queued waiters, save on the event loop when that fails */
+static void save_run(void)
+{
+	int status;
+
+	if (TAILQ_EMPTY(&bg_save.queued))
+		return;
+
+	save_take_queued();
+	if (save_start() == 0)
+		return;
+
+	pthread_mutex_lock(&save_mutex);
+	if ((status = dm_save_files()) == SAVE_FULL)
+		dm_journal_reset();
+	pthread_mutex_unlock(&save_mutex);
+
+	save_notify(status);
+}
+
+/* read the outcome of a child that is done or killed */
+static int save_reap(void)
+{
+	uint8_t status;
+	ssize_t r;
+
+	ev_io_stop(EV_DEFAULT_UC_ &bg_save.io_ev);
+	ev_timer_stop(EV_DEFAULT_UC_ &bg_save.timeout_ev);
+
+	/* a killed child closes the pipe, the read returns 0 then */
+	while ((r = read(bg_save.io_ev.fd, &status, 1)) < 0 && errno == EINTR)
+		;
+	/* no answer, the child died */
+	if (r != 1 || status > SAVE_FAILED)
+		status = SAVE_FAILED;
+
+	close(bg_save.io_ev.fd);
+	waitpid(bg_save.pid, NULL, 0);
+	bg_save.pid = -1;
+
+	dm_journal_fork_done(status == SAVE_FULL, status != SAVE_FAILED);
+
+	return status;
+}
+
+static void save_collect(void)
+{
+	save_notify(save_reap());
+	save_run();
+}
+
+static void save_io_cb(EV_P_UNUSED_ ev_io *w __attribute__ ((unused)),
+		       int revents __attribute__ ((unused)))
+{
+	save_collect();
+}
+
+static void save_timeout_cb(EV_P_UNUSED_ ev_timer *w __attribute__ ((unused)),
+			    int revents __attribute__ ((unused)))
+{
+	debug("(): save child %d hangs, killing it", bg_save.pid);
+	kill(bg_save.pid, SIGKILL);
+}
+
+/* cb is called from the event loop with 0 once the config is on disk, -1 when the save failed */
+int dm_save_async(void (*cb)(void *, int), void *data)
+{
+	struct save_waiter *w;
+
+	if (!(w = malloc(sizeof(struct save_waiter))))
+		return -1;
+
+	w->cb = cb;
+	w->data = data;
+	TAILQ_INSERT_TAIL(&bg_save.queued, w, list);
+
+	if (bg_save.pid < 0) {
+		save_take_queued();
+		if (save_start() != 0) {
+			TAILQ_REMOVE(&bg_save.running, w, list);
+			free(w);
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+void dm_save_cancel(void *data)
+{
+	struct save_list *lists[] = { &bg_save.running, &bg_save.queued };
+	struct save_waiter *w, *next;
+
+	for (unsigned int i = 0; i < sizeof(lists) / sizeof(lists[0]); i++)
+		for (w = TAILQ_FIRST(lists[i]); w; w = next) {
+			next = TAILQ_NEXT(w, list);
+			if (w->data == data) {
+				TAILQ_REMOVE(lists[i], w, list);
+				free(w);
+			}
+		}
+}
+
+/*
+ * stop the background save without waiting for it, the files are not
+ * touched by a child afterwards. The waiters of a child that did not
+ * finish go back to the queue, the next save covers them.
+ */
+void dm_save_wait(void)
+{
+	struct save_waiter *w;
+	int status;
+
+	if (bg_save.pid < 0)
+		return;
+
+	kill(bg_save.pid, SIGKILL);
+	if ((status = save_reap()) != SAVE_FAILED) {
+		save_notify(status);
+		return;
+	}
+
+	while ((w = TAILQ_LAST(&bg_save.running, save_list))) {
+		TAILQ_REMOVE(&bg_save.running, w, list);
+		TAILQ_INSERT_HEAD(&bg_save.queued, w, list);
+	}
+}
+
+void dm_save(void)
+{
+	int status;
+
+	dm_save_wait();
+
+	pthread_mutex_lock(&save_mutex);
+	if ((status = dm_save_files()) == SAVE_FULL)
+		dm_journal_reset();
+	pthread_mutex_unlock(&save_mutex);
+
+	/* the queued waiters are covered by this save */
+	save_take_queued();
+	save_notify(status);
+}
+
+/*
+ * the binary config can only be read with the schema it was written for,
+ * the XML config is what a firmware with another schema falls back to.
+ * Saves only write the binary config, the XML config is refreshed on
+ * shutdown, before the firmware changes. Without a binary config the XML
+ * config is the newest one (e.g. restored from a backup) and must not be
+ * overwritten.
+ */
+static void dm_export_config(void)
+{
+	/* a save that was asked for and not answered yet is not lost */
+	if (bg_save.pid > 0 || !TAILQ_EMPTY(&bg_save.queued))
+		dm_save();
+
+	pthread_mutex_lock(&save_mutex);
+	if (access(DM_CONFIG_BIN, F_OK) == 0)
+		dm_write_config(DM_CONFIG, 0);
 	pthread_mutex_unlock(&save_mutex);
 }
 
@@ -120,10 +465,35 @@ void usage(void)
 
 static void dm_load_base_config(void)
 {
+	static const char *const dirs[] = { DM_BASE_CONFIG, IPKG_BASE_CONFIG, NULL };
+	uint64_t stamp = dm_base_image_stamp(dirs);
+	int rc;
+
+	if ((rc = dm_base_image_load(DM_BASE_IMAGE, stamp)) == 0)
+		return;
+
+	/* not on top of what the image left behind */
+	if (rc < 0)
+		dm_reset_store();
+
 	dm_deserialize_directory(DM_BASE_CONFIG, DS_BASECONFIG);
 	dm_deserialize_directory(IPKG_BASE_CONFIG, DS_BASECONFIG);
+
+	if (dm_base_image_save(DM_BASE_IMAGE, stamp) != 0)
+		debug("(): failed to write "DM_BASE_IMAGE);
 }
 
+/* what a differential config is relative to, in load order */
+static const char *const baseline_dirs[] = {
+	DM_BASE_CONFIG, IPKG_BASE_CONFIG,
+	DM_DEFAULT_CONFIG, IPKG_DEFAULT_CONFIG,
+	NULL
+};
+
+/* subtrees the binary config loads on first access, -l path */
+#define DM_LAZY_MAX 16
+static const char *lazy_paths[DM_LAZY_MAX + 1];
+
 static void dm_load_default_config(void)
 {
 	dm_deserialize_directory(DM_DEFAULT_CONFIG, DS_USERCONFIG);
@@ -141,6 +511,9 @@ int main(int argc, char *argv[])
 	ev_signal sigusr2_watcher;
 
 	int run_daemon = 0;
+	int journal_valid = 0;
+	int lazy_cnt = 0;
+	int rc;
 	int c;
 	FILE *fin;
 
@@ -159,12 +532,17 @@ int main(int argc, char *argv[])
 	logx_open(basename(argv[0]), LOG_CONS | LOG_PID | LOG_PERROR, LOG_DAEMON);
 	logx_level = LOG_DEBUG;
 
-	while (-1 != (c = getopt(argc, argv, "dh"))) {
+	while (-1 != (c = getopt(argc, argv, "dl:h"))) {
 		switch(c) {
 			case 'd':
 				run_daemon = 1;
 				break;
 
+			case 'l':
+				if (lazy_cnt < DM_LAZY_MAX)
+					lazy_paths[lazy_cnt++] = optarg;
+				break;
+
 			case 'h':
 				usage();
 				exit(1);
@@ -198,16 +576,38 @@ int main(int argc, char *argv[])
 	if (fp_Lua_function("fncStartup", 0))
 		debug("(): Error during Lua function execution");
 
+	dm_baseline_set_dirs(baseline_dirs);
+	dm_binconfig_set_lazy(lazy_paths);
 	dm_load_base_config();
 
-	printf("deserialize "DM_CONFIG"\n");
-	fin = fopen(DM_CONFIG, "r");
-	if (fin) {
-		dm_deserialize_store(fin, DS_USERCONFIG | DS_VERSIONCHECK);
-		fclose(fin);
+	printf("deserialize "DM_CONFIG_BIN"\n");
+	if ((rc = dm_binconfig_load_file(DM_CONFIG_BIN, DS_USERCONFIG)) == 0) {
+		/* changes saved after the last compaction */
+		journal_valid = dm_journal_replay_file(DM_JOURNAL, DS_USERCONFIG) == 0;
 	} else {
-		dm_load_default_config();
-        }
+		/* failed halfway, start over from the base config */
+		if (rc < 0) {
+			dm_reset_store();
+			dm_load_base_config();
+		}
+
+		/* missing, or written for another schema or config version */
+		printf("deserialize "DM_CONFIG"\n");
+		fin = fopen(DM_CONFIG, "r");
+		if (fin) {
+			dm_deserialize_store(fin, DS_USERCONFIG | DS_VERSIONCHECK);
+			fclose(fin);
+		} else {
+			dm_load_default_config();
+
+			if ((fin = fopen(DM_CONFIG_DIFF, "r"))) {
+				printf("deserialize "DM_CONFIG_DIFF"\n");
+				dm_deserialize_store(fin, DS_USERCONFIG | DS_VERSIONCHECK);
+				fclose(fin);
+			}
+		}
+	}
+	dm_journal_start(journal_valid);
 
 	if (run_daemon)
 		if (daemon(1, 0) != 0) {
@@ -224,6 +624,7 @@ int main(int argc, char *argv[])
 
 	ev_loop(EV_DEFAULT_UC_ 0);
 
+	dm_export_config();
 	dm_shutdown();
 
 	printf("mem usage: %d\n", dm_mem);
@@ -6,10 +6,15 @@
 #include "config.h"
 #endif
 
+#include <pthread.h>
+#include <ev.h>
+
 #include "dm.h"
 #include "dm_token.h"
 #include "dm_store.h"
 #include "dm_action.h"
+#include "dm_snapshot.h"
+#include "dm_binconfig.h"
 
 #include "process.h"
 #include "snmpd.h"
@@ -45,6 +50,44 @@ static int snmp_running = 0;
 static int keep_running;
 static pthread_t tid;
 
+struct dm_snapshot *snmp_snapshot;
+
+/* the MIB modules only read below it */
+static const dm_selector snmp_root = { dm__InternetGatewayDevice, dm__IGD_X_TPLINO_NET_SessionControl, 0 };
+
+/*
+ * the event loop pins the snapshot for each batch, between two of its
+ * own writes, and loads the lazy subtrees the MIB modules read
+ */
+static ev_async pin_ev;
+static pthread_mutex_t pin_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t pin_cond = PTHREAD_COND_INITIALIZER;
+static int pin_wanted;
+
+static void
+pinEvent(EV_P_ ev_async *w __attribute__((unused)), int revents __attribute__((unused)))
+{
+	pthread_mutex_lock(&pin_lock);
+	if (pin_wanted) {
+		dm_lazy_load_below(snmp_root);
+		snmp_snapshot = dm_snapshot_pin();
+		pin_wanted = 0;
+		pthread_cond_signal(&pin_cond);
+	}
+	pthread_mutex_unlock(&pin_lock);
+}
+
+static void pin_snapshot(void)
+{
+	pthread_mutex_lock(&pin_lock);
+	pin_wanted = 1;
+	ev_async_send(EV_DEFAULT_UC_ &pin_ev);
+	while (pin_wanted && keep_running)
+		pthread_cond_wait(&pin_cond, &pin_lock);
+	pin_wanted = 0;
+	pthread_mutex_unlock(&pin_lock);
+}
+
 static int check_and_process(void)
 {
         int             numfds;
@@ -53,6 +96,7 @@ static int check_and_process(void)
 	struct timeval *tvp = &timeout;
         int             count;
         int             fakeblock = 0;
+	int r;
 
         numfds = 0;
         FD_ZERO(&fdset);
@@ -66,7 +110,12 @@ static int check_and_process(void)
         count = select(numfds, &fdset, 0, 0, tvp);
 	pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
 
-	return agent_check_and_process(0);
+	pin_snapshot();
+	r = agent_check_and_process(0);
+	dm_snapshot_release(snmp_snapshot);
+	snmp_snapshot = NULL;
+
+	return r;
 }
 
 void agentx_shutdown(void *parm __attribute__((unused)))
@@ -139,6 +188,9 @@ static void *agentx_thread(void *arg __attribute__ ((unused)))
 
 static void start_agentx(void)
 {
+	ev_async_init(&pin_ev, pinEvent);
+	ev_async_start(EV_DEFAULT_UC_ &pin_ev);
+
 	keep_running = 1;
 	pthread_create(&tid, NULL, agentx_thread, NULL);
 }
@@ -146,9 +198,16 @@ static void start_agentx(void)
 static void stop_agentx(void)
 {
 	if (keep_running) {
+		/* a batch waiting for its snapshot goes on without it */
+		pthread_mutex_lock(&pin_lock);
 		keep_running = 0;
+		pthread_cond_signal(&pin_cond);
+		pthread_mutex_unlock(&pin_lock);
+
 		pthread_cancel(tid);
 		pthread_join(tid, NULL);
+
+		ev_async_stop(EV_DEFAULT_UC_ &pin_ev);
 	}
 }
 
@@ -216,6 +275,7 @@ void start_snmpd(void)
 
 	unlink(AGENTX_MASTER);
 	vsystem(NET_SNMPD " -p " NET_SNMPD_PID);
+
 	start_agentx();
 	snmp_running = 1;
 
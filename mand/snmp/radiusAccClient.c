@@ -91,7 +91,7 @@ radiusAccClient_handler(netsnmp_mib_handler *handler,
 			switch (subid) {
 			case radiusAccClientInvalidServerAddresses_oid:
 				/** VAR: InternetGatewayDevice.X_TPLINO_NET_SessionControl.RadiusServer.Accounting.Stats */
-				ret_value = dm_get_uint_by_selector((dm_selector){ dm__InternetGatewayDevice,
+				ret_value = snmp_get_uint_by_selector((dm_selector){ dm__InternetGatewayDevice,
 							dm__IGD_X_TPLINO_NET_SessionControl,
 							dm__IGD_SCG_RadiusClient,
 							dm__IGD_SCG_RC_Accounting,
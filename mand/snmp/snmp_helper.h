@@ -1,6 +1,8 @@
 #ifndef __SNMP_HELPER_H
 #define __SNMP_HELPER_H
 
+#include "dm_snapshot.h"
+
 static unsigned long long ltime(void)
 {
         struct timeval tv;
@@ -9,4 +11,27 @@ static unsigned long long ltime(void)
         return tv.tv_sec * 1000 + tv.tv_usec / 1000;
 }
 
+/* pinned on the event loop for each batch of requests the AgentX thread answers */
+extern struct dm_snapshot *snmp_snapshot;
+
+static inline DM_RESULT snmp_uint_cb(void *data, const dm_selector sb __attribute__((unused)),
+				     const struct dm_element *elem __attribute__((unused)),
+				     int st_type __attribute__((unused)), const DM_VALUE val)
+{
+	*(unsigned int *)data = DM_UINT(val);
+	return DM_OK;
+}
+
+/* read a value as it was when the current batch started */
+static inline unsigned int snmp_get_uint_by_selector(const dm_selector sel)
+{
+	unsigned int v = 0;
+
+	if (!snmp_snapshot)
+		return dm_get_uint_by_selector(sel);
+
+	dm_snapshot_get_value_by_selector_cb(snmp_snapshot, sel, T_UINT, &v, snmp_uint_cb);
+	return v;
+}
+
 #endif
@@ -1,5 +1,9 @@
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/stat.h>
 
 #include "expat.h"
 #include "dm_token.h"
@@ -7,6 +11,15 @@
 #include "dm_index.h"
 #include "dm_serialize.h"
 #include "dm_deserialize.h"
+#include "dm_store_priv.h"
+#include "dm_strings.h"
+#include "dm_cache.h"
+#include "dm_binconfig.h"
+#include "dm_baseline.h"
+#include "dm_snapshot.h"
+#include "dm_dmconfig.h"
+
+#include "libdmconfig/dm_dmconfig_rpc_impl.h"
 
 #if 0
 
@@ -116,6 +129,894 @@ void test_del_object()
 	dm_del_table_by_selector(&nif);
 }
 
+static void cache_set_string(struct cache *c, const char *name, const char *s)
+{
+	struct dm_element_ref ref;
+	dm_selector sel;
+	DM_VALUE new_value;
+
+	dm_name2sel(name, &sel);
+	if (!dm_get_element_ref(sel, &ref)) {
+		fprintf(stderr, "%s: not found\n", name);
+		return;
+	}
+
+	memset(&new_value, 0, sizeof(new_value));
+	dm_set_string_value(&new_value, s);
+	cache_add(c, sel, "", ref.kw_elem, ref.st_base, ref.st_value, new_value, 0, NULL);
+}
+
+static int cache_commit(struct cache *c)
+{
+	if (!cache_is_current(c)) {
+		cache_reset(c);
+		return 0;
+	}
+
+	cache_apply(c, -1);
+	return 1;
+}
+
+/* two configure sessions writing concurrently */
+int test_concurrent_sessions()
+{
+	struct cache a, b;
+	dm_selector sel;
+	int r = 0;
+
+	cache_init(&a);
+	cache_init(&b);
+
+	/* disjoint subtrees, both commits succeed */
+	cache_set_string(&a, "system.ntp.1.name", "session-a");
+	cache_set_string(&b, "system.ntp.3.name", "session-b");
+
+	if (strcmp(dm_cache_get_string_by_selector(&a, *dm_name2sel("system.ntp.3.name", &sel)), "name") != 0) {
+		fprintf(stderr, "session a sees pending change of session b\n");
+		r++;
+	}
+
+	if (!cache_commit(&a) || !cache_commit(&b)) {
+		fprintf(stderr, "disjoint commit failed\n");
+		r++;
+	}
+
+	if (strcmp(dm_get_string_by_selector(*dm_name2sel("system.ntp.1.name", &sel)), "session-a") != 0 ||
+	    strcmp(dm_get_string_by_selector(*dm_name2sel("system.ntp.3.name", &sel)), "session-b") != 0) {
+		fprintf(stderr, "disjoint commit lost a change\n");
+		r++;
+	}
+
+	/* same value, the second commit has to fail */
+	cache_set_string(&a, "system.ntp.1.name", "conflict-a");
+	cache_set_string(&b, "system.ntp.1.name", "conflict-b");
+
+	if (!cache_commit(&a)) {
+		fprintf(stderr, "first commit failed\n");
+		r++;
+	}
+	if (cache_commit(&b)) {
+		fprintf(stderr, "conflicting commit succeeded\n");
+		r++;
+	}
+
+	if (strcmp(dm_get_string_by_selector(*dm_name2sel("system.ntp.1.name", &sel)), "conflict-a") != 0) {
+		fprintf(stderr, "conflicting commit changed the store\n");
+		r++;
+	}
+
+	cache_free(&a);
+	cache_free(&b);
+
+	return r;
+}
+
+static DM_RESULT snapshot_string_cb(void *data, const dm_selector sb __attribute__((unused)),
+				    const struct dm_element *elem __attribute__((unused)),
+				    int st_type __attribute__((unused)), const DM_VALUE val)
+{
+	snprintf(data, 64, "%s", DM_STRING(val) ? : "");
+	return DM_OK;
+}
+
+static int snapshot_check(struct dm_snapshot *s, const char *name, const char *expect)
+{
+	char buf[64] = "";
+	dm_selector sel;
+	DM_RESULT r;
+
+	dm_name2sel(name, &sel);
+	r = dm_snapshot_get_value_by_selector_cb(s, sel, T_STR, buf, snapshot_string_cb);
+	if (expect ? (r != DM_OK || strcmp(buf, expect) != 0) : r != DM_VALUE_NOT_FOUND) {
+		fprintf(stderr, "snapshot: %s is \"%s\" (%d), expected \"%s\"\n", name, buf, r, expect ? : "(none)");
+		return 1;
+	}
+	return 0;
+}
+
+/* a pinned snapshot keeps its view across value changes, instance adds and deletes */
+int test_snapshot()
+{
+	struct dm_snapshot *s;
+	dm_selector sel, nsel;
+	char name[64];
+	dm_id id;
+	int r = 0;
+
+	dm_name2sel("system.ntp.1.name", &sel);
+	dm_set_string_by_selector(sel, "before", DV_UPDATED);
+
+	if (!(s = dm_snapshot_pin()))
+		return 1;
+
+	dm_set_string_by_selector(sel, "after", DV_UPDATED);
+
+	dm_name2sel("system.ntp", &nsel);
+	id = DM_ID_AUTO_OBJECT;
+	if (!dm_add_instance_by_selector(nsel, &id)) {
+		fprintf(stderr, "snapshot: add instance failed\n");
+		r++;
+	}
+	snprintf(name, sizeof(name), "system.ntp.%d.name", id);
+
+	r += snapshot_check(s, "system.ntp.1.name", "before");
+	r += snapshot_check(s, name, NULL);
+
+	dm_name2sel("system.ntp.1", &nsel);
+	dm_del_table_by_selector(nsel);
+	r += snapshot_check(s, "system.ntp.1.name", "before");
+
+	dm_snapshot_release(s);
+
+	return r;
+}
+
+/* committed changes replay from the journal, a batch torn by a crash is dropped */
+int test_journal()
+{
+	char fname[] = "/tmp/dm_tests.journal.XXXXXX";
+	struct dm_instance_node *node;
+	struct cache c;
+	struct stat st;
+	dm_selector sel;
+	uint64_t version;
+	dm_id id;
+	FILE *f;
+	int fd;
+	int r = 0;
+
+	if ((fd = mkstemp(fname)) < 0)
+		return 1;
+	close(fd);
+	unlink(fname);
+
+	/* a full save, the journal starts on top of it */
+	dm_journal_start(1);
+	if (!(f = tmpfile()))
+		return 1;
+	dm_binconfig_save(f, S_CFG);
+	fclose(f);
+	dm_journal_reset();
+
+	cache_init(&c);
+	cache_set_string(&c, "system.ntp.3.name", "journaled");
+	cache_commit(&c);
+
+	/* changes outside of the saved config keep the journal valid */
+	version = dm_config_current();
+	dm_name2sel("system.ntp", &sel);
+	id = DM_ID_AUTO_OBJECT;
+	if ((node = dm_add_instance_by_selector(sel, &id))) {
+		dm_set_string_by_id(DM_TABLE(node->table), dm__Sys_NTP_i_name, "status");
+		dm_selcat(sel, id);
+		dm_del_table_by_selector(sel);
+	}
+	if (dm_config_current() != version) {
+		fprintf(stderr, "journal: a status object changed the config version\n");
+		r++;
+	}
+
+	if (dm_journal_flush(fname, 1 << 20) != 0) {
+		fprintf(stderr, "journal: first batch not appended\n");
+		r++;
+	}
+
+	cache_set_string(&c, "system.ntp.3.name", "torn");
+	cache_commit(&c);
+	if (dm_journal_flush(fname, 1 << 20) != 0) {
+		fprintf(stderr, "journal: second batch not appended\n");
+		r++;
+	}
+
+	/* a crash in the middle of the second batch */
+	if (stat(fname, &st) != 0 || truncate(fname, st.st_size - 2) != 0) {
+		fprintf(stderr, "journal: cannot truncate %s\n", fname);
+		r++;
+	}
+
+	dm_name2sel("system.ntp.3.name", &sel);
+	dm_set_string_by_selector(sel, "changed", DV_UPDATED);
+
+	if (dm_journal_replay_file(fname, DS_USERCONFIG) != 0) {
+		fprintf(stderr, "journal: replay failed\n");
+		r++;
+	}
+	if (strcmp(dm_get_string_by_selector(sel), "journaled") != 0) {
+		fprintf(stderr, "journal: system.ntp.3.name is \"%s\" after replay\n", dm_get_string_by_selector(sel));
+		r++;
+	}
+
+	cache_free(&c);
+	unlink(fname);
+
+	return r;
+}
+
+/* system.ntp is still on disk */
+static int lazy_ntp(void)
+{
+	struct dm_value_table *st;
+	dm_selector sel;
+
+	dm_name2sel("system.ntp", &sel);
+	sel[1] = 0;
+	if (!(st = dm_get_table_by_selector(sel)))
+		return 0;
+
+	dm_name2sel("system.ntp", &sel);
+	return (st->values[sel[1] - 1].flags & DV_LAZY) != 0;
+}
+
+static int lazy_save(const char *fname, const char *const paths[])
+{
+	FILE *f;
+	int r;
+
+	unlink(fname);
+	if (!(f = fopen(fname, "w")))
+		return 1;
+
+	dm_binconfig_set_lazy(paths);
+	r = dm_binconfig_save(f, S_CFG);
+	dm_binconfig_set_lazy(NULL);
+
+	return fclose(f) != 0 || r;
+}
+
+static int lazy_boot(const char *fname)
+{
+	dm_reset_store();
+	return dm_binconfig_load_file(fname, DS_USERCONFIG);
+}
+
+/* a save keeps unloaded spans, a deleted table drops the spans below it, a damaged span loads nothing */
+int test_lazy()
+{
+	static const char *const ntp[] = { "system.ntp", NULL };
+	static const char *const transport[] = { "system.ntp.1.transport", NULL };
+	char fname[] = "/tmp/dm_tests.lazy.XXXXXX";
+	char copy[] = "/tmp/dm_tests.lazy.XXXXXX";
+	dm_selector name, sel;
+	const char *s;
+	char *buf = NULL, *p;
+	long size;
+	FILE *f;
+	int fd;
+	int r = 0;
+
+	if ((fd = mkstemp(fname)) < 0)
+		return 1;
+	close(fd);
+	if ((fd = mkstemp(copy)) < 0) {
+		unlink(fname);
+		return 1;
+	}
+	close(fd);
+
+	dm_name2sel("system.ntp.1.name", &name);
+	dm_set_string_by_selector(name, "lazy-span", DV_UPDATED);
+	r |= lazy_save(fname, ntp);
+
+	r |= lazy_boot(fname);
+	if (!lazy_ntp()) {
+		fprintf(stderr, "lazy: system.ntp was loaded at boot\n");
+		r++;
+	}
+	r |= lazy_save(copy, NULL);
+	if (!lazy_ntp()) {
+		fprintf(stderr, "lazy: the save loaded system.ntp\n");
+		r++;
+	}
+	r |= lazy_boot(copy);
+	if (!(s = dm_get_string_by_selector(name)) || strcmp(s, "lazy-span") != 0) {
+		fprintf(stderr, "lazy: the copied span did not restore system.ntp.1.name\n");
+		r++;
+	}
+
+	r |= lazy_save(copy, transport);
+	r |= lazy_boot(copy);
+	if (!dm_lazy_pending()) {
+		fprintf(stderr, "lazy: system.ntp.1.transport was loaded at boot\n");
+		r++;
+	}
+	dm_name2sel("system.ntp.1", &sel);
+	dm_del_table_by_selector(sel);
+	if (dm_lazy_pending()) {
+		fprintf(stderr, "lazy: the span below a deleted instance is still there\n");
+		r++;
+	}
+
+	if (!(f = fopen(fname, "r")) ||
+	    fseek(f, 0, SEEK_END) != 0 || (size = ftell(f)) <= 0 ||
+	    !(buf = malloc(size)) ||
+	    fseek(f, 0, SEEK_SET) != 0 || fread(buf, size, 1, f) != 1 ||
+	    !(p = memmem(buf, size, "lazy-span", 9))) {
+		fprintf(stderr, "lazy: cannot damage %s\n", fname);
+		r++;
+	} else {
+		*p ^= 0x20;
+		fclose(f);
+		unlink(copy);
+		if ((f = fopen(copy, "w"))) {
+			fwrite(buf, size, 1, f);
+			fclose(f);
+		}
+		f = NULL;
+
+		r |= lazy_boot(copy);
+		if ((s = dm_get_string_by_selector(name))) {
+			fprintf(stderr, "lazy: a damaged span restored system.ntp.1.name as \"%s\"\n", s);
+			r++;
+		}
+		if (lazy_ntp() || dm_lazy_pending()) {
+			fprintf(stderr, "lazy: a damaged span is still pending\n");
+			r++;
+		}
+	}
+	if (f)
+		fclose(f);
+	free(buf);
+
+	/* the store the tests after this one expect */
+	r |= lazy_boot(fname);
+	dm_name2sel("system.ntp", &sel);
+	dm_lazy_load_below(sel);
+	if (dm_lazy_pending() || !(s = dm_get_string_by_selector(name)) || strcmp(s, "lazy-span") != 0) {
+		fprintf(stderr, "lazy: system.ntp was not loaded\n");
+		r++;
+	}
+
+	unlink(fname);
+	unlink(copy);
+
+	return r;
+}
+
+/* the JSON export loads back into the store */
+int test_json()
+{
+	static const char *const values[] = {
+		"json \"quoted\"\n\x01 \xc3\xa4",
+		/* no UTF-8, written escaped */
+		"raw \xff\xfe \\101 \xc3",
+	};
+	/* deeper than the deserializer state stack */
+	static const char deep[] =
+		"{\"a\": {\"b\": {\"c\": {\"d\": {\"e\": {\"f\": {\"g\": {\"h\": {\"i\": {\"j\": {\"k\": {\"l\": 1}}}}}}}}}}}}\n";
+	dm_selector sel;
+	FILE *f;
+	int r = 0;
+
+	dm_name2sel("system.ntp.1.name", &sel);
+
+	for (unsigned int i = 0; i < sizeof(values) / sizeof(values[0]); i++) {
+		dm_set_string_by_selector(sel, (char *)values[i], DV_UPDATED);
+
+		if (!(f = tmpfile()))
+			return 1;
+
+		dm_serialize_store(f, S_CFG | S_JSON);
+		dm_set_string_by_selector(sel, "changed", DV_UPDATED);
+
+		rewind(f);
+		if (dm_deserialize_store(f, DS_USERCONFIG) != 0) {
+			fprintf(stderr, "JSON config did not parse\n");
+			r++;
+		}
+		fclose(f);
+
+		if (strcmp(dm_get_string_by_selector(sel), values[i]) != 0) {
+			fprintf(stderr, "JSON config did not restore system.ntp.1.name %u\n", i);
+			r++;
+		}
+	}
+
+	if (!(f = tmpfile()))
+		return 1;
+	fputs(deep, f);
+	rewind(f);
+	if (dm_deserialize_store(f, DS_USERCONFIG) == 0) {
+		fprintf(stderr, "JSON config nested too deep did parse\n");
+		r++;
+	}
+	fclose(f);
+
+	return r;
+}
+
+/* a chunk larger than an answer can hold is refused, it would look like the last one */
+int test_dump_chunk()
+{
+	SOCKCONTEXT *ctx;
+	DM2_REQUEST answer;
+	uint32_t rc;
+	int r = 0;
+
+	if (!(ctx = talloc_zero(NULL, SOCKCONTEXT)) ||
+	    dm_new_packet(ctx, &answer, CMD_DB_DUMP, 0, APP_ID, 1, 1) != RC_OK) {
+		talloc_free(ctx);
+		return 1;
+	}
+
+	rc = rpc_db_dump(ctx, "", 0, 0xffffff, CONFIG_FORMAT_XML, &answer);
+	if (rc != RC_ERR_AVP_MISFORMED || ctx->dump) {
+		fprintf(stderr, "DB DUMP accepted a chunk larger than an answer: %u\n", rc);
+		r++;
+	}
+
+	talloc_free(ctx);
+	return r;
+}
+
+/* the diff of system.ntp against a base config, loaded on top of that config again */
+static const char diff_base[] =
+	"<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+	"<OpenCPE>\n"
+	"  <system>\n"
+	"    <ntp instance='901'><name>base-1</name></ntp>\n"
+	"    <ntp instance='902'><name>base-2</name></ntp>\n"
+	"  </system>\n"
+	"</OpenCPE>\n";
+
+static int diff_check(const char *fmt)
+{
+	dm_selector sel;
+	int r = 0;
+
+	dm_name2sel("system.ntp.901.name", &sel);
+	if (strcmp(dm_get_string_by_selector(sel), "changed") != 0) {
+		fprintf(stderr, "%s diff did not restore system.ntp.901.name\n", fmt);
+		r++;
+	}
+	dm_name2sel("system.ntp.902", &sel);
+	if (dm_get_instance_node_by_selector(sel)) {
+		fprintf(stderr, "%s diff did not delete system.ntp.902\n", fmt);
+		r++;
+	}
+	dm_name2sel("system.ntp.903.name", &sel);
+	if (strcmp(dm_get_string_by_selector(sel), "added") != 0) {
+		fprintf(stderr, "%s diff did not restore system.ntp.903\n", fmt);
+		r++;
+	}
+
+	return r;
+}
+
+int test_diff()
+{
+	static const struct {
+		const char *name;
+		int flags;
+		const char *deleted;
+	} fmts[] = {
+		{ "XML", 0, "<ntp deleted=\"true\" instance='902' />" },
+		{ "JSON", S_JSON, "\"deleted\": true, \"instance\": 902" },
+	};
+	char dir[] = "/tmp/dm_diff.XXXXXX";
+	const char *dirs[] = { dir, NULL };
+	char fname[64];
+	dm_selector sel;
+	dm_id id = 903;
+	FILE *f;
+	int r = 0;
+
+	if (!mkdtemp(dir))
+		return 1;
+	snprintf(fname, sizeof(fname), "%s/base.xml", dir);
+	if (!(f = fopen(fname, "w")))
+		return 1;
+	fputs(diff_base, f);
+	fclose(f);
+
+	dm_baseline_set_dirs(dirs);
+	dm_deserialize_directory(dir, DS_BASECONFIG);
+
+	dm_name2sel("system.ntp.901.name", &sel);
+	dm_set_string_by_selector(sel, "changed", DV_UPDATED);
+	dm_name2sel("system.ntp.902", &sel);
+	dm_del_object_by_selector(sel);
+	dm_name2sel("system.ntp", &sel);
+	dm_add_instance_by_selector(sel, &id);
+	dm_name2sel("system.ntp.903.name", &sel);
+	dm_set_string_by_selector(sel, "added", DV_UPDATED);
+
+	for (unsigned int i = 0; i < sizeof(fmts) / sizeof(fmts[0]); i++) {
+		char buf[64 * 1024];
+		size_t len;
+
+		if (!(f = tmpfile())) {
+			r++;
+			break;
+		}
+		dm_serialize_store(f, S_CFG | S_DIFF | fmts[i].flags);
+
+		rewind(f);
+		len = fread(buf, 1, sizeof(buf) - 1, f);
+		buf[len] = '\0';
+		if (!strstr(buf, "changed") || !strstr(buf, "added") || !strstr(buf, fmts[i].deleted) ||
+		    strstr(buf, "base-")) {
+			fprintf(stderr, "%s diff is wrong:\n%s", fmts[i].name, buf);
+			r++;
+		}
+
+		/* back to the base config */
+		dm_name2sel("system.ntp.903", &sel);
+		dm_del_object_by_selector(sel);
+		dm_deserialize_directory(dir, DS_BASECONFIG);
+
+		rewind(f);
+		if (dm_deserialize_store(f, DS_USERCONFIG) != 0) {
+			fprintf(stderr, "%s diff did not parse\n", fmts[i].name);
+			r++;
+		}
+		fclose(f);
+
+		r += diff_check(fmts[i].name);
+	}
+
+	dm_name2sel("system.ntp.901", &sel);
+	dm_del_object_by_selector(sel);
+	dm_name2sel("system.ntp.903", &sel);
+	dm_del_object_by_selector(sel);
+	dm_baseline_set_dirs(NULL);
+
+	unlink(fname);
+	rmdir(dir);
+
+	return r;
+}
+
+#define BENCH_SERVERS 25000
+
+static double bench_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int bench_load(FILE *f, int binary, double *t, long *size)
+{
+	double start;
+	int r;
+
+	*size = ftell(f);
+	rewind(f);
+
+	start = bench_now();
+	if (binary)
+		r = dm_binconfig_load(f, DS_USERCONFIG);
+	else
+		r = dm_deserialize_store(f, DS_USERCONFIG);
+	*t = bench_now() - start;
+
+	return r;
+}
+
+/* add system.ntp.{i} and one system.ntp.{i}.transport.{j} each for i in [first, first + cnt) */
+static int bench_populate(dm_selector sel, int first, int cnt)
+{
+	char buf[64];
+	dm_selector base;
+	int len;
+
+	dm_name2sel("system.ntp", &base);
+	dm_selcpy(sel, base);
+	for (len = 0; len < DM_SELECTOR_LEN && sel[len]; len++)
+		;
+
+	for (int i = first; i < first + cnt; i++) {
+		dm_id id = 10000 + i;
+
+		sel[len] = 0;
+		if (!dm_add_instance_by_selector(sel, &id))
+			continue;
+
+		sel[len] = id;
+		sel[len + 1] = dm__Sys_NTP_i_name;
+		sel[len + 2] = 0;
+		snprintf(buf, sizeof(buf), "server-%d", i);
+		dm_set_string_by_selector(sel, buf, DV_UPDATED);
+
+		sel[len + 1] = dm__Sys_NTP_i_transport;
+		id = 1;
+		dm_add_instance_by_selector(sel, &id);
+	}
+
+	return len;
+}
+
+static void bench_cleanup(dm_selector sel, int len, int first, int cnt)
+{
+	for (int i = first; i < first + cnt; i++) {
+		sel[len] = 10000 + i;
+		sel[len + 1] = 0;
+		dm_del_table_by_selector(sel);
+	}
+}
+
+/* save the bench store as XML and in the binary format, load each into a store without it */
+int bench_binconfig()
+{
+	char buf[64];
+	dm_selector sel, first;
+	double start, xml_save, xml_load, bin_save, bin_load;
+	long xml_size, bin_size;
+	FILE *xml, *bin;
+	const char *s;
+	int len;
+	int r = 0;
+
+	if (!(xml = tmpfile()))
+		return 1;
+	if (!(bin = tmpfile())) {
+		fclose(xml);
+		return 1;
+	}
+
+	len = bench_populate(sel, 1, BENCH_SERVERS);
+
+	start = bench_now();
+	dm_serialize_store(xml, S_CFG);
+	fflush(xml);
+	xml_save = bench_now() - start;
+
+	start = bench_now();
+	r |= dm_binconfig_save(bin, S_CFG);
+	bin_save = bench_now() - start;
+
+	/* the loads have to restore this */
+	dm_selcpy(first, sel);
+	first[len] = 10001;
+	first[len + 1] = dm__Sys_NTP_i_name;
+	first[len + 2] = 0;
+
+	bench_cleanup(sel, len, 1, BENCH_SERVERS);
+	r |= bench_load(xml, 0, &xml_load, &xml_size);
+	if (!(s = dm_get_string_by_selector(first)) || strcmp(s, "server-1") != 0) {
+		fprintf(stderr, "XML config did not restore %s\n", dm_sel2name(first, buf, sizeof(buf)));
+		r++;
+	}
+
+	bench_cleanup(sel, len, 1, BENCH_SERVERS);
+	r |= bench_load(bin, 1, &bin_load, &bin_size);
+	if (!(s = dm_get_string_by_selector(first)) || strcmp(s, "server-1") != 0) {
+		fprintf(stderr, "binary config did not restore %s\n", dm_sel2name(first, buf, sizeof(buf)));
+		r++;
+	}
+
+	fclose(xml);
+	fclose(bin);
+
+	printf("%d instances\n", BENCH_SERVERS * 2);
+	printf("xml:    save %8.3fs, load %8.3fs, %10ld bytes\n", xml_save, xml_load, xml_size);
+	printf("binary: save %8.3fs, load %8.3fs, %10ld bytes\n", bin_save, bin_load, bin_size);
+
+	bench_cleanup(sel, len, 1, BENCH_SERVERS);
+
+	return r;
+}
+
+/* boot with system.ntp saved as a lazy subtree, eager for comparison, then touch one server */
+int bench_lazy()
+{
+	static const char *const paths[] = { "system.ntp", NULL };
+	char fname[] = "/tmp/dm_lazy.XXXXXX";
+	dm_selector sel, first, parent;
+	struct dm_value_table *st;
+	double start, eager, boot, touch;
+	const char *s;
+	FILE *f;
+	int fd, len;
+	int r = 0;
+
+	if ((fd = mkstemp(fname)) < 0)
+		return 1;
+	if (!(f = fdopen(fd, "w"))) {
+		close(fd);
+		unlink(fname);
+		return 1;
+	}
+
+	len = bench_populate(sel, 1, BENCH_SERVERS);
+	dm_binconfig_set_lazy(paths);
+	r |= dm_binconfig_save(f, S_CFG);
+	fclose(f);
+	dm_binconfig_set_lazy(NULL);
+	bench_cleanup(sel, len, 1, BENCH_SERVERS);
+
+	if ((f = fopen(fname, "r"))) {
+		start = bench_now();
+		r |= dm_binconfig_load(f, DS_USERCONFIG);
+		eager = bench_now() - start;
+		fclose(f);
+	} else
+		r++;
+	bench_cleanup(sel, len, 1, BENCH_SERVERS);
+
+	start = bench_now();
+	r |= dm_binconfig_load_file(fname, DS_USERCONFIG);
+	boot = bench_now() - start;
+
+	dm_selcpy(parent, sel);
+	parent[len - 1] = 0;
+	if (!(st = dm_get_table_by_selector(parent)) || !(st->values[sel[len - 1] - 1].flags & DV_LAZY)) {
+		fprintf(stderr, "system.ntp was loaded at boot\n");
+		r++;
+	}
+
+	dm_selcpy(first, sel);
+	first[len] = 10001;
+	first[len + 1] = dm__Sys_NTP_i_name;
+	first[len + 2] = 0;
+
+	start = bench_now();
+	s = dm_get_string_by_selector(first);
+	touch = bench_now() - start;
+
+	if (!s || strcmp(s, "server-1") != 0) {
+		fprintf(stderr, "lazy load did not restore server-1\n");
+		r++;
+	}
+
+	printf("lazy:   boot %8.3fs (eager %8.3fs), first access %8.3fs\n", boot, eager, touch);
+
+	bench_cleanup(sel, len, 1, BENCH_SERVERS);
+	unlink(fname);
+
+	return r;
+}
+
+#define BENCH_ROUNDS 5
+
+static int bench_count_leaves(void *userData, CB_type type, dm_id id __attribute__((unused)),
+			      const struct dm_element *elem, const DM_VALUE value __attribute__((unused)))
+{
+	if ((elem->flags & F_INTERNAL) != 0)
+		return 0;
+
+	if (type == CB_element)
+		(*(long *)userData)++;
+	return 1;
+}
+
+/* XML serializer throughput on the bench store */
+int bench_serialize()
+{
+	dm_selector sel;
+	double start, t;
+	long leaves = 0, size = 0;
+	FILE *f;
+	int len;
+
+	len = bench_populate(sel, 1, BENCH_SERVERS);
+	dm_walk_table_cb(DM_SELECTOR_LEN, &leaves, bench_count_leaves, &dm_root, dm_value_store);
+
+	if (!(f = tmpfile()))
+		return 1;
+
+	start = bench_now();
+	for (int i = 0; i < BENCH_ROUNDS; i++) {
+		rewind(f);
+		dm_serialize_store(f, S_ALL);
+		fflush(f);
+		size = ftell(f);
+	}
+	t = bench_now() - start;
+	fclose(f);
+
+	printf("serialize: %ld leaves, %ld bytes, %8.3fs for %d rounds\n", leaves, size, t, BENCH_ROUNDS);
+	printf("serialize: %8.1f MB/s, %10.0f leaves/s\n",
+	       size * BENCH_ROUNDS / t / (1024 * 1024), leaves * BENCH_ROUNDS / t);
+
+	bench_cleanup(sel, len, 1, BENCH_SERVERS);
+
+	return size == 0;
+}
+
+#define BENCH_FILES 16
+
+static int bench_check_startup(dm_selector sel, int len)
+{
+	dm_selector name;
+	const char *s;
+	char buf[64];
+	int r = 0;
+
+	dm_selcpy(name, sel);
+	name[len + 1] = dm__Sys_NTP_i_name;
+	name[len + 2] = 0;
+
+	for (int i = 1; i <= BENCH_SERVERS; i += BENCH_SERVERS / BENCH_FILES - 1) {
+		name[len] = 10000 + i;
+		snprintf(buf, sizeof(buf), "server-%d", i);
+
+		s = dm_get_string_by_selector(name);
+		if (!s || strcmp(s, buf) != 0) {
+			fprintf(stderr, "directory load did not restore %s\n", buf);
+			r++;
+		}
+	}
+
+	return r;
+}
+
+/* load a config directory of BENCH_FILES fragments, sequentially and on all CPUs */
+int bench_startup()
+{
+	char dir[] = "/tmp/dm_bench.XXXXXX";
+	char fname[64];
+	dm_selector sel;
+	int chunk = BENCH_SERVERS / BENCH_FILES;
+	double t[2];
+	int len = 0;
+	int r = 0;
+
+	if (!mkdtemp(dir))
+		return 1;
+
+	for (int i = 0; i < BENCH_FILES; i++) {
+		int cnt = i < BENCH_FILES - 1 ? chunk : BENCH_SERVERS - i * chunk;
+		FILE *f;
+
+		snprintf(fname, sizeof(fname), "%s/%02d.xml", dir, i);
+		len = bench_populate(sel, 1 + i * chunk, cnt);
+		if ((f = fopen(fname, "w"))) {
+			dm_serialize_store(f, S_CFG);
+			fclose(f);
+		} else
+			r++;
+		bench_cleanup(sel, len, 1 + i * chunk, cnt);
+	}
+
+	for (int i = 0; i < 2; i++) {
+		double start;
+
+		dm_deserialize_workers = i == 0 ? 1 : 0;
+
+		start = bench_now();
+		r |= dm_deserialize_directory(dir, DS_USERCONFIG);
+		t[i] = bench_now() - start;
+
+		r |= bench_check_startup(sel, len);
+		bench_cleanup(sel, len, 1, BENCH_SERVERS);
+	}
+	dm_deserialize_workers = 0;
+
+	for (int i = 0; i < BENCH_FILES; i++) {
+		snprintf(fname, sizeof(fname), "%s/%02d.xml", dir, i);
+		unlink(fname);
+	}
+	rmdir(dir);
+
+	printf("startup: %d files, %d instances\n", BENCH_FILES, BENCH_SERVERS * 2);
+	printf("startup: sequential %8.3fs, parallel %8.3fs (%ld CPUs)\n",
+	       t[0], t[1], sysconf(_SC_NPROCESSORS_ONLN));
+
+	return r;
+}
+
 #define DM_CONFIG   "/jffs/etc/dm.xml"
 void dm_save(void)
 {
@@ -143,6 +1044,20 @@ void dm_save(void)
 	pthread_mutex_unlock(&save_mutex);
 }
 
+/* no background save here, callers save synchronously */
+int dm_save_async(void (*cb)(void *, int) __attribute__((unused)), void *data __attribute__((unused)))
+{
+	return -1;
+}
+
+void dm_save_cancel(void *data __attribute__((unused)))
+{
+}
+
+void dm_save_wait(void)
+{
+}
+
 int
 main(int argc, char *argv[])
 {
@@ -152,9 +1067,19 @@ main(int argc, char *argv[])
 	printf("deserialize\n");
 	dm_deserialize_store(stdin, 0);
 
+	if (argc > 1 && strcmp(argv[1], "-b") == 0)
+		return (bench_binconfig() | bench_lazy() | bench_serialize() | bench_startup()) ? 1 : 0;
+
+	r = test_concurrent_sessions();
+	r |= test_json();
+	r |= test_dump_chunk();
+	r |= test_diff();
+	r |= test_snapshot();
+	r |= test_journal();
+	r |= test_lazy();
 	test_del_object();
 
 	dm_serialize_store(stdout, S_ALL);
 	printf("mem usage: %d\n", dm_mem);
-	return 0;
+	return r ? 1 : 0;
 }